@@ -86,6 +86,10 @@ public:
     zx_status_t Protect(vaddr_t vaddr, size_t count, uint mmu_flags) override;
     zx_status_t Query(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags) override;
 
+    void BeginTlbBatch() override;
+    void EndTlbBatch() override;
+    void FlushTlbBatch() override;
+
     vaddr_t PickSpot(vaddr_t base, uint prev_region_mmu_flags,
                      vaddr_t end, uint next_region_mmu_flags,
                      vaddr_t align, size_t size, uint mmu_flags) override;
@@ -96,6 +100,19 @@ public:
 
     int active_cpus() { return active_cpus_.load(); }
 
+    // Process-context identifier tagging this aspace's TLB entries, or 0 if it
+    // doesn't have one and every switch to it flushes the TLB.
+    uint16_t pcid() const { return pcid_; }
+
+    // Called before shooting down TLB entries of this aspace. Forgets which
+    // CPUs have current translations cached under its PCID, so that CPUs not
+    // running it flush the PCID when they next switch to it, and returns the
+    // CPUs that are running it and need to be interrupted.
+    int PrepareTlbShootdown();
+
+    // Called by a CPU running this aspace once it has applied a shootdown.
+    void FinishTlbShootdown(uint cpu);
+
     IoBitmap& io_bitmap() { return io_bitmap_; }
 
     static void ContextSwitch(X86ArchVmAspace* from, X86ArchVmAspace* to);
@@ -129,6 +146,14 @@ private:
     // CPUs that are currently executing in this aspace.
     // Actually an mp_cpu_mask_t, but header dependencies.
     fbl::atomic_int active_cpus_{0};
+
+    // See pcid().
+    uint16_t pcid_ = 0;
+
+    // CPUs whose TLB entries tagged with |pcid_| are known to be current, and
+    // that may therefore switch to this aspace without flushing them.
+    // Actually an mp_cpu_mask_t, but header dependencies.
+    fbl::atomic_int pcid_current_cpus_{0};
 };
 
 using ArchVmAspace = X86ArchVmAspace;
@@ -68,6 +68,11 @@
 
 #define X86_MMU_PG_NX           (1UL << 63)
 
+/* CR3 fields used when CR4.PCIDE is set */
+#define X86_CR3_PCID_MASK       0xfffUL
+#define X86_CR3_NOFLUSH         (1UL << 63)
+#define X86_NUM_PCIDS           4096
+
 #define X86_PAGING_LEVELS       4
 
 #define MMU_GUEST_SIZE_SHIFT    48
@@ -16,7 +16,13 @@
 #include <arch/x86/feature.h>
 #include <arch/x86/mmu.h>
 #include <arch/x86/mmu_mem_types.h>
+#include <bitmap/raw-bitmap.h>
+#include <bitmap/storage.h>
+#include <fbl/auto_lock.h>
+#include <fbl/mutex.h>
+#include <kernel/cmdline.h>
 #include <kernel/mp.h>
+#include <lib/counters.h>
 #include <new>
 #include <vm/arch_vm_aspace.h>
 #include <vm/physmap.h>
@@ -34,6 +40,16 @@ uint8_t g_paddr_width = 32;
 /* True if the system supports 1GB pages */
 static bool supports_huge_pages = false;
 
+/* True if user aspaces get PCIDs, so switching between them keeps their TLB entries */
+static bool use_pcid = false;
+
+// Address space switches that kept the TLB entries cached for the new aspace's PCID.
+KCOUNTER(context_switch_pcid_keep, "kernel.mmu.context_switch.pcid_keep");
+// Address space switches that had to flush the TLB entries for the new aspace.
+KCOUNTER(context_switch_flush, "kernel.mmu.context_switch.flush");
+// TLB shootdowns avoided by folding them into the single shootdown of a batch.
+KCOUNTER(tlb_shootdown_batched, "kernel.mmu.tlb_shootdown.batched");
+
 /* top level kernel page tables, initialized in start.S */
 volatile pt_entry_t pml4[NO_OF_PT_ENTRIES] __ALIGNED(PAGE_SIZE);
 volatile pt_entry_t pdp[NO_OF_PT_ENTRIES] __ALIGNED(PAGE_SIZE); /* temporary */
@@ -137,18 +153,78 @@ static void x86_tlb_nonglobal_invalidate() {
     x86_set_cr3(x86_get_cr3());
 }
 
+namespace {
+
+// Hands out PCIDs to user aspaces. PCID 0 is never handed out; it is used by
+// the kernel aspace and by any user aspace created while all the others are
+// taken, which then just flushes on every switch.
+class PcidAllocator {
+public:
+    PcidAllocator() { bitmap_.Reset(X86_NUM_PCIDS); }
+    ~PcidAllocator() = default;
+
+    uint16_t Alloc();
+    void Free(uint16_t pcid);
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(PcidAllocator);
+
+    fbl::Mutex lock_;
+    uint16_t last_ TA_GUARDED(lock_) = 0;
+
+    bitmap::RawBitmapGeneric<bitmap::FixedStorage<X86_NUM_PCIDS>> bitmap_ TA_GUARDED(lock_);
+};
+
+uint16_t PcidAllocator::Alloc() {
+    fbl::AutoLock al(&lock_);
+
+    // Start the search from the last found id + 1 and wrap when hitting the
+    // end of the range, so that a PCID that was just freed is reused last.
+    // Whoever gets it still starts with no CPUs marked current, so stale
+    // entries left behind by the previous owner are flushed either way.
+    size_t val;
+    bool notfound = bitmap_.Get(last_ + 1, X86_NUM_PCIDS, &val);
+    if (unlikely(notfound)) {
+        notfound = bitmap_.Get(1, X86_NUM_PCIDS, &val);
+        if (unlikely(notfound)) {
+            LTRACEF("out of PCIDs\n");
+            return 0;
+        }
+    }
+    bitmap_.SetOne(val);
+    last_ = static_cast<uint16_t>(val);
+
+    LTRACEF("new pcid %#zx\n", val);
+    return last_;
+}
+
+void PcidAllocator::Free(uint16_t pcid) {
+    LTRACEF("free pcid %#x\n", pcid);
+    DEBUG_ASSERT(pcid != 0);
+
+    fbl::AutoLock al(&lock_);
+    bitmap_.ClearOne(pcid);
+}
+
+PcidAllocator pcid_allocator;
+
+} // namespace
+
 /* Task used for invalidating a TLB entry on each CPU */
 struct TlbInvalidatePage_context {
     ulong target_cr3;
+    X86ArchVmAspace* aspace;
     const PendingTlbInvalidation* pending;
 };
 static void TlbInvalidatePage_task(void* raw_context) {
     DEBUG_ASSERT(arch_ints_disabled());
     TlbInvalidatePage_context* context = (TlbInvalidatePage_context*)raw_context;
 
-    ulong cr3 = x86_get_cr3();
+    ulong cr3 = x86_get_cr3() & ~X86_CR3_PCID_MASK;
     if (context->target_cr3 != cr3 && !context->pending->contains_global) {
-        /* This invalidation doesn't apply to this CPU, ignore it */
+        /* This invalidation doesn't apply to this CPU, ignore it. If it ran
+         * the aspace recently, PrepareTlbShootdown() has already made sure
+         * it will flush the aspace's PCID before running it again. */
         return;
     }
 
@@ -158,20 +234,23 @@ static void TlbInvalidatePage_task(void* raw_context) {
         } else {
             x86_tlb_nonglobal_invalidate();
         }
-        return;
+    } else {
+        for (uint i = 0; i < context->pending->count; ++i) {
+            const auto& item = context->pending->item[i];
+            switch (item.page_level()) {
+                case PML4_L:
+                    panic("PML4_L invld found; should not be here\n");
+                case PDP_L:
+                case PD_L:
+                case PT_L:
+                    __asm__ volatile("invlpg %0" ::"m"(*(uint8_t*)item.addr()));
+                    break;
+            }
+        }
     }
 
-    for (uint i = 0; i < context->pending->count; ++i) {
-        const auto& item = context->pending->item[i];
-        switch (item.page_level()) {
-            case PML4_L:
-                panic("PML4_L invld found; should not be here\n");
-            case PDP_L:
-            case PD_L:
-            case PT_L:
-                __asm__ volatile("invlpg %0" ::"m"(*(uint8_t*)item.addr()));
-                break;
-        }
+    if (context->aspace != nullptr && context->target_cr3 == cr3) {
+        context->aspace->FinishTlbShootdown(arch_curr_cpu_num());
     }
 }
 
@@ -186,9 +265,10 @@ static void x86_tlb_invalidate_page(const X86PageTableBase* pt, PendingTlbInvali
         return;
     }
 
-    ulong cr3 = pt ? pt->phys() : x86_get_cr3();
+    ulong cr3 = pt ? pt->phys() : (x86_get_cr3() & ~X86_CR3_PCID_MASK);
+    X86ArchVmAspace* aspace = pt ? static_cast<X86ArchVmAspace*>(pt->ctx()) : nullptr;
     struct TlbInvalidatePage_context task_context = {
-        .target_cr3 = cr3, .pending = pending,
+        .target_cr3 = cr3, .aspace = aspace, .pending = pending,
     };
 
     /* Target only CPUs this aspace is active on.  It may be the case that some
@@ -202,7 +282,7 @@ static void x86_tlb_invalidate_page(const X86PageTableBase* pt, PendingTlbInvali
         target = MP_IPI_TARGET_ALL;
     } else {
         target = MP_IPI_TARGET_MASK;
-        target_mask = static_cast<X86ArchVmAspace*>(pt->ctx())->active_cpus();
+        target_mask = aspace->PrepareTlbShootdown();
     }
 
     mp_sync_exec(target, target_mask, TlbInvalidatePage_task, &task_context);
@@ -494,7 +574,17 @@ void x86_mmu_early_init() {
     LTRACEF("paddr_width %u vaddr_width %u\n", g_paddr_width, g_vaddr_width);
 }
 
-void x86_mmu_init(void) {}
+void x86_mmu_init(void) {
+    // Turn on PCIDs on the boot cpu now that the command line is available.
+    // This runs before any user aspace exists and before the other cpus are
+    // started; they pick the setting up in x86_mmu_percpu_init().
+    if (x86_feature_test(X86_FEATURE_PCID) && cmdline_get_bool("kernel.x86.pcid", true)) {
+        DEBUG_ASSERT((x86_get_cr3() & X86_CR3_PCID_MASK) == 0);
+        use_pcid = true;
+        x86_set_cr4(x86_get_cr4() | X86_CR4_PCIDE);
+    }
+    dprintf(INFO, "x86 mmu: PCIDs %s\n", use_pcid ? "enabled" : "disabled");
+}
 
 X86PageTableBase::X86PageTableBase() {
 }
@@ -592,9 +682,15 @@ zx_status_t X86ArchVmAspace::Init(vaddr_t base, size_t size, uint mmu_flags) {
             return status;
         }
 
-        LTRACEF("user aspace: pt phys %#" PRIxPTR ", virt %p\n", pt_->phys(), pt_->virt());
+        if (use_pcid) {
+            pcid_ = pcid_allocator.Alloc();
+        }
+
+        LTRACEF("user aspace: pcid %#x pt phys %#" PRIxPTR ", virt %p\n",
+                pcid_, pt_->phys(), pt_->virt());
     }
     fbl::atomic_init(&active_cpus_, 0);
+    fbl::atomic_init(&pcid_current_cpus_, 0);
 
     return ZX_OK;
 }
@@ -608,6 +704,10 @@ zx_status_t X86ArchVmAspace::Destroy() {
     } else {
         static_cast<X86PageTableMmu*>(pt_)->Destroy(base_, size_);
     }
+    if (pcid_ != 0) {
+        pcid_allocator.Free(pcid_);
+        pcid_ = 0;
+    }
     return ZX_OK;
 }
 
@@ -641,18 +741,62 @@ zx_status_t X86ArchVmAspace::Protect(vaddr_t vaddr, size_t count, uint mmu_flags
     return pt_->ProtectPages(vaddr, count, mmu_flags);
 }
 
+void X86ArchVmAspace::BeginTlbBatch() {
+    pt_->BeginTlbBatch();
+}
+
+void X86ArchVmAspace::EndTlbBatch() {
+    uint ops = pt_->EndTlbBatch();
+    if (ops > 1) {
+        kcounter_add(tlb_shootdown_batched, ops - 1);
+    }
+}
+
+void X86ArchVmAspace::FlushTlbBatch() {
+    pt_->FlushTlbBatch();
+}
+
+int X86ArchVmAspace::PrepareTlbShootdown() {
+    // Clearing the current set before sampling the active set pairs with the
+    // opposite order in ContextSwitch(): a cpu switching in concurrently
+    // either shows up as active and gets interrupted, or finds its bit clear
+    // and flushes.
+    pcid_current_cpus_.store(0);
+    return active_cpus_.load();
+}
+
+void X86ArchVmAspace::FinishTlbShootdown(uint cpu) {
+    pcid_current_cpus_.fetch_or(cpu_num_to_mask(cpu));
+}
+
 void X86ArchVmAspace::ContextSwitch(X86ArchVmAspace* old_aspace, X86ArchVmAspace* aspace) {
     cpu_mask_t cpu_bit = cpu_num_to_mask(arch_curr_cpu_num());
     if (aspace != nullptr) {
         aspace->canary_.Assert();
-        paddr_t phys = aspace->pt_phys();
-        LTRACEF_LEVEL(3, "switching to aspace %p, pt %#" PRIXPTR "\n", aspace, phys);
-        x86_set_cr3(phys);
+        // Become active before looking at which cpus are current; see
+        // PrepareTlbShootdown().
+        aspace->active_cpus_.fetch_or(cpu_bit);
 
-        if (old_aspace != nullptr) {
+        ulong cr3 = aspace->pt_phys();
+        if (aspace->pcid_ != 0) {
+            cr3 |= aspace->pcid_;
+            // Keep the entries cached under this PCID if nothing in the
+            // aspace has been shot down since this cpu last had them current.
+            if (aspace->pcid_current_cpus_.fetch_or(cpu_bit) & cpu_bit) {
+                cr3 |= X86_CR3_NOFLUSH;
+            }
+        }
+        if (cr3 & X86_CR3_NOFLUSH) {
+            kcounter_add(context_switch_pcid_keep, 1);
+        } else {
+            kcounter_add(context_switch_flush, 1);
+        }
+        LTRACEF_LEVEL(3, "switching to aspace %p, cr3 %#" PRIxPTR "\n", aspace, cr3);
+        x86_set_cr3(cr3);
+
+        if (old_aspace != nullptr && old_aspace != aspace) {
             old_aspace->active_cpus_.fetch_and(~cpu_bit);
         }
-        aspace->active_cpus_.fetch_or(cpu_bit);
     } else {
         LTRACEF_LEVEL(3, "switching to kernel aspace, pt %#" PRIxPTR "\n", kernel_pt_phys);
         x86_set_cr3(kernel_pt_phys);
@@ -691,6 +835,10 @@ void x86_mmu_percpu_init(void) {
         cr4 |= X86_CR4_SMEP;
     if (x86_feature_test(X86_FEATURE_SMAP))
         cr4 |= X86_CR4_SMAP;
+    // Only legal while the current PCID is 0, which holds as we're running on
+    // the kernel aspace here.
+    if (use_pcid)
+        cr4 |= X86_CR4_PCIDE;
     x86_set_cr4(cr4);
 
     // Set NXE bit in X86_MSR_IA32_EFER.
@@ -10,6 +10,8 @@
 #include <fbl/canary.h>
 #include <fbl/mutex.h>
 #include <hwreg/bitfields.h>
+#include <kernel/thread.h>
+#include <list.h>
 // Needed for ARCH_MMU_FLAG_*
 #include <vm/arch_vm_aspace.h>
 
@@ -53,6 +55,10 @@ struct PendingTlbInvalidation {
     // bit set.
     void enqueue(vaddr_t v, PageTableLevel level, bool is_global_page, bool is_terminal);
 
+    // Move all of the invalidations pending in |other| into this one, leaving
+    // |other| empty.  Falls back to a full shootdown if they do not fit.
+    void take(PendingTlbInvalidation* other);
+
     // Clear the list of pending invalidations
     void clear();
 
@@ -91,6 +97,18 @@ public:
 
     zx_status_t QueryVaddr(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags);
 
+    // Defer the TLB invalidations (and the freeing of page table pages) of
+    // subsequent operations by the calling thread until EndTlbBatch(), which
+    // performs them all with a single shootdown.  Batches do not nest.
+    void BeginTlbBatch();
+    // Returns the number of operations whose invalidations were folded into
+    // the batch's shootdown.
+    uint EndTlbBatch();
+    // Issue the invalidations deferred by the current batch so far, if there
+    // is one, without ending it.  Unlike the other two, any thread may call
+    // this.
+    void FlushTlbBatch();
+
 protected:
     // Initialize an empty page table, assigning this given context to it.
     zx_status_t Init(void* ctx);
@@ -185,4 +203,10 @@ private:
 
     // low lock to protect the mmu code
     fbl::Mutex lock_;
+
+    // State of the TLB batch started by BeginTlbBatch(), if any.
+    thread_t* tlb_batch_owner_ TA_GUARDED(lock_) = nullptr;
+    uint tlb_batch_ops_ TA_GUARDED(lock_) = 0;
+    PendingTlbInvalidation tlb_batch_ TA_GUARDED(lock_);
+    list_node tlb_batch_free_ TA_GUARDED(lock_) = LIST_INITIAL_VALUE(tlb_batch_free_);
 };
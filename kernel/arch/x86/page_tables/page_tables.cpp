@@ -105,6 +105,22 @@ void PendingTlbInvalidation::enqueue(vaddr_t v, PageTableLevel level, bool is_gl
     count++;
 }
 
+void PendingTlbInvalidation::take(PendingTlbInvalidation* other) {
+    contains_global |= other->contains_global;
+    if (other->full_shootdown || count + other->count > fbl::count_of(item)) {
+        full_shootdown = true;
+    }
+    if (!full_shootdown) {
+        for (uint i = 0; i < other->count; ++i) {
+            item[count++] = other->item[i];
+        }
+    } else if (count == 0) {
+        // Keep |count| non-zero so the full shootdown is not skipped.
+        count = other->count;
+    }
+    other->clear();
+}
+
 void PendingTlbInvalidation::clear() {
     count = 0;
     full_shootdown = false;
@@ -227,7 +243,23 @@ void X86PageTableBase::ConsistencyManager::Finish() {
         // invalidations.
         mb();
     }
-    pt_->TlbInvalidate(&tlb_);
+    if (pt_->tlb_batch_owner_ == get_current_thread()) {
+        // Fold our work into the batch; the page table pages must outlive any
+        // stale TLB entries, so they are freed with the batch as well.
+        if (tlb_.count > 0) {
+            pt_->tlb_batch_ops_++;
+        }
+        pt_->tlb_batch_.take(&tlb_);
+        list_splice_after(&to_free_, pt_->tlb_batch_free_.prev);
+    } else {
+        if (pt_->tlb_batch_owner_ != nullptr) {
+            // Another thread's batch may be holding back invalidations of
+            // entries that this operation found already cleared.  Issue them
+            // too, so our caller can rely on them having completed.
+            tlb_.take(&pt_->tlb_batch_);
+        }
+        pt_->TlbInvalidate(&tlb_);
+    }
     pt_ = nullptr;
 }
 
@@ -972,6 +1004,48 @@ zx_status_t X86PageTableBase::ProtectPages(vaddr_t vaddr, size_t count, uint mmu
     return ZX_OK;
 }
 
+void X86PageTableBase::BeginTlbBatch() {
+    canary_.Assert();
+
+    fbl::AutoLock a(&lock_);
+    DEBUG_ASSERT(tlb_batch_owner_ == nullptr);
+    tlb_batch_owner_ = get_current_thread();
+}
+
+uint X86PageTableBase::EndTlbBatch() {
+    canary_.Assert();
+
+    list_node to_free = LIST_INITIAL_VALUE(to_free);
+    uint ops;
+    {
+        fbl::AutoLock a(&lock_);
+        DEBUG_ASSERT(tlb_batch_owner_ == get_current_thread());
+        tlb_batch_owner_ = nullptr;
+        TlbInvalidate(&tlb_batch_);
+        tlb_batch_.clear();
+        ops = tlb_batch_ops_;
+        tlb_batch_ops_ = 0;
+        list_move(&tlb_batch_free_, &to_free);
+    }
+
+    if (!list_is_empty(&to_free)) {
+        pmm_free(&to_free);
+    }
+    return ops;
+}
+
+void X86PageTableBase::FlushTlbBatch() {
+    canary_.Assert();
+
+    fbl::AutoLock a(&lock_);
+    if (tlb_batch_owner_ != nullptr) {
+        // The page table pages stay with the batch; only its owner's
+        // operations could have freed them.
+        TlbInvalidate(&tlb_batch_);
+        tlb_batch_.clear();
+    }
+}
+
 zx_status_t X86PageTableBase::QueryVaddr(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags) {
     canary_.Assert();
 
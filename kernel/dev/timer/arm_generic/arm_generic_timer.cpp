@@ -236,6 +236,16 @@ zx_ticks_t current_ticks(void) {
     return read_ct();
 }
 
+bool platform_monotonic_from_ticks(struct fp_32_64* ns_per_tick) {
+    // Userspace reads the virtual counter, which is offset from the physical
+    // one by an amount only EL2 can see.
+    if (reg_procs->read_ct != read_cntvct) {
+        return false;
+    }
+    *ns_per_tick = ns_per_cntpct;
+    return true;
+}
+
 zx_ticks_t ticks_per_second(void) {
     return u64_mul_u32_fp32_64(1000 * 1000 * 1000, cntpct_per_ns);
 }
@@ -18,9 +18,6 @@
 __BEGIN_CDECLS
 
 struct percpu {
-    // per cpu timer queue
-    struct list_node timer_queue;
-
     // per cpu preemption timer; ZX_TIME_INFINITE means not set
     zx_time_t preempt_timer_deadline;
 
@@ -31,6 +28,14 @@ struct percpu {
     struct list_node run_queue[NUM_PRIORITIES];
     uint32_t run_queue_bitmap;
 
+    // total number of threads waiting across all of the run queues
+    uint32_t run_queue_length;
+
+    // cpus sharing this cpu's physical core and last level cache, including this cpu.
+    // set once during boot by sched_set_cpu_topology().
+    cpu_mask_t smt_siblings;
+    cpu_mask_t cache_siblings;
+
 #if WITH_LOCK_DEP
     // state for runtime lock validation when in irq context
     lockdep_state_t lock_state;
@@ -41,6 +41,12 @@ bool sched_unblock_list(struct list_node* list) __WARN_UNUSED_RESULT TA_REQ(thre
 
 void sched_transition_off_cpu(cpu_num_t old_cpu) TA_REQ(thread_lock);
 
+// record which cpus share a physical core (SMT siblings) and which share the last level
+// cache with |cpu|. both masks must include |cpu| itself. called by platform code during
+// boot; until then every cpu is treated as its own core and cache domain.
+void sched_set_cpu_topology(cpu_num_t cpu, cpu_mask_t smt_siblings, cpu_mask_t cache_siblings)
+    TA_EXCL(thread_lock);
+
 // sched_preempt_timer_tick is called when the preemption timer for a CPU has fired.
 //
 // This function is logically private and should only be called by timer.cpp.
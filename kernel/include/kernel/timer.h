@@ -7,9 +7,9 @@
 
 #pragma once
 
+#include <fbl/intrusive_wavl_tree.h>
 #include <kernel/deadline.h>
 #include <kernel/spinlock.h>
-#include <list.h>
 #include <sys/types.h>
 #include <zircon/compiler.h>
 #include <zircon/types.h>
@@ -25,7 +25,7 @@ typedef void (*timer_callback)(struct timer*, zx_time_t now, void* arg);
 
 typedef struct timer {
     int magic;
-    struct list_node node;
+    fbl::WAVLTreeNodeState<struct timer*> node;
 
     zx_time_t scheduled_time;
     zx_duration_t slack; // Stores the applied slack adjustment from
@@ -34,18 +34,20 @@ typedef struct timer {
     void* arg;
 
     volatile int active_cpu; // <0 if inactive
+    volatile int queue_cpu;  // cpu whose queue holds the timer, <0 if none
     volatile bool cancel;    // true if cancel is pending
 } timer_t;
 
 #define TIMER_INITIAL_VALUE(t)              \
     {                                       \
         .magic = TIMER_MAGIC,               \
-        .node = LIST_INITIAL_CLEARED_VALUE, \
+        .node = {},                         \
         .scheduled_time = 0,                \
         .slack = 0,                         \
         .callback = NULL,                   \
         .arg = NULL,                        \
         .active_cpu = -1,                   \
+        .queue_cpu = -1,                    \
         .cancel = false,                    \
     }
 
@@ -10,9 +10,12 @@
 #include <debug.h>
 #include <err.h>
 #include <inttypes.h>
+#include <kernel/lockdep.h>
 #include <kernel/mp.h>
 #include <kernel/percpu.h>
 #include <kernel/thread.h>
+#include <kernel/thread_lock.h>
+#include <lib/counters.h>
 #include <lib/ktrace.h>
 #include <list.h>
 #include <platform.h>
@@ -53,6 +56,22 @@
 // threads get 10ms to run before they use up their time slice and the scheduler is invoked
 #define THREAD_INITIAL_TIME_SLICE ZX_MSEC(10)
 
+// how many more queued threads the last cpu a thread ran on may have compared to the least
+// loaded candidate before a wakeup gives up on cache affinity and goes to the other cpu
+#define MAX_CACHE_AFFINE_IMBALANCE 1
+
+// Number of threads made ready on a cpu that already had other threads waiting to run.
+KCOUNTER(sched_queued_behind_counter, "kernel.sched.wakeup.queued_behind");
+
+// Largest number of threads seen waiting in a single cpu's run queue.
+KCOUNTER_MAX(sched_max_queue_length_counter, "kernel.sched.run_queue.max_length");
+
+// Number of times a cpu about to go idle tried to pull work from another cpu.
+KCOUNTER(sched_steal_attempt_counter, "kernel.sched.steal.attempts");
+
+// Number of threads pulled from another cpu's run queue by a cpu about to go idle.
+KCOUNTER(sched_steal_counter, "kernel.sched.steal.success");
+
 static bool local_migrate_if_needed(thread_t* curr_thread);
 
 // compute the effective priority of a thread
@@ -152,6 +171,85 @@ static cpu_mask_t rand_cpu(cpu_mask_t mask) {
     }
 }
 
+// using the per cpu run queue bitmap, find the highest populated queue
+static uint highest_run_queue(const struct percpu* c) TA_REQ(thread_lock) {
+    return HIGHEST_PRIORITY - __builtin_clz(c->run_queue_bitmap) -
+           (sizeof(c->run_queue_bitmap) * CHAR_BIT - NUM_PRIORITIES);
+}
+
+// pick the cpu out of the passed in mask with the fewest threads waiting in its run queue.
+// ties go to the cpu whose highest waiting thread has the lowest priority, and after that
+// to whichever cpu the rotor reaches first so equally loaded cpus share new work.
+static cpu_mask_t least_loaded_cpu(cpu_mask_t mask) TA_REQ(thread_lock) {
+    mask &= mp_get_active_mask();
+    if (unlikely(mask == 0)) {
+        return 0;
+    }
+
+    cpu_num_t highest_cpu = highest_cpu_set(mask);
+
+    // protected by THREAD_LOCK, safe to use non atomically
+    static cpu_num_t rot = 0;
+    if (++rot > highest_cpu) {
+        rot = 0;
+    }
+
+    cpu_num_t best_cpu = INVALID_CPU;
+    uint32_t best_length = UINT32_MAX;
+    int best_priority = HIGHEST_PRIORITY + 1;
+    for (cpu_num_t i = 0; i <= highest_cpu; i++) {
+        cpu_num_t cpu = (rot + i) % (highest_cpu + 1);
+        if (!(mask & cpu_num_to_mask(cpu))) {
+            continue;
+        }
+
+        const struct percpu* c = &percpu[cpu];
+        int priority = c->run_queue_bitmap ? (int)highest_run_queue(c) : -1;
+        if (c->run_queue_length < best_length ||
+            (c->run_queue_length == best_length && priority < best_priority)) {
+            best_cpu = cpu;
+            best_length = c->run_queue_length;
+            best_priority = priority;
+        }
+    }
+
+    return cpu_num_to_mask(best_cpu);
+}
+
+// out of the passed in mask of idle cpus, pick the one closest to |last_cpu| in the cpu
+// topology. cpus sharing a cache with the last cpu beat remote ones, and within either
+// group a cpu whose whole physical core is idle beats an idle SMT sibling of a busy core,
+// so two busy threads don't end up sharing a core while other cores sit idle.
+static cpu_mask_t pick_idle_cpu(cpu_mask_t idle_mask, cpu_num_t last_cpu) TA_REQ(thread_lock) {
+    DEBUG_ASSERT(idle_mask != 0);
+
+    // compute which of the candidates sit on a core with no busy SMT sibling
+    cpu_mask_t all_idle = mp_get_idle_mask();
+    cpu_mask_t idle_cores = 0;
+    for (cpu_mask_t mask = idle_mask; mask != 0;) {
+        cpu_num_t cpu = lowest_cpu_set(mask);
+        mask &= ~cpu_num_to_mask(cpu);
+        if ((percpu[cpu].smt_siblings & all_idle) == percpu[cpu].smt_siblings) {
+            idle_cores |= cpu_num_to_mask(cpu);
+        }
+    }
+
+    if (is_valid_cpu_num(last_cpu)) {
+        cpu_mask_t cache_local = idle_mask & percpu[last_cpu].cache_siblings;
+        if (cache_local & idle_cores) {
+            return rand_cpu(cache_local & idle_cores);
+        }
+        if (cache_local) {
+            return rand_cpu(cache_local);
+        }
+    }
+
+    if (idle_cores) {
+        return rand_cpu(idle_cores);
+    }
+    return rand_cpu(idle_mask);
+}
+
 // find a cpu to wake up
 static cpu_mask_t find_cpu_mask(thread_t* t) TA_REQ(thread_lock) {
     // get the last cpu the thread ran on
@@ -182,42 +280,62 @@ static cpu_mask_t find_cpu_mask(thread_t* t) TA_REQ(thread_lock) {
             return last_ran_cpu_mask;
         }
 
-        // pick an idle_cpu
+        // pick an idle cpu near the last one, avoiding the SMT siblings of busy cpus
         DEBUG_ASSERT((idle_cpu_mask & mp_get_active_mask()) == idle_cpu_mask);
-        return rand_cpu(idle_cpu_mask);
+        return pick_idle_cpu(idle_cpu_mask, t->last_cpu);
     }
 
     // no idle cpus in our affinity mask
 
-    // if the last cpu it ran on is in the affinity mask and not the current cpu, pick that
-    if ((last_ran_cpu_mask & cpu_affinity & active_cpu_mask) &&
-        last_ran_cpu_mask != curr_cpu_mask) {
-        return last_ran_cpu_mask;
-    }
-
-    // fall back to picking a cpu out of the affinity mask, preferring something other
+    // pick the least loaded cpu out of the affinity mask, preferring something other
     // than the local cpu.
     // the affinity mask hard pins the thread to the cpus in the mask, so it's not possible
     // to pick a cpu outside of that list.
-    cpu_mask_t mask = cpu_affinity & ~(curr_cpu_mask);
+    cpu_mask_t mask = cpu_affinity & active_cpu_mask & ~(curr_cpu_mask);
     if (mask == 0) {
         return curr_cpu_mask; // local cpu is the only choice
     }
 
-    mask = rand_cpu(mask);
-    if (mask == 0) {
+    cpu_mask_t least_loaded_mask = least_loaded_cpu(mask);
+    if (least_loaded_mask == 0) {
         return curr_cpu_mask; // local cpu is the only choice
     }
-    DEBUG_ASSERT((mask & mp_get_active_mask()) == mask);
-    return mask;
+    DEBUG_ASSERT((least_loaded_mask & mp_get_active_mask()) == least_loaded_mask);
+
+    // stay within the last cpu's cache domain unless it's noticeably busier than elsewhere
+    if (is_valid_cpu_num(t->last_cpu)) {
+        cpu_mask_t cache_local_mask =
+            least_loaded_cpu(mask & percpu[t->last_cpu].cache_siblings);
+        if (cache_local_mask != 0 && cache_local_mask != least_loaded_mask) {
+            const struct percpu* local = &percpu[lowest_cpu_set(cache_local_mask)];
+            const struct percpu* least = &percpu[lowest_cpu_set(least_loaded_mask)];
+            if (local->run_queue_length <= least->run_queue_length + MAX_CACHE_AFFINE_IMBALANCE) {
+                least_loaded_mask = cache_local_mask;
+            }
+        }
+    }
+
+    // if the last cpu it ran on is a candidate and isn't much busier than the least loaded
+    // one, stay there to keep the thread's cache warm
+    if (last_ran_cpu_mask & mask) {
+        const struct percpu* last = &percpu[t->last_cpu];
+        const struct percpu* least = &percpu[lowest_cpu_set(least_loaded_mask)];
+        if (last->run_queue_length <= least->run_queue_length + MAX_CACHE_AFFINE_IMBALANCE) {
+            return last_ran_cpu_mask;
+        }
+    }
+
+    return least_loaded_mask;
 }
 
 // run queue manipulation
 static void insert_in_run_queue_head(cpu_num_t cpu, thread_t* t) TA_REQ(thread_lock) {
     DEBUG_ASSERT(!list_in_list(&t->queue_node));
 
-    list_add_head(&percpu[cpu].run_queue[t->effec_priority], &t->queue_node);
-    percpu[cpu].run_queue_bitmap |= (1u << t->effec_priority);
+    struct percpu* c = &percpu[cpu];
+    list_add_head(&c->run_queue[t->effec_priority], &t->queue_node);
+    c->run_queue_bitmap |= (1u << t->effec_priority);
+    c->run_queue_length++;
 
     // mark the cpu as busy since the run queue now has at least one item in it
     mp_set_cpu_busy(cpu);
@@ -226,8 +344,10 @@ static void insert_in_run_queue_head(cpu_num_t cpu, thread_t* t) TA_REQ(thread_l
 static void insert_in_run_queue_tail(cpu_num_t cpu, thread_t* t) TA_REQ(thread_lock) {
     DEBUG_ASSERT(!list_in_list(&t->queue_node));
 
-    list_add_tail(&percpu[cpu].run_queue[t->effec_priority], &t->queue_node);
-    percpu[cpu].run_queue_bitmap |= (1u << t->effec_priority);
+    struct percpu* c = &percpu[cpu];
+    list_add_tail(&c->run_queue[t->effec_priority], &t->queue_node);
+    c->run_queue_bitmap |= (1u << t->effec_priority);
+    c->run_queue_length++;
 
     // mark the cpu as busy since the run queue now has at least one item in it
     mp_set_cpu_busy(cpu);
@@ -238,21 +358,16 @@ static void remove_from_run_queue(thread_t* t, int prio_queue) TA_REQ(thread_loc
     DEBUG_ASSERT(t->state == THREAD_READY);
     DEBUG_ASSERT(is_valid_cpu_num(t->curr_cpu));
 
+    struct percpu* c = &percpu[t->curr_cpu];
     list_delete(&t->queue_node);
+    c->run_queue_length--;
 
     // clear the old cpu's queue bitmap if that was the last entry
-    struct percpu* c = &percpu[t->curr_cpu];
     if (list_is_empty(&c->run_queue[prio_queue])) {
         c->run_queue_bitmap &= ~(1u << prio_queue);
     }
 }
 
-// using the per cpu run queue bitmap, find the highest populated queue
-static uint highest_run_queue(const struct percpu* c) TA_REQ(thread_lock) {
-    return HIGHEST_PRIORITY - __builtin_clz(c->run_queue_bitmap) -
-           (sizeof(c->run_queue_bitmap) * CHAR_BIT - NUM_PRIORITIES);
-}
-
 static thread_t* sched_get_top_thread(cpu_num_t cpu) TA_REQ(thread_lock) {
     // pop the head of the highest priority queue with any threads
     // queued up on the passed in cpu.
@@ -262,6 +377,7 @@ static thread_t* sched_get_top_thread(cpu_num_t cpu) TA_REQ(thread_lock) {
         uint highest_queue = highest_run_queue(c);
 
         thread_t* newthread = list_remove_head_type(&c->run_queue[highest_queue], thread_t, queue_node);
+        c->run_queue_length--;
 
         DEBUG_ASSERT(newthread);
         DEBUG_ASSERT_MSG(newthread->cpu_affinity & cpu_num_to_mask(cpu),
@@ -282,6 +398,87 @@ static thread_t* sched_get_top_thread(cpu_num_t cpu) TA_REQ(thread_lock) {
     return &c->idle_thread;
 }
 
+// pull a waiting thread over from the busiest other cpu so that |cpu| doesn't go idle
+// while runnable threads are queued elsewhere. returns nullptr if there was nothing
+// waiting anywhere that is allowed to run on |cpu|.
+static thread_t* sched_steal_thread(cpu_num_t cpu) TA_REQ(thread_lock) {
+    cpu_mask_t cpu_mask = cpu_num_to_mask(cpu);
+    cpu_mask_t active_mask = mp_get_active_mask();
+
+    // a cpu on its way offline must not pick up more work
+    if (!(active_mask & cpu_mask)) {
+        return nullptr;
+    }
+
+    kcounter_add(sched_steal_attempt_counter, 1);
+
+    // find the cpu with the most threads waiting, looking within our own cache domain
+    // before pulling threads away from their caches on a remote one
+    cpu_num_t busiest_cpu = INVALID_CPU;
+    cpu_mask_t domains[] = {percpu[cpu].cache_siblings, CPU_MASK_ALL};
+    for (cpu_mask_t domain : domains) {
+        uint32_t busiest_length = 0;
+        cpu_mask_t candidates = domain & active_mask & ~cpu_mask;
+        while (candidates != 0) {
+            cpu_num_t i = lowest_cpu_set(candidates);
+            candidates &= ~cpu_num_to_mask(i);
+            if (percpu[i].run_queue_length > busiest_length) {
+                busiest_cpu = i;
+                busiest_length = percpu[i].run_queue_length;
+            }
+        }
+        if (busiest_cpu != INVALID_CPU) {
+            break;
+        }
+    }
+    if (busiest_cpu == INVALID_CPU) {
+        return nullptr;
+    }
+
+    // take the highest priority thread waiting there that is allowed to run here
+    struct percpu* c = &percpu[busiest_cpu];
+    thread_t* stolen = nullptr;
+    for (int prio = HIGHEST_PRIORITY; prio >= LOWEST_PRIORITY && !stolen; prio--) {
+        if (!(c->run_queue_bitmap & (1u << prio))) {
+            continue;
+        }
+
+        thread_t* t;
+        list_for_every_entry (&c->run_queue[prio], t, thread_t, queue_node) {
+            if (t->cpu_affinity & cpu_mask) {
+                stolen = t;
+                break;
+            }
+        }
+
+        if (stolen) {
+            list_delete(&stolen->queue_node);
+            c->run_queue_length--;
+            if (list_is_empty(&c->run_queue[prio])) {
+                c->run_queue_bitmap &= ~(1u << prio);
+            }
+        }
+    }
+
+    if (!stolen) {
+        return nullptr;
+    }
+
+    // keep the idle mask the way the insert and local dequeue paths leave it: the busiest
+    // cpu may have been idling with a reschedule pending for the thread we took, and now
+    // has nothing to run, while this cpu is about to run the stolen thread rather than idle
+    if (c->run_queue_length == 0 && c->idle_thread.state == THREAD_RUNNING) {
+        mp_set_cpu_idle(busiest_cpu);
+    }
+    mp_set_cpu_busy(cpu);
+
+    LOCAL_KTRACE2("sched_steal", busiest_cpu, cpu);
+
+    kcounter_add(sched_steal_counter, 1);
+    stolen->curr_cpu = cpu;
+    return stolen;
+}
+
 void sched_init_thread(thread_t* t, int priority) {
     t->base_priority = priority;
     t->priority_boost = 0;
@@ -314,6 +511,14 @@ static void find_cpu_and_insert(thread_t* t, bool* local_resched,
     DEBUG_ASSERT(cpu != 0);
 
     cpu_num = lowest_cpu_set(cpu);
+
+    // track how often wakeups land behind other waiting threads
+    uint32_t queue_length = percpu[cpu_num].run_queue_length;
+    if (queue_length > 0) {
+        kcounter_add(sched_queued_behind_counter, 1);
+    }
+    kcounter_max(sched_max_queue_length_counter, queue_length + 1);
+
     if (cpu_num == arch_curr_cpu_num()) {
         *local_resched = true;
     } else {
@@ -791,6 +996,14 @@ void sched_resched_internal() {
     // pick a new thread to run
     thread_t* newthread = sched_get_top_thread(cpu);
 
+    // rather than going idle, try to take some work from a busier cpu
+    if (thread_is_idle(newthread)) {
+        thread_t* stolen = sched_steal_thread(cpu);
+        if (stolen) {
+            newthread = stolen;
+        }
+    }
+
     DEBUG_ASSERT(newthread);
 
     newthread->state = THREAD_RUNNING;
@@ -899,10 +1112,24 @@ void sched_resched_internal() {
     final_context_switch(oldthread, newthread);
 }
 
+void sched_set_cpu_topology(cpu_num_t cpu, cpu_mask_t smt_siblings, cpu_mask_t cache_siblings) {
+    DEBUG_ASSERT(is_valid_cpu_num(cpu));
+    DEBUG_ASSERT(smt_siblings & cpu_num_to_mask(cpu));
+    DEBUG_ASSERT((cache_siblings & smt_siblings) == smt_siblings);
+
+    Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+    percpu[cpu].smt_siblings = smt_siblings;
+    percpu[cpu].cache_siblings = cache_siblings;
+}
+
 void sched_init_early() {
-    // initialize the run queues
-    for (unsigned int cpu = 0; cpu < SMP_MAX_CPUS; cpu++)
+    // initialize the run queues, and treat every cpu as its own core
+    // until the platform tells us otherwise
+    for (unsigned int cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        percpu[cpu].smt_siblings = cpu_num_to_mask(cpu);
+        percpu[cpu].cache_siblings = cpu_num_to_mask(cpu);
         for (unsigned int i = 0; i < NUM_PRIORITIES; i++) {
             list_initialize(&percpu[cpu].run_queue[i]);
         }
+    }
 }
@@ -23,6 +23,7 @@
 #include <err.h>
 #include <inttypes.h>
 #include <kernel/align.h>
+#include <kernel/atomic.h>
 #include <kernel/lockdep.h>
 #include <kernel/mp.h>
 #include <kernel/percpu.h>
@@ -32,7 +33,6 @@
 #include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <lib/counters.h>
-#include <list.h>
 #include <malloc.h>
 #include <platform.h>
 #include <platform/timer.h>
@@ -57,8 +57,45 @@ KCOUNTER(timer_canceled_counter, "kernel.timer.canceled");
 
 namespace {
 
-spin_lock_t timer_lock __CPU_ALIGN_EXCLUSIVE = SPIN_LOCK_INITIAL_VALUE;
-DECLARE_SINGLETON_LOCK_WRAPPER(TimerLock, timer_lock);
+// Values of timer_t::queue_cpu for timers that are in no queue, and for those
+// that timer_transition_off_cpu() is moving from one queue to another.
+constexpr int kTimerNotQueued = -1;
+constexpr int kTimerMigrating = -2;
+
+// Timers are ordered by when they are due.  Coalesced timers share a
+// scheduled time, so their addresses break the tie.
+struct TimerKey {
+    zx_time_t scheduled_time;
+    uintptr_t address;
+};
+
+struct TimerKeyTraits {
+    static TimerKey GetKey(const timer_t& timer) {
+        return {timer.scheduled_time, reinterpret_cast<uintptr_t>(&timer)};
+    }
+    static bool LessThan(const TimerKey& a, const TimerKey& b) {
+        return a.scheduled_time < b.scheduled_time ||
+               (a.scheduled_time == b.scheduled_time && a.address < b.address);
+    }
+    static bool EqualTo(const TimerKey& a, const TimerKey& b) {
+        return a.scheduled_time == b.scheduled_time && a.address == b.address;
+    }
+};
+
+struct TimerNodeTraits {
+    static fbl::WAVLTreeNodeState<timer_t*>& node_state(timer_t& timer) { return timer.node; }
+};
+
+using TimerTree = fbl::WAVLTree<TimerKey, timer_t*, TimerKeyTraits, TimerNodeTraits>;
+
+// Each cpu's pending timers, with a lock of their own so that cpus setting
+// and firing timers do not contend with each other.
+struct TimerQueue {
+    DECLARE_SPINLOCK(TimerQueue) lock;
+    TimerTree timers TA_GUARDED(lock);
+} __CPU_ALIGN;
+
+TimerQueue timer_queues[SMP_MAX_CPUS];
 
 } // anonymous namespace
 
@@ -81,142 +118,140 @@ static void update_platform_timer(uint cpu, zx_time_t new_deadline) {
     }
 }
 
-static void insert_timer_in_queue(uint cpu, timer_t* timer,
-                                  zx_time_t earliest_deadline, zx_time_t latest_deadline) {
+static void insert_timer_in_queue(uint cpu, TimerQueue& queue, timer_t* timer,
+                                  zx_time_t earliest_deadline, zx_time_t latest_deadline)
+    TA_REQ(queue.lock) {
 
     DEBUG_ASSERT(arch_ints_disabled());
     LTRACEF("timer %p, cpu %u, scheduled %" PRIi64 "\n", timer, cpu, timer->scheduled_time);
 
-    // For inserting the timer we consider several cases. In general we
-    // want to coalesce with the current timer unless we can prove that
+    TimerTree& timers = queue.timers;
+
+    // For inserting the timer we consider the timers either side of it. In
+    // general we want to coalesce with one of them unless we can prove that
     // either that:
-    //  1- there is no slack overlap with current timer OR
+    //  1- there is no slack overlap with either OR
     //  2- the next timer is a better fit.
     //
     // In diagrams that follow
-    // - Let |e| be the current (existing) timer deadline
+    // - Let |e| be the last existing timer deadline before the timer we are inserting
     // - Let |t| be the deadline of the timer we are inserting
-    // - Let |n| be the next timer deadline if any
-    // - Let |x| be the end of the list (not a timer)
+    // - Let |n| be the next timer deadline, at or after |t|
     // - Let |(| and |)| the earliest_deadline and latest_deadline.
     //
-    timer_t* entry;
-
-    list_for_every_entry (&percpu[cpu].timer_queue, entry, timer_t, node) {
-        if (entry->scheduled_time > latest_deadline) {
-            // New timer latest is earlier than the current timer.
-            // Just add upfront as is, without slack.
-            //
-            //   ---------t---)--e-------------------------------> time
-            //
-            timer->slack = 0ll;
-            list_add_before(&entry->node, &timer->node);
-            return;
-        }
-
-        if (entry->scheduled_time >= timer->scheduled_time) {
-            //  New timer slack overlaps and is to the left (or equal). We
-            //  coalesce with current by scheduling late.
-            //
-            //  --------(----t---e-)----------------------------> time
-            //
-            timer->slack = zx_time_sub_time(entry->scheduled_time, timer->scheduled_time);
-            timer->scheduled_time = entry->scheduled_time;
-            kcounter_add(timer_coalesced_counter, 1);
-            list_add_after(&entry->node, &timer->node);
-            return;
-        }
-
-        if (entry->scheduled_time < earliest_deadline) {
-            // new timer earliest is later than the current timer. This case
-            // is handled in a future iteration.
-            //
-            //   ----------------e--(---t-----------------------> time
-            //
-            continue;
-        }
-
-        // New timer is to the right of current timer and there is overlap
-        // with the current timer, but could the next timer (if any) be
-        // a better fit?
+    auto next = timers.lower_bound({timer->scheduled_time, 0});
+    auto entry = next;
+    --entry;
+    if (entry.IsValid() && entry->scheduled_time < earliest_deadline) {
+        // The timer before has no slack overlap.
         //
-        //  -------------(--e---t-----?-------------------> time
+        //   ----------------e--(---t-----------------------> time
         //
+        entry = timers.end();
+    }
 
-        const timer_t* next =
-            list_next_type(&percpu[cpu].timer_queue, &entry->node, timer_t, node);
-
-        if (next != NULL) {
-            if (next->scheduled_time <= timer->scheduled_time) {
-                // The new timer is to the right of the next timer. There is no
-                // chance the current timer is a better fit.
-                //
-                //  -------------(--e---n---t----------------------> time
-                //
-                continue;
-            }
-
-            if (next->scheduled_time < latest_deadline) {
-                // There is slack overlap with the next timer, and also with the
-                // current timer. Which coalescing is a better match?
-                //
-                //  --------------(-e---t---n-)-----------------------> time
-                //
-                zx_duration_t delta_entry =
-                    zx_time_sub_time(timer->scheduled_time, entry->scheduled_time);
-                zx_duration_t delta_next =
-                    zx_time_sub_time(next->scheduled_time, timer->scheduled_time);
-                if (delta_next < delta_entry) {
-                    // New timer is closer to the next timer, handle it in the
-                    // next iteration.
-                    continue;
-                }
-            }
-        }
-
-        // Handles the remaining cases, note that there is overlap with
-        // the current timer.
+    timer_t* coalesce_with = nullptr;
+    if (next.IsValid() && next->scheduled_time <= latest_deadline &&
+        (!entry.IsValid() || next->scheduled_time == timer->scheduled_time ||
+         (next->scheduled_time < latest_deadline &&
+          zx_time_sub_time(next->scheduled_time, timer->scheduled_time) <
+              zx_time_sub_time(timer->scheduled_time, entry->scheduled_time)))) {
+        //  New timer slack overlaps the next timer, and there is either no
+        //  overlap with the one before or the next one is closer. We
+        //  coalesce with next by scheduling late.
+        //
+        //  --------(----t---n-)----------------------------> time
+        //  ------(--e------t--n--)-------------------------> time
         //
-        //  1- this is the last timer (next == NULL) or
+        coalesce_with = &*next;
+    } else if (entry.IsValid()) {
+        // Handles the remaining cases with overlap with the timer before:
+        //
+        //  1- there is no next timer, or
         //  2- there is no overlap with the next timer, or
-        //  3- there is overlap with both current and next but
-        //     current is closer.
+        //  3- there is overlap with both but the one before is closer.
         //
         //  So we coalesce by scheduling early.
         //
-        timer->slack = zx_time_sub_time(entry->scheduled_time, timer->scheduled_time);
-        timer->scheduled_time = entry->scheduled_time;
+        //  -------------(--e---t-----)-n------------------> time
+        //
+        coalesce_with = &*entry;
+    }
+
+    if (coalesce_with != nullptr) {
+        timer->slack = zx_time_sub_time(coalesce_with->scheduled_time, timer->scheduled_time);
+        timer->scheduled_time = coalesce_with->scheduled_time;
         kcounter_add(timer_coalesced_counter, 1);
-        list_add_after(&entry->node, &timer->node);
-        return;
+    } else {
+        // No overlap with anything, so add the timer as is, without slack.
+        //
+        //   ---------t---)--n-------------------------------> time
+        //
+        timer->slack = 0ll;
     }
 
-    // Walked off the end of the list and there was no overlap.
-    timer->slack = 0;
-    list_add_tail(&percpu[cpu].timer_queue, &timer->node);
+    timers.insert(timer);
+    timer->queue_cpu = cpu;
 }
 
-void timer_set(timer_t* timer, const Deadline& deadline,
-               timer_callback callback, void* arg) {
-    LTRACEF("timer %p deadline.when %" PRIi64 " deadline.slack.amount %" PRIi64
-            " deadline.slack.mode %u callback %p arg %p\n",
-            timer, deadline.when(), deadline.slack().amount(), deadline.slack().mode(), callback,
-            arg);
+// Removes |timer| from the queue of the cpu it is queued on, if it is queued.
+// Returns false if it was not.
+static bool remove_timer_from_queue(timer_t* timer) {
+    for (;;) {
+        // Pairs with the store in timer_tick(): a timer found unqueued because
+        // it is firing is also found busy.
+        const int queue_cpu = atomic_load(&timer->queue_cpu);
+        if (queue_cpu == kTimerNotQueued) {
+            return false;
+        }
+        if (queue_cpu == kTimerMigrating) {
+            arch_spinloop_pause();
+            continue;
+        }
 
-    DEBUG_ASSERT(timer->magic == TIMER_MAGIC);
-    DEBUG_ASSERT(deadline.slack().mode() <= TIMER_SLACK_EARLY);
-    DEBUG_ASSERT(deadline.slack().amount() >= 0);
+        TimerQueue& queue = timer_queues[queue_cpu];
+        Guard<SpinLock, IrqSave> guard{&queue.lock};
 
-    if (list_in_list(&timer->node)) {
-        panic("timer %p already in list\n", timer);
-    }
+        // The timer may have fired or moved since we looked.
+        if (timer->queue_cpu != queue_cpu) {
+            continue;
+        }
 
-    const zx_time_t latest_deadline = deadline.latest();
-    const zx_time_t earliest_deadline = deadline.earliest();
+        const uint cpu = arch_curr_cpu_num();
+        const bool was_head = &queue.timers.front() == timer;
 
-    Guard<spin_lock_t, IrqSave> guard{TimerLock::Get()};
+        queue.timers.erase(*timer);
+        timer->queue_cpu = kTimerNotQueued;
+        kcounter_add(timer_canceled_counter, 1);
 
-    uint cpu = arch_curr_cpu_num();
+        // TODO(cpu): if  after removing |timer| there is one other single timer with
+        // the same scheduled_time and slack non-zero then it is possible to return
+        // that timer to the ideal scheduled_time.
+
+        // see if we've just modified the head of this cpu's timer queue.
+        // if we modified another cpu's queue, we'll just let it fire and sort itself out
+        if (unlikely(was_head) && queue_cpu == (int)cpu) {
+            // timer we're canceling was at head of queue, see if we should update platform timer
+            if (!queue.timers.is_empty()) {
+                update_platform_timer(cpu, queue.timers.front().scheduled_time);
+            } else if (percpu[cpu].next_timer_deadline == ZX_TIME_INFINITE) {
+                LTRACEF("clearing old hw timer, preempt timer not set, nothing in the queue\n");
+                platform_stop_timer();
+            }
+        }
+        return true;
+    }
+}
+
+// Queues |timer| on |cpu|, the current cpu.
+//
+// Can only be called when interrupts are disabled.
+static void timer_set_on_cpu(uint cpu, timer_t* timer, const Deadline& deadline,
+                             timer_callback callback, void* arg) {
+    DEBUG_ASSERT(arch_ints_disabled());
+
+    TimerQueue& queue = timer_queues[cpu];
+    Guard<SpinLock, NoIrqSave> guard{&queue.lock};
 
     bool currently_active = (timer->active_cpu == (int)cpu);
     if (unlikely(currently_active)) {
@@ -237,15 +272,38 @@ void timer_set(timer_t* timer, const Deadline& deadline,
 
     LTRACEF("scheduled time %" PRIi64 "\n", timer->scheduled_time);
 
-    insert_timer_in_queue(cpu, timer, earliest_deadline, latest_deadline);
+    insert_timer_in_queue(cpu, queue, timer, deadline.earliest(), deadline.latest());
     kcounter_add(timer_created_counter, 1);
 
-    if (list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node) == timer) {
+    if (&queue.timers.front() == timer) {
         // we just modified the head of the timer queue
         update_platform_timer(cpu, deadline.when());
     }
 }
 
+void timer_set(timer_t* timer, const Deadline& deadline,
+               timer_callback callback, void* arg) {
+    LTRACEF("timer %p deadline.when %" PRIi64 " deadline.slack.amount %" PRIi64
+            " deadline.slack.mode %u callback %p arg %p\n",
+            timer, deadline.when(), deadline.slack().amount(), deadline.slack().mode(), callback,
+            arg);
+
+    DEBUG_ASSERT(timer->magic == TIMER_MAGIC);
+    DEBUG_ASSERT(deadline.slack().mode() <= TIMER_SLACK_EARLY);
+    DEBUG_ASSERT(deadline.slack().amount() >= 0);
+
+    if (timer->queue_cpu != kTimerNotQueued) {
+        panic("timer %p already in queue %d\n", timer, timer->queue_cpu);
+    }
+
+    // keep interrupts disabled between picking the queue and locking it so we
+    // can't migrate to another cpu in between
+    spin_lock_saved_state_t irq_state;
+    arch_interrupt_save(&irq_state, SPIN_LOCK_FLAG_INTERRUPTS);
+    timer_set_on_cpu(arch_curr_cpu_num(), timer, deadline, callback, arg);
+    arch_interrupt_restore(irq_state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
 void timer_preempt_reset(zx_time_t deadline) {
     DEBUG_ASSERT(arch_ints_disabled());
 
@@ -274,62 +332,44 @@ void timer_preempt_cancel() {
 bool timer_cancel(timer_t* timer) {
     DEBUG_ASSERT(timer->magic == TIMER_MAGIC);
 
-    Guard<spin_lock_t, IrqSave> guard{TimerLock::Get()};
-
-    uint cpu = arch_curr_cpu_num();
-
     // mark the timer as canceled
     timer->cancel = true;
     mb();
 
     // see if we're trying to cancel the timer we're currently in the middle of handling
-    if (unlikely(timer->active_cpu == (int)cpu)) {
-        // zero it out
-        timer->callback = NULL;
-        timer->arg = NULL;
-
-        // we're done, so return back to the callback
-        return false;
+    {
+        spin_lock_saved_state_t irq_state;
+        arch_interrupt_save(&irq_state, SPIN_LOCK_FLAG_INTERRUPTS);
+        const bool in_callback = timer->active_cpu == (int)arch_curr_cpu_num();
+        arch_interrupt_restore(irq_state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+        if (unlikely(in_callback)) {
+            // zero it out
+            timer->callback = NULL;
+            timer->arg = NULL;
+
+            // we're done, so return back to the callback
+            return false;
+        }
     }
 
-    bool callback_not_running;
-
     // if the timer is in a queue, remove it and adjust hardware timers if needed
-    if (list_in_list(&timer->node)) {
-        callback_not_running = true;
-
-        // save a copy of the old head of the queue so later we can see if we modified the head
-        timer_t* oldhead = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
-
-        // remove our timer from the queue
-        list_delete(&timer->node);
-        kcounter_add(timer_canceled_counter, 1);
-
-        // TODO(cpu): if  after removing |timer| there is one other single timer with
-        // the same scheduled_time and slack non-zero then it is possible to return
-        // that timer to the ideal scheduled_time.
+    bool callback_not_running = remove_timer_from_queue(timer);
 
-        // see if we've just modified the head of this cpu's timer queue.
-        // if we modified another cpu's queue, we'll just let it fire and sort itself out
-        if (unlikely(oldhead == timer)) {
-            // timer we're canceling was at head of queue, see if we should update platform timer
-            timer_t* newhead = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
-            if (newhead) {
-                update_platform_timer(cpu, newhead->scheduled_time);
-            } else if (percpu[cpu].next_timer_deadline == ZX_TIME_INFINITE) {
-                LTRACEF("clearing old hw timer, preempt timer not set, nothing in the queue\n");
-                platform_stop_timer();
-            }
+    // wait for the timer to become un-busy in case a callback is currently active on another cpu
+    for (;;) {
+        while (timer->active_cpu >= 0) {
+            arch_spinloop_pause();
         }
-    } else {
-        callback_not_running = false;
-    }
-
-    guard.Release();
+        mb();
 
-    // wait for the timer to become un-busy in case a callback is currently active on another cpu
-    while (timer->active_cpu >= 0) {
-        arch_spinloop_pause();
+        // A callback that reset the timer before it could see the cancel has
+        // queued it again, on the cpu it ran on.  Any later callback sees the
+        // cancel and leaves the timer alone.
+        if (!remove_timer_from_queue(timer)) {
+            break;
+        }
+        callback_not_running = true;
     }
 
     // zero it out
@@ -360,14 +400,15 @@ void timer_tick(zx_time_t now) {
         sched_preempt_timer_tick(now);
     }
 
-    Guard<spin_lock_t, NoIrqSave> guard{TimerLock::Get()};
+    TimerQueue& queue = timer_queues[cpu];
+    Guard<SpinLock, NoIrqSave> guard{&queue.lock};
 
     for (;;) {
         // see if there's an event to process
-        timer = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
-        if (likely(timer == 0)) {
+        if (likely(queue.timers.is_empty())) {
             break;
         }
+        timer = &queue.timers.front();
         LTRACEF("next item on timer queue %p at %" PRIi64 " now %" PRIi64 " (%p, arg %p)\n",
                 timer, timer->scheduled_time, now, timer->callback, timer->arg);
         if (likely(now < timer->scheduled_time)) {
@@ -379,10 +420,12 @@ void timer_tick(zx_time_t now) {
         DEBUG_ASSERT_MSG(timer && timer->magic == TIMER_MAGIC,
                          "ASSERT: timer failed magic check: timer %p, magic 0x%x\n",
                          timer, (uint)timer->magic);
-        list_delete(&timer->node);
-
-        // mark the timer busy
+        // mark the timer busy before taking it off the queue, so that a
+        // timer_cancel() on another cpu that finds it unqueued without taking
+        // our lock also finds it busy, and waits for the callback
         timer->active_cpu = cpu;
+        queue.timers.erase(*timer);
+        atomic_store(&timer->queue_cpu, kTimerNotQueued);
         // Unlocking the spinlock in CallUnlocked acts as a memory barrier.
 
         // Now that the timer is off of the list, release the spinlock to handle
@@ -407,9 +450,8 @@ void timer_tick(zx_time_t now) {
 
     // get the deadline of the event at the head of the queue (if any)
     zx_time_t deadline = ZX_TIME_INFINITE;
-    timer = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
-    if (timer) {
-        deadline = timer->scheduled_time;
+    if (!queue.timers.is_empty()) {
+        deadline = queue.timers.front().scheduled_time;
 
         // has to be the case or it would have fired already
         DEBUG_ASSERT(deadline > now);
@@ -442,49 +484,69 @@ zx_status_t timer_trylock_or_cancel(timer_t* t, spin_lock_t* lock) {
 }
 
 void timer_transition_off_cpu(uint old_cpu) {
-    Guard<spin_lock_t, IrqSave> guard{TimerLock::Get()};
+    spin_lock_saved_state_t irq_state;
+    arch_interrupt_save(&irq_state, SPIN_LOCK_FLAG_INTERRUPTS);
     uint cpu = arch_curr_cpu_num();
-
-    timer_t* old_head = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
-
-    timer_t *entry = NULL, *tmp_entry = NULL;
-    // Move all timers from old_cpu to this cpu
-    list_for_every_entry_safe (&percpu[old_cpu].timer_queue, entry, tmp_entry, timer_t, node) {
-        list_delete(&entry->node);
-        // We lost the original asymmetric slack information so when we combine them
-        // with the other timer queue they are not coalesced again.
-        // TODO(cpu): figure how important this case is.
-        insert_timer_in_queue(cpu, entry, entry->scheduled_time, entry->scheduled_time);
-        // Note, we do not increment the "created" counter here because we are simply moving these
-        // timers from one queue to another and we already counted them when they were first
-        // created.
+    DEBUG_ASSERT(cpu != old_cpu);
+
+    // Take all of old_cpu's timers first, so that the two queues' locks are
+    // never held together.  Until they are queued again, anyone cancelling
+    // one of them waits for it to land.
+    TimerTree moving;
+    {
+        TimerQueue& old_queue = timer_queues[old_cpu];
+        Guard<SpinLock, NoIrqSave> guard{&old_queue.lock};
+        for (timer_t& entry : old_queue.timers) {
+            entry.queue_cpu = kTimerMigrating;
+        }
+        moving.swap(old_queue.timers);
     }
 
-    timer_t* new_head = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
-    if (new_head != NULL && new_head != old_head) {
-        // we just modified the head of the timer queue
-        update_platform_timer(cpu, new_head->scheduled_time);
+    {
+        TimerQueue& queue = timer_queues[cpu];
+        Guard<SpinLock, NoIrqSave> guard{&queue.lock};
+
+        const timer_t* old_head = queue.timers.is_empty() ? nullptr : &queue.timers.front();
+
+        // Move all timers from old_cpu to this cpu
+        while (!moving.is_empty()) {
+            timer_t* entry = moving.pop_front();
+            // We lost the original asymmetric slack information so when we combine them
+            // with the other timer queue they are not coalesced again.
+            // TODO(cpu): figure how important this case is.
+            insert_timer_in_queue(cpu, queue, entry, entry->scheduled_time, entry->scheduled_time);
+            // Note, we do not increment the "created" counter here because we are simply moving
+            // these timers from one queue to another and we already counted them when they were
+            // first created.
+        }
+
+        if (!queue.timers.is_empty() && &queue.timers.front() != old_head) {
+            // we just modified the head of the timer queue
+            update_platform_timer(cpu, queue.timers.front().scheduled_time);
+        }
     }
 
     // the old cpu has no tasks left, so reset the deadlines
     percpu[old_cpu].preempt_timer_deadline = ZX_TIME_INFINITE;
     percpu[old_cpu].next_timer_deadline = ZX_TIME_INFINITE;
+
+    arch_interrupt_restore(irq_state, SPIN_LOCK_FLAG_INTERRUPTS);
 }
 
 void timer_thaw_percpu(void) {
     DEBUG_ASSERT(arch_ints_disabled());
-    Guard<spin_lock_t, NoIrqSave> guard{TimerLock::Get()};
 
     uint cpu = arch_curr_cpu_num();
+    TimerQueue& queue = timer_queues[cpu];
+    Guard<SpinLock, NoIrqSave> guard{&queue.lock};
 
     // reset next_timer_deadline so that update_platform_timer will reconfigure the timer
     percpu[cpu].next_timer_deadline = ZX_TIME_INFINITE;
     zx_time_t deadline = percpu[cpu].preempt_timer_deadline;
 
-    timer_t* t = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
-    if (t) {
-        if (t->scheduled_time < deadline) {
-            deadline = t->scheduled_time;
+    if (!queue.timers.is_empty()) {
+        if (queue.timers.front().scheduled_time < deadline) {
+            deadline = queue.timers.front().scheduled_time;
         }
     }
 
@@ -495,7 +557,6 @@ void timer_thaw_percpu(void) {
 
 void timer_queue_init(void) {
     for (uint i = 0; i < SMP_MAX_CPUS; i++) {
-        list_initialize(&percpu[i].timer_queue);
         percpu[i].preempt_timer_deadline = ZX_TIME_INFINITE;
         percpu[i].next_timer_deadline = ZX_TIME_INFINITE;
     }
@@ -506,21 +567,21 @@ static void dump_timer_queues(char* buf, size_t len) {
     size_t ptr = 0;
     zx_time_t now = current_time();
 
-    Guard<spin_lock_t, IrqSave> guard{TimerLock::Get()};
-
     for (uint i = 0; i < SMP_MAX_CPUS; i++) {
         if (mp_is_cpu_online(i)) {
             ptr += snprintf(buf + ptr, len - ptr, "cpu %u:\n", i);
 
-            timer_t* t;
+            TimerQueue& queue = timer_queues[i];
+            Guard<SpinLock, IrqSave> guard{&queue.lock};
+
             zx_time_t last = now;
-            list_for_every_entry (&percpu[i].timer_queue, t, timer_t, node) {
-                zx_duration_t delta_now = zx_time_sub_time(t->scheduled_time, now);
-                zx_duration_t delta_last = zx_time_sub_time(t->scheduled_time, last);
+            for (const timer_t& t : queue.timers) {
+                zx_duration_t delta_now = zx_time_sub_time(t.scheduled_time, now);
+                zx_duration_t delta_last = zx_time_sub_time(t.scheduled_time, last);
                 ptr += snprintf(buf + ptr, len - ptr,
                                 "\ttime %" PRIi64 " delta_now %" PRIi64 " delta_last %" PRIi64 " func %p arg %p\n",
-                                t->scheduled_time, delta_now, delta_last, t->callback, t->arg);
-                last = t->scheduled_time;
+                                t.scheduled_time, delta_now, delta_last, t.callback, t.arg);
+                last = t.scheduled_time;
             }
         }
     }
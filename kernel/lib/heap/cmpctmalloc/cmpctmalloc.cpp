@@ -13,8 +13,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <arch/ops.h>
 #include <debug.h>
 #include <err.h>
+#include <kernel/align.h>
 #include <kernel/mutex.h>
 #include <kernel/spinlock.h>
 #include <kernel/thread.h>
@@ -109,6 +111,18 @@
 //   Exception: to avoid OS free/alloc churn when right on the edge, the heap
 //   will try to hold onto one entirely-free, non-large OS allocation instead of
 //   returning it to the OS. See cached_os_alloc.
+//
+// Per-cpu caches:
+//   With CMPCT_PERCPU_CACHE, areas with up to CACHE_MAX_SIZE usable bytes are
+//   not returned to the free buckets when freed. Instead each cpu keeps a
+//   stack of them per size class (the size classes are the free buckets),
+//   guarded by a per-cpu spinlock, and hands them straight back out for
+//   allocations of that class without taking the heap mutex. Cached areas
+//   are still tagged as allocated, so the rest of the heap never sees them.
+//   An empty class is refilled with a batch of areas carved out under a
+//   single acquisition of the heap mutex, and a class that grows past its
+//   limit returns half of its areas the same way. cmpct_trim() empties all of
+//   the caches before looking for pages to give back.
 
 #if defined(DEBUG) || LK_DEBUGLEVEL > 2
 #define CMPCT_DEBUG
@@ -118,6 +132,10 @@
 
 KCOUNTER_MAX(max_allocation, "kernel.heap.max_allocation");
 
+#if !defined(CMPCT_PERCPU_CACHE)
+#define CMPCT_PERCPU_CACHE 1
+#endif
+
 // Use HEAP_ENABLE_TESTS to enable internal testing. The tests are not useful
 // when the target system is up. By that time we have done hundreds of allocations
 // already.
@@ -202,6 +220,11 @@ static struct heap theheap;
 
 static ssize_t heap_grow(size_t len);
 
+#if CMPCT_PERCPU_CACHE
+static void cache_drain_all(void) TA_REQ(theheap.lock);
+static void cache_dump(void);
+#endif
+
 static void lock(void) TA_ACQ(theheap.lock) {
     mutex_acquire(&theheap.lock);
 }
@@ -240,6 +263,10 @@ void cmpct_dump(bool panic_time) TA_NO_THREAD_SAFETY_ANALYSIS {
         }
     }
 
+#if CMPCT_PERCPU_CACHE
+    cache_dump();
+#endif
+
     if (!panic_time) {
         unlock();
     }
@@ -812,6 +839,10 @@ void cmpct_trim(void) {
     // header. They might be at the start or the end of a block, so we can trim
     // them and free the page(s).
     lock();
+#if CMPCT_PERCPU_CACHE
+    // Cached areas pin down pages that could otherwise be returned.
+    cache_drain_all();
+#endif
     for (int bucket = size_to_index_freeing(PAGE_SIZE);
          bucket < NUMBER_OF_BUCKETS;
          bucket++) {
@@ -900,24 +931,13 @@ void cmpct_trim(void) {
     unlock();
 }
 
-void* cmpct_alloc(size_t size) {
-    if (size == 0u) {
-        return NULL;
-    }
-
-    kcounter_max(max_allocation, size);
-
-    // Large allocations are no longer allowed. See ZX-1318 for details.
-    if (size > (HEAP_LARGE_ALLOC_BYTES - sizeof(header_t))) {
-        return NULL;
-    }
-
+// Carves out an area with room for |size| bytes. Called with the lock held.
+static void* alloc_locked(size_t size) TA_REQ(theheap.lock) {
     size_t rounded_up;
     int start_bucket = size_to_index_allocating(size, &rounded_up);
 
     rounded_up += sizeof(header_t);
 
-    lock();
     int bucket = find_nonempty_bucket(start_bucket);
     if (bucket == -1) {
         // Grow heap by at least 12% if we can.
@@ -928,7 +948,6 @@ void* cmpct_alloc(size_t size) {
         // we succeed or get too small.
         while (heap_grow(growby) < 0) {
             if (growby <= rounded_up) {
-                unlock();
                 return NULL;
             }
             growby = MAX(growby >> 1, rounded_up);
@@ -960,6 +979,270 @@ void* cmpct_alloc(size_t size) {
     memset(((char*)result) + size, PADDING_FILL,
            rounded_up - size - sizeof(header_t));
 #endif
+    return result;
+}
+
+// Returns the area starting at |header| to the free buckets, coalescing it
+// with its neighbors. Called with the lock held.
+static void free_locked(header_t* header) TA_REQ(theheap.lock) {
+    size_t size = header->size;
+    header_t* left = header->left;
+    if (left != NULL && is_tagged_as_free(left)) {
+        // Coalesce with left free object.
+        unlink_free_unknown_bucket((free_t*)left);
+        header_t* right = right_header(header);
+        if (is_tagged_as_free(right)) {
+            // Coalesce both sides.
+            unlink_free_unknown_bucket((free_t*)right);
+            header_t* right_right = right_header(right);
+            FixLeftPointer(right_right, left);
+            free_memory(left, left->left, left->size + size + right->size);
+        } else {
+            // Coalesce only left.
+            FixLeftPointer(right, left);
+            free_memory(left, left->left, left->size + size);
+        }
+    } else {
+        header_t* right = right_header(header);
+        if (is_tagged_as_free(right)) {
+            // Coalesce only right.
+            header_t* right_right = right_header(right);
+            unlink_free_unknown_bucket((free_t*)right);
+            FixLeftPointer(right_right, header);
+            free_memory(header, left, size + right->size);
+        } else {
+            free_memory(header, left, size);
+        }
+    }
+}
+
+#if CMPCT_PERCPU_CACHE
+
+// Largest usable area size that goes through the per-cpu caches.
+#define CACHE_MAX_SIZE 2048u
+
+// One class per free bucket up to and including CACHE_MAX_SIZE. Checked
+// against size_to_index_freeing() in cmpct_init().
+#define NUMBER_OF_CACHE_CLASSES 48
+
+// A class holds on to at most about this many bytes, but never fewer than
+// CACHE_CLASS_MIN_COUNT or more than CACHE_CLASS_MAX_COUNT areas.
+#define CACHE_CLASS_BYTES (8u * 1024u)
+#define CACHE_CLASS_MIN_COUNT 4u
+#define CACHE_CLASS_MAX_COUNT 64u
+
+KCOUNTER(cache_hit_count, "kernel.heap.cache.hit");
+KCOUNTER(cache_refill_count, "kernel.heap.cache.refill");
+KCOUNTER(cache_flush_count, "kernel.heap.cache.flush");
+
+// Overlaid on the payload of a cached area.
+typedef struct cache_entry_struct {
+    struct cache_entry_struct* next;
+} cache_entry_t;
+
+struct cpu_cache {
+    // Only taken by the owning cpu, except by cmpct_trim() and cmpct_dump().
+    // Never held while acquiring theheap.lock.
+    spin_lock_t lock;
+
+    struct {
+        cache_entry_t* head;
+        uint32_t count;
+    } classes[NUMBER_OF_CACHE_CLASSES];
+} __CPU_ALIGN;
+
+static struct cpu_cache cpu_caches[SMP_MAX_CPUS];
+
+static uint32_t cache_class_limit(size_t size) {
+    return MAX(CACHE_CLASS_MIN_COUNT, MIN(CACHE_CLASS_MAX_COUNT, CACHE_CLASS_BYTES / size));
+}
+
+// Returns |chain| to the free buckets.
+static void cache_free_chain(cache_entry_t* chain) TA_REQ(theheap.lock) {
+    while (chain != NULL) {
+        cache_entry_t* next = chain->next;
+        free_locked((header_t*)chain - 1);
+        chain = next;
+    }
+}
+
+// Pops an area of size class |cls| off the current cpu's cache.
+static void* cache_pop(int cls) {
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    struct cpu_cache* cache = &cpu_caches[arch_curr_cpu_num()];
+    spin_lock(&cache->lock);
+    cache_entry_t* entry = cache->classes[cls].head;
+    if (entry != NULL) {
+        cache->classes[cls].head = entry->next;
+        cache->classes[cls].count--;
+    }
+    spin_unlock(&cache->lock);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+    return entry;
+}
+
+// Allocation path for areas of up to CACHE_MAX_SIZE bytes. |rounded| is
+// |size| rounded up to its bucket size.
+static void* cache_alloc(size_t size, size_t rounded) {
+    int cls = size_to_index_freeing(rounded);
+
+    void* result = cache_pop(cls);
+    if (result != NULL) {
+        kcounter_add(cache_hit_count, 1);
+#ifdef CMPCT_DEBUG
+        memset(result, ALLOC_FILL, size);
+#endif
+        return result;
+    }
+
+    // Carve out the area we need plus half a class worth of spares in one go.
+    kcounter_add(cache_refill_count, 1);
+    uint32_t spares = cache_class_limit(rounded) / 2;
+    cache_entry_t* chain = NULL;
+    lock();
+    result = alloc_locked(size);
+    for (uint32_t i = 0; result != NULL && i < spares; i++) {
+        cache_entry_t* entry = (cache_entry_t*)alloc_locked(rounded);
+        if (entry == NULL) {
+            break;
+        }
+        entry->next = chain;
+        chain = entry;
+    }
+    unlock();
+
+    if (chain == NULL) {
+        return result;
+    }
+
+    // We may have moved to another cpu in the meantime, which is harmless.
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    struct cpu_cache* cache = &cpu_caches[arch_curr_cpu_num()];
+    spin_lock(&cache->lock);
+    while (chain != NULL) {
+        cache_entry_t* next = chain->next;
+        chain->next = cache->classes[cls].head;
+        cache->classes[cls].head = chain;
+        cache->classes[cls].count++;
+        chain = next;
+    }
+    spin_unlock(&cache->lock);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    return result;
+}
+
+// Puts a freed area in the current cpu's cache. Returns false if the area is
+// too big to be cached.
+static bool cache_free(header_t* header) {
+    size_t usable = header->size - sizeof(header_t);
+    if (usable > CACHE_MAX_SIZE) {
+        return false;
+    }
+
+    // Round down, so that every area in a class can serve any allocation that
+    // maps to it.
+    int cls = size_to_index_freeing(usable);
+    uint32_t limit = cache_class_limit(usable);
+
+    cache_entry_t* entry = (cache_entry_t*)(header + 1);
+    cache_entry_t* flush = NULL;
+
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    struct cpu_cache* cache = &cpu_caches[arch_curr_cpu_num()];
+    spin_lock(&cache->lock);
+    entry->next = cache->classes[cls].head;
+    cache->classes[cls].head = entry;
+    if (++cache->classes[cls].count > limit) {
+        // Hand back the older half of the class. The most recently freed
+        // areas stay behind, as they are the most likely to still be hot.
+        cache_entry_t* keep = entry;
+        for (uint32_t i = 1; i < limit / 2; i++) {
+            keep = keep->next;
+        }
+        flush = keep->next;
+        keep->next = NULL;
+        cache->classes[cls].count = limit / 2;
+    }
+    spin_unlock(&cache->lock);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    if (flush != NULL) {
+        kcounter_add(cache_flush_count, 1);
+        lock();
+        cache_free_chain(flush);
+        unlock();
+    }
+
+    return true;
+}
+
+// Prints the number of areas each cpu is holding on to. Reads the caches
+// without locking them, as it may be called at panic time.
+static void cache_dump(void) TA_NO_THREAD_SAFETY_ANALYSIS {
+    dprintf(INFO, "\tper-cpu caches:\n");
+    for (cpu_num_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        size_t areas = 0;
+        size_t bytes = 0;
+        for (int cls = 0; cls < NUMBER_OF_CACHE_CLASSES; cls++) {
+            for (cache_entry_t* e = cpu_caches[cpu].classes[cls].head; e != NULL; e = e->next) {
+                areas++;
+                bytes += ((header_t*)e - 1)->size;
+            }
+        }
+        if (areas > 0) {
+            dprintf(INFO, "\t\tcpu %u: %zu areas, %zu bytes\n", cpu, areas, bytes);
+        }
+    }
+}
+
+// Empties every cpu's cache back into the free buckets.
+static void cache_drain_all(void) TA_REQ(theheap.lock) {
+    for (auto& cache : cpu_caches) {
+        cache_entry_t* chains[NUMBER_OF_CACHE_CLASSES];
+
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&cache.lock, state);
+        for (int cls = 0; cls < NUMBER_OF_CACHE_CLASSES; cls++) {
+            chains[cls] = cache.classes[cls].head;
+            cache.classes[cls].head = NULL;
+            cache.classes[cls].count = 0;
+        }
+        spin_unlock_irqrestore(&cache.lock, state);
+
+        for (int cls = 0; cls < NUMBER_OF_CACHE_CLASSES; cls++) {
+            cache_free_chain(chains[cls]);
+        }
+    }
+}
+
+#endif  // CMPCT_PERCPU_CACHE
+
+void* cmpct_alloc(size_t size) {
+    if (size == 0u) {
+        return NULL;
+    }
+
+    kcounter_max(max_allocation, size);
+
+    // Large allocations are no longer allowed. See ZX-1318 for details.
+    if (size > (HEAP_LARGE_ALLOC_BYTES - sizeof(header_t))) {
+        return NULL;
+    }
+
+#if CMPCT_PERCPU_CACHE
+    size_t rounded;
+    size_to_index_allocating(size, &rounded);
+    if (rounded <= CACHE_MAX_SIZE) {
+        return cache_alloc(size, rounded);
+    }
+#endif
+
+    lock();
+    void* result = alloc_locked(size);
     unlock();
     return result;
 }
@@ -1006,36 +1289,13 @@ void cmpct_free(void* payload) {
     }
     header_t* header = (header_t*)payload - 1;
     DEBUG_ASSERT(!is_tagged_as_free(header)); // Double free!
-    size_t size = header->size;
-    lock();
-    header_t* left = header->left;
-    if (left != NULL && is_tagged_as_free(left)) {
-        // Coalesce with left free object.
-        unlink_free_unknown_bucket((free_t*)left);
-        header_t* right = right_header(header);
-        if (is_tagged_as_free(right)) {
-            // Coalesce both sides.
-            unlink_free_unknown_bucket((free_t*)right);
-            header_t* right_right = right_header(right);
-            FixLeftPointer(right_right, left);
-            free_memory(left, left->left, left->size + size + right->size);
-        } else {
-            // Coalesce only left.
-            FixLeftPointer(right, left);
-            free_memory(left, left->left, left->size + size);
-        }
-    } else {
-        header_t* right = right_header(header);
-        if (is_tagged_as_free(right)) {
-            // Coalesce only right.
-            header_t* right_right = right_header(right);
-            unlink_free_unknown_bucket((free_t*)right);
-            FixLeftPointer(right_right, header);
-            free_memory(header, left, size + right->size);
-        } else {
-            free_memory(header, left, size);
-        }
+#if CMPCT_PERCPU_CACHE
+    if (cache_free(header)) {
+        return;
     }
+#endif
+    lock();
+    free_locked(header);
     unlock();
 }
 
@@ -1131,6 +1391,10 @@ void cmpct_init(void) {
         theheap.free_list_bits[i] = 0;
     }
 
+#if CMPCT_PERCPU_CACHE
+    DEBUG_ASSERT(size_to_index_freeing(CACHE_MAX_SIZE) == NUMBER_OF_CACHE_CLASSES - 1);
+#endif
+
     size_t initial_alloc = HEAP_GROW_SIZE - 2 * sizeof(header_t);
 
     theheap.remaining = 0;
@@ -12,12 +12,20 @@
 // redline.
 typedef void(oom_lowmem_callback_t)(size_t shortfall_bytes);
 
+// Called when the system's free memory drops below the reclaim level, which
+// sits above the redline. Should try to free |target_bytes| of memory that can
+// be recovered later (e.g. clean pages backed by a pager), and returns the
+// number of bytes actually freed.
+typedef size_t(oom_reclaim_callback_t)(size_t target_bytes);
+
 // Initializes the out-of-memory system. If |enable| is true, starts the
-// memory-watcher thread, which calls |lowmem_callback| when the PMM has less
-// than |redline_bytes| free memory, sleeping for |sleep_duration_ns| between
-// checks.
+// memory-watcher thread, which sleeps for |sleep_duration_ns| between checks.
+// When the PMM has less than |reclaim_bytes| free memory the thread first
+// calls |reclaim_callback| to recover memory cheaply; if free memory is still
+// below |redline_bytes| afterwards, it calls |lowmem_callback|.
 //
 // If |enable| is false, the thread can be started manually using 'k oom start'.
 // TODO(dbort): Add a programmatic way to start/stop the thread.
 void oom_init(bool enable, uint64_t sleep_duration_ns, size_t redline_bytes,
-              oom_lowmem_callback_t* lowmem_callback);
+              oom_lowmem_callback_t* lowmem_callback, size_t reclaim_bytes,
+              oom_reclaim_callback_t* reclaim_callback);
@@ -29,6 +29,9 @@ static fbl::Mutex oom_mutex;
 // Function to call when we hit a low-memory condition.
 static oom_lowmem_callback_t* oom_lowmem_callback TA_GUARDED(oom_mutex);
 
+// Function to call when free memory drops below the reclaim level.
+static oom_reclaim_callback_t* oom_reclaim_callback TA_GUARDED(oom_mutex);
+
 // The thread, if it's running; nullptr otherwise.
 static thread_t* oom_thread TA_GUARDED(oom_mutex);
 
@@ -41,6 +44,9 @@ static uint64_t oom_sleep_duration_ns TA_GUARDED(oom_mutex);
 // If the PMM has fewer than this many bytes free, start killing processes.
 static uint64_t oom_redline_bytes TA_GUARDED(oom_mutex);
 
+// If the PMM has fewer than this many bytes free, start reclaiming pages.
+static uint64_t oom_reclaim_bytes TA_GUARDED(oom_mutex);
+
 // True if the thread should print the current free value when it runs.
 static bool oom_printing TA_GUARDED(oom_mutex);
 
@@ -54,7 +60,28 @@ static int oom_loop(void* arg) {
 
     size_t last_free_bytes = total_bytes;
     while (true) {
-        const size_t free_bytes = pmm_count_free_pages() * PAGE_SIZE;
+        size_t free_bytes = pmm_count_free_pages() * PAGE_SIZE;
+
+        // Try to get back above the reclaim level by dropping memory that can
+        // be recovered later before looking at the redline.
+        size_t reclaim_target_bytes = 0;
+        oom_reclaim_callback_t* reclaim_callback = nullptr;
+        {
+            AutoLock lock(&oom_mutex);
+            if (!oom_running) {
+                break;
+            }
+            if (free_bytes < oom_reclaim_bytes) {
+                reclaim_target_bytes = oom_reclaim_bytes - free_bytes;
+                reclaim_callback = oom_reclaim_callback;
+            }
+        }
+        if (reclaim_callback != nullptr) {
+            const size_t reclaimed_bytes = reclaim_callback(reclaim_target_bytes);
+            if (reclaimed_bytes > 0) {
+                free_bytes = pmm_count_free_pages() * PAGE_SIZE;
+            }
+        }
 
         bool lowmem = false;
         bool printing = false;
@@ -107,6 +134,9 @@ static int oom_loop(void* arg) {
         last_free_bytes = free_bytes;
 
         if (lowmem) {
+            // Pages parked in the per-cpu caches count as free, but only the
+            // cpu holding them can hand them out; put them back in the pool.
+            pmm_drain_page_caches();
             lowmem_callback(shortfall_bytes);
         }
 
@@ -131,16 +161,20 @@ static void start_thread_locked() TA_REQ(oom_mutex) {
 }
 
 void oom_init(bool enable, uint64_t sleep_duration_ns, size_t redline_bytes,
-              oom_lowmem_callback_t* lowmem_callback) {
+              oom_lowmem_callback_t* lowmem_callback, size_t reclaim_bytes,
+              oom_reclaim_callback_t* reclaim_callback) {
     DEBUG_ASSERT(sleep_duration_ns > 0);
     DEBUG_ASSERT(redline_bytes > 0);
     DEBUG_ASSERT(lowmem_callback != nullptr);
+    DEBUG_ASSERT(reclaim_callback != nullptr);
 
     AutoLock lock(&oom_mutex);
     DEBUG_ASSERT(oom_lowmem_callback == nullptr);
     oom_lowmem_callback = lowmem_callback;
+    oom_reclaim_callback = reclaim_callback;
     oom_sleep_duration_ns = sleep_duration_ns;
     oom_redline_bytes = redline_bytes;
+    oom_reclaim_bytes = reclaim_bytes;
     oom_printing = false;
     oom_simulate_lowmem = false;
     if (enable) {
@@ -202,6 +236,8 @@ static int cmd_oom(int argc, const cmd_args* argv, uint32_t flags) {
         char buf[MAX_FORMAT_SIZE_LEN];
         format_size_fixed(buf, sizeof(buf), oom_redline_bytes, 'M');
         printf("  redline: %s (%" PRIu64 " bytes)\n", buf, oom_redline_bytes);
+        format_size_fixed(buf, sizeof(buf), oom_reclaim_bytes, 'M');
+        printf("  reclaim: %s (%" PRIu64 " bytes)\n", buf, oom_reclaim_bytes);
     } else if (strcmp(argv[1].str, "print") == 0) {
         oom_printing = !oom_printing;
         printf("OOM print is now %s\n", oom_printing ? "on" : "off");
@@ -16,7 +16,7 @@
 // hash. There is also a 4 byte 'git-' prefix, and possibly a 6 byte
 // '-dirty' suffix. Let's be generous and use 64 bytes.
 #define MAX_BUILDID_SIZE 64
-#define VDSO_CONSTANTS_SIZE (4 * 4 + 2 * 8 + 2 * 4 + MAX_BUILDID_SIZE)
+#define VDSO_CONSTANTS_SIZE (4 * 4 + 2 * 8 + 2 * 4 + 4 * 4 + MAX_BUILDID_SIZE)
 
 #ifndef __ASSEMBLER__
 
@@ -54,6 +54,13 @@ struct vdso_constants {
     // Conversion factor for zx_ticks_get return values to seconds.
     zx_ticks_t ticks_per_second;
 
+    // If nonzero, the monotonic clock is the value of zx_ticks_get scaled
+    // by ns_per_tick, a 32.64 fixed-point number laid out like struct
+    // fp_32_64 in <lib/fixed_point.h>.  Otherwise zx_clock_get_monotonic
+    // has to ask the kernel.
+    uint32_t monotonic_from_ticks;
+    uint32_t ns_per_tick[3];
+
     // Total amount of physical memory in the system, in bytes.
     uint64_t physmem;
 
@@ -9,6 +9,7 @@
 
 #include <fbl/alloc_checker.h>
 #include <kernel/cmdline.h>
+#include <lib/fixed_point.h>
 #include <object/handle.h>
 #include <platform.h>
 #include <vm/pmm.h>
@@ -221,6 +222,12 @@ const VDso* VDso::Create() {
         "vDSO constants", vdso->vmo()->vmo(), VDSO_DATA_CONSTANTS);
     zx_ticks_t per_second = ticks_per_second();
 
+    // If the monotonic clock is a fixed multiple of the counter userspace
+    // reads for zx_ticks_get, the vDSO can compute it without a syscall.
+    struct fp_32_64 ns_per_tick = {};
+    bool monotonic_from_ticks = per_second != 0 &&
+        platform_monotonic_from_ticks(&ns_per_tick);
+
     // Initialize the constants that should be visible to the vDSO.
     // Rather than assigning each member individually, do this with
     // struct assignment and a compound literal so that the compiler
@@ -235,6 +242,12 @@ const VDso* VDso::Create() {
         arch_dcache_line_size(),
         arch_icache_line_size(),
         per_second,
+        monotonic_from_ticks,
+        {
+          ns_per_tick.l0,
+          ns_per_tick.l32,
+          ns_per_tick.l64,
+        },
         pmm_count_total_bytes(),
         BUILDID,
     };
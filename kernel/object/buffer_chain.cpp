@@ -6,6 +6,14 @@
 
 #include <object/buffer_chain.h>
 
+#include <lib/counters.h>
+#include <vm/vm_address_region.h>
+#include <vm/vm_aspace.h>
+
+// Whole pages moved into user VMOs by LendPages, and those it had to copy.
+KCOUNTER(buffer_chain_pages_lent, "kernel.channel.pages.lent");
+KCOUNTER(buffer_chain_pages_copied, "kernel.channel.pages.copied");
+
 // Makes a const void* look like a user_in_ptr<const void>.
 //
 // Sometimes we need to copy data from kernel space. KernelPtrAdapter allows us to implement the
@@ -30,5 +38,93 @@ zx_status_t BufferChain::CopyInKernel(const void* src, size_t dst_offset, size_t
     return CopyInCommon(KernelPtrAdapter(src), dst_offset, size);
 }
 
+zx_status_t BufferChain::CopyInPagesKernel(const void* src, size_t size) {
+    return CopyInPagesCommon(KernelPtrAdapter(src), size);
+}
+
+zx_status_t BufferChain::CopyOutPages(user_out_ptr<void> dst, size_t size) const {
+    size_t rem = size;
+    const vm_page_t* page;
+    list_for_every_entry (&whole_pages_, page, vm_page_t, queue_node) {
+        if (rem == 0) {
+            break;
+        }
+        const size_t copy_len = fbl::min<size_t>(rem, PAGE_SIZE);
+        const char* src = static_cast<const char*>(paddr_to_physmap(page->paddr()));
+        const zx_status_t status = dst.copy_array_to_user(src, copy_len);
+        if (unlikely(status != ZX_OK)) {
+            return status;
+        }
+        dst = dst.byte_offset(copy_len);
+        rem -= copy_len;
+    }
+    return ZX_OK;
+}
+
+zx_status_t BufferChain::LendPages(user_out_ptr<void> dst, size_t size) {
+    const vaddr_t base = reinterpret_cast<vaddr_t>(dst.get());
+    VmAspace* aspace = VmAspace::vaddr_to_aspace(base);
+    if (!IS_PAGE_ALIGNED(base) || size < PAGE_SIZE || !aspace || !aspace->is_user()) {
+        return CopyOutPages(dst, size);
+    }
+
+    // Pages that end up being copied stay with the chain.  They are set aside while the rest are
+    // looked at, and then put back in front of whatever remains.
+    list_node copied = LIST_INITIAL_VALUE(copied);
+    zx_status_t status = ZX_OK;
+
+    const size_t num_pages = size / PAGE_SIZE;
+    size_t done = 0;
+    while (done < num_pages) {
+        const vaddr_t va = base + done * PAGE_SIZE;
+
+        // Move as many pages as the mapping at |va| covers in one go.
+        list_node run = LIST_INITIAL_VALUE(run);
+        fbl::RefPtr<VmAddressRegionOrMapping> region = aspace->FindRegion(va);
+        fbl::RefPtr<VmMapping> mapping = region ? region->as_vm_mapping() : nullptr;
+        size_t run_pages = 1;
+        if (mapping && va >= mapping->base()) {
+            const size_t mapped_pages = (mapping->base() + mapping->size() - va) / PAGE_SIZE;
+            run_pages = fbl::clamp<size_t>(mapped_pages, 1, num_pages - done);
+        }
+        for (size_t i = 0; i < run_pages; i++) {
+            vm_page_t* page = list_remove_head_type(&whole_pages_, vm_page_t, queue_node);
+            page->state = VM_PAGE_STATE_ALLOC;
+            list_add_tail(&run, &page->queue_node);
+        }
+        if (mapping && mapping->ReplacePages(va, &run) == ZX_OK) {
+            kcounter_add(buffer_chain_pages_lent, run_pages);
+            done += run_pages;
+            continue;
+        }
+
+        // The memory at |va| can't take the pages, so copy them there instead, which also
+        // reports the right error if it isn't writable.
+        vm_page_t* page;
+        list_for_every_entry (&run, page, vm_page_t, queue_node) {
+            page->state = VM_PAGE_STATE_IPC;
+            if (status == ZX_OK) {
+                const void* src = paddr_to_physmap(page->paddr());
+                status = dst.byte_offset(done * PAGE_SIZE).copy_array_to_user(src, PAGE_SIZE);
+                done++;
+            }
+        }
+        list_splice_after(&run, copied.prev);
+        kcounter_add(buffer_chain_pages_copied, run_pages);
+        if (status != ZX_OK) {
+            break;
+        }
+    }
+
+    // The tail of the data is copied.
+    if (status == ZX_OK && size > done * PAGE_SIZE) {
+        status = CopyOutPages(dst.byte_offset(done * PAGE_SIZE), size - done * PAGE_SIZE);
+    }
+
+    list_splice_after(&copied, &whole_pages_);
+    return status;
+}
+
 template zx_status_t BufferChain::CopyInCommon(user_in_ptr<const void> src, size_t dst_offset,
                                                size_t size);
+template zx_status_t BufferChain::CopyInPagesCommon(user_in_ptr<const void> src, size_t size);
@@ -138,9 +138,48 @@ static bool copy_in_copy_out() {
     END_TEST;
 }
 
+static bool copy_in_copy_out_pages() {
+    BEGIN_TEST;
+
+    constexpr size_t kNumPages = 3;
+    constexpr size_t kSize = kNumPages * PAGE_SIZE - 1;
+    fbl::AllocChecker ac;
+    auto buf = ktl::unique_ptr<char[]>(new (&ac) char[kSize]);
+    ASSERT_TRUE(ac.check(), "");
+    ktl::unique_ptr<UserMemory> mem = UserMemory::Create(kSize);
+    auto mem_in = make_user_in_ptr(mem->in());
+    auto mem_out = make_user_out_ptr(mem->out());
+
+    // The whole pages come in addition to the one buffer holding the chain.
+    BufferChain* bc = BufferChain::Alloc(0, kNumPages);
+    ASSERT_NE(nullptr, bc, "");
+    ASSERT_EQ(1u, bc->buffers()->size_slow(), "");
+    ASSERT_NE(nullptr, bc->page_data(), "");
+
+    for (size_t i = 0; i < kSize; ++i) {
+        buf[i] = static_cast<char>(i / PAGE_SIZE + 'A');
+    }
+    ASSERT_EQ(ZX_OK, bc->CopyInPagesKernel(buf.get(), kSize), "");
+    EXPECT_EQ('A', bc->page_data()[0], "");
+
+    // Copying out leaves the pages with the chain.
+    memset(buf.get(), 0, kSize);
+    ASSERT_EQ(ZX_OK, bc->CopyOutPages(mem_out, kSize), "");
+    ASSERT_EQ(ZX_OK, mem_in.copy_array_from_user(buf.get(), kSize), "");
+    for (size_t i = 0; i < kSize; ++i) {
+        EXPECT_EQ(static_cast<char>(i / PAGE_SIZE + 'A'), buf[i], "");
+    }
+    EXPECT_NE(nullptr, bc->page_data(), "");
+
+    BufferChain::Free(bc);
+
+    END_TEST;
+}
+
 }  // namespace
 
 UNITTEST_START_TESTCASE(buffer_chain_tests)
 UNITTEST("alloc_free_basic", alloc_free_basic)
 UNITTEST("copy_in_copy_out", copy_in_copy_out)
+UNITTEST("copy_in_copy_out_pages", copy_in_copy_out_pages)
 UNITTEST_END_TESTCASE(buffer_chain_tests, "buffer_chain", "BufferChain tests");
@@ -222,6 +222,27 @@ zx_status_t ChannelDispatcher::Write(zx_koid_t owner, MessagePacketPtr msg) {
     return ZX_OK;
 }
 
+zx_status_t ChannelDispatcher::WriteBatch(zx_koid_t owner, MessagePacketPtr* msgs,
+                                          size_t count) {
+    canary_.Assert();
+
+    AutoReschedDisable resched_disable; // Must come before the lock guard.
+    resched_disable.Disable();
+    Guard<fbl::Mutex> guard{get_lock()};
+
+    // See Write() for an explanation of this test.
+    if (owner != owner_)
+        return ZX_ERR_BAD_HANDLE;
+
+    if (!peer_)
+        return ZX_ERR_PEER_CLOSED;
+
+    for (size_t i = 0; i < count; ++i)
+        peer_->WriteSelf(ktl::move(msgs[i]));
+
+    return ZX_OK;
+}
+
 zx_status_t ChannelDispatcher::Call(zx_koid_t owner,
                                     MessagePacketPtr msg,
                                     zx_time_t deadline, MessagePacketPtr* reply) {
@@ -18,6 +18,7 @@
 #include <object/process_dispatcher.h>
 #include <object/vm_object_dispatcher.h>
 #include <pretty/sizes.h>
+#include <vm/shared_page.h>
 #include <zircon/types.h>
 
 // Machinery to walk over a job tree and run a callback on each process.
@@ -731,6 +732,16 @@ static int mwd_thread(void* arg) {
     }
 }
 
+static void DumpSharedPages() {
+    size_t pages, refs;
+    VmSharedPageRef::GetStats(&pages, &refs);
+
+    char saved[MAX_FORMAT_SIZE_LEN];
+    printf("%zu shared pages, %zu references, %zu pages (%s) saved\n",
+           pages, refs, refs - pages,
+           format_size(saved, sizeof(saved), (refs - pages) * PAGE_SIZE));
+}
+
 static int cmd_diagnostics(int argc, const cmd_args* argv, uint32_t flags) {
     int rc = 0;
 
@@ -750,6 +761,7 @@ static int cmd_diagnostics(int argc, const cmd_args* argv, uint32_t flags) {
         printf("%s asd  <pid>|kernel : dump process/kernel address space\n",
                argv[0].str);
         printf("%s htinfo            : handle table info\n", argv[0].str);
+        printf("%s dedup             : deduplicated page info\n", argv[0].str);
         return -1;
     }
 
@@ -818,6 +830,10 @@ static int cmd_diagnostics(int argc, const cmd_args* argv, uint32_t flags) {
         if (argc != 2)
             goto usage;
         DumpHandleTable();
+    } else if (strcmp(argv[1].str, "dedup") == 0) {
+        if (argc != 2)
+            goto usage;
+        DumpSharedPages();
     } else {
         printf("unrecognized subcommand '%s'\n", argv[1].str);
         goto usage;
@@ -83,8 +83,8 @@ FutexNode* FutexNode::WakeThreads(FutexNode* node, uint32_t count,
     FutexNode* const list_end = node->queue_prev_;
     for (uint32_t i = 0; i < count; i++) {
         DEBUG_ASSERT(node->GetKey() == old_hash_key);
-        // Clear this field to avoid any possible confusion.
-        node->set_hash_key(0);
+        // Leave the key alone: if the wait times out concurrently,
+        // FutexWait() uses it to find the lock we are holding.
 
         const bool is_last_node = (node == list_end);
         FutexNode* next = node->queue_next_;
@@ -174,11 +174,11 @@ void FutexNode::WakeThread() {
     // for |this| wakes and exits, deleting |this|.  There are two
     // cases to consider:
     //  1) The thread's wait times out, or the thread is killed or
-    //     suspended.  In those cases, FutexWait() will reacquire the
-    //     FutexContext lock.  We are currently holding that lock, so
-    //     FutexWait() will not race with us.
+    //     suspended.  In those cases, FutexWait() will reacquire the lock
+    //     of the FutexContext bucket holding this futex.  We are currently
+    //     holding that lock, so FutexWait() will not race with us.
     //  2) The thread is woken by our wait_queue_wake_one() call.  In
-    //     this case, FutexWait() will *not* reacquire the FutexContext
+    //     this case, FutexWait() will *not* reacquire the bucket's
     //     lock.  To handle this correctly, we must not access |this|
     //     after wait_queue_wake_one().
 
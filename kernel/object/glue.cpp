@@ -25,6 +25,8 @@
 #include <object/port_dispatcher.h>
 #include <object/process_dispatcher.h>
 
+#include <vm/vm_object_paged.h>
+
 #include <fbl/function.h>
 
 #include <zircon/types.h>
@@ -62,6 +64,11 @@ static void oom_lowmem(size_t shortfall_bytes) {
     }
 }
 
+static size_t oom_reclaim(size_t target_bytes) {
+    const size_t target_pages = ROUNDUP(target_bytes, PAGE_SIZE) / PAGE_SIZE;
+    return VmObjectPaged::ReclaimColdPages(target_pages) * PAGE_SIZE;
+}
+
 static void object_glue_init(uint level) TA_NO_THREAD_SAFETY_ANALYSIS {
     Handle::Init();
     root_job = JobDispatcher::CreateRootJob();
@@ -70,7 +77,9 @@ static void object_glue_init(uint level) TA_NO_THREAD_SAFETY_ANALYSIS {
     oom_init(cmdline_get_bool("kernel.oom.enable", true),
              ZX_SEC(cmdline_get_uint64("kernel.oom.sleep-sec", 1)),
              cmdline_get_uint64("kernel.oom.redline-mb", 50) * MB,
-             oom_lowmem);
+             oom_lowmem,
+             cmdline_get_uint64("kernel.oom.reclaim-mb", 150) * MB,
+             oom_reclaim);
 }
 
 LK_INIT_HOOK(libobject, object_glue_init, LK_INIT_LEVEL_THREADING);
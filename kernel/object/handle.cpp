@@ -9,6 +9,7 @@
 #include <object/dispatcher.h>
 #include <fbl/arena.h>
 #include <fbl/mutex.h>
+#include <kernel/thread.h>
 #include <lib/counters.h>
 #include <pow2.h>
 
@@ -58,7 +59,8 @@ void Handle::Init() TA_NO_THREAD_SAFETY_ANALYSIS {
 }
 
 void Handle::set_process_id(zx_koid_t pid) {
-    process_id_.store(pid, fbl::memory_order_relaxed);
+    // This has to be ordered before Delete's check of pins_, see TryCopy.
+    process_id_.store(pid);
     dispatcher_->set_owner(pid);
 }
 
@@ -165,8 +167,9 @@ void Handle::TearDown() TA_EXCL(ArenaLock::Get()) {
 
     // There may be stale pointers to this slot. Zero out most of its fields
     // to ensure that the Handle does not appear to belong to any process
-    // or point to any Dispatcher.
-    memset(this, 0, sizeof(*this));
+    // or point to any Dispatcher.  Leave pins_ alone, as concurrent TryCopy
+    // calls may be changing it.
+    memset(this, 0, reinterpret_cast<char*>(&pins_) - reinterpret_cast<char*>(this));
 
     // Hold onto the base_value for the next user of this slot, stashing
     // it at the beginning of the free slot.
@@ -185,6 +188,12 @@ void Handle::Delete() {
     if (disp->is_waitable())
         disp->Cancel(this);
 
+    // By now the handle belongs to no process, so any new TryCopy will
+    // fail, but one that got in before that may still be copying out the
+    // dispatcher.  They run with preemption disabled, so this is short.
+    while (pins_.load() != 0)
+        arch_spinloop_pause();
+
     TearDown();
 
     bool zero_handles = false;
@@ -204,15 +213,46 @@ void Handle::Delete() {
 
 Handle* Handle::FromU32(uint32_t value) TA_NO_THREAD_SAFETY_ANALYSIS {
     uintptr_t handle_addr = IndexToHandle(value & kHandleIndexMask);
-    {
-        Guard<fbl::Mutex> guard{ArenaLock::Get()};
-        if (unlikely(!arena_.in_range(handle_addr)))
-            return nullptr;
-    }
+    // This doesn't take ArenaLock: the arena hands out its slots in order
+    // and never gives back the memory of freed ones, so once a slot is in
+    // range it stays in range and mapped.
+    if (unlikely(!arena_.in_range(handle_addr)))
+        return nullptr;
     auto handle = reinterpret_cast<Handle*>(handle_addr);
     return likely(handle->base_value() == value) ? handle : nullptr;
 }
 
+bool Handle::TryCopy(uint32_t base_value, zx_koid_t pid,
+                     fbl::RefPtr<Dispatcher>* dispatcher, zx_rights_t* rights) {
+    // Pinning the handle before checking that it's still ours pairs with
+    // set_process_id and the wait in Delete: either Delete sees the pin and
+    // waits for us, or we see the handle has been taken away.
+    thread_preempt_disable();
+    pins_.fetch_add(1);
+    fbl::RefPtr<Dispatcher> copied_dispatcher;
+    zx_rights_t copied_rights = 0;
+    bool found = base_value_.load(fbl::memory_order_acquire) == base_value &&
+                 process_id_.load() == pid;
+    if (found) {
+        if (dispatcher)
+            copied_dispatcher = dispatcher_;
+        copied_rights = rights_;
+        // Check again that the slot was not torn down and handed out anew
+        // to the same process while we were copying.
+        found = base_value_.load(fbl::memory_order_acquire) == base_value &&
+                process_id_.load(fbl::memory_order_acquire) == pid;
+    }
+    pins_.fetch_sub(1);
+    thread_preempt_reenable();
+    if (found) {
+        if (dispatcher)
+            *dispatcher = ktl::move(copied_dispatcher);
+        if (rights)
+            *rights = copied_rights;
+    }
+    return found;
+}
+
 uint32_t Handle::Count(const fbl::RefPtr<const Dispatcher>& dispatcher) {
     // Handle::ArenaLock also guards Dispatcher::handle_count_.
     Guard<fbl::Mutex> guard{ArenaLock::Get()};
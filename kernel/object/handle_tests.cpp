@@ -0,0 +1,61 @@
+// Copyright 2018 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <object/handle.h>
+
+#include <lib/unittest/unittest.h>
+#include <object/event_dispatcher.h>
+
+namespace {
+
+// An arbitrary koid no real process will have.
+constexpr zx_koid_t kFakeProcessId = ~0ull - 1;
+
+static bool try_copy() {
+    BEGIN_TEST;
+
+    fbl::RefPtr<Dispatcher> event;
+    zx_rights_t rights;
+    ASSERT_EQ(ZX_OK, EventDispatcher::Create(0u, &event, &rights), "");
+    HandleOwner handle = Handle::Make(event, rights);
+    ASSERT_TRUE(handle, "");
+    const uint32_t base_value = handle->base_value();
+    EXPECT_EQ(handle.get(), Handle::FromU32(base_value), "");
+
+    // Not owned by the process yet.
+    fbl::RefPtr<Dispatcher> copied;
+    zx_rights_t copied_rights = 0;
+    EXPECT_FALSE(handle->TryCopy(base_value, kFakeProcessId, &copied, &copied_rights), "");
+    EXPECT_NULL(copied, "");
+
+    handle->set_process_id(kFakeProcessId);
+    EXPECT_TRUE(handle->TryCopy(base_value, kFakeProcessId, &copied, &copied_rights), "");
+    EXPECT_EQ(event.get(), copied.get(), "");
+    EXPECT_EQ(rights, copied_rights, "");
+    EXPECT_TRUE(handle->TryCopy(base_value, kFakeProcessId, nullptr, nullptr), "");
+
+    // Wrong process, or a stale value for this slot.
+    EXPECT_FALSE(handle->TryCopy(base_value, kFakeProcessId - 1, nullptr, nullptr), "");
+    EXPECT_FALSE(handle->TryCopy(base_value + 1, kFakeProcessId, nullptr, nullptr), "");
+
+    // Taken away from the process, as by zx_handle_close.
+    handle->set_process_id(ZX_KOID_INVALID);
+    EXPECT_FALSE(handle->TryCopy(base_value, kFakeProcessId, nullptr, nullptr), "");
+
+    // Once the handle is gone, its value no longer maps to anything usable,
+    // even though the slot stays in the arena.
+    handle.reset(nullptr);
+    Handle* stale = Handle::FromU32(base_value);
+    EXPECT_NULL(stale, "");
+
+    END_TEST;
+}
+
+} // namespace
+
+UNITTEST_START_TESTCASE(handle_tests)
+UNITTEST("try_copy", try_copy)
+UNITTEST_END_TESTCASE(handle_tests, "handle", "Handle tests");
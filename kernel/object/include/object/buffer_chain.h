@@ -39,6 +39,10 @@
 //   |+------------------------------+|     |+------------------------------+|
 //   +--------------------------------+     +--------------------------------+
 //
+// A BufferChain can also hold a number of whole pages, for data that is laid out page by page
+// rather than spread over the buffers.  Such data can be handed over to user memory by moving the
+// pages themselves, see LendPages.
+//
 class BufferChain {
 public:
     class Buffer;
@@ -55,7 +59,7 @@ public:
 
     // Unfortunately, we don't yet know sizeof(BufferChain) so estimate and rely on static_asserts
     // further down to verify.
-    constexpr static size_t kSizeOfBufferChain = sizeof(BufferList) + sizeof(list_node);
+    constexpr static size_t kSizeOfBufferChain = sizeof(BufferList) + 2 * sizeof(list_node);
 
     // kContig is the number of bytes guaranteed to be stored contiguously in any buffer
     constexpr static size_t kContig = kRawDataSize - kSizeOfBufferChain;
@@ -82,35 +86,45 @@ public:
         return ZX_OK;
     }
 
-    // Creates a BufferChain with enough buffers to store |size| bytes.
+    // Creates a BufferChain with enough buffers to store |size| bytes, and with |num_pages| whole
+    // pages besides.
     //
     // It is the caller's responsibility to free the chain with BufferChain::Free.
     //
     // Returns nullptr on error.
-    static BufferChain* Alloc(size_t size) {
+    static BufferChain* Alloc(size_t size, size_t num_pages = 0) {
         size += sizeof(BufferChain);
         const size_t num_buffers = (size + kRawDataSize - 1) / kRawDataSize;
 
         // Allocate a list of pages.
         list_node pages = LIST_INITIAL_VALUE(pages);
-        zx_status_t status = pmm_alloc_pages(num_buffers, 0, &pages);
+        zx_status_t status = pmm_alloc_pages(num_buffers + num_pages, 0, &pages);
         if (unlikely(status != ZX_OK)) {
             return nullptr;
         }
 
-        // Construct a Buffer in each page and add them to a temporary list.
+        // Construct a Buffer in each of the first |num_buffers| pages and add them to a temporary
+        // list.  The rest stay whole.
         BufferChain::BufferList temp;
-        vm_page_t* page;
-        list_for_every_entry (&pages, page, vm_page_t, queue_node) {
+        list_node buffer_pages = LIST_INITIAL_VALUE(buffer_pages);
+        for (size_t i = 0; i < num_buffers; i++) {
+            vm_page_t* page = list_remove_head_type(&pages, vm_page_t, queue_node);
             DEBUG_ASSERT(page->state == VM_PAGE_STATE_ALLOC);
             page->state = VM_PAGE_STATE_IPC;
+            list_add_tail(&buffer_pages, &page->queue_node);
             void* va = paddr_to_physmap(page->paddr());
             temp.push_front(new (va) BufferChain::Buffer);
         }
+        vm_page_t* page;
+        list_for_every_entry (&pages, page, vm_page_t, queue_node) {
+            DEBUG_ASSERT(page->state == VM_PAGE_STATE_ALLOC);
+            page->state = VM_PAGE_STATE_IPC;
+        }
 
-        // We now have a list of buffers and a list of pages.  Construct a chain inside the first
-        // buffer and give the buffers and pages to the chain.
-        BufferChain* chain = new (temp.front().data()) BufferChain(&temp, &pages);
+        // We now have a list of buffers and two lists of pages.  Construct a chain inside the
+        // first buffer and give the buffers and pages to the chain.
+        BufferChain* chain = new (temp.front().data()) BufferChain(&temp, &buffer_pages, &pages);
+        DEBUG_ASSERT(list_is_empty(&buffer_pages));
         DEBUG_ASSERT(list_is_empty(&pages));
 
         return chain;
@@ -122,6 +136,7 @@ public:
         BufferChain::BufferList buffers(ktl::move(*chain->buffers()));
         list_node pages = LIST_INITIAL_VALUE(pages);
         list_move(&chain->pages_, &pages);
+        list_splice_after(&chain->whole_pages_, &pages);
 
         chain->~BufferChain();
 
@@ -142,6 +157,31 @@ public:
     // Same as CopyIn except |src| can be in kernel space.
     zx_status_t CopyInKernel(const void* src, size_t dst_offset, size_t size);
 
+    // Copies |size| bytes from |src| to the whole pages of this chain, starting at the first.
+    zx_status_t CopyInPages(user_in_ptr<const void> src, size_t size) {
+        return CopyInPagesCommon(src, size);
+    }
+
+    // Same as CopyInPages except |src| can be in kernel space.
+    zx_status_t CopyInPagesKernel(const void* src, size_t size);
+
+    // Copies |size| bytes from the whole pages of this chain, starting at the first, to |dst|.
+    zx_status_t CopyOutPages(user_out_ptr<void> dst, size_t size) const;
+
+    // Same as CopyOutPages, except that where |dst| is page aligned, and covers all of a page of
+    // this chain, the page is moved into the VMO mapped at |dst| instead of being copied.  Pages
+    // moved out of the chain are gone from it, so this can only be done once.
+    zx_status_t LendPages(user_out_ptr<void> dst, size_t size);
+
+    // Returns the start of the first whole page, if there is one.
+    char* page_data() {
+        if (list_is_empty(&whole_pages_)) {
+            return nullptr;
+        }
+        vm_page_t* page = list_peek_head_type(&whole_pages_, vm_page_t, queue_node);
+        return static_cast<char*>(paddr_to_physmap(page->paddr()));
+    }
+
     class Buffer final : public fbl::SinglyLinkedListable<Buffer*> {
     public:
         Buffer() = default;
@@ -169,9 +209,10 @@ public:
     BufferList* buffers() { return &buffers_; }
 
 private:
-    explicit BufferChain(BufferList* buffers, list_node* pages) {
+    explicit BufferChain(BufferList* buffers, list_node* pages, list_node* whole_pages) {
         buffers_.swap(*buffers);
         list_move(pages, &pages_);
+        list_move(whole_pages, &whole_pages_);
 
         // |this| now lives inside the first buffer.
         buffers_.front().set_reserved(sizeof(BufferChain));
@@ -179,6 +220,7 @@ private:
 
     ~BufferChain() {
         DEBUG_ASSERT(list_is_empty(&pages_));
+        DEBUG_ASSERT(list_is_empty(&whole_pages_));
     }
 
     // |PTR_IN| is a user_in_ptr-like type.
@@ -202,12 +244,36 @@ private:
         return ZX_OK;
     }
 
+    // |PTR_IN| is a user_in_ptr-like type.
+    template <typename PTR_IN>
+    zx_status_t CopyInPagesCommon(PTR_IN src, size_t size) {
+        size_t rem = size;
+        vm_page_t* page;
+        list_for_every_entry (&whole_pages_, page, vm_page_t, queue_node) {
+            if (rem == 0) {
+                break;
+            }
+            const size_t copy_len = fbl::min<size_t>(rem, PAGE_SIZE);
+            char* dst = static_cast<char*>(paddr_to_physmap(page->paddr()));
+            const zx_status_t status = src.copy_array_from_user(dst, copy_len);
+            if (unlikely(status != ZX_OK)) {
+                return status;
+            }
+            src = src.byte_offset(copy_len);
+            rem -= copy_len;
+        }
+        return ZX_OK;
+    }
+
     // Take care when adding fields as BufferChain lives inside the first buffer of buffers_.
     BufferList buffers_;
 
     // pages_ is a list of vm_page_t descriptors for the pages that back BufferList.
     list_node pages_ = LIST_INITIAL_VALUE(pages_);
 
+    // whole_pages_ is a list of vm_page_t descriptors for pages that hold data without a Buffer.
+    list_node whole_pages_ = LIST_INITIAL_VALUE(whole_pages_);
+
     DISALLOW_COPY_ASSIGN_AND_MOVE(BufferChain);
 };
 static_assert(sizeof(BufferChain) == BufferChain::kSizeOfBufferChain, "");
@@ -50,6 +50,13 @@ public:
     zx_status_t Write(zx_koid_t owner,
                       MessagePacketPtr msg) TA_NO_THREAD_SAFETY_ANALYSIS;
 
+    // Write the |count| messages in |msgs| to the opposing endpoint's message queue, in order,
+    // as if by as many calls to Write() but without letting any other writer in between.
+    // Either all of the messages are written or none are.
+    zx_status_t WriteBatch(zx_koid_t owner,
+                           MessagePacketPtr* msgs,
+                           size_t count) TA_NO_THREAD_SAFETY_ANALYSIS;
+
     // Perform a transacted Write + Read. |owner| is the process attempting to write
     // to the channel, or ZX_KOID_INVALID if kernel is doing it. If |owner| does not
     // match what was last set by Dispatcher::set_owner() the call will fail.
@@ -14,7 +14,8 @@
 
 // FutexContext is a class that encapsulates support for futex operations.
 // FutexContext uses a hash table keyed on the futex address (a pointer to integer in userspace)
-// to contain all active futexes.
+// to contain all active futexes.  The table is split into buckets, each with its own lock, so
+// that operations on unrelated futexes don't contend with each other.
 // A futex is considered active if there is one or more threads blocked on the futex.
 // After no threads are left blocked on a futex it is removed from the hash table.
 // The value in the futex hash table is the FutexNode object associated with the head
@@ -78,14 +79,33 @@ private:
     FutexContext(const FutexContext&) = delete;
     FutexContext& operator=(const FutexContext&) = delete;
 
-    void QueueNodesLocked(FutexNode* head) TA_REQ(lock_);
+    // A bucket holds the futexes whose addresses hash to it.
+    struct Bucket {
+        // protects futexes
+        DECLARE_MUTEX(Bucket) lock;
 
-    bool UnqueueNodeLocked(FutexNode* node) TA_REQ(lock_);
+        // Key is futex address, value is the FutexNode for the head of futex's blocked thread
+        // list.
+        FutexNode::HashTable futexes TA_GUARDED(lock);
+    };
+
+    static constexpr uint32_t kBucketShift = 4;
+    static constexpr size_t kNumBuckets = 1u << kBucketShift;
+
+    Bucket* GetBucket(uintptr_t futex_key);
+
+    static void QueueNodesLocked(Bucket* bucket, FutexNode* head) TA_REQ(bucket->lock);
+
+    // Takes the lock of whichever bucket |node| is queued in.
+    bool UnqueueNode(FutexNode* node);
 
-    // protects futex_table_
-    DECLARE_MUTEX(FutexContext) lock_;
+    // Does the work of FutexRequeue once the locks of both buckets are held.  The buckets may
+    // be the same, which the static analysis can't express.
+    zx_status_t RequeueLocked(Bucket* wake_bucket, user_in_ptr<const zx_futex_t> wake_ptr,
+                              uint32_t wake_count, zx_futex_t current_value,
+                              Bucket* requeue_bucket, user_in_ptr<const zx_futex_t> requeue_ptr,
+                              uint32_t requeue_count, AutoReschedDisable* resched_disable)
+        TA_NO_THREAD_SAFETY_ANALYSIS;
 
-    // Hash table for futexes in this context.
-    // Key is futex address, value is the FutexNode for the head of futex's blocked thread list.
-    FutexNode::HashTable futex_table_ TA_GUARDED(lock_);
+    Bucket buckets_[kNumBuckets];
 };
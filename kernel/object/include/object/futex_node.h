@@ -18,7 +18,11 @@
 // Intended to be embedded within a ThreadDispatcher Instance
 class FutexNode : public fbl::SinglyLinkedListable<FutexNode*> {
 public:
-    using HashTable = fbl::HashTable<uintptr_t, FutexNode*>;
+    // There is one of these in each of a FutexContext's buckets, so it is
+    // kept small.
+    static constexpr size_t kHashTableBuckets = 7;
+    using HashTable = fbl::HashTable<uintptr_t, FutexNode*, fbl::SinglyLinkedList<FutexNode*>,
+                                     size_t, kHashTableBuckets>;
 
     FutexNode();
     ~FutexNode();
@@ -110,7 +110,7 @@ public:
     // pointer to this instance.  ProcessDispatcher will XOR this with its
     // |handle_rand_| to create the zx_handle_t value that user space sees.
     uint32_t base_value() const {
-        return base_value_;
+        return base_value_.load(fbl::memory_order_relaxed);
     }
 
     // To be called once during bring up.
@@ -119,6 +119,14 @@ public:
     // Maps an integer obtained by Handle::base_value() back to a Handle.
     static Handle* FromU32(uint32_t value);
 
+    // Copies out this handle's dispatcher and rights if it still has
+    // |base_value| and belongs to process |pid|, without taking any lock.
+    // The handle may be concurrently removed from its process and deleted:
+    // Delete waits for a copy in progress to finish, and one that starts
+    // after the removal fails.  Either out parameter may be null.
+    bool TryCopy(uint32_t base_value, zx_koid_t pid,
+                 fbl::RefPtr<Dispatcher>* dispatcher, zx_rights_t* rights);
+
     // Get the number of outstanding handles for a given dispatcher.
     static uint32_t Count(const fbl::RefPtr<const Dispatcher>&);
 
@@ -161,11 +169,19 @@ private:
 
     // process_id_ is atomic because threads from different processes can
     // access it concurrently, while holding different instances of
-    // handle_table_lock_.
+    // handle_table_lock_, and TryCopy reads it without any lock.
     fbl::atomic<zx_koid_t> process_id_;
     fbl::RefPtr<Dispatcher> dispatcher_;
     const zx_rights_t rights_;
-    const uint32_t base_value_;
+    // base_value_ is atomic because TryCopy reads it without any lock, while
+    // the slot may be torn down and handed out again.
+    fbl::atomic<uint32_t> base_value_;
+
+    // The number of TryCopy calls looking at this slot.  Stale lookups can
+    // touch this at any time, even while the slot is free, so neither the
+    // constructors nor TearDown initialize it; arena memory starts out
+    // zeroed and is never decommitted.  This must be the last member.
+    fbl::atomic<uint32_t> pins_;
 
     // The handle arena.
     static fbl::Arena TA_GUARDED(ArenaLock::Get()) arena_;
@@ -9,8 +9,10 @@
 #include <stdint.h>
 
 #include <lib/user_copy/user_ptr.h>
+#include <vm/vm_object.h>
 #include <zircon/types.h>
 #include <fbl/intrusive_single_list.h>
+#include <fbl/ref_ptr.h>
 
 // MBufChain is a container for storing a stream of bytes or a sequence of datagrams.
 //
@@ -36,6 +38,20 @@ public:
     // Returns an error on failure.
     zx_status_t WriteDatagram(user_in_ptr<const void> src, size_t len, size_t* written);
 
+    // Appends |len| bytes starting at |offset| in |vmo| without copying them, and sets |written|
+    // to the number of bytes appended.  The chain holds a reference to |vmo| until the bytes are
+    // read, and the bytes are copied out of it then, so the caller must not change its contents.
+    //
+    // When |datagram| is true the bytes form one datagram and, as with WriteDatagram(), either
+    // all of them are appended or none are.  Otherwise as many as fit are appended.
+    //
+    // The bytes count against max_size() as at least MBuf::kMallocSize, the memory their MBuf
+    // takes, so that small writes can't make the chain hold much more than its limit.
+    //
+    // Returns an error on failure.
+    zx_status_t WriteVmo(fbl::RefPtr<VmObject> vmo, uint64_t offset, size_t len, bool datagram,
+                         size_t* written);
+
     // Reads up to |len| bytes from chain into |dst|.
     //
     // When |datagram| is false, the data in the chain is treated as a stream (no boundaries).
@@ -64,20 +80,45 @@ public:
     }
 
     // Returns the maximum number of bytes that can be stored in the chain.
-    size_t max_size() const { return kSizeMax; }
+    size_t max_size() const { return max_size_; }
+
+    // Returns the number of bytes left before the chain is full.  Bytes written with WriteVmo()
+    // use up more than their length; see there.
+    size_t free_space() const;
+
+    // Sets the maximum number of bytes that can be stored in the chain.
+    //
+    // Returns ZX_ERR_OUT_OF_RANGE if |max_size| is 0 or more than kSizeLimit, and
+    // ZX_ERR_BAD_STATE if the chain already stores more than |max_size| bytes.
+    zx_status_t set_max_size(size_t max_size);
 
 private:
+    // Where the bytes of an MBuf written with WriteVmo() are.
+    struct VmoRef {
+        fbl::RefPtr<VmObject> vmo;
+        uint64_t offset;
+    };
+
     // An MBuf is a small fixed-size chainable memory buffer.
     struct MBuf : public fbl::SinglyLinkedListable<MBuf*> {
-        // 8 for the linked list and 4 for the explicit uint32_t fields.
+        // 8 for the linked list and 4 for each of the explicit uint32_t fields, of which the
+        // last is split between |extra_charge_| and |has_vmo_|.
         static constexpr size_t kHeaderSize = 8 + (4 * 4);
         // 16 is for the malloc header.
         static constexpr size_t kMallocSize = 2048 - 16;
         static constexpr size_t kPayloadSize = kMallocSize - kHeaderSize;
 
+        MBuf() {}
+        ~MBuf() { ClearVmo(); }
+
         // Returns number of bytes of free space in this MBuf.
         size_t rem() const;
 
+        // Makes this MBuf's bytes the ones at |offset| + |off_| in |vmo|.
+        void SetVmo(fbl::RefPtr<VmObject> vmo, uint64_t offset);
+        // Drops the reference taken by SetVmo(), if any.
+        void ClearVmo();
+
         uint32_t off_ = 0u;
         uint32_t len_ = 0u;
         // pkt_len_ is set to the total number of bytes in a packet
@@ -86,17 +127,34 @@ private:
         //
         // Always 0 in ZX_SOCKET_STREAM mode.
         uint32_t pkt_len_ = 0u;
-        uint32_t unused_;
-        char data_[kPayloadSize] = {0};
-        // TODO: maybe union data_ with char* blocks for large messages
+        // The bytes this MBuf counts against the chain's limit on top of those it holds, which
+        // stay counted until it is freed.  Only set when |has_vmo_| is, and never more than
+        // kMallocSize.
+        uint16_t extra_charge_ = 0u;
+        // When set, |vmo_| holds the bytes of this MBuf rather than |data_|, and no more can
+        // be appended to it.
+        bool has_vmo_ = false;
+        union {
+            char data_[kPayloadSize] = {0};
+            VmoRef vmo_;
+        };
     };
     static_assert(sizeof(MBuf) == MBuf::kMallocSize, "");
+    static_assert(MBuf::kMallocSize <= UINT16_MAX, "");
 
-    static constexpr size_t kSizeMax = 128 * MBuf::kPayloadSize;
+public:
+    // The maximum number of bytes a new chain can store.
+    static constexpr size_t kSizeDefault = 128 * MBuf::kPayloadSize;
+    // The most that set_max_size() accepts.
+    static constexpr size_t kSizeLimit = 16 * 1024 * 1024;
 
+private:
     MBuf* AllocMBuf();
     void FreeMBuf(MBuf* buf);
 
+    // Returns the number of bytes counted against max_size_.
+    size_t charged() const { return size_ + extra_charge_; }
+
     // Helper method to provide common code for Read() and Peek().
     //
     // The static template function allows us to use the same code for both
@@ -109,4 +167,7 @@ private:
     fbl::SinglyLinkedList<MBuf*> tail_;
     MBuf* head_ = nullptr;
     size_t size_ = 0u;
+    // The sum of the extra_charge_ of the MBufs in the chain.
+    size_t extra_charge_ = 0u;
+    size_t max_size_ = kSizeDefault;
 };
@@ -50,6 +50,18 @@ public:
     // Copies the packet's |data_size()| bytes to |buf|.
     // Returns an error if |buf| points to a bad user address.
     zx_status_t CopyDataTo(user_out_ptr<void> buf) const {
+        if (whole_pages_) {
+            return buffer_chain_->CopyOutPages(buf, data_size_);
+        }
+        return buffer_chain_->CopyOut(buf, payload_offset_, data_size_);
+    }
+
+    // Same as CopyDataTo, except that a large payload may be moved to |buf| a page at a time
+    // rather than copied, after which the packet no longer holds it.
+    zx_status_t TransferDataTo(user_out_ptr<void> buf) {
+        if (whole_pages_) {
+            return buffer_chain_->LendPages(buf, data_size_);
+        }
         return buffer_chain_->CopyOut(buf, payload_offset_, data_size_);
     }
 
@@ -66,14 +78,12 @@ public:
             return 0;
         }
         // The first few bytes of the payload are a zx_txid_t.
-        void* payload_start = buffer_chain_->buffers()->front().data() + payload_offset_;
-        return *reinterpret_cast<zx_txid_t*>(payload_start);
+        return *reinterpret_cast<zx_txid_t*>(payload_start());
     }
 
     void set_txid(zx_txid_t txid) {
         if (data_size_ >= sizeof(zx_txid_t)) {
-            void* payload_start = buffer_chain_->buffers()->front().data() + payload_offset_;
-            *(reinterpret_cast<zx_txid_t*>(payload_start)) = txid;
+            *(reinterpret_cast<zx_txid_t*>(payload_start())) = txid;
         }
     }
 
@@ -83,9 +93,10 @@ private:
     // when a user creates a MessagePacket, they end up with the proper
     // MessagePacket::UPtr type for managing the message packet's life cycle.
     MessagePacket(BufferChain* chain, uint32_t data_size, uint32_t payload_offset,
-                  uint16_t num_handles, Handle** handles)
+                  uint16_t num_handles, Handle** handles, bool whole_pages)
         : buffer_chain_(chain), handles_(handles), data_size_(data_size),
-          payload_offset_(payload_offset), num_handles_(num_handles), owns_handles_(false) {}
+          payload_offset_(payload_offset), num_handles_(num_handles), owns_handles_(false),
+          whole_pages_(whole_pages) {}
 
     // A private destructor helps to make sure that only our custom deleter is
     // ever used to destroy this object which, in turn, makes it very difficult
@@ -106,12 +117,22 @@ private:
     static zx_status_t CreateCommon(uint32_t data_size, uint32_t num_handles,
                                     MessagePacketPtr* msg);
 
+    char* payload_start() const {
+        if (whole_pages_) {
+            return buffer_chain_->page_data();
+        }
+        return buffer_chain_->buffers()->front().data() + payload_offset_;
+    }
+
     BufferChain* buffer_chain_;
     Handle** const handles_;
     const uint32_t data_size_;
     const uint32_t payload_offset_;
     const uint16_t num_handles_;
     bool owns_handles_;
+    // Whether the payload is kept in whole pages of |buffer_chain_| rather than in its buffers,
+    // after the handles.
+    const bool whole_pages_;
 };
 
 namespace internal {
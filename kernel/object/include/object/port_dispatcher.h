@@ -14,6 +14,7 @@
 #include <zircon/syscalls/port.h>
 #include <zircon/types.h>
 
+#include <fbl/atomic.h>
 #include <fbl/canary.h>
 #include <fbl/intrusive_double_list.h>
 #include <fbl/mutex.h>
@@ -76,6 +77,12 @@
 //   The |o1| pointer is used to destroy the port observer only
 //   when cancellation happens and the port still owns the packet.
 //
+// 3) Level-triggered observers look like repeating ones, but their
+//    packet is in the port's list exactly while the object has one of
+//    the trigger signals asserted. The observer takes the packet out
+//    when the signals go away, and the port puts it back at the end of
+//    the list when it is dequeued while they are still asserted.
+//
 
 class ExceptionPort;
 class PortDispatcher;
@@ -94,6 +101,13 @@ struct PortPacket final : public fbl::DoublyLinkedListable<PortPacket*> {
     const void* const handle;
     ktl::unique_ptr<const PortObserver> observer;
     PortAllocator* const allocator;
+    // Only set for the packets of level-triggered observers, where it
+    // says whether the object is ready.
+    const fbl::atomic<bool>* level_ready;
+    // Set while a level-triggered packet is out of the port's queue on a
+    // caller's requeue list; see PortDispatcher::DequeueBatch(). Guarded by
+    // the port's lock.
+    bool requeue_pending;
 
     PortPacket(const void* handle, PortAllocator* allocator);
     PortPacket(const PortPacket&) = delete;
@@ -101,6 +115,7 @@ struct PortPacket final : public fbl::DoublyLinkedListable<PortPacket*> {
 
     uint64_t key() const { return packet.key; }
     bool is_ephemeral() const { return allocator != nullptr; }
+    bool is_level() const { return level_ready != nullptr; }
     void Free() { allocator->Free(this); }
 };
 
@@ -114,8 +129,8 @@ struct PortInterruptPacket final : public fbl::DoublyLinkedListable<PortInterrup
 // callbacks.
 class PortObserver final : public StateObserver {
 public:
-    PortObserver(uint32_t type, const Handle* handle, fbl::RefPtr<PortDispatcher> port,
-                 uint64_t key, zx_signals_t signals);
+    PortObserver(uint32_t type, bool level, const Handle* handle,
+                 fbl::RefPtr<PortDispatcher> port, uint64_t key, zx_signals_t signals);
     ~PortObserver() = default;
 
 private:
@@ -137,6 +152,10 @@ private:
     const zx_signals_t trigger_;
     PortPacket packet_;
 
+    // Whether any of |trigger_| is asserted, for level-triggered observers.
+    // Written under the object state lock and read under the port lock.
+    fbl::atomic<bool> ready_;
+
     fbl::RefPtr<PortDispatcher> const port_;
 };
 
@@ -147,6 +166,7 @@ private:
 //  2- Object state change notification: zx_object_wait_async()
 //      a) single-shot mode
 //      b) repeating mode
+//      c) level-triggered mode
 //  3- Manual queuing: zx_port_queue()
 //  4- Interrupt change notification: zx_interrupt_bind()
 //
@@ -178,6 +198,22 @@ public:
     zx_status_t QueueUser(const zx_port_packet_t& packet);
     bool QueueInterruptPacket(PortInterruptPacket* port_packet, zx_time_t timestamp);
     zx_status_t Dequeue(const Deadline& deadline, zx_port_packet_t* packet);
+
+    // Like Dequeue(), but once there is at least one packet, takes as many as
+    // are queued up to |max|, interrupt packets first.  The number taken is
+    // returned in |count|.
+    //
+    // Level-triggered packets whose objects are still ready are moved to
+    // |requeue| instead of going back on the queue, so that further calls
+    // for the same batch don't return them again.  The caller must pass
+    // |requeue| to Requeue() once it is done with the batch.
+    zx_status_t DequeueBatch(const Deadline& deadline, zx_port_packet_t* packets, size_t max,
+                             size_t* count, fbl::DoublyLinkedList<PortPacket*>* requeue);
+
+    // Puts the packets that DequeueBatch() set aside back on the end of the
+    // queue, leaving out those whose objects are no longer ready or whose
+    // waits have been canceled since.
+    void Requeue(fbl::DoublyLinkedList<PortPacket*>* requeue);
     bool RemoveInterruptPacket(PortInterruptPacket* port_packet);
 
     // Decides who is going to destroy the observer. If it returns the
@@ -203,6 +239,12 @@ private:
 
     explicit PortDispatcher(uint32_t options);
 
+    // Takes up to |max| of the packets that are queued without waiting, and
+    // returns the number taken.  Level-triggered packets to be queued again
+    // are moved to |requeue|.
+    size_t DequeueAvailable(zx_port_packet_t* packets, size_t max,
+                            fbl::DoublyLinkedList<PortPacket*>* requeue);
+
     // Adopts a RefPtr to |eport|, and adds it to |eports_|.
     // Called by ExceptionPort.
     void LinkExceptionPort(ExceptionPort* eport);
@@ -218,6 +260,8 @@ private:
     bool zero_handles_ TA_GUARDED(get_lock());
 
     // Next three members handle the object, manual and exception notifications.
+    // |num_packets_| leaves out level-triggered packets, which are not subject
+    // to the per-port limit.
     size_t num_packets_ TA_GUARDED(get_lock());
     fbl::DoublyLinkedList<PortPacket*> packets_ TA_GUARDED(get_lock());
     fbl::DoublyLinkedList<fbl::RefPtr<ExceptionPort>> eports_ TA_GUARDED(get_lock());
@@ -287,6 +287,13 @@ private:
     ProcessDispatcher& operator=(const ProcessDispatcher&) = delete;
 
 
+    // Looks up |handle_value| without taking |handle_table_lock_|, copying
+    // out the dispatcher and rights of the handle if it belongs to this
+    // process.  Either out parameter may be null.  Applies the bad handle
+    // policy on failure unless |skip_policy| is true.
+    bool LookupHandle(zx_handle_t handle_value, fbl::RefPtr<Dispatcher>* dispatcher,
+                      zx_rights_t* rights, bool skip_policy = false) const;
+
     zx_status_t GetDispatcherInternal(zx_handle_t handle_value, fbl::RefPtr<Dispatcher>* dispatcher,
                                       zx_rights_t* rights);
 
@@ -334,7 +341,8 @@ private:
     // our address space
     fbl::RefPtr<VmAspace> aspace_;
 
-    // our list of handles
+    // our list of handles.  Adding and removing handles takes the lock, but
+    // looking one up usually doesn't; see LookupHandle.
     mutable DECLARE_MUTEX(ProcessDispatcher) handle_table_lock_; // protects |handles_|.
     fbl::DoublyLinkedList<Handle*> handles_ TA_GUARDED(handle_table_lock_);
 
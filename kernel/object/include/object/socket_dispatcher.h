@@ -45,6 +45,11 @@ public:
     // Socket methods.
     zx_status_t Write(Plane plane, user_in_ptr<const void> src, size_t len, size_t* written);
 
+    // Queues |len| bytes starting at |offset| in |vmo| on the data plane, without copying them
+    // into the socket.  The bytes are copied straight from |vmo| to the reader.
+    zx_status_t WriteVmo(fbl::RefPtr<VmObject> vmo, uint64_t offset, size_t len,
+                         size_t* written);
+
     // Shut this endpoint of the socket down for reading, writing, or both.
     zx_status_t Shutdown(uint32_t how);
 
@@ -64,6 +69,8 @@ public:
     zx_status_t SetReadThreshold(size_t value);
     size_t GetWriteThreshold() const;
     zx_status_t SetWriteThreshold(size_t value);
+    size_t GetReadBufferMax() const;
+    zx_status_t SetReadBufferMax(size_t value);
 
     void GetInfo(zx_info_socket_t* info) const;
 
@@ -89,6 +96,9 @@ private:
     zx_status_t WriteData(user_in_ptr<const void> src, size_t len, size_t* written);
     zx_status_t WriteControl(user_in_ptr<const void> src, size_t len);
     zx_status_t WriteSelfLocked(user_in_ptr<const void> src, size_t len, size_t* nwritten) TA_REQ(get_lock());
+    zx_status_t WriteVmoSelfLocked(fbl::RefPtr<VmObject> vmo, uint64_t offset, size_t len,
+                                   size_t* nwritten) TA_REQ(get_lock());
+    void OnWrittenLocked(bool was_empty, size_t written) TA_REQ(get_lock());
     zx_status_t WriteControlSelfLocked(user_in_ptr<const void> src, size_t len) TA_REQ(get_lock());
     zx_status_t UserSignalSelfLocked(uint32_t clear_mask, uint32_t set_mask) TA_REQ(get_lock());
     zx_status_t ShutdownOtherLocked(uint32_t how) TA_REQ(get_lock());
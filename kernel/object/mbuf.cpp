@@ -6,10 +6,13 @@
 
 #include <object/mbuf.h>
 
+#include <assert.h>
+#include <new>
 #include <type_traits>
 
 #include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
+#include <ktl/move.h>
 #include <lib/user_copy/user_ptr.h>
 
 #define LOCAL_TRACE 0
@@ -17,12 +20,28 @@
 constexpr size_t MBufChain::MBuf::kHeaderSize;
 constexpr size_t MBufChain::MBuf::kMallocSize;
 constexpr size_t MBufChain::MBuf::kPayloadSize;
-constexpr size_t MBufChain::kSizeMax;
+constexpr size_t MBufChain::kSizeDefault;
+constexpr size_t MBufChain::kSizeLimit;
 
 size_t MBufChain::MBuf::rem() const {
+    if (has_vmo_)
+        return 0;
     return kPayloadSize - (off_ + len_);
 }
 
+void MBufChain::MBuf::SetVmo(fbl::RefPtr<VmObject> vmo, uint64_t offset) {
+    DEBUG_ASSERT(!has_vmo_);
+    new (&vmo_) VmoRef{ktl::move(vmo), offset};
+    has_vmo_ = true;
+}
+
+void MBufChain::MBuf::ClearVmo() {
+    if (!has_vmo_)
+        return;
+    vmo_.~VmoRef();
+    has_vmo_ = false;
+}
+
 MBufChain::~MBufChain() {
     while (!tail_.is_empty())
         delete tail_.pop_front();
@@ -31,7 +50,20 @@ MBufChain::~MBufChain() {
 }
 
 bool MBufChain::is_full() const {
-    return size_ >= kSizeMax;
+    return charged() >= max_size_;
+}
+
+size_t MBufChain::free_space() const {
+    return max_size_ - fbl::min(charged(), max_size_);
+}
+
+zx_status_t MBufChain::set_max_size(size_t max_size) {
+    if (max_size == 0 || max_size > kSizeLimit)
+        return ZX_ERR_OUT_OF_RANGE;
+    if (max_size < charged())
+        return ZX_ERR_BAD_STATE;
+    max_size_ = max_size;
+    return ZX_OK;
 }
 
 bool MBufChain::is_empty() const {
@@ -58,9 +90,15 @@ size_t MBufChain::ReadHelper(T* chain, user_out_ptr<void> dst, size_t len, bool
     size_t pos = 0;
     auto iter = chain->tail_.begin();
     while (pos < len && iter != chain->tail_.end()) {
-        const char* src = iter->data_ + iter->off_;
         size_t copy_len = MIN(iter->len_, len - pos);
-        if (dst.byte_offset(pos).copy_array_to_user(src, copy_len) != ZX_OK)
+        zx_status_t status;
+        if (iter->has_vmo_) {
+            status = iter->vmo_.vmo->ReadUser(dst.byte_offset(pos),
+                                              iter->vmo_.offset + iter->off_, copy_len);
+        } else {
+            status = dst.byte_offset(pos).copy_array_to_user(iter->data_ + iter->off_, copy_len);
+        }
+        if (status != ZX_OK)
             return pos;
         pos += copy_len;
 
@@ -102,9 +140,9 @@ zx_status_t MBufChain::WriteDatagram(user_in_ptr<const void> src, size_t len,
     if (len == 0) {
         return ZX_ERR_INVALID_ARGS;
     }
-    if (len > kSizeMax)
+    if (len > max_size_)
         return ZX_ERR_OUT_OF_RANGE;
-    if (len + size_ > kSizeMax)
+    if (len + charged() > max_size_)
         return ZX_ERR_SHOULD_WAIT;
 
     fbl::SinglyLinkedList<MBuf*> bufs;
@@ -167,10 +205,10 @@ zx_status_t MBufChain::WriteStream(user_in_ptr<const void> src, size_t len, size
         }
         void* dst = head_->data_ + head_->off_ + head_->len_;
         size_t copy_len = fbl::min(head_->rem(), len - pos);
-        if (size_ + copy_len > kSizeMax) {
-            copy_len = kSizeMax - size_;
-            if (copy_len == 0)
+        if (charged() + copy_len > max_size_) {
+            if (charged() >= max_size_)
                 break;
+            copy_len = max_size_ - charged();
         }
         if (src.byte_offset(pos).copy_array_from_user(dst, copy_len) != ZX_OK)
             break;
@@ -186,6 +224,46 @@ zx_status_t MBufChain::WriteStream(user_in_ptr<const void> src, size_t len, size
     return ZX_OK;
 }
 
+zx_status_t MBufChain::WriteVmo(fbl::RefPtr<VmObject> vmo, uint64_t offset, size_t len,
+                                bool datagram, size_t* written) {
+    if (len == 0 || len > UINT32_MAX)
+        return ZX_ERR_INVALID_ARGS;
+    if (datagram) {
+        const size_t charge = fbl::max(len, MBuf::kMallocSize);
+        if (charge > max_size_)
+            return ZX_ERR_OUT_OF_RANGE;
+        if (charge + charged() > max_size_)
+            return ZX_ERR_SHOULD_WAIT;
+    } else {
+        // The last write may take the chain past its limit by less than one MBuf, rather than
+        // leaving the writer to retry until enough has been read for a whole one.
+        if (charged() >= max_size_)
+            return ZX_ERR_SHOULD_WAIT;
+        len = fbl::min(len, max_size_ - charged());
+    }
+
+    MBuf* buf = AllocMBuf();
+    if (buf == nullptr)
+        return ZX_ERR_SHOULD_WAIT;
+    buf->SetVmo(ktl::move(vmo), offset);
+    buf->len_ = static_cast<uint32_t>(len);
+    buf->extra_charge_ = static_cast<uint16_t>(fbl::max(len, MBuf::kMallocSize) - len);
+    extra_charge_ += buf->extra_charge_;
+    if (datagram)
+        buf->pkt_len_ = static_cast<uint32_t>(len);
+
+    if (head_ == nullptr) {
+        tail_.push_front(buf);
+    } else {
+        tail_.insert_after(tail_.make_iterator(*head_), buf);
+    }
+    head_ = buf;
+
+    *written = len;
+    size_ += len;
+    return ZX_OK;
+}
+
 MBufChain::MBuf* MBufChain::AllocMBuf() {
     if (freelist_.is_empty()) {
         fbl::AllocChecker ac;
@@ -196,7 +274,10 @@ MBufChain::MBuf* MBufChain::AllocMBuf() {
 }
 
 void MBufChain::FreeMBuf(MBuf* buf) {
+    extra_charge_ -= buf->extra_charge_;
     buf->off_ = 0u;
     buf->len_ = 0u;
+    buf->extra_charge_ = 0u;
+    buf->ClearVmo();
     freelist_.push_front(buf);
 }
@@ -10,6 +10,7 @@
 #include <ktl/unique_ptr.h>
 #include <lib/unittest/unittest.h>
 #include <lib/unittest/user_memory.h>
+#include <vm/vm_object_paged.h>
 
 namespace {
 
@@ -525,6 +526,125 @@ static bool datagram_peek_underflow() {
     END_TEST;
 }
 
+// Tests that the chain holds no more than a max size set on it.
+static bool set_max_size() {
+    BEGIN_TEST;
+
+    MBufChain chain;
+    EXPECT_EQ(MBufChain::kSizeDefault, chain.max_size(), "");
+    EXPECT_EQ(ZX_ERR_OUT_OF_RANGE, chain.set_max_size(0), "");
+    EXPECT_EQ(ZX_ERR_OUT_OF_RANGE, chain.set_max_size(MBufChain::kSizeLimit + 1), "");
+    ASSERT_EQ(ZX_OK, chain.set_max_size(4), "");
+
+    ASSERT_TRUE(WriteHelper(&chain, "abc", MessageType::kStream), "");
+    EXPECT_FALSE(chain.is_full(), "");
+    EXPECT_EQ(ZX_ERR_BAD_STATE, chain.set_max_size(2), "");
+
+    ktl::unique_ptr<UserMemory> mem = UserMemory::Create(2);
+    size_t written = 0;
+    ASSERT_EQ(ZX_OK, chain.WriteStream(make_user_in_ptr(mem->in()), 2, &written), "");
+    EXPECT_EQ(1u, written, "");
+    EXPECT_TRUE(chain.is_full(), "");
+
+    // A larger chain takes more than the default.
+    constexpr size_t kBigSize = 4 * MBufChain::kSizeDefault;
+    MBufChain big;
+    ASSERT_EQ(ZX_OK, big.set_max_size(kBigSize), "");
+    constexpr size_t kWriteLen = 65536;
+    ktl::unique_ptr<UserMemory> big_mem = UserMemory::Create(kWriteLen);
+    while (big.WriteStream(make_user_in_ptr(big_mem->in()), kWriteLen, &written) == ZX_OK) {
+    }
+    EXPECT_EQ(kBigSize, big.size(), "");
+
+    END_TEST;
+}
+
+// Tests that bytes written from a VMO read back like any others, and that the chain keeps its
+// own reference to the VMO.
+static bool write_vmo() {
+    BEGIN_TEST;
+
+    fbl::RefPtr<VmObject> vmo;
+    ASSERT_EQ(ZX_OK, VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, PAGE_SIZE, &vmo), "");
+    ASSERT_EQ(ZX_OK, vmo->Write("xxabcdef", 0, 8), "");
+
+    MBufChain chain;
+    size_t written = 0;
+    EXPECT_EQ(ZX_ERR_INVALID_ARGS, chain.WriteVmo(vmo, 2, 0, false, &written), "");
+    ASSERT_TRUE(WriteHelper(&chain, "12", MessageType::kStream), "");
+    ASSERT_EQ(ZX_OK, chain.WriteVmo(ktl::move(vmo), 2, 3, false, &written), "");
+    EXPECT_EQ(3u, written, "");
+    // Copied bytes go into a new MBuf after the VMO's.
+    ASSERT_TRUE(WriteHelper(&chain, "34", MessageType::kStream), "");
+    EXPECT_EQ(7u, chain.size(), "");
+
+    EXPECT_TRUE(Equal(ReadHelper(&chain, 7, MessageType::kStream, ReadType::kPeek), "12abc34"),
+                "");
+    EXPECT_TRUE(Equal(ReadHelper(&chain, 4, MessageType::kStream, ReadType::kRead), "12ab"), "");
+    EXPECT_TRUE(Equal(ReadHelper(&chain, 7, MessageType::kStream, ReadType::kRead), "c34"), "");
+    EXPECT_TRUE(chain.is_empty(), "");
+
+    END_TEST;
+}
+
+// Tests that a datagram written from a VMO is all or nothing.
+static bool datagram_write_vmo() {
+    BEGIN_TEST;
+
+    fbl::RefPtr<VmObject> vmo;
+    ASSERT_EQ(ZX_OK, VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, 2 * PAGE_SIZE, &vmo), "");
+    ASSERT_EQ(ZX_OK, vmo->Write("abcdef", 0, 6), "");
+
+    MBufChain chain;
+    ASSERT_EQ(ZX_OK, chain.set_max_size(PAGE_SIZE + 8), "");
+    size_t written = 0;
+    EXPECT_EQ(ZX_ERR_OUT_OF_RANGE, chain.WriteVmo(vmo, 0, PAGE_SIZE + 9, true, &written), "");
+    ASSERT_EQ(ZX_OK, chain.WriteVmo(vmo, 0, PAGE_SIZE, true, &written), "");
+    EXPECT_EQ(PAGE_SIZE, written, "");
+    // Even a short datagram counts as a whole MBuf.
+    EXPECT_EQ(ZX_ERR_SHOULD_WAIT, chain.WriteVmo(vmo, 0, 3, true, &written), "");
+    ASSERT_TRUE(WriteHelper(&chain, "12", MessageType::kDatagram), "");
+
+    EXPECT_EQ(PAGE_SIZE, chain.size(true), "");
+    EXPECT_TRUE(Equal(ReadHelper(&chain, 4, MessageType::kDatagram, ReadType::kRead), "abcd"),
+                "");
+    EXPECT_TRUE(Equal(ReadHelper(&chain, 4, MessageType::kDatagram, ReadType::kRead), "12"), "");
+    EXPECT_TRUE(chain.is_empty(), "");
+
+    END_TEST;
+}
+
+// Tests that short writes from a VMO count against the chain's limit as whole MBufs until
+// they are read.
+static bool write_vmo_charge() {
+    BEGIN_TEST;
+
+    fbl::RefPtr<VmObject> vmo;
+    ASSERT_EQ(ZX_OK, VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, PAGE_SIZE, &vmo), "");
+    ASSERT_EQ(ZX_OK, vmo->Write("ab", 0, 2), "");
+
+    MBufChain chain;
+    ASSERT_EQ(ZX_OK, chain.set_max_size(3000), "");
+    size_t written = 0;
+    ASSERT_EQ(ZX_OK, chain.WriteVmo(vmo, 0, 1, false, &written), "");
+    EXPECT_FALSE(chain.is_full(), "");
+    EXPECT_EQ(ZX_ERR_BAD_STATE, chain.set_max_size(2), "");
+    // The last write may go past the limit by less than an MBuf.
+    ASSERT_EQ(ZX_OK, chain.WriteVmo(vmo, 1, 1, false, &written), "");
+    EXPECT_EQ(1u, written, "");
+    EXPECT_TRUE(chain.is_full(), "");
+    EXPECT_EQ(ZX_ERR_SHOULD_WAIT, chain.WriteVmo(vmo, 0, 1, false, &written), "");
+    EXPECT_EQ(2u, chain.size(), "");
+
+    EXPECT_TRUE(Equal(ReadHelper(&chain, 2, MessageType::kStream, ReadType::kPeek), "ab"), "");
+    EXPECT_TRUE(chain.is_full(), "");
+    EXPECT_TRUE(Equal(ReadHelper(&chain, 2, MessageType::kStream, ReadType::kRead), "ab"), "");
+    EXPECT_FALSE(chain.is_full(), "");
+    EXPECT_EQ(ZX_OK, chain.set_max_size(2), "");
+
+    END_TEST;
+}
+
 } // namespace
 
 UNITTEST_START_TESTCASE(mbuf_tests)
@@ -549,4 +669,8 @@ UNITTEST("datagram_peek", datagram_peek)
 UNITTEST("datagram_peek_empty", datagram_peek_empty)
 UNITTEST("datagram_peek_zero", datagram_peek_zero)
 UNITTEST("datagram_peek_underflow", datagram_peek_underflow)
+UNITTEST("set_max_size", set_max_size)
+UNITTEST("write_vmo", write_vmo)
+UNITTEST("datagram_write_vmo", datagram_write_vmo)
+UNITTEST("write_vmo_charge", write_vmo_charge)
 UNITTEST_END_TESTCASE(mbuf_tests, "mbuf", "MBuf test");
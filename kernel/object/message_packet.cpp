@@ -21,6 +21,9 @@
 //
 // The first buffer in a MessagePacket's BufferChain contains the MessagePacket object, followed by
 // its handles (if any), and finally its payload data (if any).
+//
+// Large payloads are instead laid out page by page in whole pages of the chain, so that they can
+// be handed to the reader by moving pages into its memory instead of copying them.
 
 // The MessagePacket object, its handles and zx_txid_t must all fit in the first buffer.
 static constexpr size_t kContiguousBytes =
@@ -30,6 +33,10 @@ static_assert(kContiguousBytes <= BufferChain::kContig, "");
 // Handles are stored just after the MessagePacket.
 static constexpr uint32_t kHandlesOffset = static_cast<uint32_t>(sizeof(MessagePacket));
 
+// Payloads of at least this size are kept in whole pages.  Below it, moving pages around costs
+// more than copying their contents.
+static constexpr uint32_t kWholePagePayloadSize = 16384u;
+
 // PayloadOffset returns the offset of the data payload from the start of the first buffer.
 static inline uint32_t PayloadOffset(uint32_t num_handles) {
     // The payload comes after the handles.
@@ -50,10 +57,14 @@ inline zx_status_t MessagePacket::CreateCommon(uint32_t data_size, uint32_t num_
     }
 
     const uint32_t payload_offset = PayloadOffset(num_handles);
+    const bool whole_pages = data_size >= kWholePagePayloadSize;
 
     // MessagePackets lives *inside* a list of buffers.  The first buffer holds the MessagePacket
-    // object, followed by its handles (if any), and finally the payload data.
-    BufferChain* chain = BufferChain::Alloc(payload_offset + data_size);
+    // object, followed by its handles (if any), and finally the payload data, unless that goes
+    // into whole pages.
+    BufferChain* chain =
+        whole_pages ? BufferChain::Alloc(payload_offset, ROUNDUP(data_size, PAGE_SIZE) / PAGE_SIZE)
+                    : BufferChain::Alloc(payload_offset + data_size);
     if (unlikely(!chain)) {
         return ZX_ERR_NO_MEMORY;
     }
@@ -66,7 +77,8 @@ inline zx_status_t MessagePacket::CreateCommon(uint32_t data_size, uint32_t num_
     MessagePacket* const packet = reinterpret_cast<MessagePacket*>(data);
     static_assert(kMaxMessageHandles <= UINT16_MAX, "");
     msg->reset(new (packet) MessagePacket(chain, data_size, payload_offset,
-                                          static_cast<uint16_t>(num_handles), handles));
+                                          static_cast<uint16_t>(num_handles), handles,
+                                          whole_pages));
     // The MessagePacket now owns the BufferChain and msg owns the MessagePacket.
 
     return ZX_OK;
@@ -80,7 +92,11 @@ zx_status_t MessagePacket::Create(user_in_ptr<const void> data, uint32_t data_si
     if (unlikely(status != ZX_OK)) {
         return status;
     }
-    status = new_msg->buffer_chain_->CopyIn(data, PayloadOffset(num_handles), data_size);
+    if (new_msg->whole_pages_) {
+        status = new_msg->buffer_chain_->CopyInPages(data, data_size);
+    } else {
+        status = new_msg->buffer_chain_->CopyIn(data, PayloadOffset(num_handles), data_size);
+    }
     if (unlikely(status != ZX_OK)) {
         return status;
     }
@@ -96,7 +112,11 @@ zx_status_t MessagePacket::Create(const void* data, uint32_t data_size, uint32_t
     if (unlikely(status != ZX_OK)) {
         return status;
     }
-    status = new_msg->buffer_chain_->CopyInKernel(data, PayloadOffset(num_handles), data_size);
+    if (new_msg->whole_pages_) {
+        status = new_msg->buffer_chain_->CopyInPagesKernel(data, data_size);
+    } else {
+        status = new_msg->buffer_chain_->CopyInKernel(data, PayloadOffset(num_handles), data_size);
+    }
     if (unlikely(status != ZX_OK)) {
         return status;
     }
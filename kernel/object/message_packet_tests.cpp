@@ -73,6 +73,48 @@ static bool create_void_star() {
     END_TEST;
 }
 
+// Create a MessagePacket large enough to keep its payload in whole pages, and move it out with
+// TransferDataTo.
+static bool transfer() {
+    BEGIN_TEST;
+    constexpr size_t kSize = 5 * PAGE_SIZE + 100;
+    ktl::unique_ptr<UserMemory> mem = UserMemory::Create(kSize);
+    auto mem_in = make_user_in_ptr(mem->in());
+    auto mem_out = make_user_out_ptr(mem->out());
+
+    fbl::AllocChecker ac;
+    auto buf = ktl::unique_ptr<char[]>(new (&ac) char[kSize]);
+    ASSERT_TRUE(ac.check(), "");
+    for (size_t i = 0; i < kSize; i++) {
+        buf[i] = static_cast<char>(i * 7);
+    }
+    ASSERT_EQ(ZX_OK, mem_out.copy_array_to_user(buf.get(), kSize), "");
+
+    MessagePacketPtr mp;
+    EXPECT_EQ(ZX_OK, MessagePacket::Create(mem_in, kSize, 0, &mp), "");
+    ASSERT_EQ(kSize, mp->data_size(), "");
+    EXPECT_EQ(*reinterpret_cast<zx_txid_t*>(buf.get()), mp->get_txid(), "");
+
+    // Clear the destination, so that what ends up there must have come from the packet.
+    auto result_buf = ktl::unique_ptr<char[]>(new (&ac) char[kSize]);
+    ASSERT_TRUE(ac.check(), "");
+    memset(result_buf.get(), 0, kSize);
+    ASSERT_EQ(ZX_OK, mem_out.copy_array_to_user(result_buf.get(), kSize), "");
+
+    // The whole pages are moved into the mapping, the tail is copied.
+    ASSERT_EQ(ZX_OK, mp->TransferDataTo(mem_out), "");
+    mp.reset();
+    ASSERT_EQ(ZX_OK, mem_in.copy_array_from_user(result_buf.get(), kSize), "");
+    EXPECT_EQ(0, memcmp(buf.get(), result_buf.get(), kSize), "");
+
+    // An unaligned destination gets a copy of everything.
+    EXPECT_EQ(ZX_OK, MessagePacket::Create(buf.get(), kSize - 1, 0, &mp), "");
+    ASSERT_EQ(ZX_OK, mp->TransferDataTo(mem_out.byte_offset(1)), "");
+    ASSERT_EQ(ZX_OK, mem_in.copy_array_from_user(result_buf.get(), kSize), "");
+    EXPECT_EQ(0, memcmp(buf.get(), result_buf.get() + 1, kSize - 1), "");
+    END_TEST;
+}
+
 // Create a MessagePacket with zero-length data.
 static bool create_zero() {
     BEGIN_TEST;
@@ -146,6 +188,7 @@ static bool copy_bad_mem() {
 UNITTEST_START_TESTCASE(message_packet_tests)
 UNITTEST("create", create)
 UNITTEST("create_void_star", create_void_star)
+UNITTEST("transfer", transfer)
 UNITTEST("create_zero", create_zero)
 UNITTEST("create_too_many_handles", create_too_many_handles)
 UNITTEST("create_bad_mem", create_bad_mem)
@@ -79,7 +79,8 @@ void ArenaPortAllocator::Free(PortPacket* port_packet) {
 }
 
 PortPacket::PortPacket(const void* handle, PortAllocator* allocator)
-    : packet{}, handle(handle), observer(nullptr), allocator(allocator) {
+    : packet{}, handle(handle), observer(nullptr), allocator(allocator), level_ready(nullptr),
+      requeue_pending(false) {
     // Note that packet is initialized to zeros.
     if (handle) {
         // Currently |handle| is only valid if the packets are not ephemeral
@@ -88,14 +89,19 @@ PortPacket::PortPacket(const void* handle, PortAllocator* allocator)
     }
 }
 
-PortObserver::PortObserver(uint32_t type, const Handle* handle, fbl::RefPtr<PortDispatcher> port,
-                           uint64_t key, zx_signals_t signals)
+PortObserver::PortObserver(uint32_t type, bool level, const Handle* handle,
+                           fbl::RefPtr<PortDispatcher> port, uint64_t key, zx_signals_t signals)
     : type_(type),
       trigger_(signals),
       packet_(handle, nullptr),
+      ready_(false),
       port_(ktl::move(port)) {
 
     DEBUG_ASSERT(handle != nullptr);
+    DEBUG_ASSERT(!level || type_ == ZX_PKT_TYPE_SIGNAL_REP);
+
+    if (level)
+        packet_.level_ready = &ready_;
 
     auto& packet = packet_.packet;
     packet.status = ZX_OK;
@@ -146,6 +152,19 @@ void PortObserver::OnRemoved() {
 
 StateObserver::Flags PortObserver::MaybeQueue(zx_signals_t new_state, uint64_t count) {
     // Always called with the object state lock being held.
+    if (packet_.is_level()) {
+        // |ready_| has to change before the port lock is taken, so that a
+        // concurrent DequeueAvailable() either sees the new value or has
+        // already finished with the packet by the time we get here.
+        if ((trigger_ & new_state) == 0u) {
+            if (ready_.exchange(false))
+                port_->CancelQueued(&packet_);
+            return 0;
+        }
+        ready_.store(true);
+        return (port_->Queue(&packet_, new_state, 1u) == ZX_OK) ? 0 : kNeedRemoval;
+    }
+
     if ((trigger_ & new_state) == 0u)
         return 0;
 
@@ -212,7 +231,8 @@ void PortDispatcher::on_zero_handles() {
     // Free any queued packets.
     while (!packets_.is_empty()) {
         auto packet = packets_.pop_front();
-        --num_packets_;
+        if (!packet->is_level())
+            --num_packets_;
 
         // If the packet is ephemeral, free it outside of the lock. Otherwise,
         // reset the observer if it is present.
@@ -274,14 +294,22 @@ zx_status_t PortDispatcher::Queue(PortPacket* port_packet, zx_signals_t observed
     if (zero_handles_)
         return ZX_ERR_BAD_STATE;
 
-    if (num_packets_ > kMaxPendingPacketCountPerPort) {
+    // Level-triggered packets live in their observers rather than in the
+    // arena, and leaving one out would lose track of a ready object, so they
+    // neither count toward the limit nor are held to it.
+    if (num_packets_ > kMaxPendingPacketCountPerPort && !port_packet->is_level()) {
         kcounter_add(port_full_count, 1);
         return ZX_ERR_SHOULD_WAIT;
     }
 
     if (observed) {
         if (port_packet->InContainer()) {
-            port_packet->packet.signal.observed |= observed;
+            // A level-triggered packet reports the signals as they are now.
+            if (port_packet->is_level()) {
+                port_packet->packet.signal.observed = observed;
+            } else {
+                port_packet->packet.signal.observed |= observed;
+            }
             // |count| is deliberately left as is.
             return ZX_OK;
         }
@@ -289,7 +317,8 @@ zx_status_t PortDispatcher::Queue(PortPacket* port_packet, zx_signals_t observed
         port_packet->packet.signal.count = count;
     }
     packets_.push_back(port_packet);
-    ++num_packets_;
+    if (!port_packet->is_level())
+        ++num_packets_;
     // This Disable() call must come before Post() to be useful, but doing
     // it earlier would also be OK.
     resched_disable.Disable();
@@ -300,51 +329,132 @@ zx_status_t PortDispatcher::Queue(PortPacket* port_packet, zx_signals_t observed
 
 zx_status_t PortDispatcher::Dequeue(const Deadline& deadline,
                                     zx_port_packet_t* out_packet) {
+    size_t count;
+    fbl::DoublyLinkedList<PortPacket*> requeue;
+    zx_status_t status = DequeueBatch(deadline, out_packet, 1, &count, &requeue);
+    Requeue(&requeue);
+    return status;
+}
+
+zx_status_t PortDispatcher::DequeueBatch(const Deadline& deadline, zx_port_packet_t* packets,
+                                         size_t max, size_t* count,
+                                         fbl::DoublyLinkedList<PortPacket*>* requeue) {
     canary_.Assert();
+    DEBUG_ASSERT(max > 0);
 
     while (true) {
-        if (options_ == ZX_PORT_BIND_TO_INTERRUPT) {
-            Guard<SpinLock, IrqSave> guard{&spinlock_};
+        // Each queued packet posted |sema_| once, and the posts for any packets
+        // taken beyond the first are left behind.  That only costs a later
+        // waiter a trip around this loop, the same as when a packet is taken
+        // here before waiting at all.
+        *count = DequeueAvailable(packets, max, requeue);
+        if (*count > 0)
+            return ZX_OK;
+
+        {
+            ThreadDispatcher::AutoBlocked by(ThreadDispatcher::Blocked::PORT);
+            zx_status_t st = sema_.Wait(deadline);
+            if (st != ZX_OK)
+                return st;
+        }
+    }
+}
+
+size_t PortDispatcher::DequeueAvailable(zx_port_packet_t* packets, size_t max,
+                                        fbl::DoublyLinkedList<PortPacket*>* requeue) {
+    size_t count = 0;
+
+    if (options_ == ZX_PORT_BIND_TO_INTERRUPT) {
+        Guard<SpinLock, IrqSave> guard{&spinlock_};
+        while (count < max) {
             PortInterruptPacket* port_interrupt_packet = interrupt_packets_.pop_front();
-            if (port_interrupt_packet != nullptr) {
-                *out_packet = {};
-                out_packet->key = port_interrupt_packet->key;
-                out_packet->type = ZX_PKT_TYPE_INTERRUPT;
-                out_packet->status = ZX_OK;
-                out_packet->interrupt.timestamp = port_interrupt_packet->timestamp;
-                return ZX_OK;
-            }
+            if (port_interrupt_packet == nullptr)
+                break;
+            zx_port_packet_t* out_packet = &packets[count++];
+            *out_packet = {};
+            out_packet->key = port_interrupt_packet->key;
+            out_packet->type = ZX_PKT_TYPE_INTERRUPT;
+            out_packet->status = ZX_OK;
+            out_packet->interrupt.timestamp = port_interrupt_packet->timestamp;
         }
-        {
-            Guard<fbl::Mutex> guard{get_lock()};
+    }
+    if (count == max)
+        return count;
+
+    fbl::DoublyLinkedList<PortPacket*> ephemeral;
+    {
+        Guard<fbl::Mutex> guard{get_lock()};
+        while (count < max) {
             PortPacket* port_packet = packets_.pop_front();
-            if (port_packet != nullptr) {
-                --num_packets_;
-                *out_packet = port_packet->packet;
-
-                bool is_ephemeral = port_packet->is_ephemeral();
-                // The reference to the port that the observer holds cannot be the last one
-                // because another reference was used to call Dequeue, so we don't need to
-                // worry about destroying ourselves.
-                port_packet->observer.reset();
-                guard.Release();
-
-                // If the packet is ephemeral, free it outside of the lock. We need to read
-                // is_ephemeral inside the lock because it's possible for a non-ephemeral packet
-                // to get deleted after a call to |MaybeReap| as soon as we release the lock.
-                if (is_ephemeral) {
-                    port_packet->Free();
+            if (port_packet == nullptr)
+                break;
+            packets[count++] = port_packet->packet;
+
+            // A level-triggered packet stays queued while its object is ready,
+            // unless the observer has been reaped, which makes this the last
+            // time it is delivered.  It goes back on the end of the queue only
+            // once the whole batch has been taken, so that each ready object
+            // shows up at most once per batch.
+            if (port_packet->is_level()) {
+                if (port_packet->observer == nullptr && port_packet->level_ready->load()) {
+                    port_packet->requeue_pending = true;
+                    requeue->push_back(port_packet);
+                    continue;
                 }
-                return ZX_OK;
+            } else {
+                --num_packets_;
             }
+
+            // Read is_ephemeral before resetting the observer: when |MaybeReap| has
+            // handed the observer to a non-ephemeral packet, the packet is part of the
+            // observer and the reset frees it.
+            const bool is_ephemeral = port_packet->is_ephemeral();
+
+            // The reference to the port that the observer holds cannot be the last one
+            // because another reference was used to call Dequeue, so we don't need to
+            // worry about destroying ourselves.
+            port_packet->observer.reset();
+
+            // If the packet is ephemeral, free it outside of the lock.
+            if (is_ephemeral)
+                ephemeral.push_back(port_packet);
         }
+    }
 
-        {
-            ThreadDispatcher::AutoBlocked by(ThreadDispatcher::Blocked::PORT);
-            zx_status_t st = sema_.Wait(deadline);
-            if (st != ZX_OK)
-                return st;
+    while (!ephemeral.is_empty()) {
+        ephemeral.pop_front()->Free();
+    }
+    return count;
+}
+
+void PortDispatcher::Requeue(fbl::DoublyLinkedList<PortPacket*>* requeue) {
+    canary_.Assert();
+
+    if (requeue->is_empty())
+        return;
+
+    AutoReschedDisable resched_disable; // Must come before the lock guard.
+    Guard<fbl::Mutex> guard{get_lock()};
+    while (!requeue->is_empty()) {
+        PortPacket* port_packet = requeue->pop_front();
+        port_packet->requeue_pending = false;
+
+        // The wait was canceled while the packet was out of the queue, and
+        // MaybeReap() left the observer to the packet.  It has been delivered
+        // for the last time, so free them both.
+        if (port_packet->observer != nullptr) {
+            port_packet->observer.reset();
+            continue;
         }
+
+        // A packet left out here is queued again by PortObserver::MaybeQueue()
+        // when its object next becomes ready.
+        if (zero_handles_ || !port_packet->level_ready->load())
+            continue;
+
+        resched_disable.Disable();
+        packets_.push_back(port_packet);
+        sema_.Post();
     }
 }
 
@@ -355,7 +465,8 @@ ktl::unique_ptr<PortObserver> PortDispatcher::MaybeReap(ktl::unique_ptr<PortObse
 
     Guard<fbl::Mutex> guard{get_lock()};
     if (port_packet->InContainer()) {
-        // The destruction will happen when the packet is dequeued or in CancelQueued()
+        // The destruction will happen when the packet is dequeued, or in CancelQueued() or
+        // Requeue()
         DEBUG_ASSERT(port_packet->observer == nullptr);
         port_packet->observer = ktl::move(observer);
     }
@@ -373,6 +484,7 @@ zx_status_t PortDispatcher::MakeObserver(uint32_t options, Handle* handle, uint6
         return ZX_ERR_NOT_SUPPORTED;
 
     uint32_t type;
+    bool level = false;
     switch (options) {
         case ZX_WAIT_ASYNC_ONCE:
             type = ZX_PKT_TYPE_SIGNAL_ONE;
@@ -380,13 +492,17 @@ zx_status_t PortDispatcher::MakeObserver(uint32_t options, Handle* handle, uint6
         case ZX_WAIT_ASYNC_REPEATING:
             type = ZX_PKT_TYPE_SIGNAL_REP;
             break;
+        case ZX_WAIT_ASYNC_LEVEL:
+            type = ZX_PKT_TYPE_SIGNAL_REP;
+            level = true;
+            break;
         default:
             return ZX_ERR_INVALID_ARGS;
     }
 
     fbl::AllocChecker ac;
-    auto observer = new (&ac) PortObserver(type, handle, fbl::RefPtr<PortDispatcher>(this), key,
-                                           signals);
+    auto observer = new (&ac) PortObserver(type, level, handle, fbl::RefPtr<PortDispatcher>(this),
+                                           key, signals);
     if (!ac.check())
         return ZX_ERR_NO_MEMORY;
 
@@ -424,10 +540,11 @@ bool PortDispatcher::CancelQueued(const void* handle, uint64_t key) {
     for (auto it = packets_.begin(); it != packets_.end();) {
         if ((it->handle == handle) && (it->key() == key)) {
             auto to_remove = it++;
+            PortPacket* port_packet = packets_.erase(to_remove);
+            if (!port_packet->is_level())
+                --num_packets_;
             // Destroyed as we go around the loop.
-            ktl::unique_ptr<const PortObserver> observer =
-                ktl::move(packets_.erase(to_remove)->observer);
-            --num_packets_;
+            ktl::unique_ptr<const PortObserver> observer = ktl::move(port_packet->observer);
             packet_removed = true;
         } else {
             ++it;
@@ -442,9 +559,16 @@ bool PortDispatcher::CancelQueued(PortPacket* port_packet) {
 
     Guard<fbl::Mutex> guard{get_lock()};
 
+    // A packet on a requeue list is not in |packets_|.  Requeue() leaves it
+    // out if it should no longer be queued.
+    if (port_packet->requeue_pending)
+        return false;
+
     if (port_packet->InContainer()) {
-        packets_.erase(*port_packet)->observer.reset();
-        --num_packets_;
+        packets_.erase(*port_packet);
+        if (!port_packet->is_level())
+            --num_packets_;
+        port_packet->observer.reset();
         return true;
     }
 
@@ -282,10 +282,87 @@ zx_status_t SocketDispatcher::WriteSelfLocked(user_in_ptr<const void> src, size_
     if (status)
         return status;
 
+    OnWrittenLocked(was_empty, st);
+
+    *written = st;
+    return status;
+}
+
+zx_status_t SocketDispatcher::WriteVmo(fbl::RefPtr<VmObject> vmo, uint64_t offset, size_t len,
+                                       size_t* nwritten) TA_NO_THREAD_SAFETY_ANALYSIS {
+    canary_.Assert();
+
+    LTRACE_ENTRY;
+
+    if (len != static_cast<size_t>(static_cast<uint32_t>(len)))
+        return ZX_ERR_INVALID_ARGS;
+
+    // The reader copies the bytes out holding the lock it shares with us, so they must not
+    // come from a pager that might never supply them.
+    if (vmo->is_pager_backed())
+        return ZX_ERR_NOT_SUPPORTED;
+
+    // The socket holds a clone of the pages the bytes are on rather than |vmo| itself, so that
+    // the bytes stay readable if |vmo| is resized.  It is made before taking our lock because
+    // cloning takes the VMO's lock.
+    fbl::RefPtr<VmObject> clone;
+    uint64_t clone_offset = 0u;
+    if (len != 0) {
+        uint64_t end;
+        if (add_overflow(offset, len, &end) || end > vmo->size())
+            return ZX_ERR_OUT_OF_RANGE;
+        clone_offset = ROUNDDOWN(offset, PAGE_SIZE);
+        zx_status_t status = vmo->CloneCOW(false, clone_offset, end - clone_offset, false,
+                                           &clone);
+        if (status != ZX_OK)
+            return status;
+    }
+
+    Guard<fbl::Mutex> guard{get_lock()};
+
+    if (!peer_)
+        return ZX_ERR_PEER_CLOSED;
+    zx_signals_t signals = GetSignalsStateLocked();
+    if (signals & ZX_SOCKET_WRITE_DISABLED)
+        return ZX_ERR_BAD_STATE;
+
+    if (len == 0) {
+        *nwritten = 0;
+        return ZX_OK;
+    }
+
+    return peer_->WriteVmoSelfLocked(ktl::move(clone), offset - clone_offset, len, nwritten);
+}
+
+zx_status_t SocketDispatcher::WriteVmoSelfLocked(fbl::RefPtr<VmObject> vmo, uint64_t offset,
+                                                 size_t len, size_t* written)
+    TA_NO_THREAD_SAFETY_ANALYSIS {
+    canary_.Assert();
+
+    if (is_full())
+        return ZX_ERR_SHOULD_WAIT;
+
+    bool was_empty = is_empty();
+
+    size_t st = 0u;
+    zx_status_t status = data_.WriteVmo(ktl::move(vmo), offset, len,
+                                        flags_ & ZX_SOCKET_DATAGRAM, &st);
+    if (status)
+        return status;
+
+    OnWrittenLocked(was_empty, st);
+
+    *written = st;
+    return status;
+}
+
+// Updates our signals, and those of the peer, after |written| bytes have been added to |data_|.
+void SocketDispatcher::OnWrittenLocked(bool was_empty, size_t written)
+    TA_NO_THREAD_SAFETY_ANALYSIS {
     zx_signals_t clear = 0u;
     zx_signals_t set = 0u;
 
-    if (st > 0) {
+    if (written > 0) {
         if (was_empty)
             set |= ZX_SOCKET_READABLE;
         // Assert signal if we go above the read threshold
@@ -297,8 +374,7 @@ zx_status_t SocketDispatcher::WriteSelfLocked(user_in_ptr<const void> src, size_
         if (peer_) {
             size_t peer_write_threshold = peer_->write_threshold_;
             // If free space falls below threshold, de-signal
-            if ((peer_write_threshold > 0) &&
-                ((data_.max_size() - data_.size()) < peer_write_threshold))
+            if ((peer_write_threshold > 0) && (data_.free_space() < peer_write_threshold))
                 clear |= ZX_SOCKET_WRITE_THRESHOLD;
         }
     }
@@ -308,9 +384,6 @@ zx_status_t SocketDispatcher::WriteSelfLocked(user_in_ptr<const void> src, size_
 
     if (clear)
         peer_->UpdateStateLocked(clear, 0u);
-
-    *written = st;
-    return status;
 }
 
 zx_status_t SocketDispatcher::Read(Plane plane, ReadType type, user_out_ptr<void> dst, size_t len,
@@ -371,8 +444,7 @@ zx_status_t SocketDispatcher::ReadData(ReadType type, user_out_ptr<void> dst, si
             // Assert (write threshold) signal if space available is above
             // threshold.
             size_t peer_write_threshold = peer_->write_threshold_;
-            if (peer_write_threshold > 0 &&
-                ((data_.max_size() - data_.size()) >= peer_write_threshold))
+            if (peer_write_threshold > 0 && data_.free_space() >= peer_write_threshold)
                 set |= ZX_SOCKET_WRITE_THRESHOLD;
             if (was_full && (st > 0))
                 set |= ZX_SOCKET_WRITABLE;
@@ -538,7 +610,7 @@ zx_status_t SocketDispatcher::SetWriteThreshold(size_t value) TA_NO_THREAD_SAFET
         UpdateStateLocked(ZX_SOCKET_WRITE_THRESHOLD, 0u);
     } else {
         // Assert signal if we have available space above the write threshold
-        if ((peer_->data_.max_size() - peer_->data_.size()) >= write_threshold_) {
+        if (peer_->data_.free_space() >= write_threshold_) {
             // Assert signal if we have available space above the write threshold
             UpdateStateLocked(0u, ZX_SOCKET_WRITE_THRESHOLD);
         } else {
@@ -548,3 +620,43 @@ zx_status_t SocketDispatcher::SetWriteThreshold(size_t value) TA_NO_THREAD_SAFET
     }
     return ZX_OK;
 }
+
+size_t SocketDispatcher::GetReadBufferMax() const TA_NO_THREAD_SAFETY_ANALYSIS {
+    canary_.Assert();
+    Guard<fbl::Mutex> guard{get_lock()};
+    return data_.max_size();
+}
+
+zx_status_t SocketDispatcher::SetReadBufferMax(size_t value) TA_NO_THREAD_SAFETY_ANALYSIS {
+    canary_.Assert();
+    Guard<fbl::Mutex> guard{get_lock()};
+    // Thresholds are never more than the buffer size.
+    if (value < read_threshold_ || (peer_ && value < peer_->write_threshold_))
+        return ZX_ERR_INVALID_ARGS;
+
+    bool was_full = is_full();
+    zx_status_t status = data_.set_max_size(value);
+    if (status != ZX_OK)
+        return status;
+
+    if (peer_) {
+        // The peer writes into our buffer, so its signals follow the space left in it.
+        zx_signals_t clear = 0u;
+        zx_signals_t set = 0u;
+        if (is_full()) {
+            clear |= ZX_SOCKET_WRITABLE;
+        } else if (was_full) {
+            set |= ZX_SOCKET_WRITABLE;
+        }
+        size_t peer_write_threshold = peer_->write_threshold_;
+        if (peer_write_threshold > 0) {
+            if (data_.free_space() >= peer_write_threshold) {
+                set |= ZX_SOCKET_WRITE_THRESHOLD;
+            } else {
+                clear |= ZX_SOCKET_WRITE_THRESHOLD;
+            }
+        }
+        peer_->UpdateStateLocked(clear, set);
+    }
+    return ZX_OK;
+}
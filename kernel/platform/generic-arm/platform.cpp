@@ -22,6 +22,7 @@
 #include <dev/uart.h>
 #include <kernel/cmdline.h>
 #include <kernel/dpc.h>
+#include <kernel/sched.h>
 #include <kernel/spinlock.h>
 #include <lk/init.h>
 #include <object/resource_dispatcher.h>
@@ -222,6 +223,35 @@ static void topology_cpu_init(void) {
     }
 }
 
+// Tell the scheduler which cpus share a core (the logical ids of one processor node) and
+// which share a cache (every processor under the same parent cluster).
+static void topology_sched_init(void) {
+    for (auto* node : system_topology::GetSystemTopology().processors()) {
+        const auto& processor = node->entity.processor;
+        cpu_mask_t smt_siblings = 0;
+        for (uint8_t i = 0; i < processor.logical_id_count; i++) {
+            smt_siblings |= cpu_num_to_mask(processor.logical_ids[i]);
+        }
+
+        cpu_mask_t cache_siblings = smt_siblings;
+        if (node->parent != nullptr) {
+            for (auto* sibling : node->parent->children) {
+                if (sibling->entity_type != ZBI_TOPOLOGY_ENTITY_PROCESSOR) {
+                    continue;
+                }
+                const auto& sibling_processor = sibling->entity.processor;
+                for (uint8_t i = 0; i < sibling_processor.logical_id_count; i++) {
+                    cache_siblings |= cpu_num_to_mask(sibling_processor.logical_ids[i]);
+                }
+            }
+        }
+
+        for (uint8_t i = 0; i < processor.logical_id_count; i++) {
+            sched_set_cpu_topology(processor.logical_ids[i], smt_siblings, cache_siblings);
+        }
+    }
+}
+
 static void platform_cpu_init(void) {
     for (uint cluster = 0; cluster < cpu_cluster_count; cluster++) {
         for (uint cpu = 0; cpu < cpu_cluster_cpus[cluster]; cpu++) {
@@ -502,6 +532,7 @@ LK_INIT_HOOK(platform_init_pre_thread, platform_init_pre_thread,
 
 void platform_init(void) {
     if (use_topology) {
+        topology_sched_init();
         topology_cpu_init();
     } else {
         platform_cpu_init();
@@ -24,6 +24,7 @@
 #include <err.h>
 #include <fbl/alloc_checker.h>
 #include <kernel/cmdline.h>
+#include <kernel/sched.h>
 #include <lib/acpi_tables.h>
 #include <lib/debuglog.h>
 #include <libzbi/zbi-cpp.h>
@@ -791,6 +792,37 @@ void platform_early_init(void) {
     boot_reserve_wire();
 }
 
+// Tell the scheduler which cpus share a physical core and which share a last level cache.
+// The package and node (die) ids are used as the cache domain, which matches the L3 on
+// current Intel parts and on AMD parts up to the CCX split.
+static void platform_init_sched_topology(const uint32_t* apic_ids, uint32_t num_cpus) {
+    DEBUG_ASSERT(num_cpus <= SMP_MAX_CPUS);
+
+    x86_cpu_topology_t topo[SMP_MAX_CPUS];
+    cpu_num_t cpu_nums[SMP_MAX_CPUS];
+    for (uint32_t i = 0; i < num_cpus; ++i) {
+        x86_cpu_topology_decode(apic_ids[i], &topo[i]);
+        int cpu_num = x86_apic_id_to_cpu_num(apic_ids[i]);
+        DEBUG_ASSERT(cpu_num >= 0);
+        cpu_nums[i] = static_cast<cpu_num_t>(cpu_num);
+    }
+
+    for (uint32_t i = 0; i < num_cpus; ++i) {
+        cpu_mask_t smt_siblings = 0;
+        cpu_mask_t cache_siblings = 0;
+        for (uint32_t j = 0; j < num_cpus; ++j) {
+            if (topo[j].package_id != topo[i].package_id || topo[j].node_id != topo[i].node_id) {
+                continue;
+            }
+            cache_siblings |= cpu_num_to_mask(cpu_nums[j]);
+            if (topo[j].core_id == topo[i].core_id) {
+                smt_siblings |= cpu_num_to_mask(cpu_nums[j]);
+            }
+        }
+        sched_set_cpu_topology(cpu_nums[i], smt_siblings, cache_siblings);
+    }
+}
+
 static void platform_init_smp(void) {
     const AcpiTableProvider acpi_table_provider;
     const AcpiTables acpi_tables(&acpi_table_provider);
@@ -881,6 +913,7 @@ static void platform_init_smp(void) {
     }
 
     x86_init_smp(apic_ids.get(), num_cpus);
+    platform_init_sched_topology(apic_ids.get(), num_cpus);
 
     // trim the boot cpu out of the apic id list before passing to the AP booting routine
     for (uint i = 0; i < num_cpus - 1; ++i) {
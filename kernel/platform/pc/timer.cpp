@@ -174,6 +174,15 @@ zx_time_t ticks_to_nanos(zx_ticks_t ticks) {
     return u64_mul_u64_fp32_64(ticks, ns_per_tsc);
 }
 
+bool platform_monotonic_from_ticks(struct fp_32_64* ns_per_tick) {
+    // The HPET and the PIT can't be read from userspace.
+    if (wall_clock != CLOCK_TSC) {
+        return false;
+    }
+    *ns_per_tick = ns_per_tsc;
+    return true;
+}
+
 // The PIT timer will keep track of wall time if we aren't using the TSC
 static interrupt_eoi pit_timer_tick(void* arg) {
     pit_ticks += 1;
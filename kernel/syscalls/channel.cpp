@@ -15,6 +15,7 @@
 #include <object/handle.h>
 #include <object/message_packet.h>
 #include <object/process_dispatcher.h>
+#include <vm/vm.h>
 #include <zircon/syscalls/policy.h>
 #include <zircon/types.h>
 
@@ -155,7 +156,7 @@ static zx_status_t channel_read(zx_handle_t handle_value, uint32_t options,
         return result;
 
     if (num_bytes > 0u) {
-        if (msg->CopyDataTo(bytes) != ZX_OK)
+        if (msg->TransferDataTo(bytes) != ZX_OK)
             return ZX_ERR_INVALID_ARGS;
     }
 
@@ -192,6 +193,92 @@ zx_status_t sys_channel_read_etc(zx_handle_t handle_value, uint32_t options,
         bytes, handle_info, num_bytes, num_handles, actual_bytes, actual_handles);
 }
 
+// zx_status_t zx_channel_read_batch
+zx_status_t sys_channel_read_batch(zx_handle_t handle_value, uint32_t options,
+                                   user_inout_ptr<zx_channel_msg_t> user_msgs, uint32_t num_msgs,
+                                   user_out_ptr<uint32_t> actual_msgs) {
+    LTRACEF("handle %x msgs %p num_msgs %u\n", handle_value, user_msgs.get(), num_msgs);
+
+    if (options != 0u)
+        return ZX_ERR_INVALID_ARGS;
+    if (num_msgs == 0u || num_msgs > ZX_CHANNEL_MAX_BATCH_MSGS)
+        return ZX_ERR_OUT_OF_RANGE;
+
+    zx_channel_msg_t msgs[ZX_CHANNEL_MAX_BATCH_MSGS];
+    if (user_msgs.copy_array_from_user(msgs, num_msgs) != ZX_OK)
+        return ZX_ERR_INVALID_ARGS;
+
+    // Turn away buffers that can't be user memory before taking any messages.  One that still
+    // faults is dealt with below.
+    for (uint32_t i = 0; i < num_msgs; ++i) {
+        const size_t handles_size = msgs[i].num_handles * sizeof(zx_handle_t);
+        if ((msgs[i].num_bytes > 0u &&
+             !is_user_address_range(reinterpret_cast<vaddr_t>(msgs[i].bytes),
+                                    msgs[i].num_bytes)) ||
+            (handles_size > 0u &&
+             !is_user_address_range(reinterpret_cast<vaddr_t>(msgs[i].handles), handles_size)))
+            return ZX_ERR_INVALID_ARGS;
+    }
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    fbl::RefPtr<ChannelDispatcher> channel;
+    zx_status_t result = up->GetDispatcherWithRights(handle_value, ZX_RIGHT_READ, &channel);
+    if (result != ZX_OK)
+        return result;
+
+    // Messages are taken off the channel and written out one at a time, so a buffer that faults
+    // loses only its own message, as with zx_channel_read(), and the ones after it are never
+    // taken.  The messages before it are still reported, since their handles are already in the
+    // process.
+    uint32_t delivered = 0;
+    for (; delivered < num_msgs; ++delivered) {
+        const uint32_t i = delivered;
+        uint32_t size = msgs[i].num_bytes;
+        uint32_t handle_count = msgs[i].num_handles;
+        MessagePacketPtr msg;
+        zx_status_t status = channel->Read(up->get_koid(), &size, &handle_count, &msg, false);
+        if (status != ZX_OK) {
+            // Past the first message, running out of messages or reaching one that doesn't fit
+            // just ends the batch.
+            if (i > 0u)
+                break;
+            // On ZX_ERR_BUFFER_TOO_SMALL, the first entry gets the size of the next message,
+            // which remains unconsumed.
+            if (status == ZX_ERR_BUFFER_TOO_SMALL) {
+                msgs[0].num_bytes = size;
+                msgs[0].num_handles = handle_count;
+                if (user_msgs.copy_array_to_user(msgs, 1) != ZX_OK)
+                    return ZX_ERR_INVALID_ARGS;
+                if (actual_msgs && actual_msgs.copy_to_user(0u) != ZX_OK)
+                    return ZX_ERR_INVALID_ARGS;
+            }
+            return status;
+        }
+
+        if (size > 0u) {
+            if (msg->TransferDataTo(make_user_out_ptr(msgs[i].bytes)) != ZX_OK) {
+                result = ZX_ERR_INVALID_ARGS;
+                break;
+            }
+        }
+        if (handle_count > 0u) {
+            msg_get_handles(up, msg.get(), make_user_out_ptr(msgs[i].handles), handle_count);
+        }
+        msgs[i].num_bytes = size;
+        msgs[i].num_handles = handle_count;
+
+        record_recv_msg_sz(size);
+        ktrace(TAG_CHANNEL_READ, (uint32_t)channel->get_koid(), size, handle_count, 0);
+    }
+
+    if (user_msgs.copy_array_to_user(msgs, delivered) != ZX_OK)
+        return ZX_ERR_INVALID_ARGS;
+    if (actual_msgs && actual_msgs.copy_to_user(delivered) != ZX_OK)
+        return ZX_ERR_INVALID_ARGS;
+    return result;
+}
+
 static zx_status_t channel_read_out(ProcessDispatcher* up,
                                     MessagePacketPtr reply,
                                     zx_channel_call_args_t* args,
@@ -212,7 +299,7 @@ static zx_status_t channel_read_out(ProcessDispatcher* up,
         return status;
 
     if (num_bytes > 0u) {
-        if (reply->CopyDataTo(make_user_out_ptr(args->rd_bytes)) != ZX_OK) {
+        if (reply->TransferDataTo(make_user_out_ptr(args->rd_bytes)) != ZX_OK) {
             return ZX_ERR_INVALID_ARGS;
         }
     }
@@ -323,6 +410,76 @@ zx_status_t sys_channel_write(zx_handle_t handle_value, uint32_t options,
     return ZX_OK;
 }
 
+// zx_status_t zx_channel_write_batch
+zx_status_t sys_channel_write_batch(zx_handle_t handle_value, uint32_t options,
+                                    user_in_ptr<const zx_channel_msg_t> user_msgs,
+                                    uint32_t num_msgs) {
+    LTRACEF("handle %x msgs %p num_msgs %u options 0x%x\n",
+            handle_value, user_msgs.get(), num_msgs, options);
+
+    if (num_msgs == 0u || num_msgs > ZX_CHANNEL_MAX_BATCH_MSGS)
+        return ZX_ERR_OUT_OF_RANGE;
+
+    zx_channel_msg_t msgs[ZX_CHANNEL_MAX_BATCH_MSGS];
+    if (user_msgs.copy_array_from_user(msgs, num_msgs) != ZX_OK)
+        return ZX_ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    // Like zx_channel_write(), consume every handle whether or not we succeed.  The handles of
+    // the messages up to |packed| belong to their packets by the time this runs.
+    uint32_t packed = 0;
+    auto cleanup = fbl::MakeAutoCall([&]() {
+        for (uint32_t i = packed; i < num_msgs; ++i) {
+            up->RemoveHandles(make_user_in_ptr(static_cast<const zx_handle_t*>(msgs[i].handles)),
+                              msgs[i].num_handles);
+        }
+    });
+
+    if (options != 0u) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+
+    fbl::RefPtr<ChannelDispatcher> channel;
+    zx_status_t status = up->GetDispatcherWithRights(handle_value, ZX_RIGHT_WRITE, &channel);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    // Build every message before writing any, so that the batch goes out whole or not at all.
+    MessagePacketPtr packets[ZX_CHANNEL_MAX_BATCH_MSGS];
+    while (packed < num_msgs) {
+        const zx_channel_msg_t& m = msgs[packed];
+        status = MessagePacket::Create(make_user_in_ptr(static_cast<const void*>(m.bytes)),
+                                       m.num_bytes, m.num_handles, &packets[packed]);
+        if (status != ZX_OK) {
+            return status;
+        }
+
+        // msg_put_handles() always consumes all handles (or there are zero handles,
+        // and so there's nothing to be done).
+        MessagePacket* msg = packets[packed++].get();
+        if (m.num_handles > 0u) {
+            status = msg_put_handles(up, msg,
+                                     make_user_in_ptr(static_cast<const zx_handle_t*>(m.handles)),
+                                     m.num_handles, static_cast<Dispatcher*>(channel.get()));
+            if (status != ZX_OK)
+                return status;
+        }
+    }
+    cleanup.cancel();
+
+    status = channel->WriteBatch(up->get_koid(), packets, num_msgs);
+    if (status != ZX_OK)
+        return status;
+
+    for (uint32_t i = 0; i < num_msgs; ++i) {
+        ktrace(TAG_CHANNEL_WRITE, (uint32_t)channel->get_koid(), msgs[i].num_bytes,
+               msgs[i].num_handles, 0);
+    }
+    return ZX_OK;
+}
+
 // zx_status_t zx_channel_call_noretry
 zx_status_t sys_channel_call_noretry(zx_handle_t handle_value, uint32_t options,
                                      zx_time_t deadline,
@@ -528,7 +528,9 @@ zx_status_t sys_object_get_info(zx_handle_t handle, uint32_t topic,
         stats.total_bytes = total * PAGE_SIZE;
         size_t other_bytes = stats.total_bytes;
 
-        stats.free_bytes = state_count[VM_PAGE_STATE_FREE] * PAGE_SIZE;
+        // Pages parked in the per-cpu pmm page caches are just as free as the rest.
+        stats.free_bytes =
+            (state_count[VM_PAGE_STATE_FREE] + state_count[VM_PAGE_STATE_CACHED]) * PAGE_SIZE;
         other_bytes -= stats.free_bytes;
 
         stats.wired_bytes = state_count[VM_PAGE_STATE_WIRED] * PAGE_SIZE;
@@ -693,6 +695,15 @@ zx_status_t sys_object_get_property(zx_handle_t handle_value, uint32_t property,
         size_t value = socket->GetWriteThreshold();
         return _value.reinterpret<size_t>().copy_to_user(value);
     }
+    case ZX_PROP_SOCKET_RX_BUFFER_MAX: {
+        if (size < sizeof(size_t))
+            return ZX_ERR_BUFFER_TOO_SMALL;
+        auto socket = DownCastDispatcher<SocketDispatcher>(&dispatcher);
+        if (!socket)
+            return ZX_ERR_WRONG_TYPE;
+        size_t value = socket->GetReadBufferMax();
+        return _value.reinterpret<size_t>().copy_to_user(value);
+    }
     default:
         return ZX_ERR_INVALID_ARGS;
     }
@@ -803,6 +814,18 @@ zx_status_t sys_object_set_property(zx_handle_t handle_value, uint32_t property,
             return status;
         return socket->SetWriteThreshold(value);
     }
+    case ZX_PROP_SOCKET_RX_BUFFER_MAX: {
+        if (size < sizeof(size_t))
+            return ZX_ERR_BUFFER_TOO_SMALL;
+        auto socket = DownCastDispatcher<SocketDispatcher>(&dispatcher);
+        if (!socket)
+            return ZX_ERR_WRONG_TYPE;
+        size_t value = 0;
+        zx_status_t status = _value.reinterpret<const size_t>().copy_from_user(&value);
+        if (status != ZX_OK)
+            return status;
+        return socket->SetReadBufferMax(value);
+    }
     case ZX_PROP_JOB_KILL_ON_OOM: {
         auto job = DownCastDispatcher<JobDispatcher>(&dispatcher);
         if (!job)
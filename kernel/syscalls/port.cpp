@@ -13,6 +13,7 @@
 #include <object/port_dispatcher.h>
 #include <object/process_dispatcher.h>
 
+#include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/ref_ptr.h>
 
@@ -96,6 +97,77 @@ zx_status_t sys_port_wait(zx_handle_t handle, zx_time_t deadline,
     return ZX_OK;
 }
 
+// zx_status_t zx_port_wait_batch
+zx_status_t sys_port_wait_batch(zx_handle_t handle, zx_time_t deadline,
+                                user_out_ptr<zx_port_packet_t> packets_out, uint32_t num_packets,
+                                user_out_ptr<uint32_t> actual_packets) {
+    LTRACEF("handle %x num_packets %u\n", handle, num_packets);
+
+    if (num_packets == 0 || num_packets > ZX_PORT_MAX_BATCH_PACKETS)
+        return ZX_ERR_OUT_OF_RANGE;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    fbl::RefPtr<PortDispatcher> port;
+    zx_status_t status = up->GetDispatcherWithRights(handle, ZX_RIGHT_READ, &port);
+    if (status != ZX_OK)
+        return status;
+
+    const Deadline slackDeadline(deadline, up->GetTimerSlackPolicy());
+
+    ktrace(TAG_PORT_WAIT, (uint32_t)port->get_koid(), 0, 0, 0);
+
+    // Packets are staged on the stack a chunk at a time.  Only the first chunk
+    // waits; the rest just take whatever else is already queued.  The
+    // level-triggered packets that are taken are put back on the queue only
+    // after the last chunk, so no chunk returns an object an earlier one did.
+    constexpr uint32_t kChunkPackets = 16;
+    zx_port_packet_t pp[kChunkPackets];
+    fbl::DoublyLinkedList<PortPacket*> requeue;
+    uint32_t actual = 0;
+    zx_status_t st = ZX_OK;
+    while (actual < num_packets) {
+        size_t count = 0;
+        const size_t max = fbl::min(num_packets - actual, kChunkPackets);
+        if (actual == 0) {
+            st = port->DequeueBatch(slackDeadline, pp, max, &count, &requeue);
+            if (st != ZX_OK)
+                break;
+        } else {
+            if (port->DequeueBatch(Deadline::no_slack(ZX_TIME_INFINITE_PAST), pp, max,
+                                   &count, &requeue) != ZX_OK)
+                break;
+        }
+
+        // Packets that were taken but cannot be copied out are lost, just as
+        // they are for zx_port_wait().
+        status = packets_out.element_offset(actual).copy_array_to_user(pp, count);
+        if (status != ZX_OK)
+            break;
+        actual += static_cast<uint32_t>(count);
+        if (count < max)
+            break;
+    }
+
+    port->Requeue(&requeue);
+
+    if (status != ZX_OK)
+        return status;
+
+    ktrace(TAG_PORT_WAIT_DONE, (uint32_t)port->get_koid(), st, 0, 0);
+
+    if (st != ZX_OK)
+        return st;
+
+    if (actual_packets) {
+        status = actual_packets.copy_to_user(actual);
+        if (status != ZX_OK)
+            return status;
+    }
+
+    return ZX_OK;
+}
+
 // zx_status_t zx_port_cancel
 zx_status_t sys_port_cancel(zx_handle_t handle, zx_handle_t source, uint64_t key) {
     auto up = ProcessDispatcher::GetCurrent();
@@ -17,6 +17,7 @@
 #include <object/handle.h>
 #include <object/process_dispatcher.h>
 #include <object/socket_dispatcher.h>
+#include <object/vm_object_dispatcher.h>
 
 #include <zircon/syscalls/policy.h>
 #include <fbl/ref_ptr.h>
@@ -78,6 +79,36 @@ zx_status_t sys_socket_write(zx_handle_t handle, uint32_t options,
     return status;
 }
 
+// zx_status_t zx_socket_write_vmo
+zx_status_t sys_socket_write_vmo(zx_handle_t handle, uint32_t options, zx_handle_t vmo_handle,
+                                 uint64_t offset, size_t size, user_out_ptr<size_t> actual) {
+    LTRACEF("handle %x vmo %x offset %#" PRIx64 " size %#zx\n", handle, vmo_handle, offset, size);
+
+    if (options != 0)
+        return ZX_ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    fbl::RefPtr<SocketDispatcher> socket;
+    zx_status_t status = up->GetDispatcherWithRights(handle, ZX_RIGHT_WRITE, &socket);
+    if (status != ZX_OK)
+        return status;
+
+    fbl::RefPtr<VmObjectDispatcher> vmo;
+    status = up->GetDispatcherWithRights(vmo_handle, ZX_RIGHT_READ, &vmo);
+    if (status != ZX_OK)
+        return status;
+
+    size_t nwritten;
+    status = socket->WriteVmo(vmo->vmo(), offset, size, &nwritten);
+
+    // Caller may ignore results if desired.
+    if (status == ZX_OK && actual)
+        status = actual.copy_to_user(nwritten);
+
+    return status;
+}
+
 // zx_status_t zx_socket_read
 zx_status_t sys_socket_read(zx_handle_t handle, uint32_t options,
                             user_out_ptr<void> buffer, size_t size,
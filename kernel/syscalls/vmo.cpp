@@ -42,11 +42,14 @@ zx_status_t sys_vmo_create(uint64_t size, uint32_t options,
                            user_out_handle* out) {
     LTRACEF("size %#" PRIx64 "\n", size);
 
-    switch (options) {
+    const bool large_pages = options & ZX_VMO_LARGE_PAGES;
+    switch (options & ~ZX_VMO_LARGE_PAGES) {
     case 0: options = VmObjectPaged::kResizable; break;
     case ZX_VMO_NON_RESIZABLE: options = 0u; break;
     default: return ZX_ERR_INVALID_ARGS;
     }
+    // compressing single pages would break up the runs that large pages map
+    options |= large_pages ? VmObjectPaged::kLargePages : VmObjectPaged::kCompressible;
 
     auto up = ProcessDispatcher::GetCurrent();
     zx_status_t res = up->QueryBasicPolicy(ZX_POL_NEW_VMO);
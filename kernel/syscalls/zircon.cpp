@@ -101,7 +101,7 @@ zx_status_t sys_clock_get_new(zx_clock_t clock_id, user_out_ptr<zx_time_t> out_t
     return out_time.copy_to_user(time);
 }
 
-zx_time_t sys_clock_get_monotonic() {
+zx_time_t sys_clock_get_monotonic_via_kernel() {
     return current_time();
 }
 
@@ -15,6 +15,7 @@
 #include <kernel/mutex.h>
 #include <kernel/spinlock.h>
 #include <kernel/thread.h>
+#include <kernel/timer.h>
 #include <platform.h>
 #include <rand.h>
 #include <stdio.h>
@@ -292,6 +293,129 @@ __NO_INLINE static void bench_rwlock() {
     printf("%" PRIu64 " cycles to acquire/release uncontended brwlock for write %u times (%" PRIu64 " cycles per)\n", c, count, c / count);
 }
 
+// Number of malloc/free pairs each thread does in bench_malloc_scaling().
+static const uint kMallocScalingIterations = 1024 * 1024;
+
+static int malloc_scaling_thread(void*) {
+    // keep a handful of small allocations of mixed sizes live, so that each
+    // free isn't simply handing back the block that was just allocated
+    void* ptrs[16] = {};
+    for (uint i = 0; i < kMallocScalingIterations; i++) {
+        uint slot = i % countof(ptrs);
+        free(ptrs[slot]);
+        ptrs[slot] = malloc(16 + (i % 8) * 48);
+    }
+    for (void* ptr : ptrs) {
+        free(ptr);
+    }
+    return 0;
+}
+
+// Runs the same small allocation workload on 1, 2, 4, ... cpus at once, one
+// thread pinned to each, and reports the aggregate rate. A heap that scales
+// keeps the per-thread rate roughly flat as cpus are added.
+__NO_INLINE static void bench_malloc_scaling() {
+    const cpu_mask_t online = mp_get_online_mask();
+    const uint num_cpus = __builtin_popcount(online);
+
+    for (uint num_threads = 1; num_threads <= num_cpus; num_threads *= 2) {
+        thread_t* threads[SMP_MAX_CPUS];
+        cpu_mask_t remaining = online;
+        uint created = 0;
+        for (; created < num_threads; created++) {
+            cpu_num_t cpu = lowest_cpu_set(remaining);
+            remaining &= ~cpu_num_to_mask(cpu);
+
+            threads[created] = thread_create("malloc bench", malloc_scaling_thread, nullptr,
+                                             DEFAULT_PRIORITY);
+            if (!threads[created]) {
+                break;
+            }
+            thread_set_cpu_affinity(threads[created], cpu_num_to_mask(cpu));
+        }
+
+        zx_time_t start = current_time();
+        for (uint i = 0; i < created; i++) {
+            thread_resume(threads[i]);
+        }
+        for (uint i = 0; i < created; i++) {
+            thread_join(threads[i], nullptr, ZX_TIME_INFINITE);
+        }
+        zx_duration_t elapsed = current_time() - start;
+
+        uint64_t pairs = (uint64_t)created * kMallocScalingIterations;
+        printf("%u threads: %" PRIu64 " malloc/free pairs in %" PRIi64 " ns, "
+               "%" PRIu64 " pairs/sec (%" PRIu64 " per thread)\n",
+               created, pairs, elapsed, pairs * ZX_SEC(1) / elapsed,
+               pairs * ZX_SEC(1) / elapsed / created);
+    }
+}
+
+// Number of timers left pending while bench_timers() measures arming and
+// cancelling one more.
+static const uint kPendingTimers = 100 * 1000;
+
+static void bench_timer_cb(timer_t*, zx_time_t, void*) {
+}
+
+// Measures the cost of arming and cancelling a timer while many others are
+// pending on the same cpu, as when many threads wait with timeouts.
+__NO_INLINE static void bench_timers() {
+    timer_t* timers = static_cast<timer_t*>(malloc(sizeof(timer_t) * (kPendingTimers + 1)));
+    if (!timers) {
+        printf("failed to allocate timers\n");
+        return;
+    }
+
+    // keep all the timers on one cpu's queue
+    thread_t* t = get_current_thread();
+    const cpu_mask_t old_affinity = t->cpu_affinity;
+    thread_set_cpu_affinity(t, cpu_num_to_mask(arch_curr_cpu_num()));
+
+    // far enough out that none of them fire, one of kPendingTimers slots
+    // spread over an hour
+    const zx_time_t base = current_time() + ZX_HOUR(1);
+    const zx_duration_t spacing = ZX_HOUR(1) / kPendingTimers;
+    const TimerSlack slack = {ZX_USEC(50), TIMER_SLACK_CENTER};
+    auto deadline = [base, spacing, &slack](uint slot) {
+        return Deadline(base + (slot % kPendingTimers) * spacing, slack);
+    };
+
+    uint64_t c = arch_cycle_count();
+    for (uint i = 0; i < kPendingTimers; i++) {
+        timer_init(&timers[i]);
+        // visit the slots out of order; 7919 is prime, so this covers them all
+        timer_set(&timers[i], deadline(i * 7919u), bench_timer_cb, nullptr);
+    }
+    c = arch_cycle_count() - c;
+    printf("%" PRIu64 " cycles to arm %u timers (%" PRIu64 " cycles per)\n",
+           c, kPendingTimers, c / kPendingTimers);
+
+    const uint count = 10000;
+    timer_t* extra = &timers[kPendingTimers];
+    timer_init(extra);
+    c = arch_cycle_count();
+    for (uint i = 0; i < count; i++) {
+        timer_set(extra, deadline(rand()), bench_timer_cb, nullptr);
+        timer_cancel(extra);
+    }
+    c = arch_cycle_count() - c;
+    printf("%" PRIu64 " cycles to arm/cancel a timer with %u pending %u times "
+           "(%" PRIu64 " cycles per)\n",
+           c, kPendingTimers, count, c / count);
+
+    c = arch_cycle_count();
+    for (uint i = 0; i < kPendingTimers; i++) {
+        timer_cancel(&timers[i]);
+    }
+    c = arch_cycle_count() - c;
+    printf("%" PRIu64 " cycles to cancel %u timers (%" PRIu64 " cycles per)\n",
+           c, kPendingTimers, c / kPendingTimers);
+
+    thread_set_cpu_affinity(t, old_affinity);
+    free(timers);
+}
+
 int benchmarks(int, const cmd_args*, uint32_t) {
     bench_set_overhead();
     bench_memcpy();
@@ -310,5 +434,9 @@ int benchmarks(int, const cmd_args*, uint32_t) {
     bench_mutex();
     bench_rwlock();
 
+    bench_malloc_scaling();
+
+    bench_timers();
+
     return 0;
 }
@@ -374,6 +374,56 @@ static bool set_from_callback() {
     END_TEST;
 }
 
+struct fire_order_args {
+    fbl::atomic<uint32_t> fired;
+    fbl::atomic<zx_time_t> last_deadline;
+    fbl::atomic<bool> out_of_order;
+};
+
+static void fire_order_cb(struct timer* t, zx_time_t now, void* void_arg) {
+    fire_order_args* arg = reinterpret_cast<fire_order_args*>(void_arg);
+    if (t->scheduled_time < arg->last_deadline.load()) {
+        arg->out_of_order.store(true);
+    }
+    arg->last_deadline.store(t->scheduled_time);
+    arg->fired.fetch_add(1);
+}
+
+// Set timers in a scrambled order, some of them sharing a deadline, and see
+// that they fire in deadline order.
+static bool fire_in_order() {
+    BEGIN_TEST;
+
+    constexpr uint32_t kTimers = 64;
+    timer_t timers[kTimers];
+    fire_order_args arg{};
+
+    // Keep all of the timers on one cpu, so that one queue orders them all.
+    thread_t* thread = get_current_thread();
+    const cpu_mask_t old_affinity = thread->cpu_affinity;
+    thread_set_cpu_affinity(thread, cpu_num_to_mask(arch_curr_cpu_num()));
+
+    const zx_time_t base = current_time() + ZX_MSEC(10);
+    for (uint32_t i = 0; i < kTimers; i++) {
+        timer_init(&timers[i]);
+        // 37 is prime, so each of the 32 deadlines is used twice.
+        const zx_time_t when = base + ((i * 37u) % (kTimers / 2)) * ZX_USEC(100);
+        timer_set(&timers[i], Deadline::no_slack(when), fire_order_cb, &arg);
+    }
+
+    while (arg.fired.load() < kTimers) {
+        thread_sleep_relative(ZX_MSEC(1));
+    }
+    thread_set_cpu_affinity(thread, old_affinity);
+
+    for (uint32_t i = 0; i < kTimers; i++) {
+        timer_cancel(&timers[i]);
+    }
+    EXPECT_FALSE(arg.out_of_order.load(), "timers fired out of order");
+
+    END_TEST;
+}
+
 static void timer_trylock_cb(struct timer* t, zx_time_t now, void* void_arg) {
     timer_args* arg = reinterpret_cast<timer_args*>(void_arg);
     atomic_store(&arg->timer_fired, 1);
@@ -485,11 +535,72 @@ static bool trylock_or_cancel_get_lock() {
     END_TEST;
 }
 
+struct cancel_race_args {
+    fbl::atomic<bool> running;
+    fbl::atomic<uint32_t> fired;
+};
+
+static void cancel_race_cb(struct timer* t, zx_time_t now, void* void_arg) {
+    cancel_race_args* arg = reinterpret_cast<cancel_race_args*>(void_arg);
+    arg->running.store(true);
+    // Stay in the callback long enough for a canceler that missed it to notice.
+    const zx_time_t until = current_time() + ZX_USEC(50);
+    while (current_time() < until) {
+    }
+    arg->fired.fetch_add(1);
+    arg->running.store(false);
+}
+
+// Cancel timers from one cpu just as they fire on another, and see that
+// timer_cancel() never returns while the callback is still running.
+static bool cancel_while_firing() {
+    BEGIN_TEST;
+
+    // We need 2 or more CPUs for this test.
+    if (get_num_cpus_online() < 2) {
+        printf("skipping test cancel_while_firing, not enough online cpus\n");
+        return true;
+    }
+
+    thread_t* thread = get_current_thread();
+    const cpu_mask_t old_affinity = thread->cpu_affinity;
+    cancel_race_args arg{};
+
+    for (int i = 0; i < 100; i++) {
+        timer_t t = TIMER_INITIAL_VALUE(t);
+
+        arch_disable_ints();
+        const uint timer_cpu = arch_curr_cpu_num();
+        const zx_time_t deadline = current_time() + ZX_USEC(200);
+        timer_set(&t, Deadline::no_slack(deadline), cancel_race_cb, &arg);
+        thread_set_cpu_affinity(thread, ~cpu_num_to_mask(timer_cpu));
+        arch_enable_ints();
+
+        // Cancel at about the time the timer fires, varying the exact moment
+        // so that some of the cancels land while it is being dequeued.
+        const zx_time_t cancel_at = deadline + (i % 10) * ZX_USEC(1) - ZX_USEC(5);
+        while (current_time() < cancel_at) {
+        }
+        const uint32_t fired_before = arg.fired.load();
+        const bool canceled = timer_cancel(&t);
+        ASSERT_FALSE(arg.running.load(), "timer_cancel returned during the callback");
+        if (canceled) {
+            // The timer came off the queue before it fired, so it never will.
+            EXPECT_EQ(fired_before, arg.fired.load(), "");
+        }
+        thread_set_cpu_affinity(thread, old_affinity);
+    }
+
+    END_TEST;
+}
+
 UNITTEST_START_TESTCASE(timer_tests)
 UNITTEST("cancel_before_deadline", cancel_before_deadline)
 UNITTEST("cancel_after_fired", cancel_after_fired)
 UNITTEST("cancel_from_callback", cancel_from_callback)
 UNITTEST("set_from_callback", set_from_callback)
+UNITTEST("fire_in_order", fire_in_order)
 UNITTEST("trylock_or_cancel_canceled", trylock_or_cancel_canceled)
 UNITTEST("trylock_or_cancel_get_lock", trylock_or_cancel_get_lock)
+UNITTEST("cancel_while_firing", cancel_while_firing)
 UNITTEST_END_TESTCASE(timer_tests, "timer", "timer tests");
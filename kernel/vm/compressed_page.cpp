@@ -0,0 +1,144 @@
+// Copyright 2018 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <vm/compressed_page.h>
+
+#include "vm_priv.h"
+#include <assert.h>
+#include <fbl/alloc_checker.h>
+#include <fbl/atomic.h>
+#include <inttypes.h>
+#include <kernel/cmdline.h>
+#include <kernel/lockdep.h>
+#include <lib/counters.h>
+#include <lk/init.h>
+#include <lz4/lz4.h>
+#include <platform.h>
+#include <string.h>
+#include <trace.h>
+#include <vm/physmap.h>
+#include <vm/vm.h>
+
+#define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
+
+// Pages compressed and decompressed.  The ratio of the two byte counters is
+// the compression ratio achieved.
+KCOUNTER(vm_compression_compressed, "kernel.vm.compression.compressed");
+KCOUNTER(vm_compression_decompressed, "kernel.vm.compression.decompressed");
+KCOUNTER(vm_compression_bytes_in, "kernel.vm.compression.bytes_in");
+KCOUNTER(vm_compression_bytes_out, "kernel.vm.compression.bytes_out");
+
+// Pages that were left alone because they compressed poorly, or because the
+// budget was used up.
+KCOUNTER(vm_compression_rejected, "kernel.vm.compression.rejected");
+KCOUNTER(vm_compression_over_budget, "kernel.vm.compression.over_budget");
+
+// Time spent compressing and decompressing, and the slowest decompression
+// seen, which is what a faulting thread waits on.
+KCOUNTER(vm_compression_compress_ns, "kernel.vm.compression.compress_ns");
+KCOUNTER(vm_compression_decompress_ns, "kernel.vm.compression.decompress_ns");
+KCOUNTER_MAX(vm_compression_decompress_ns_max, "kernel.vm.compression.decompress_ns_max");
+
+namespace {
+
+// A page that does not shrink to at most this size stays uncompressed, as
+// storing it would free up too little memory for the cost of a fault.
+constexpr size_t kMaxCompressedSize = PAGE_SIZE / 2;
+
+constexpr uint64_t kDefaultBudgetMb = 64;
+
+// Bytes of compressed data that may be held at once, and those held now.
+size_t budget_bytes;
+fbl::atomic<size_t> stored_bytes(0);
+
+// The LZ4 state is too big to live on a kernel stack, so there is one shared
+// instance, along with a buffer large enough for any result worth keeping.
+struct CompressorLock {};
+DECLARE_MUTEX(CompressorLock) compressor_lock;
+LZ4_stream_t compressor_state TA_GUARDED(compressor_lock);
+char compressor_buffer[kMaxCompressedSize] TA_GUARDED(compressor_lock);
+
+void compression_init(uint level) {
+    budget_bytes = cmdline_get_uint64("kernel.vm.compression-budget-mb", kDefaultBudgetMb) * MB;
+}
+
+} // namespace
+
+LK_INIT_HOOK(vm_compression, &compression_init, LK_INIT_LEVEL_VM);
+
+bool VmCompressedPage::BudgetExhausted() {
+    return stored_bytes.load() >= budget_bytes;
+}
+
+ktl::unique_ptr<VmCompressedPage> VmCompressedPage::Compress(uint64_t offset, paddr_t pa) {
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(offset));
+
+    const char* src = static_cast<const char*>(paddr_to_physmap(pa));
+    DEBUG_ASSERT(src);
+
+    const zx_time_t start = current_time();
+
+    Guard<fbl::Mutex> guard{&compressor_lock};
+    const int size = LZ4_compress_fast_extState(&compressor_state, src, compressor_buffer,
+                                                PAGE_SIZE, kMaxCompressedSize, 1);
+    if (size <= 0) {
+        kcounter_add(vm_compression_rejected, 1);
+        return nullptr;
+    }
+
+    // reserve our share of the budget before allocating anything
+    if (stored_bytes.fetch_add(size) + size > budget_bytes) {
+        stored_bytes.fetch_sub(size);
+        kcounter_add(vm_compression_over_budget, 1);
+        return nullptr;
+    }
+
+    fbl::AllocChecker ac;
+    ktl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[size]);
+    if (!ac.check()) {
+        stored_bytes.fetch_sub(size);
+        return nullptr;
+    }
+    memcpy(data.get(), compressor_buffer, size);
+    guard.Release();
+
+    ktl::unique_ptr<VmCompressedPage> page(
+        new (&ac) VmCompressedPage(offset, ktl::move(data), size));
+    if (!ac.check()) {
+        stored_bytes.fetch_sub(size);
+        return nullptr;
+    }
+
+    LTRACEF("offset %#" PRIx64 " compressed to %d bytes\n", offset, size);
+
+    kcounter_add(vm_compression_compressed, 1);
+    kcounter_add(vm_compression_bytes_in, PAGE_SIZE);
+    kcounter_add(vm_compression_bytes_out, size);
+    kcounter_add(vm_compression_compress_ns, current_time() - start);
+
+    return page;
+}
+
+VmCompressedPage::~VmCompressedPage() {
+    stored_bytes.fetch_sub(size_);
+}
+
+void VmCompressedPage::Decompress(paddr_t pa) const {
+    char* dst = static_cast<char*>(paddr_to_physmap(pa));
+    DEBUG_ASSERT(dst);
+
+    const zx_time_t start = current_time();
+
+    const int size = LZ4_decompress_safe(reinterpret_cast<const char*>(data_.get()),
+                                        dst, static_cast<int>(size_), PAGE_SIZE);
+    ASSERT_MSG(size == PAGE_SIZE, "corrupt compressed page at offset %#" PRIx64 ": %d\n",
+               offset_, size);
+
+    const zx_duration_t elapsed = current_time() - start;
+    kcounter_add(vm_compression_decompressed, 1);
+    kcounter_add(vm_compression_decompress_ns, elapsed);
+    kcounter_max(vm_compression_decompress_ns_max, elapsed);
+}
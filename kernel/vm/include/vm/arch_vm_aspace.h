@@ -58,6 +58,16 @@ public:
 
     virtual zx_status_t Query(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags) = 0;
 
+    // Allow the TLB invalidations of Unmap and Protect calls made until the
+    // matching EndTlbBatch() to be deferred and issued together by it.  The
+    // caller must not free memory that was mapped in the meantime before
+    // EndTlbBatch() or FlushTlbBatch() returns.  Batches do not nest.
+    virtual void BeginTlbBatch() {}
+    virtual void EndTlbBatch() {}
+    // Issue the invalidations deferred so far by the open batch, if any,
+    // leaving it open.  May be called from any thread.
+    virtual void FlushTlbBatch() {}
+
     virtual vaddr_t PickSpot(vaddr_t base, uint prev_region_mmu_flags,
                              vaddr_t end, uint next_region_mmu_flags,
                              vaddr_t align, size_t size, uint mmu_flags) = 0;
@@ -0,0 +1,51 @@
+// Copyright 2018 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <fbl/intrusive_wavl_tree.h>
+#include <fbl/macros.h>
+#include <ktl/move.h>
+#include <ktl/unique_ptr.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <zircon/types.h>
+
+// The LZ4 compressed contents of a page of an anonymous VmObjectPaged, kept
+// in the kernel heap in place of the page itself.  All of the compressed
+// pages in the system share a single budget, set by the
+// kernel.vm.compression-budget-mb command line option.
+class VmCompressedPage final
+    : public fbl::WAVLTreeContainable<ktl::unique_ptr<VmCompressedPage>> {
+public:
+    // Compresses the page at |pa|, which is to be stored at |offset| of its
+    // object.  Returns null, leaving the page alone, if it does not compress
+    // well enough to be worth keeping, if the budget would be exceeded, or if
+    // memory for the result could not be allocated.
+    static ktl::unique_ptr<VmCompressedPage> Compress(uint64_t offset, paddr_t pa);
+
+    // Whether the budget is used up, in which case Compress() is bound to fail.
+    static bool BudgetExhausted();
+
+    ~VmCompressedPage();
+
+    // Restores the page's contents into the page at |pa|.
+    void Decompress(paddr_t pa) const;
+
+    uint64_t GetKey() const { return offset_; }
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(VmCompressedPage);
+
+private:
+    VmCompressedPage(uint64_t offset, ktl::unique_ptr<uint8_t[]> data, size_t size)
+        : offset_(offset), data_(ktl::move(data)), size_(size) {}
+
+    const uint64_t offset_;
+    const ktl::unique_ptr<uint8_t[]> data_;
+    const size_t size_;
+};
+
+using VmCompressedPageTree = fbl::WAVLTree<uint64_t, ktl::unique_ptr<VmCompressedPage>>;
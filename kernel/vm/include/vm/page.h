@@ -22,13 +22,17 @@ enum vm_page_state {
     VM_PAGE_STATE_MMU,   // allocated to serve arch-specific mmu purposes
     VM_PAGE_STATE_IOMMU, // allocated for platform-specific iommu structures
     VM_PAGE_STATE_IPC,
+    VM_PAGE_STATE_CACHED, // free, but held in a per-cpu pmm page cache
 
     VM_PAGE_STATE_COUNT_
 };
 
-#define VM_PAGE_STATE_BITS 3
+#define VM_PAGE_STATE_BITS 4
 static_assert((1u << VM_PAGE_STATE_BITS) >= VM_PAGE_STATE_COUNT_, "");
 
+// vm_page flags
+#define VM_PAGE_FLAG_ZEROED (0x1) // free page known to be filled with zeroes
+
 // core per page structure allocated at pmm arena creation time
 typedef struct vm_page {
     struct list_node queue_node;
@@ -47,6 +51,12 @@ typedef struct vm_page {
 #define VM_PAGE_OBJECT_MAX_PIN_COUNT ((1ul << VM_PAGE_OBJECT_PIN_COUNT_BITS) - 1)
 
             uint8_t pin_count : VM_PAGE_OBJECT_PIN_COUNT_BITS;
+            // set whenever the page is looked up through its object, cleared by
+            // the page reclaimer as it sweeps past
+            uint8_t referenced : 1;
+            // set once the page may have been modified; only clean pages can be
+            // dropped and later read back in from a page source
+            uint8_t dirty : 1;
         } object; // attached to a vm object
     };
 
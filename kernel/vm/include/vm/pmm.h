@@ -32,6 +32,9 @@ zx_status_t pmm_add_arena(const pmm_arena_info_t* arena) __NONNULL((1));
 // flags for allocation routines below
 #define PMM_ALLOC_FLAG_ANY (0x0)    // no restrictions on which arena to allocate from
 #define PMM_ALLOC_FLAG_LO_MEM (0x1) // allocate only from arenas marked LO_MEM
+#define PMM_ALLOC_FLAG_ZEROED (0x2) // returned pages are filled with zeroes (page allocators only)
+#define PMM_ALLOC_FLAG_NO_DRAIN (0x4) // fail rather than drain the per-cpu page caches
+                                      // to find a contiguous run (contiguous allocator only)
 
 // Allocate count pages of physical memory, adding to the tail of the passed list.
 // The list must be initialized.
@@ -60,6 +63,13 @@ void pmm_free_page(vm_page_t* page) __NONNULL((1));
 // Return count of unallocated physical pages in system.
 uint64_t pmm_count_free_pages();
 
+// Return count of free pages currently held in the per-cpu page caches. These
+// are included in pmm_count_free_pages().
+uint64_t pmm_count_cached_pages();
+
+// Return every page held in the per-cpu page caches to the global free list.
+void pmm_drain_page_caches();
+
 // Return amount of physical memory in system, in bytes.
 uint64_t pmm_count_total_bytes();
 
@@ -0,0 +1,64 @@
+// Copyright 2018 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <fbl/intrusive_wavl_tree.h>
+#include <fbl/macros.h>
+#include <ktl/unique_ptr.h>
+#include <list.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <vm/page.h>
+#include <zircon/types.h>
+
+class VmSharedPage;
+
+// A reference held by a VmObjectPaged to a page whose contents turned out to
+// be identical to those of pages elsewhere, and which is shared read-only in
+// their place.  Writing to such a page has to make a private copy first.
+class VmSharedPageRef final
+    : public fbl::WAVLTreeContainable<ktl::unique_ptr<VmSharedPageRef>> {
+public:
+    // Looks for a shared page with the same contents as |page|, which is at
+    // |offset| of its object, and returns a reference to it.  If one is
+    // found, |page| is no longer needed and is added to |free_list|.
+    // Otherwise |page| itself becomes a shared page, owned by the returned
+    // reference.  Either way the caller has to remove |page| from its object.
+    // Returns null, leaving |page| alone, if memory could not be allocated.
+    static ktl::unique_ptr<VmSharedPageRef> Share(uint64_t offset, vm_page_t* page,
+                                                  list_node* free_list);
+
+    // Share() with the hash of the contents of |page| given by the caller.
+    // Only meant for tests, which use it to make different pages collide.
+    static ktl::unique_ptr<VmSharedPageRef> ShareWithHash(uint64_t offset, vm_page_t* page,
+                                                          uint64_t hash, list_node* free_list);
+
+    // The number of distinct shared pages, and of references to them.  The
+    // difference is the number of pages that sharing has saved.
+    static void GetStats(size_t* shared_pages, size_t* references);
+
+    // Drops the reference, freeing the page if it was the last one.
+    ~VmSharedPageRef();
+
+    // If this is the only reference to the page, stops sharing it and returns
+    // it, leaving the reference empty.  Returns null otherwise.
+    vm_page_t* TakeIfExclusive();
+
+    vm_page_t* page() const;
+    uint64_t GetKey() const { return offset_; }
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(VmSharedPageRef);
+
+private:
+    VmSharedPageRef(uint64_t offset, VmSharedPage* shared)
+        : offset_(offset), shared_(shared) {}
+
+    const uint64_t offset_;
+    VmSharedPage* shared_;
+};
+
+using VmSharedPageRefTree = fbl::WAVLTree<uint64_t, ktl::unique_ptr<VmSharedPageRef>>;
@@ -203,6 +203,25 @@ protected:
 
     // node for element in list of parent's children.
     fbl::WAVLTreeNodeState<fbl::RefPtr<VmAddressRegionOrMapping>, bool> subregion_list_node_;
+
+    // Keeps the subtree state below up to date as the parent's list of
+    // children changes.
+    struct SubtreeObserver : public fbl::DefaultWAVLTreeObserver {
+        static constexpr bool kTracksSubtrees = true;
+        static void RecordSubtreeChange(VmAddressRegionOrMapping* node,
+                                        VmAddressRegionOrMapping* left,
+                                        VmAddressRegionOrMapping* right);
+    };
+
+    // State of the subtree rooted at this node in the parent's list of
+    // children: the base of its first region, the end of its last region, and
+    // the largest and the total size of the gaps between adjacent regions
+    // within it.  This lets the allocators skip over every part of the address
+    // space with no room for a request, and find a free address by rank.
+    vaddr_t subtree_base_ = 0;
+    vaddr_t subtree_end_ = 0;
+    size_t subtree_max_gap_ = 0;
+    size_t subtree_gap_bytes_ = 0;
 };
 
 // A representation of a contiguous range of virtual address space
@@ -271,7 +290,7 @@ protected:
 private:
     using ChildList = fbl::WAVLTree<vaddr_t, fbl::RefPtr<VmAddressRegionOrMapping>,
                                     fbl::DefaultKeyedObjectTraits<vaddr_t, VmAddressRegionOrMapping>,
-                                    WAVLTreeTraits>;
+                                    WAVLTreeTraits, SubtreeObserver>;
 
     DISALLOW_COPY_ASSIGN_AND_MOVE(VmAddressRegion);
 
@@ -328,6 +347,20 @@ private:
                         vaddr_t* pva, vaddr_t search_base, vaddr_t align,
                         size_t region_size, size_t min_gap, uint arch_mmu_flags);
 
+    // returns true if a region can be allocated at or, after the arch layer's
+    // adjustment, just above |candidate| within the gap that holds it, and if
+    // so populates pva with the base address to use.
+    bool CheckSpotLocked(vaddr_t candidate, vaddr_t align, size_t region_size,
+                         uint arch_mmu_flags, vaddr_t* pva);
+
+    // total size of the gaps between and around the children
+    size_t FreeBytesLocked();
+
+    // returns the address of the free byte with the given rank, counting up
+    // from the bottom of the region, and the bounds [gap_base, gap_end) of the
+    // gap that holds it.  |rank| must be less than FreeBytesLocked().
+    vaddr_t FreeByteAtRankLocked(size_t rank, vaddr_t* gap_base, vaddr_t* gap_end);
+
     // search for a spot to allocate for a region of a given size
     zx_status_t AllocSpotLocked(size_t size, uint8_t align_pow2, uint arch_mmu_flags, vaddr_t* spot);
 
@@ -342,9 +375,18 @@ private:
     // Utility for allocators for iterating over gaps between allocations
     // F should have a signature of bool func(vaddr_t gap_base, size_t gap_size).
     // If func returns false, the iteration stops.  gap_base will be aligned in
-    // accordance with align_pow2.
+    // accordance with align_pow2.  Gaps smaller than |min_gap_size| before
+    // alignment may be skipped, without visiting the regions around them, as
+    // may gaps that end at or below |search_base|.
     template <typename F>
-    void ForEachGap(F func, uint8_t align_pow2);
+    void ForEachGap(F func, uint8_t align_pow2, size_t min_gap_size, vaddr_t search_base = 0);
+
+    // Helper for ForEachGap: visit the gaps to the left of each region in the
+    // subtree rooted at |node|, where |prev_end| is the end of the region
+    // before the subtree.  Returns false if the iteration was stopped.
+    template <typename F>
+    bool ForEachGapInSubtree(ChildList::iterator node, vaddr_t prev_end, F& func,
+                             vaddr_t align, size_t min_gap_size, vaddr_t search_base);
 
     // list of subregions, indexed by base address
     ChildList subregions_;
@@ -434,6 +476,12 @@ public:
     // offset modification and locking.
     zx_status_t DecommitRange(size_t offset, size_t len);
 
+    // Convenience wrapper for vmo()->ReplacePages() for the pages starting at
+    // address |va| of the mapping, with the necessary offset modification and
+    // locking.  Fails unless the mapping is writable, as the pages take the
+    // place of writing their contents through it.
+    zx_status_t ReplacePages(vaddr_t va, list_node* pages);
+
     // Map in pages from the underlying vm object, optionally committing pages as it goes
     zx_status_t MapRange(size_t offset, size_t len, bool commit);
 
@@ -487,6 +535,10 @@ private:
     // Implementation for Protect().  This does not acquire the aspace lock.
     zx_status_t ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_flags);
 
+    // Move or resize this mapping within its parent, whose list of children is
+    // keyed by base_ and keeps subtree state that depends on both.
+    void SetBaseAndSizeLocked(vaddr_t base, size_t size);
+
     // Version of AllocatedPages() that does not acquire the aspace lock
     size_t AllocatedPagesLocked() const override;
 
@@ -497,6 +549,15 @@ private:
     // in Clang around capability aliasing, we need to relax the analysis.
     void ActivateLocked();
 
+    // Maps pages that are already resident in the object around |va|, which
+    // was just faulted in, so that touching them doesn't take a fault each.
+    void FaultAroundLocked(vaddr_t va, uint mmu_flags) TA_REQ(object_->lock());
+
+    // If the large page sized block of the mapping containing |va| is backed by a
+    // physically contiguous, suitably aligned run of pages owned by the object, maps
+    // the whole block with a single large page and returns true.
+    bool MapLargePageLocked(vaddr_t va, uint pf_flags) TA_REQ(object_->lock());
+
     // pointer and region of the object we are mapping
     fbl::RefPtr<VmObject> object_;
     uint64_t object_offset_ = 0;
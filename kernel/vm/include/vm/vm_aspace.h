@@ -11,12 +11,15 @@
 #include <assert.h>
 #include <fbl/canary.h>
 #include <fbl/intrusive_double_list.h>
+#include <fbl/intrusive_single_list.h>
 #include <fbl/intrusive_wavl_tree.h>
 #include <fbl/macros.h>
 #include <fbl/ref_counted.h>
 #include <fbl/ref_ptr.h>
+#include <fbl/unique_ptr.h>
 #include <kernel/lockdep.h>
 #include <kernel/mutex.h>
+#include <ktl/move.h>
 #include <lib/crypto/prng.h>
 #include <vm/arch_vm_aspace.h>
 #include <vm/vm.h>
@@ -27,8 +30,26 @@ namespace hypervisor {
 class GuestPhysicalAddressSpace;
 } // namespace hypervisor
 
+class VmAspace;
 class VmObject;
 
+// Ties a VMO to the open TLB batch of an aspace that unmapped some of its
+// pages, so that the VMO issues the batch's invalidations before freeing any
+// of them.  Also keeps the VMO alive until the batch ends.
+class VmTlbBatchRef : public fbl::DoublyLinkedListable<VmTlbBatchRef*>,
+                      public fbl::SinglyLinkedListable<fbl::unique_ptr<VmTlbBatchRef>> {
+public:
+    VmTlbBatchRef(VmAspace* aspace, fbl::RefPtr<VmObject> object)
+        : aspace_(aspace), object_(ktl::move(object)) {}
+
+    VmAspace* aspace() const { return aspace_; }
+    VmObject* object() const { return object_.get(); }
+
+private:
+    VmAspace* const aspace_;
+    const fbl::RefPtr<VmObject> object_;
+};
+
 class VmAspace : public fbl::DoublyLinkedListable<VmAspace*>, public fbl::RefCounted<VmAspace> {
 public:
     // Create an address space of the type specified in |flags| with name |name|.
@@ -159,6 +180,18 @@ protected:
     friend class VmMapping;
     Lock<fbl::Mutex>* lock() { return &lock_; }
 
+    // Batch the TLB invalidations of the arch aspace operations made between
+    // these calls into a single shootdown.  Must be called with the aspace
+    // lock held; batches may nest.
+    void BeginTlbBatchLocked();
+    void EndTlbBatchLocked();
+
+    // Tie |vmo| to the current TLB batch, if any.  A mapping must call this
+    // with the VMO lock held after unmapping a range and before it leaves or
+    // shrinks in the VMO's mapping list, since the VMO can then free pages
+    // whose invalidations the batch is still holding.
+    void AddTlbBatchObjectLocked(const fbl::RefPtr<VmObject>& vmo);
+
     // Expose the PRNG for ASLR to VmAddressRegion
     crypto::PRNG& AslrPrng() {
         DEBUG_ASSERT(aslr_enabled_);
@@ -212,6 +245,11 @@ private:
 
     fbl::RefPtr<VmMapping> vdso_code_mapping_;
 
+    // Nesting depth of the current TLB batch, and the VMOs tied to it.
+    // Guarded by lock_.
+    uint tlb_batch_depth_ = 0;
+    fbl::SinglyLinkedList<fbl::unique_ptr<VmTlbBatchRef>> tlb_batch_objects_;
+
     // initialization routines need to construct the singleton kernel address space
     // at a particular points in the bootup process
     static void KernelAspaceInitPreHeap();
@@ -12,7 +12,7 @@
 #include <fbl/intrusive_double_list.h>
 #include <fbl/macros.h>
 #include <fbl/name.h>
-#include <fbl/ref_counted.h>
+#include <fbl/ref_counted_upgradeable.h>
 #include <fbl/ref_ptr.h>
 #include <kernel/lockdep.h>
 #include <kernel/mutex.h>
@@ -25,7 +25,9 @@
 #include <zircon/thread_annotations.h>
 #include <zircon/types.h>
 
+class VmAspace;
 class VmMapping;
+class VmTlbBatchRef;
 class PageRequest;
 
 typedef zx_status_t (*vmo_lookup_fn_t)(void* context, size_t offset, size_t index, paddr_t pa);
@@ -40,7 +42,7 @@ public:
 //
 // Can be created without mapping and used as a container of data, or mappable
 // into an address space via VmAddressRegion::CreateVmMapping
-class VmObject : public fbl::RefCounted<VmObject>,
+class VmObject : public fbl::RefCountedUpgradeable<VmObject>,
                  public fbl::DoublyLinkedListable<VmObject*> {
 public:
     // public API
@@ -57,6 +59,12 @@ public:
     virtual bool is_contiguous() const { return false; }
     // Returns true if the object size can be changed.
     virtual bool is_resizable() const { return false; }
+    // Returns true if contiguous, aligned runs of the object's pages may be
+    // mapped with large pages.
+    virtual bool allows_large_pages() const { return false; }
+    // Returns true if the object or one of its ancestors gets its pages from a
+    // page source, so that reading it may block until the source supplies them.
+    virtual bool is_pager_backed() const { return false; }
 
     // Returns the number of physical pages currently allocated to the
     // object where (offset <= page_offset < offset+len).
@@ -79,6 +87,11 @@ public:
         return ZX_ERR_NOT_SUPPORTED;
     }
 
+    // share the committed pages of a range with any identical pages elsewhere
+    virtual zx_status_t DeduplicateRange(uint64_t offset, uint64_t len) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
     // Pin the given range of the vmo.  If any pages are not committed, this
     // returns a ZX_ERR_NO_MEMORY.
     virtual zx_status_t Pin(uint64_t offset, uint64_t len) {
@@ -128,6 +141,14 @@ public:
         return ZX_ERR_NOT_SUPPORTED;
     }
 
+    // Replaces the pages in the range [offset, offset + n * PAGE_SIZE) with the n pages
+    // on |pages|, as if their contents had been written there.  The pages must be in the
+    // ALLOC state, and are taken off |pages| on success.  Fails if any page in the range
+    // is pinned.
+    virtual zx_status_t ReplacePages(uint64_t offset, list_node* pages) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
     // The associated VmObjectDispatcher will set an observer to notify user mode.
     void SetChildObserver(VmObjectChildObserver* child_observer);
 
@@ -190,6 +211,9 @@ public:
     // |page_request| must be non-null if any flags in VMM_PF_FLAG_FAULT_MASK are set, unless
     // the caller knows that the vm object is not paged.
     //
+    // Pages on |free_list|, if any, are used before allocating new ones and must already be
+    // zeroed (see PMM_ALLOC_FLAG_ZEROED).
+    //
     // Returns ZX_ERR_SHOULD_WAIT if the caller should try again after waiting on the
     // PageRequest.
     //
@@ -208,6 +232,14 @@ public:
         return ZX_ERR_NOT_SUPPORTED;
     }
 
+    // If every page in the page aligned range [offset, offset + len) is present in this
+    // object (and not just in a parent) and the pages are physically contiguous, returns
+    // ZX_OK and the physical address of the first page in |pa|. Never allocates pages.
+    virtual zx_status_t LookupContiguousLocked(uint64_t offset, uint64_t len,
+                                               paddr_t* pa) TA_REQ(lock_) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
     Lock<fbl::Mutex>* lock() TA_RET_CAP(lock_) { return &lock_; }
     Lock<fbl::Mutex>& lock_ref() TA_RET_CAP(lock_) { return lock_; }
 
@@ -215,6 +247,13 @@ public:
     void RemoveMappingLocked(VmMapping* r) TA_REQ(lock_);
     uint32_t num_mappings() const;
 
+    // Track the TLB batches of aspaces that unmapped some of our pages and
+    // may not have shot down their translations yet.  See
+    // VmAspace::AddTlbBatchObjectLocked().
+    void AddTlbBatchLocked(VmTlbBatchRef* r) TA_REQ(lock_);
+    void RemoveTlbBatchLocked(VmTlbBatchRef* r) TA_REQ(lock_);
+    bool HasTlbBatchLocked(const VmAspace* aspace) const TA_REQ(lock_);
+
     // Returns true if this VMO is mapped into any VmAspace whose is_user()
     // returns true.
     bool IsMappedByUser() const;
@@ -260,6 +299,10 @@ protected:
     // inform all mappings and children that a range of this vmo's pages were added or removed.
     void RangeChangeUpdateLocked(uint64_t offset, uint64_t len) TA_REQ(lock_);
 
+    // Issue the invalidations still held back by TLB batches that unmapped
+    // some of our pages, which must happen before any of them are freed.
+    void FlushTlbBatchesLocked() TA_REQ(lock_);
+
     // above call but called from a parent
     virtual void RangeChangeUpdateFromParentLocked(uint64_t offset, uint64_t len)
         // Called under the parent's lock, which confuses analysis.
@@ -284,6 +327,9 @@ protected:
     // list of every child
     fbl::DoublyLinkedList<VmObject*> children_list_ TA_GUARDED(lock_);
 
+    // list of every TLB batch that has yet to end since it unmapped our pages
+    fbl::DoublyLinkedList<VmTlbBatchRef*> tlb_batch_list_ TA_GUARDED(lock_);
+
     // parent pointer (may be null)
     fbl::RefPtr<VmObject> parent_ TA_GUARDED(lock_);
 
@@ -17,7 +17,9 @@
 #include <lib/user_copy/user_ptr.h>
 #include <list.h>
 #include <stdint.h>
+#include <vm/compressed_page.h>
 #include <vm/page_source.h>
+#include <vm/shared_page.h>
 #include <vm/pmm.h>
 #include <vm/vm.h>
 #include <vm/vm_aspace.h>
@@ -32,6 +34,13 @@ public:
     // |options_| is a bitmask of:
     static constexpr uint32_t kResizable = (1u << 0);
     static constexpr uint32_t kContiguous = (1u << 1);
+    // Cold pages may be compressed in memory.  This is kernel-internal and is
+    // not reported through create_options().
+    static constexpr uint32_t kCompressible = (1u << 2);
+    // Committing backs aligned, empty chunks with contiguous runs where the
+    // pmm has them, so that they can be mapped with large pages.  Also
+    // kernel-internal.
+    static constexpr uint32_t kLargePages = (1u << 3);
 
     static zx_status_t Create(uint32_t pmm_alloc_flags,
                               uint32_t options,
@@ -59,7 +68,9 @@ public:
 
     zx_status_t Resize(uint64_t size) override;
     zx_status_t ResizeLocked(uint64_t size) override TA_REQ(lock_);
-    uint32_t create_options() const override { return options_; }
+    uint32_t create_options() const override {
+        return options_ & ~(kCompressible | kLargePages);
+    }
     uint64_t size() const override
         // TODO: Figure out whether it's safe to lock here without causing
         // any deadlocks.
@@ -67,12 +78,17 @@ public:
     bool is_paged() const override { return true; }
     bool is_contiguous() const override { return (options_ & kContiguous); }
     bool is_resizable() const override { return (options_ & kResizable); }
+    bool allows_large_pages() const override { return (options_ & (kContiguous | kLargePages)); }
+    bool is_compressible() const { return (options_ & kCompressible); }
+    bool is_pager_backed() const override;
 
     size_t AllocatedPagesInRange(uint64_t offset, uint64_t len) const override;
 
     zx_status_t CommitRange(uint64_t offset, uint64_t len) override;
     zx_status_t DecommitRange(uint64_t offset, uint64_t len) override;
 
+    zx_status_t DeduplicateRange(uint64_t offset, uint64_t len) override;
+
     zx_status_t Pin(uint64_t offset, uint64_t len) override;
     void Unpin(uint64_t offset, uint64_t len) override;
 
@@ -86,6 +102,7 @@ public:
 
     zx_status_t TakePages(uint64_t offset, uint64_t len, VmPageSpliceList* pages) override;
     zx_status_t SupplyPages(uint64_t offset, uint64_t len, VmPageSpliceList* pages) override;
+    zx_status_t ReplacePages(uint64_t offset, list_node* pages) override;
 
     void Dump(uint depth, bool verbose) override;
 
@@ -99,6 +116,9 @@ public:
         // Calls a Locked method of the parent, which confuses analysis.
         TA_NO_THREAD_SAFETY_ANALYSIS;
 
+    zx_status_t LookupContiguousLocked(uint64_t offset, uint64_t len,
+                                       paddr_t* pa) override TA_REQ(lock_);
+
     zx_status_t CloneCOW(bool resizable, uint64_t offset, uint64_t size, bool copy_name,
                          fbl::RefPtr<VmObject>* clone_vmo) override
         // Calls a Locked method of the child, which confuses analysis.
@@ -116,6 +136,22 @@ public:
         page_source_->Detach();
     }
 
+    // Sweeps a clock hand over at most |max_scan| resident pages of this
+    // object, reclaiming up to |max_evict| unpinned pages that have not been
+    // referenced since the hand last passed them.  Referenced pages get a
+    // second chance: the bit is cleared and the page is unmapped, so that the
+    // next access faults and marks it again.  Objects with a page source
+    // evict clean pages, which the source can provide again.  Compressible
+    // objects compress pages into the heap, and decompress them on the next
+    // fault.  Other objects reclaim nothing.  Returns the number of pages
+    // freed.
+    size_t ReclaimPages(size_t max_evict, size_t max_scan);
+
+    // Frees up to |target_pages| pages across every object that can reclaim
+    // them, visiting the objects round robin.  Returns the number of pages
+    // freed.
+    static size_t ReclaimColdPages(size_t target_pages);
+
     // The size is clamped to allow VmPageList to use a one-past-the-end for
     // VmPageListNode offsets.
     static const uint64_t MAX_SIZE = ROUNDDOWN(UINT64_MAX, VmPageListNode::kPageFanOut * PAGE_SIZE);
@@ -150,7 +186,7 @@ private:
     zx_status_t PinLocked(uint64_t offset, uint64_t len) TA_REQ(lock_);
     void UnpinLocked(uint64_t offset, uint64_t len) TA_REQ(lock_);
 
-    fbl::RefPtr<PageSource> GetRootPageSourceLocked()
+    fbl::RefPtr<PageSource> GetRootPageSourceLocked() const
         // Walks the clone chain to get the root page source, which confuses analysis.
         TA_NO_THREAD_SAFETY_ANALYSIS;
 
@@ -160,10 +196,40 @@ private:
     // see AllocatedPagesInRange
     size_t AllocatedPagesInRangeLocked(uint64_t offset, uint64_t len) const TA_REQ(lock_);
 
+    // internal check if this object itself has any pages in a range
+    bool AnyPagesInRangeLocked(uint64_t offset, uint64_t len) const TA_REQ(lock_);
+
+    // Brings the compressed page at |offset|, if there is one, back into
+    // page_list_, taking the page to hold it from |free_list| if that is
+    // non-null and non-empty.  Returns ZX_ERR_NOT_FOUND if the page at
+    // |offset| is not compressed.
+    zx_status_t DecompressPageLocked(uint64_t offset, list_node* free_list,
+                                     vm_page_t** page_out) TA_REQ(lock_);
+
+    // Gives the shared page at |offset|, if there is one, back to this object
+    // alone, copying it into a page taken from |free_list| if that is
+    // non-null and non-empty, unless no one else was sharing it.  Returns
+    // ZX_ERR_NOT_FOUND if the page at |offset| is not shared.
+    zx_status_t UnsharePageLocked(uint64_t offset, list_node* free_list,
+                                  vm_page_t** page_out) TA_REQ(lock_);
+
+    // Moves every compressed page in [start, end) back into page_list_.
+    zx_status_t DecompressRangeLocked(uint64_t start, uint64_t end) TA_REQ(lock_);
+
+    // Moves every compressed or shared page in [start, end) back into
+    // page_list_, as a page of this object alone.
+    zx_status_t MakeRangePrivateLocked(uint64_t start, uint64_t end) TA_REQ(lock_);
+
+    // Drops every compressed or shared page in [start, end).
+    void FreeStoredRangeLocked(uint64_t start, uint64_t end) TA_REQ(lock_);
+
     // internal read/write routine that takes a templated copy function to help share some code
     template <typename T>
     zx_status_t ReadWriteInternal(uint64_t offset, size_t len, bool write, T copyfunc);
 
+    // make the object's pages visible to the page reclaimer
+    void AddToReclaimList();
+
     // set our offset within our parent
     zx_status_t SetParentOffsetLocked(uint64_t o) TA_REQ(lock_);
 
@@ -179,4 +245,27 @@ private:
 
     // a tree of pages
     VmPageList page_list_ TA_GUARDED(lock_);
+
+    // the contents of pages that were compressed to free them, by offset
+    VmCompressedPageTree compressed_pages_ TA_GUARDED(lock_);
+
+    // pages shared read-only with other objects in place of our own, by offset
+    VmSharedPageRefTree shared_pages_ TA_GUARDED(lock_);
+
+    // offset of the page reclaimer's clock hand
+    uint64_t reclaim_cursor_ TA_GUARDED(lock_) = 0;
+
+    // Objects with a page source, and compressible objects, are kept on a
+    // global list for the page reclaimer to sweep.
+    using ReclaimNodeState = fbl::DoublyLinkedListNodeState<VmObjectPaged*>;
+    ReclaimNodeState reclaim_list_state_;
+
+    struct ReclaimListTraits {
+        static ReclaimNodeState& node_state(VmObjectPaged& vmo) {
+            return vmo.reclaim_list_state_;
+        }
+    };
+    using ReclaimList = fbl::DoublyLinkedList<VmObjectPaged*, ReclaimListTraits>;
+    DECLARE_SINGLETON_MUTEX(ReclaimListLock);
+    static ReclaimList reclaim_list_ TA_GUARDED(ReclaimListLock::Get());
 };
@@ -7,23 +7,30 @@
 #pragma once
 
 #include <err.h>
+#include <fbl/algorithm.h>
 #include <fbl/canary.h>
-#include <fbl/intrusive_wavl_tree.h>
+#include <fbl/intrusive_single_list.h>
 #include <fbl/macros.h>
+#include <kernel/align.h>
 #include <ktl/unique_ptr.h>
 #include <vm/vm.h>
 #include <zircon/types.h>
 
 struct vm_page;
 
-class VmPageListNode final : public fbl::WAVLTreeContainable<ktl::unique_ptr<VmPageListNode>> {
+// A leaf of a VmPageList, holding the pages for kPageFanOut consecutive page
+// offsets.  The page array comes first and spans whole cache lines so that
+// walking a run of pages touches as few lines as possible; the list node used
+// by VmPageSpliceList lives after it rather than in a base class.
+class VmPageListNode final {
 public:
     explicit VmPageListNode(uint64_t offset);
     ~VmPageListNode();
 
     DISALLOW_COPY_ASSIGN_AND_MOVE(VmPageListNode);
 
-    static const size_t kPageFanOut = 16;
+    static const size_t kPageFanOutShift = 5;
+    static const size_t kPageFanOut = 1u << kPageFanOutShift;
 
     // accessors
     uint64_t offset() const { return obj_offset_; }
@@ -94,12 +101,22 @@ public:
         return true;
     }
 
+    struct ListTraits {
+        static fbl::SinglyLinkedListNodeState<ktl::unique_ptr<VmPageListNode>>& node_state(
+            VmPageListNode& obj) {
+            return obj.list_node_;
+        }
+    };
+
 private:
+    vm_page* pages_[kPageFanOut] = {};
+
+    fbl::SinglyLinkedListNodeState<ktl::unique_ptr<VmPageListNode>> list_node_;
+
     fbl::Canary<fbl::magic("PLST")> canary_;
 
     uint64_t obj_offset_ = 0;
-    vm_page* pages_[kPageFanOut] = {};
-};
+} __CPU_ALIGN;
 
 class VmPageList;
 
@@ -129,12 +146,18 @@ private:
     uint64_t pos_ = 0;
 
     VmPageListNode head_ = VmPageListNode(0);
-    fbl::WAVLTree<uint64_t, ktl::unique_ptr<VmPageListNode>> middle_;
+    // Whole leaves taken from the page list, in ascending offset order.
+    fbl::SinglyLinkedList<ktl::unique_ptr<VmPageListNode>, VmPageListNode::ListTraits> middle_;
     VmPageListNode tail_ = VmPageListNode(0);
 
     friend VmPageList;
 };
 
+// A sparse map from page aligned offsets to vm_pages, implemented as a radix
+// tree.  Leaves are VmPageListNodes; each interior level resolves another
+// kInteriorFanOutShift bits of the leaf index.  The tree is only as tall as the
+// largest offset it holds requires, so small VMOs are a single leaf and the
+// largest possible VMO is a handful of levels deep.
 class VmPageList final {
 public:
     VmPageList();
@@ -142,82 +165,37 @@ public:
 
     DISALLOW_COPY_ASSIGN_AND_MOVE(VmPageList);
 
-    // walk the page tree, calling the passed in function on every tree node
+    // walk the page tree, calling the passed in function on every page
     template <typename T>
     zx_status_t ForEveryPage(T per_page_func) {
-        for (auto& pl : list_) {
-            zx_status_t status = pl.ForEveryPage(per_page_func, pl.offset(),
-                                                 pl.offset() + pl.kPageFanOut * PAGE_SIZE);
-            if (unlikely(status != ZX_ERR_NEXT)) {
-                if (status == ZX_ERR_STOP) {
-                    break;
-                }
-                return status;
-            }
-        }
-        return ZX_OK;
+        return ForEveryPageInRange(per_page_func, 0, UINT64_MAX);
     }
 
-    // walk the page tree, calling the passed in function on every tree node
+    // walk the page tree, calling the passed in function on every page
     template <typename T>
     zx_status_t ForEveryPage(T per_page_func) const {
-        for (auto& pl : list_) {
-            zx_status_t status = pl.ForEveryPage(per_page_func, pl.offset(),
-                                                 pl.offset() + pl.kPageFanOut * PAGE_SIZE);
-            if (unlikely(status != ZX_ERR_NEXT)) {
-                if (status == ZX_ERR_STOP) {
-                    break;
-                }
-                return status;
-            }
-        }
-        return ZX_OK;
+        return ForEveryPageInRange(per_page_func, 0, UINT64_MAX);
     }
 
-    // walk the page tree, calling the passed in function on every tree node
+    // walk the page tree, calling the passed in function on every page in
+    // the range [start_offset, end_offset)
     template <typename T>
     zx_status_t ForEveryPageInRange(T per_page_func, uint64_t start_offset, uint64_t end_offset) {
-        // Find the first node with a start after start_offset; if start_offset
-        // is in a node, it'll be in the one before it.
-        auto start = --list_.upper_bound(start_offset);
-        if (!start.IsValid()) {
-            start = list_.begin();
-        }
-        const auto end = list_.lower_bound(end_offset);
-        for (auto itr = start; itr != end; ++itr) {
-            auto& pl = *itr;
-            zx_status_t status = pl.ForEveryPage(per_page_func, start_offset, end_offset);
-            if (unlikely(status != ZX_ERR_NEXT)) {
-                if (status == ZX_ERR_STOP) {
-                    break;
-                }
-                return status;
-            }
-        }
-        return ZX_OK;
+        return ForEveryLeafInRange<VmPageListNode>(
+            root_, height_, start_offset, end_offset,
+            [&per_page_func, start_offset, end_offset](VmPageListNode* pl) {
+                return pl->ForEveryPage(per_page_func, start_offset, end_offset);
+            });
     }
 
     template <typename T>
     zx_status_t ForEveryPageInRange(T per_page_func, uint64_t start_offset,
                                     uint64_t end_offset) const {
-        // Find the first node with a start after start_offset; if start_offset
-        // is in a node, it'll be in the one before it.
-        auto start = --list_.upper_bound(start_offset);
-        if (!start.IsValid()) {
-            start = list_.begin();
-        }
-        const auto end = list_.lower_bound(end_offset);
-        for (auto itr = start; itr != end; ++itr) {
-            auto& pl = *itr;
-            zx_status_t status = pl.ForEveryPage(per_page_func, start_offset, end_offset);
-            if (unlikely(status != ZX_ERR_NEXT)) {
-                if (status == ZX_ERR_STOP) {
-                    break;
-                }
-                return status;
-            }
-        }
-        return ZX_OK;
+        return ForEveryLeafInRange<const VmPageListNode>(
+            root_, height_, start_offset, end_offset,
+            [&per_page_func, start_offset, end_offset](const VmPageListNode* pl) {
+                return pl->ForEveryPage(per_page_func, start_offset, end_offset);
+            });
     }
 
     zx_status_t AddPage(vm_page*, uint64_t offset);
@@ -228,11 +206,102 @@ public:
     size_t FreeAllPages();
     // Frees all pages in the range [start_offset, end_offset).
     void FreePages(uint64_t start_offset, uint64_t end_offset);
+    // Allocates the nodes that hold the range [start_offset, end_offset), so
+    // that adding pages to it can't fail.  The caller must fill the range, or
+    // the empty nodes stay around until something prunes them.
+    zx_status_t PopulateRange(uint64_t start_offset, uint64_t end_offset);
     bool IsEmpty();
 
     // Takes the pages in the range [offset, length) out of this page list.
     VmPageSpliceList TakePages(uint64_t offset, uint64_t length);
 
 private:
-    fbl::WAVLTree<uint64_t, ktl::unique_ptr<VmPageListNode>> list_;
+    static const size_t kInteriorFanOutShift = 6;
+    static const size_t kInteriorFanOut = 1u << kInteriorFanOutShift;
+
+    // An interior node of the tree.  Each slot points to either another
+    // interior node or, on the last level, to a VmPageListNode.
+    struct InteriorNode {
+        void* slots[kInteriorFanOut] = {};
+
+        bool IsEmpty() const {
+            for (const auto slot : slots) {
+                if (slot) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    } __CPU_ALIGN;
+
+    static uint64_t LeafIndex(uint64_t offset) {
+        return offset >> (PAGE_SIZE_SHIFT + VmPageListNode::kPageFanOutShift);
+    }
+
+    // The largest leaf index which a tree of |height| interior levels can hold.
+    static uint64_t MaxLeafIndex(uint height) {
+        const size_t bits = height * kInteriorFanOutShift;
+        return bits >= 64 ? UINT64_MAX : (1ull << bits) - 1;
+    }
+
+    // Calls |func| on every leaf under |node|, a node at |level| whose first
+    // leaf is |node_first|, that lies in the leaf index range [first, last].
+    template <typename LeafType, typename F>
+    static zx_status_t ForEveryLeafInNode(void* node, uint level, uint64_t node_first,
+                                          uint64_t first, uint64_t last, F& func) {
+        if (level == 0) {
+            return func(static_cast<LeafType*>(node));
+        }
+        const InteriorNode* interior = static_cast<const InteriorNode*>(node);
+        const size_t shift = (level - 1) * kInteriorFanOutShift;
+        const uint64_t start = first > node_first ? (first - node_first) >> shift : 0;
+        const uint64_t end = fbl::min<uint64_t>((last - node_first) >> shift, kInteriorFanOut - 1);
+        for (size_t i = start; i <= end; i++) {
+            if (interior->slots[i]) {
+                zx_status_t status = ForEveryLeafInNode<LeafType>(
+                    interior->slots[i], level - 1, node_first + (i << shift), first, last, func);
+                if (unlikely(status != ZX_ERR_NEXT)) {
+                    return status;
+                }
+            }
+        }
+        return ZX_ERR_NEXT;
+    }
+
+    template <typename LeafType, typename F>
+    static zx_status_t ForEveryLeafInRange(void* root, uint height, uint64_t start_offset,
+                                           uint64_t end_offset, F func) {
+        if (!root || end_offset <= start_offset) {
+            return ZX_OK;
+        }
+        const uint64_t first = LeafIndex(start_offset);
+        const uint64_t last = fbl::min(LeafIndex(end_offset - 1), MaxLeafIndex(height));
+        if (first > last) {
+            return ZX_OK;
+        }
+        zx_status_t status = ForEveryLeafInNode<LeafType>(root, height, 0, first, last, func);
+        if (status == ZX_ERR_NEXT || status == ZX_ERR_STOP) {
+            return ZX_OK;
+        }
+        return status;
+    }
+
+    // Returns the leaf holding |leaf_index|, or null if there is none.
+    VmPageListNode* LookupLeaf(uint64_t leaf_index) const;
+    // Returns the leaf holding |leaf_index|, allocating it and any interior
+    // nodes on the way to it if needed.
+    zx_status_t LookupOrAllocateLeaf(uint64_t leaf_index, VmPageListNode** leaf);
+    // Removes the leaf holding |leaf_index| from the tree, if there is one.
+    ktl::unique_ptr<VmPageListNode> DetachLeaf(uint64_t leaf_index);
+    // Frees every empty leaf, and every interior node left without children,
+    // in the leaf index range [first, last].
+    void PruneEmpty(uint64_t first, uint64_t last);
+    bool PruneEmptyInNode(void** slot, uint level, uint64_t node_first,
+                          uint64_t first, uint64_t last);
+    static void FreeNode(void* node, uint level);
+
+    // The root of the tree, and the number of interior levels below it.  When
+    // |height_| is 0 the root is a single leaf holding the first page offsets.
+    void* root_ = nullptr;
+    uint height_ = 0;
 };
@@ -84,6 +84,11 @@ void PageSource::OnPagesSupplied(uint64_t offset, uint64_t len) {
     }
 }
 
+bool PageSource::IsDetached() const {
+    Guard<fbl::Mutex> guard{&page_source_mtx_};
+    return detached_;
+}
+
 zx_status_t PageSource::GetPage(uint64_t offset, PageRequest* request,
                                 vm_page_t** const page_out, paddr_t* const pa_out) {
     canary_.Assert();
@@ -10,6 +10,7 @@
 #include <assert.h>
 #include <err.h>
 #include <inttypes.h>
+#include <kernel/cmdline.h>
 #include <kernel/mp.h>
 #include <kernel/timer.h>
 #include <lib/console.h>
@@ -47,6 +48,25 @@ static void pmm_enforce_fill(uint level) {
 LK_INIT_HOOK(pmm_fill, &pmm_enforce_fill, LK_INIT_LEVEL_VM);
 #endif
 
+// Default number of free pages each cpu may hold on to in its page cache.
+static constexpr uint32_t kDefaultPageCacheSize = 64;
+
+static void pmm_init_page_caches(uint level) {
+    uint32_t size = cmdline_get_uint32("kernel.pmm.page-cache-size", kDefaultPageCacheSize);
+    if (size > 0) {
+        pmm_node.InitPageCaches(size);
+    }
+}
+LK_INIT_HOOK(pmm_page_caches, &pmm_init_page_caches, LK_INIT_LEVEL_VM);
+
+// Default number of pages the background zeroing thread keeps ready.
+static constexpr uint32_t kDefaultZeroPoolSize = 256;
+
+static void pmm_init_zero_pool(uint level) {
+    pmm_node.InitZeroPool(cmdline_get_uint32("kernel.pmm.zero-pool-size", kDefaultZeroPoolSize));
+}
+LK_INIT_HOOK(pmm_zero_pool, &pmm_init_zero_pool, LK_INIT_LEVEL_THREADING);
+
 vm_page_t* paddr_to_vm_page(paddr_t addr) {
     return pmm_node.PaddrToPage(addr);
 }
@@ -103,6 +123,14 @@ uint64_t pmm_count_free_pages() {
     return pmm_node.CountFreePages();
 }
 
+uint64_t pmm_count_cached_pages() {
+    return pmm_node.CountCachedPages();
+}
+
+void pmm_drain_page_caches() {
+    pmm_node.DrainPageCaches();
+}
+
 uint64_t pmm_count_total_bytes() {
     return pmm_node.CountTotalBytes();
 }
@@ -5,9 +5,13 @@
 // https://opensource.org/licenses/MIT
 #include "pmm_node.h"
 
+#include <fbl/algorithm.h>
 #include <inttypes.h>
 #include <kernel/mp.h>
+#include <kernel/thread.h>
+#include <lib/counters.h>
 #include <new>
+#include <platform.h>
 #include <trace.h>
 #include <vm/bootalloc.h>
 #include <vm/physmap.h>
@@ -16,6 +20,34 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+// Number of single page allocations satisfied from a per-cpu page cache.
+KCOUNTER(pmm_cache_hit_counter, "kernel.pmm.cache.hit");
+
+// Number of times a per-cpu page cache was refilled from the global free list.
+KCOUNTER(pmm_cache_refill_counter, "kernel.pmm.cache.refill");
+
+// Number of times a full per-cpu page cache spilled a batch back to the global free list.
+KCOUNTER(pmm_cache_spill_counter, "kernel.pmm.cache.spill");
+
+// Number of times every per-cpu page cache was drained back to the global free list.
+KCOUNTER(pmm_cache_drain_counter, "kernel.pmm.cache.drain");
+
+// Number of PMM_ALLOC_FLAG_ZEROED pages handed out already zeroed by the zero pool.
+KCOUNTER(pmm_zero_pool_hit_counter, "kernel.pmm.zero_pool.hit");
+
+// Number of PMM_ALLOC_FLAG_ZEROED pages that had to be zeroed by the allocating thread.
+KCOUNTER(pmm_zero_pool_miss_counter, "kernel.pmm.zero_pool.miss");
+
+// Time in nanoseconds the zero pool thread has spent zeroing pages.
+KCOUNTER(pmm_zero_pool_background_ns_counter, "kernel.pmm.zero_pool.background_ns");
+
+// Time in nanoseconds allocating threads have spent zeroing pages after a pool miss.
+KCOUNTER(pmm_zero_pool_inline_ns_counter, "kernel.pmm.zero_pool.inline_ns");
+
+// The zero pool thread pulls pages off the free list in batches of this size, so it never
+// holds lock_ for long or has more than a handful of pages out of circulation at once.
+static constexpr size_t kZeroPoolBatch = 16;
+
 namespace {
 
 void set_state_alloc(vm_page* page) {
@@ -26,6 +58,35 @@ void set_state_alloc(vm_page* page) {
     page->state = VM_PAGE_STATE_ALLOC;
 }
 
+void zero_page(vm_page* page) {
+    void* ptr = paddr_to_physmap(page->paddr());
+    DEBUG_ASSERT(ptr);
+
+    arch_zero_page(ptr);
+}
+
+// Called on every page leaving the allocator. Zeroes the page if the caller asked for
+// that and it didn't come out of the zero pool, and drops the pool marker either way.
+void finish_alloc_zeroing(vm_page* page, uint alloc_flags) {
+    const bool zeroed = page->flags & VM_PAGE_FLAG_ZEROED;
+    page->flags &= ~VM_PAGE_FLAG_ZEROED;
+
+    if (!(alloc_flags & PMM_ALLOC_FLAG_ZEROED)) {
+        return;
+    }
+
+    if (zeroed) {
+        kcounter_add(pmm_zero_pool_hit_counter, 1);
+        return;
+    }
+
+    kcounter_add(pmm_zero_pool_miss_counter, 1);
+
+    zx_time_t start = current_time();
+    zero_page(page);
+    kcounter_add(pmm_zero_pool_inline_ns_counter, current_time() - start);
+}
+
 } // namespace
 
 PmmNode::PmmNode() {
@@ -91,25 +152,336 @@ void PmmNode::AddFreePages(list_node* list) TA_NO_THREAD_SAFETY_ANALYSIS {
     LTRACEF("free count now %" PRIu64 "\n", free_count_);
 }
 
-zx_status_t PmmNode::AllocPage(uint alloc_flags, vm_page_t** page_out, paddr_t* pa_out) {
-    Guard<fbl::Mutex> guard{&lock_};
+void PmmNode::InitPageCaches(size_t max_pages) {
+    DEBUG_ASSERT(page_cache_max_ == 0);
+
+    page_cache_batch_ = fbl::max<size_t>(max_pages / 2, 1);
+    page_cache_max_ = max_pages;
+}
+
+// Takes a page out of the current cpu's cache. The page is returned in the free state.
+vm_page* PmmNode::AllocCachedPage() {
+    if (page_cache_max_ == 0) {
+        return nullptr;
+    }
+
+    // keep interrupts disabled between picking the cache and locking it so we
+    // can't migrate to another cpu in between
+    spin_lock_saved_state_t irq_state;
+    arch_interrupt_save(&irq_state, SPIN_LOCK_FLAG_INTERRUPTS);
+    vm_page* page;
+    {
+        PageCache& cache = page_caches_[arch_curr_cpu_num()];
+        Guard<SpinLock, NoIrqSave> guard{&cache.lock};
+        page = list_remove_head_type(&cache.pages, vm_page, queue_node);
+        if (page) {
+            cache.count--;
+        }
+    }
+    arch_interrupt_restore(irq_state, SPIN_LOCK_FLAG_INTERRUPTS);
 
-    vm_page* page = list_remove_head_type(&free_list_, vm_page, queue_node);
     if (!page) {
-        return ZX_ERR_NO_MEMORY;
+        return nullptr;
+    }
+
+    cached_count_.fetch_sub(1);
+    kcounter_add(pmm_cache_hit_counter, 1);
+
+    DEBUG_ASSERT(page->state == VM_PAGE_STATE_CACHED);
+    page->state = VM_PAGE_STATE_FREE;
+    return page;
+}
+
+// Takes one page off the free list for the caller and moves up to a batch of pages after it
+// into the current cpu's cache. Returns nullptr without touching anything if caching is
+// disabled or free memory is too low to be parking pages in caches.
+vm_page* PmmNode::RefillPageCacheLocked() {
+    if (page_cache_max_ == 0 || free_count_ <= page_cache_max_ * SMP_MAX_CPUS) {
+        return nullptr;
     }
 
-    DEBUG_ASSERT(free_count_ > 0);
+    // leave the zero pool alone, those pages are better spent on zeroed allocations
+    vm_page* page = list_remove_head_type(&free_list_, vm_page, queue_node);
+    if (!page) {
+        return nullptr;
+    }
     free_count_--;
 
+    spin_lock_saved_state_t irq_state;
+    arch_interrupt_save(&irq_state, SPIN_LOCK_FLAG_INTERRUPTS);
+    size_t moved = 0;
+    {
+        PageCache& cache = page_caches_[arch_curr_cpu_num()];
+        Guard<SpinLock, NoIrqSave> guard{&cache.lock};
+        while (moved < page_cache_batch_ && cache.count < page_cache_max_) {
+            vm_page* p = list_remove_head_type(&free_list_, vm_page, queue_node);
+            if (!p) {
+                break;
+            }
+            DEBUG_ASSERT(p->is_free());
+            p->state = VM_PAGE_STATE_CACHED;
+            list_add_tail(&cache.pages, &p->queue_node);
+            cache.count++;
+            moved++;
+        }
+    }
+    arch_interrupt_restore(irq_state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    free_count_ -= moved;
+    cached_count_.fetch_add(moved);
+    kcounter_add(pmm_cache_refill_counter, 1);
+
+    return page;
+}
+
+// Puts a page being freed into the current cpu's cache, spilling a batch back to the free
+// list if that overflows the cache. Returns false if caching is disabled.
+bool PmmNode::FreeCachedPage(vm_page* page) {
+    if (page_cache_max_ == 0) {
+        return false;
+    }
+
+    LTRACEF("page %p state %u paddr %#" PRIxPTR "\n", page, page->state, page->paddr());
+
+    DEBUG_ASSERT(page->state != VM_PAGE_STATE_OBJECT || page->object.pin_count == 0);
+    DEBUG_ASSERT(!page->is_free());
+
+#if PMM_ENABLE_FREE_FILL
+    FreeFill(page);
+#endif
+
+    // remove it from its old queue
+    if (list_in_list(&page->queue_node)) {
+        list_delete(&page->queue_node);
+    }
+
+    page->state = VM_PAGE_STATE_CACHED;
+    page->flags &= ~VM_PAGE_FLAG_ZEROED;
+    cached_count_.fetch_add(1);
+
+    list_node spill = LIST_INITIAL_VALUE(spill);
+    spin_lock_saved_state_t irq_state;
+    arch_interrupt_save(&irq_state, SPIN_LOCK_FLAG_INTERRUPTS);
+    {
+        PageCache& cache = page_caches_[arch_curr_cpu_num()];
+        Guard<SpinLock, NoIrqSave> guard{&cache.lock};
+        list_add_head(&cache.pages, &page->queue_node);
+        cache.count++;
+
+        // give back the coldest pages if we've gone over
+        if (cache.count > page_cache_max_) {
+            for (size_t i = 0; i < page_cache_batch_; i++) {
+                vm_page* p = list_remove_tail_type(&cache.pages, vm_page, queue_node);
+                list_add_tail(&spill, &p->queue_node);
+            }
+            cache.count -= page_cache_batch_;
+        }
+    }
+    arch_interrupt_restore(irq_state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    if (!list_is_empty(&spill)) {
+        kcounter_add(pmm_cache_spill_counter, 1);
+
+        Guard<fbl::Mutex> guard{&lock_};
+        ReturnCachedListLocked(&spill);
+    }
+
+    return true;
+}
+
+// Moves pages that were taken out of a per-cpu cache onto the free list.
+void PmmNode::ReturnCachedListLocked(list_node* list) {
+    vm_page* page;
+    while ((page = list_remove_head_type(list, vm_page, queue_node)) != nullptr) {
+        DEBUG_ASSERT(page->state == VM_PAGE_STATE_CACHED);
+        page->state = VM_PAGE_STATE_FREE;
+        list_add_head(&free_list_, &page->queue_node);
+        free_count_++;
+        cached_count_.fetch_sub(1);
+    }
+}
+
+void PmmNode::DrainPageCachesLocked() {
+    if (page_cache_max_ == 0) {
+        return;
+    }
+
+    kcounter_add(pmm_cache_drain_counter, 1);
+
+    for (auto& cache : page_caches_) {
+        list_node pages = LIST_INITIAL_VALUE(pages);
+        {
+            Guard<SpinLock, IrqSave> guard{&cache.lock};
+            list_move(&cache.pages, &pages);
+            cache.count = 0;
+        }
+        ReturnCachedListLocked(&pages);
+    }
+}
+
+void PmmNode::DrainPageCaches() {
+    Guard<fbl::Mutex> guard{&lock_};
+
+    DrainPageCachesLocked();
+}
+
+void PmmNode::InitZeroPool(size_t target_pages) {
+    DEBUG_ASSERT(zeroed_target_ == 0);
+
+    if (target_pages == 0) {
+        return;
+    }
+
+    auto entry = [](void* arg) -> int {
+        return static_cast<PmmNode*>(arg)->ZeroPoolThread();
+    };
+    // run just above the idle threads so zeroing only soaks up otherwise idle cpu time
+    thread_t* t = thread_create("pmm-zero-pool", entry, this, LOWEST_PRIORITY + 1);
+    if (!t) {
+        printf("PMM: failed to create zero pool thread\n");
+        return;
+    }
+
+    zeroed_target_ = target_pages;
+    thread_detach_and_resume(t);
+    zero_pool_event_.SignalNoResched();
+}
+
+int PmmNode::ZeroPoolThread() {
+    for (;;) {
+        zero_pool_event_.Wait(Deadline::infinite());
+
+        // top the pool back up a batch at a time
+        for (;;) {
+            list_node batch = LIST_INITIAL_VALUE(batch);
+            {
+                Guard<fbl::Mutex> guard{&lock_};
+
+                // stop once the pool is full, or once zeroing more would use up what is
+                // left of free_list_
+                const uint64_t zeroed = zeroed_count_.load();
+                if (zeroed >= zeroed_target_ || free_count_ - zeroed <= zeroed_target_) {
+                    break;
+                }
+
+                size_t count = fbl::min<size_t>(zeroed_target_ - zeroed, kZeroPoolBatch);
+                while (count-- > 0) {
+                    vm_page* page = list_remove_head_type(&free_list_, vm_page, queue_node);
+                    if (!page) {
+                        break;
+                    }
+
+                    // take the page out of circulation while we zero it
+                    set_state_alloc(page);
+                    free_count_--;
+                    list_add_tail(&batch, &page->queue_node);
+                }
+            }
+
+            if (list_is_empty(&batch)) {
+                break;
+            }
+
+            zx_time_t start = current_time();
+            vm_page* page;
+            list_for_every_entry (&batch, page, vm_page, queue_node) {
+#if PMM_ENABLE_FREE_FILL
+                CheckFreeFill(page);
+#endif
+                zero_page(page);
+            }
+            kcounter_add(pmm_zero_pool_background_ns_counter, current_time() - start);
+
+            Guard<fbl::Mutex> guard{&lock_};
+            while ((page = list_remove_head_type(&batch, vm_page, queue_node)) != nullptr) {
+                page->state = VM_PAGE_STATE_FREE;
+                page->flags |= VM_PAGE_FLAG_ZEROED;
+                list_add_tail(&zeroed_list_, &page->queue_node);
+                free_count_++;
+                zeroed_count_.fetch_add(1);
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Takes a page off the free queues without updating free_count_ or the page state. Callers
+// that want a zeroed page get one from the zero pool if there is one, everyone else only
+// dips into the pool once free_list_ is empty.
+vm_page* PmmNode::AllocFreeLocked(uint alloc_flags) {
+    const bool want_zeroed = alloc_flags & PMM_ALLOC_FLAG_ZEROED;
+    list_node* first = want_zeroed ? &zeroed_list_ : &free_list_;
+    list_node* second = want_zeroed ? &free_list_ : &zeroed_list_;
+
+    vm_page* page = list_remove_head_type(first, vm_page, queue_node);
+    if (!page) {
+        page = list_remove_head_type(second, vm_page, queue_node);
+    }
+
+    if (page && (page->flags & VM_PAGE_FLAG_ZEROED)) {
+        if (zeroed_count_.fetch_sub(1) - 1 < zeroed_target_ / 2) {
+            zero_pool_event_.SignalNoResched();
+        }
+    } else if (page && want_zeroed && zeroed_target_ > 0) {
+        // the pool ran dry, possibly because the zero pool thread gave up while memory
+        // was short; give it another go
+        zero_pool_event_.SignalNoResched();
+    }
+
+    return page;
+}
+
+// Pulls a specific free page off whichever free queue it is on.
+void PmmNode::UnlinkFreePageLocked(vm_page* page) {
+    DEBUG_ASSERT(page->is_free());
+
+    list_delete(&page->queue_node);
+    if (page->flags & VM_PAGE_FLAG_ZEROED) {
+        page->flags &= ~VM_PAGE_FLAG_ZEROED;
+        zeroed_count_.fetch_sub(1);
+    }
+}
+
+zx_status_t PmmNode::AllocPage(uint alloc_flags, vm_page_t** page_out, paddr_t* pa_out) {
+    // a page from the zero pool beats a cached one that would have to be zeroed inline
+    const bool use_cache = !(alloc_flags & PMM_ALLOC_FLAG_ZEROED) || zeroed_count_.load() == 0;
+
+    vm_page* page = use_cache ? AllocCachedPage() : nullptr;
+    if (!page) {
+        Guard<fbl::Mutex> guard{&lock_};
+
+        if (use_cache) {
+            page = RefillPageCacheLocked();
+        }
+        if (!page) {
+            page = AllocFreeLocked(alloc_flags);
+            if (!page) {
+                // memory is tight, take back whatever the other cpus are holding on to
+                DrainPageCachesLocked();
+                page = AllocFreeLocked(alloc_flags);
+                if (!page) {
+                    return ZX_ERR_NO_MEMORY;
+                }
+            }
+
+            DEBUG_ASSERT(free_count_ > 0);
+            free_count_--;
+        }
+    }
+
     DEBUG_ASSERT(page->is_free());
 
     set_state_alloc(page);
 
 #if PMM_ENABLE_FREE_FILL
-    CheckFreeFill(page);
+    if (!(page->flags & VM_PAGE_FLAG_ZEROED)) {
+        CheckFreeFill(page);
+    }
 #endif
 
+    finish_alloc_zeroing(page, alloc_flags);
+
     if (pa_out) {
         *pa_out = page->paddr();
     }
@@ -133,33 +505,53 @@ zx_status_t PmmNode::AllocPages(size_t count, uint alloc_flags, list_node* list)
         return ZX_OK;
     }
 
-    Guard<fbl::Mutex> guard{&lock_};
+    list_node alloc_list = LIST_INITIAL_VALUE(alloc_list);
+    {
+        Guard<fbl::Mutex> guard{&lock_};
 
-    while (count > 0) {
-        vm_page* page = list_remove_head_type(&free_list_, vm_page, queue_node);
-        if (unlikely(!page)) {
-            // free pages that have already been allocated
-            FreeListLocked(list);
-            return ZX_ERR_NO_MEMORY;
-        }
+        bool drained = false;
+        while (count > 0) {
+            vm_page* page = AllocFreeLocked(alloc_flags);
+            if (unlikely(!page)) {
+                if (!drained) {
+                    // take back whatever the per-cpu caches are holding on to and try again
+                    DrainPageCachesLocked();
+                    drained = true;
+                    continue;
+                }
+
+                // free pages that have already been allocated
+                FreeListLocked(&alloc_list);
+                return ZX_ERR_NO_MEMORY;
+            }
 
-        LTRACEF("allocating page %p, pa %#" PRIxPTR "\n", page, page->paddr());
+            LTRACEF("allocating page %p, pa %#" PRIxPTR "\n", page, page->paddr());
 
-        DEBUG_ASSERT(free_count_ > 0);
+            DEBUG_ASSERT(free_count_ > 0);
 
-        free_count_--;
+            free_count_--;
 
-        DEBUG_ASSERT(page->is_free());
+            DEBUG_ASSERT(page->is_free());
 #if PMM_ENABLE_FREE_FILL
-        CheckFreeFill(page);
+            if (!(page->flags & VM_PAGE_FLAG_ZEROED)) {
+                CheckFreeFill(page);
+            }
 #endif
 
-        page->state = VM_PAGE_STATE_ALLOC;
-        list_add_tail(list, &page->queue_node);
+            page->state = VM_PAGE_STATE_ALLOC;
+            list_add_tail(&alloc_list, &page->queue_node);
 
-        count--;
+            count--;
+        }
     }
 
+    // do any zeroing outside of the lock
+    vm_page* page;
+    list_for_every_entry (&alloc_list, page, vm_page, queue_node) {
+        finish_alloc_zeroing(page, alloc_flags);
+    }
+    list_splice_after(&alloc_list, list->prev);
+
     return ZX_OK;
 }
 
@@ -178,6 +570,9 @@ zx_status_t PmmNode::AllocRange(paddr_t address, size_t count, list_node* list)
 
     Guard<fbl::Mutex> guard{&lock_};
 
+    // the requested pages may be sitting in a per-cpu cache
+    DrainPageCachesLocked();
+
     // walk through the arenas, looking to see if the physical page belongs to it
     for (auto& a : arena_list_) {
         while (allocated < count && a.address_in_arena(address)) {
@@ -190,7 +585,7 @@ zx_status_t PmmNode::AllocRange(paddr_t address, size_t count, list_node* list)
                 break;
             }
 
-            list_delete(&page->queue_node);
+            UnlinkFreePageLocked(page);
 
             page->state = VM_PAGE_STATE_ALLOC;
 
@@ -232,6 +627,8 @@ zx_status_t PmmNode::AllocContiguous(const size_t count, uint alloc_flags, uint8
 
     Guard<fbl::Mutex> guard{&lock_};
 
+    bool drained = false;
+retry:
     for (auto& a : arena_list_) {
         vm_page_t* p = a.FindFreeContiguous(count, alignment_log2);
         if (!p) {
@@ -245,23 +642,32 @@ zx_status_t PmmNode::AllocContiguous(const size_t count, uint alloc_flags, uint8
             DEBUG_ASSERT_MSG(p->is_free(), "p %p state %u\n", p, p->state);
             DEBUG_ASSERT(list_in_list(&p->queue_node));
 
-            list_delete(&p->queue_node);
+#if PMM_ENABLE_FREE_FILL
+            if (!(p->flags & VM_PAGE_FLAG_ZEROED)) {
+                CheckFreeFill(p);
+            }
+#endif
+
+            UnlinkFreePageLocked(p);
             p->state = VM_PAGE_STATE_ALLOC;
 
             DEBUG_ASSERT(free_count_ > 0);
 
             free_count_--;
 
-#if PMM_ENABLE_FREE_FILL
-            CheckFreeFill(p);
-#endif
-
             list_add_tail(list, &p->queue_node);
         }
 
         return ZX_OK;
     }
 
+    // pages parked in the per-cpu caches may be what's breaking up the run
+    if (!drained && page_cache_max_ > 0 && !(alloc_flags & PMM_ALLOC_FLAG_NO_DRAIN)) {
+        DrainPageCachesLocked();
+        drained = true;
+        goto retry;
+    }
+
     LTRACEF("couldn't find run\n");
     return ZX_ERR_NOT_FOUND;
 }
@@ -283,6 +689,7 @@ void PmmNode::FreePageLocked(vm_page* page) {
 
     // mark it free
     page->state = VM_PAGE_STATE_FREE;
+    page->flags &= ~VM_PAGE_FLAG_ZEROED;
 
     // add it to the free queue
     list_add_head(&free_list_, &page->queue_node);
@@ -291,6 +698,10 @@ void PmmNode::FreePageLocked(vm_page* page) {
 }
 
 void PmmNode::FreePage(vm_page* page) {
+    if (FreeCachedPage(page)) {
+        return;
+    }
+
     Guard<fbl::Mutex> guard{&lock_};
 
     FreePageLocked(page);
@@ -314,7 +725,15 @@ void PmmNode::FreeList(list_node* list) {
 
 // okay if accessed outside of a lock
 uint64_t PmmNode::CountFreePages() const TA_NO_THREAD_SAFETY_ANALYSIS {
-    return free_count_;
+    return free_count_ + cached_count_.load();
+}
+
+uint64_t PmmNode::CountCachedPages() const {
+    return cached_count_.load();
+}
+
+uint64_t PmmNode::CountZeroedPages() const {
+    return zeroed_count_.load();
 }
 
 uint64_t PmmNode::CountTotalBytes() const TA_NO_THREAD_SAFETY_ANALYSIS {
@@ -340,6 +759,19 @@ void PmmNode::Dump(bool is_panic) const {
     auto dump = [this]() TA_NO_THREAD_SAFETY_ANALYSIS {
         printf("pmm node %p: free_count %zu (%zu bytes), total size %zu\n",
                this, free_count_, free_count_ * PAGE_SIZE, arena_cumulative_size_);
+        if (page_cache_max_ > 0) {
+            uint64_t cached = cached_count_.load();
+            printf("\tper-cpu page caches: %" PRIu64 " pages (%" PRIu64 " bytes), max %zu per cpu\n",
+                   cached, cached * PAGE_SIZE, page_cache_max_);
+            for (cpu_num_t i = 0; i < SMP_MAX_CPUS; i++) {
+                if (page_caches_[i].count > 0) {
+                    printf("\t\tcpu %u: %zu pages\n", i, page_caches_[i].count);
+                }
+            }
+        }
+        if (zeroed_target_ > 0) {
+            printf("\tzero pool: %" PRIu64 " of %zu pages\n", zeroed_count_.load(), zeroed_target_);
+        }
         for (auto& a : arena_list_) {
             a.Dump(false, false);
         }
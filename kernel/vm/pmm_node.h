@@ -5,11 +5,15 @@
 // https://opensource.org/licenses/MIT
 #pragma once
 
+#include <fbl/atomic.h>
 #include <fbl/canary.h>
 #include <fbl/intrusive_double_list.h>
 #include <fbl/mutex.h>
 
+#include <kernel/align.h>
+#include <kernel/event.h>
 #include <kernel/lockdep.h>
+#include <kernel/spinlock.h>
 #include <vm/pmm.h>
 
 #include "pmm_arena.h"
@@ -37,6 +41,7 @@ public:
     void FreeList(list_node* list);
 
     uint64_t CountFreePages() const;
+    uint64_t CountCachedPages() const;
     uint64_t CountTotalBytes() const;
     void CountTotalStates(uint64_t state_count[VM_PAGE_STATE_COUNT_]) const;
 
@@ -55,10 +60,35 @@ public:
     // add new pages to the free queue. used when boostrapping a PmmArena
     void AddFreePages(list_node* list);
 
+    // Enables the per-cpu page caches, letting each cpu hold up to |max_pages| free pages.
+    // Passing 0 leaves them disabled.
+    void InitPageCaches(size_t max_pages);
+
+    // Returns every page held in the per-cpu caches to the global free list.
+    void DrainPageCaches();
+
+    // Starts a low priority thread that keeps up to |target_pages| free pages zeroed ahead
+    // of time for PMM_ALLOC_FLAG_ZEROED allocations.
+    void InitZeroPool(size_t target_pages);
+
+    uint64_t CountZeroedPages() const;
+
 private:
     void FreePageLocked(vm_page* page) TA_REQ(lock_);
     void FreeListLocked(list_node* list) TA_REQ(lock_);
 
+    // per-cpu page cache helpers
+    vm_page* AllocCachedPage();
+    vm_page* RefillPageCacheLocked() TA_REQ(lock_);
+    bool FreeCachedPage(vm_page* page);
+    void ReturnCachedListLocked(list_node* list) TA_REQ(lock_);
+    void DrainPageCachesLocked() TA_REQ(lock_);
+
+    // zero pool helpers
+    vm_page* AllocFreeLocked(uint alloc_flags) TA_REQ(lock_);
+    void UnlinkFreePageLocked(vm_page* page) TA_REQ(lock_);
+    int ZeroPoolThread();
+
     fbl::Canary<fbl::magic("PNOD")> canary_;
 
     mutable DECLARE_MUTEX(PmmNode) lock_;
@@ -75,6 +105,39 @@ private:
     list_node modified_list_ TA_GUARDED(lock_) = LIST_INITIAL_VALUE(modified_list_);
     list_node wired_list_ TA_GUARDED(lock_) = LIST_INITIAL_VALUE(wired_list_);
 
+    // A per-cpu magazine of free pages sitting in front of free_list_, so that most single
+    // page allocations and frees never touch lock_. Pages move between a cache and the free
+    // list in batches of half the cache size. Cached pages are in VM_PAGE_STATE_CACHED so that
+    // the arena scans done by AllocRange and AllocContiguous never see them as free.
+    struct PageCache {
+        DECLARE_SPINLOCK(PmmNode::PageCache) lock;
+        list_node pages TA_GUARDED(lock) = LIST_INITIAL_VALUE(pages);
+        size_t count TA_GUARDED(lock) = 0;
+    } __CPU_ALIGN;
+
+    PageCache page_caches_[SMP_MAX_CPUS];
+
+    // Set once at init and read without locking afterwards.
+    size_t page_cache_max_ = 0;
+    size_t page_cache_batch_ = 0;
+
+    // total number of pages sitting in the per-cpu caches
+    fbl::atomic<uint64_t> cached_count_{0};
+
+    // Free pages that the zero pool thread has already cleared and marked VM_PAGE_FLAG_ZEROED.
+    // They are still in VM_PAGE_STATE_FREE and counted in free_count_, but kept off free_list_
+    // so that regular allocations only dip into them once free_list_ runs dry.
+    list_node zeroed_list_ TA_GUARDED(lock_) = LIST_INITIAL_VALUE(zeroed_list_);
+
+    // Only modified with lock_ held, but read without it to skip the lock when the pool is empty.
+    fbl::atomic<uint64_t> zeroed_count_{0};
+
+    // Set once at init, zero if the pool is disabled.
+    size_t zeroed_target_ = 0;
+
+    // Wakes the zero pool thread when the pool drops below half of its target.
+    Event zero_pool_event_{EVENT_FLAG_AUTOUNSIGNAL};
+
 #if PMM_ENABLE_FREE_FILL
     void FreeFill(vm_page_t* page);
     void CheckFreeFill(vm_page_t* page);
@@ -0,0 +1,228 @@
+// Copyright 2018 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <vm/shared_page.h>
+
+#include "vm_priv.h"
+#include <assert.h>
+#include <fbl/alloc_checker.h>
+#include <inttypes.h>
+#include <kernel/lockdep.h>
+#include <lib/counters.h>
+#include <lib/crypto/global_prng.h>
+#include <lk/init.h>
+#include <string.h>
+#include <trace.h>
+#include <vm/physmap.h>
+#include <vm/pmm.h>
+
+#define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
+
+// Pages that were found identical to an existing shared page and freed, and
+// shared pages that had to be copied because they were written to.
+KCOUNTER(vm_dedup_merged, "kernel.vm.dedup.merged");
+KCOUNTER(vm_dedup_copied, "kernel.vm.dedup.copied");
+
+// The shared pages are kept in a tree ordered by a hash of their contents.
+// Different contents can hash the same, so the physical address of the page
+// breaks ties.  The hash is keyed with a secret drawn at boot, so that
+// userspace can't pick contents that collide.
+struct VmSharedPageKey {
+    uint64_t hash;
+    paddr_t pa;
+
+    bool operator<(const VmSharedPageKey& other) const {
+        return hash < other.hash || (hash == other.hash && pa < other.pa);
+    }
+    bool operator==(const VmSharedPageKey& other) const {
+        return hash == other.hash && pa == other.pa;
+    }
+};
+
+class VmSharedPage final : public fbl::WAVLTreeContainable<VmSharedPage*> {
+public:
+    VmSharedPage(uint64_t hash, vm_page_t* page)
+        : key_{hash, page->paddr()}, page_(page) {}
+
+    VmSharedPageKey GetKey() const { return key_; }
+    vm_page_t* page() const { return page_; }
+
+    // number of VmSharedPageRefs pointing at this page
+    size_t ref_count = 1;
+
+private:
+    const VmSharedPageKey key_;
+    vm_page_t* const page_;
+};
+
+namespace {
+
+struct SharedPageLock {};
+DECLARE_MUTEX(SharedPageLock) shared_page_lock;
+fbl::WAVLTree<VmSharedPageKey, VmSharedPage*> shared_pages TA_GUARDED(shared_page_lock);
+size_t shared_page_refs TA_GUARDED(shared_page_lock) = 0;
+
+// At most this many shared pages with the same hash as a new page are
+// compared with it.  Past that, the new page is shared on its own, so that
+// pages which happen to collide can't make sharing arbitrarily slow.
+constexpr size_t kMaxCompares = 8;
+
+uint64_t hash_key[2];
+
+void shared_page_init(uint level) {
+    crypto::GlobalPRNG::GetInstance()->Draw(hash_key, sizeof(hash_key));
+}
+
+inline uint64_t Rotl(uint64_t x, int b) {
+    return (x << b) | (x >> (64 - b));
+}
+
+// SipHash-2-4 of a page, keyed with |hash_key|.
+uint64_t HashPage(const void* data) {
+    uint64_t v0 = hash_key[0] ^ 0x736f6d6570736575ull;
+    uint64_t v1 = hash_key[1] ^ 0x646f72616e646f6dull;
+    uint64_t v2 = hash_key[0] ^ 0x6c7967656e657261ull;
+    uint64_t v3 = hash_key[1] ^ 0x7465646279746573ull;
+
+    auto sip_round = [&]() {
+        v0 += v1;
+        v1 = Rotl(v1, 13);
+        v1 ^= v0;
+        v0 = Rotl(v0, 32);
+        v2 += v3;
+        v3 = Rotl(v3, 16);
+        v3 ^= v2;
+        v0 += v3;
+        v3 = Rotl(v3, 21);
+        v3 ^= v0;
+        v2 += v1;
+        v1 = Rotl(v1, 17);
+        v1 ^= v2;
+        v2 = Rotl(v2, 32);
+    };
+    auto compress = [&](uint64_t m) {
+        v3 ^= m;
+        sip_round();
+        sip_round();
+        v0 ^= m;
+    };
+
+    const uint64_t* words = static_cast<const uint64_t*>(data);
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(uint64_t); i++) {
+        compress(words[i]);
+    }
+    // The page is a whole number of words, so the last block only holds the
+    // length.
+    compress(static_cast<uint64_t>(PAGE_SIZE & 0xff) << 56);
+
+    v2 ^= 0xff;
+    for (int i = 0; i < 4; i++) {
+        sip_round();
+    }
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+} // namespace
+
+LK_INIT_HOOK(vm_shared_page, &shared_page_init, LK_INIT_LEVEL_VM);
+
+ktl::unique_ptr<VmSharedPageRef> VmSharedPageRef::Share(uint64_t offset, vm_page_t* page,
+                                                        list_node* free_list) {
+    const void* data = paddr_to_physmap(page->paddr());
+    DEBUG_ASSERT(data);
+    return ShareWithHash(offset, page, HashPage(data), free_list);
+}
+
+ktl::unique_ptr<VmSharedPageRef> VmSharedPageRef::ShareWithHash(uint64_t offset, vm_page_t* page,
+                                                                uint64_t hash,
+                                                                list_node* free_list) {
+    DEBUG_ASSERT(page->state == VM_PAGE_STATE_OBJECT);
+    DEBUG_ASSERT(page->object.pin_count == 0);
+
+    const void* data = paddr_to_physmap(page->paddr());
+    DEBUG_ASSERT(data);
+
+    fbl::AllocChecker ac;
+    ktl::unique_ptr<VmSharedPageRef> ref(new (&ac) VmSharedPageRef(offset, nullptr));
+    if (!ac.check()) {
+        return nullptr;
+    }
+
+    Guard<fbl::Mutex> guard{&shared_page_lock};
+
+    size_t compares = 0;
+    for (auto iter = shared_pages.lower_bound({hash, 0});
+         iter.IsValid() && iter->GetKey().hash == hash && compares < kMaxCompares;
+         ++iter, ++compares) {
+        if (memcmp(paddr_to_physmap(iter->page()->paddr()), data, PAGE_SIZE) == 0) {
+            iter->ref_count++;
+            shared_page_refs++;
+            ref->shared_ = &*iter;
+            list_add_tail(free_list, &page->queue_node);
+            kcounter_add(vm_dedup_merged, 1);
+            return ref;
+        }
+    }
+
+    VmSharedPage* shared = new (&ac) VmSharedPage(hash, page);
+    if (!ac.check()) {
+        return nullptr;
+    }
+    shared_pages.insert(shared);
+    shared_page_refs++;
+    ref->shared_ = shared;
+
+    LTRACEF("offset %#" PRIx64 " page %p is now shared\n", offset, page);
+
+    return ref;
+}
+
+void VmSharedPageRef::GetStats(size_t* pages, size_t* references) {
+    Guard<fbl::Mutex> guard{&shared_page_lock};
+    *pages = shared_pages.size();
+    *references = shared_page_refs;
+}
+
+VmSharedPageRef::~VmSharedPageRef() {
+    if (!shared_) {
+        return;
+    }
+
+    vm_page_t* page = nullptr;
+    {
+        Guard<fbl::Mutex> guard{&shared_page_lock};
+        shared_page_refs--;
+        if (--shared_->ref_count == 0) {
+            shared_pages.erase(*shared_);
+            page = shared_->page();
+            delete shared_;
+        }
+    }
+    if (page) {
+        pmm_free_page(page);
+    }
+}
+
+vm_page_t* VmSharedPageRef::TakeIfExclusive() {
+    DEBUG_ASSERT(shared_);
+
+    Guard<fbl::Mutex> guard{&shared_page_lock};
+    if (shared_->ref_count > 1) {
+        kcounter_add(vm_dedup_copied, 1);
+        return nullptr;
+    }
+    shared_pages.erase(*shared_);
+    shared_page_refs--;
+    vm_page_t* page = shared_->page();
+    delete shared_;
+    shared_ = nullptr;
+    return page;
+}
+
+vm_page_t* VmSharedPageRef::page() const {
+    DEBUG_ASSERT(shared_);
+    return shared_->page();
+}
@@ -10,6 +10,7 @@
 #include <assert.h>
 #include <err.h>
 #include <fbl/alloc_checker.h>
+#include <fbl/auto_call.h>
 #include <inttypes.h>
 #include <lib/vdso.h>
 #include <pow2.h>
@@ -250,9 +251,24 @@ zx_status_t VmAddressRegion::CreateVmMapping(size_t mapping_offset, size_t size,
     }
 
     fbl::RefPtr<VmAddressRegionOrMapping> res;
-    zx_status_t status =
-        CreateSubVmarInternal(mapping_offset, size, align_pow2, vmar_flags, ktl::move(vmo),
-                              vmo_offset, arch_mmu_flags, name, &res);
+    zx_status_t status = ZX_ERR_NO_MEMORY;
+#if VM_LARGE_PAGES
+    // When the caller doesn't care where a large mapping goes, line it up with
+    // a large page boundary so that contiguous runs of the object can be mapped
+    // with large pages. Fall back to the requested alignment if there is no
+    // such spot.
+    if (vmo->allows_large_pages() &&
+        !(vmar_flags & (VMAR_FLAG_SPECIFIC | VMAR_FLAG_SPECIFIC_OVERWRITE)) &&
+        size >= VM_LARGE_PAGE_SIZE &&
+        align_pow2 < VM_LARGE_PAGE_SHIFT && IS_ALIGNED(vmo_offset, VM_LARGE_PAGE_SIZE)) {
+        status = CreateSubVmarInternal(mapping_offset, size, VM_LARGE_PAGE_SHIFT, vmar_flags, vmo,
+                                       vmo_offset, arch_mmu_flags, name, &res);
+    }
+#endif
+    if (status == ZX_ERR_NO_MEMORY) {
+        status = CreateSubVmarInternal(mapping_offset, size, align_pow2, vmar_flags,
+                                       ktl::move(vmo), vmo_offset, arch_mmu_flags, name, &res);
+    }
     if (status != ZX_OK) {
         return status;
     }
@@ -299,6 +315,12 @@ zx_status_t VmAddressRegion::DestroyLocked() {
     // The cur reference prevents regions from being destructed after dropping
     // the last reference to them when removing from their parent.
     fbl::RefPtr<VmAddressRegion> cur(this);
+
+    // Shoot down the TLB entries of all of the mappings at once.  Their VMOs
+    // are tied to the batch until then, so they can't free the pages first.
+    aspace_->BeginTlbBatchLocked();
+    auto end_batch = fbl::MakeAutoCall([this]() { aspace_->EndTlbBatchLocked(); });
+
     while (cur) {
         // Iterate through children destroying mappings. If we find a
         // subregion, stop so we can traverse down.
@@ -510,6 +532,23 @@ not_found:
     return true; // not_found: stop search
 }
 
+bool VmAddressRegion::CheckSpotLocked(vaddr_t candidate, vaddr_t align, size_t region_size,
+                                      uint arch_mmu_flags, vaddr_t* pva) {
+    DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
+
+    auto after_iter = subregions_.upper_bound(candidate);
+    auto before_iter = after_iter;
+    if (after_iter == subregions_.begin()) {
+        before_iter = subregions_.end();
+    } else {
+        --before_iter;
+    }
+
+    return CheckGapLocked(before_iter, after_iter, pva, candidate, align, region_size, 0,
+                          arch_mmu_flags) &&
+           *pva != static_cast<vaddr_t>(-1);
+}
+
 zx_status_t VmAddressRegion::AllocSpotLocked(size_t size, uint8_t align_pow2, uint arch_mmu_flags,
                                              vaddr_t* spot) {
     canary_.Assert();
@@ -690,6 +729,11 @@ zx_status_t VmAddressRegion::UnmapInternalLocked(vaddr_t base, size_t size,
         }
     }
 
+    // Shoot down the TLB entries of all of the mappings at once.  Their VMOs
+    // are tied to the batch until then, so they can't free the pages first.
+    aspace_->BeginTlbBatchLocked();
+    auto end_batch = fbl::MakeAutoCall([this]() { aspace_->EndTlbBatchLocked(); });
+
     bool at_top = true;
     for (auto itr = begin; itr != end;) {
         // Create a copy of the iterator, in case we destroy this element
@@ -822,6 +866,9 @@ zx_status_t VmAddressRegion::Protect(vaddr_t base, size_t size, uint new_arch_mm
         return ZX_ERR_NOT_FOUND;
     }
 
+    aspace_->BeginTlbBatchLocked();
+    auto end_batch = fbl::MakeAutoCall([this]() { aspace_->EndTlbBatchLocked(); });
+
     for (auto itr = begin; itr != end;) {
         DEBUG_ASSERT(itr->is_mapping());
 
@@ -847,12 +894,78 @@ zx_status_t VmAddressRegion::Protect(vaddr_t base, size_t size, uint new_arch_mm
     return ZX_OK;
 }
 
+template <typename F>
+void VmAddressRegion::ForEachGap(F func, uint8_t align_pow2, size_t min_gap_size,
+                                 vaddr_t search_base) {
+    const vaddr_t align = 1UL << align_pow2;
+
+    if (!ForEachGapInSubtree(subregions_.root(), base_, func, align, min_gap_size,
+                             search_base)) {
+        return;
+    }
+
+    // Grab the gap to the right of the last region (note that if there are no
+    // regions, this handles reporting the VMAR's whole span as a gap).
+    const vaddr_t prev_region_end = ROUNDUP(subregions_.is_empty()
+                                                ? base_
+                                                : subregions_.root()->subtree_end_,
+                                            align);
+    const vaddr_t end = base_ + size_;
+    if (end > prev_region_end) {
+        const size_t gap = end - prev_region_end;
+        func(prev_region_end, gap);
+    }
+}
+
+template <typename F>
+bool VmAddressRegion::ForEachGapInSubtree(ChildList::iterator node, vaddr_t prev_end, F& func,
+                                          vaddr_t align, size_t min_gap_size,
+                                          vaddr_t search_base) {
+    // Walk the subtree in address order, but skip any part of it which cannot
+    // contain a gap of at least |min_gap_size| or lies below |search_base|, so
+    // that finding a gap that fits costs O(log n) rather than a scan of every
+    // region.
+    while (node.IsValid()) {
+        if (node->subtree_end_ <= search_base) {
+            return true;
+        }
+        if (node->subtree_max_gap_ < min_gap_size &&
+            node->subtree_base_ - prev_end < min_gap_size) {
+            return true;
+        }
+
+        // Every gap to the left of this region ends at or below its base.
+        if (node->base() > search_base) {
+            auto left = node.left();
+            if (left.IsValid()) {
+                if (!ForEachGapInSubtree(left, prev_end, func, align, min_gap_size,
+                                         search_base)) {
+                    return false;
+                }
+                prev_end = left->subtree_end_;
+            }
+
+            // Report the gap to the left of this region.  We round up the end of
+            // the previous region to the requested alignment, so all gaps reported
+            // will be for aligned ranges.
+            const vaddr_t gap_base = ROUNDUP(prev_end, align);
+            if (node->base() > gap_base && node->base() - prev_end >= min_gap_size) {
+                if (!func(gap_base, node->base() - gap_base)) {
+                    return false;
+                }
+            }
+        }
+
+        prev_end = node->base() + node->size();
+        node = node.right();
+    }
+    return true;
+}
+
 zx_status_t VmAddressRegion::LinearRegionAllocatorLocked(size_t size, uint8_t align_pow2,
                                                          uint arch_mmu_flags, vaddr_t* spot) {
     DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
 
-    const vaddr_t base = 0;
-
     if (align_pow2 < PAGE_SIZE_SHIFT) {
         align_pow2 = PAGE_SIZE_SHIFT;
     }
@@ -860,49 +973,99 @@ zx_status_t VmAddressRegion::LinearRegionAllocatorLocked(size_t size, uint8_t al
 
     // Find the first gap in the address space which can contain a region of the
     // requested size.
-    auto before_iter = subregions_.end();
-    auto after_iter = subregions_.begin();
+    zx_status_t status = ZX_ERR_NO_MEMORY;
+    ForEachGap([this, align, size, arch_mmu_flags, spot, &status](vaddr_t gap_base,
+                                                                  size_t gap_len) -> bool {
+        if (gap_len < size) {
+            return true;
+        }
 
-    do {
-        if (CheckGapLocked(before_iter, after_iter, spot, base, align, size, 0, arch_mmu_flags)) {
+        auto after_iter = subregions_.upper_bound(gap_base);
+        auto before_iter = after_iter;
+        if (after_iter == subregions_.begin()) {
+            before_iter = subregions_.end();
+        } else {
+            --before_iter;
+        }
+
+        if (CheckGapLocked(before_iter, after_iter, spot, gap_base, align, size, 0,
+                           arch_mmu_flags)) {
             if (*spot != static_cast<vaddr_t>(-1)) {
-                return ZX_OK;
-            } else {
-                return ZX_ERR_NO_MEMORY;
+                status = ZX_OK;
             }
+            return false;
         }
+        return true;
+    },
+               align_pow2, size);
 
-        before_iter = after_iter++;
-    } while (before_iter.IsValid());
+    return status;
+}
 
-    // couldn't find anything
-    return ZX_ERR_NO_MEMORY;
+size_t VmAddressRegion::FreeBytesLocked() {
+    DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
+
+    if (subregions_.is_empty()) {
+        return size_;
+    }
+    auto root = subregions_.root();
+    return size_ - (root->subtree_end_ - root->subtree_base_) + root->subtree_gap_bytes_;
 }
 
-template <typename F>
-void VmAddressRegion::ForEachGap(F func, uint8_t align_pow2) {
-    const vaddr_t align = 1UL << align_pow2;
+vaddr_t VmAddressRegion::FreeByteAtRankLocked(size_t rank, vaddr_t* gap_base, vaddr_t* gap_end) {
+    DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
+    DEBUG_ASSERT(rank < FreeBytesLocked());
 
-    // Scan the regions list to find the gap to the left of each region.  We
-    // round up the end of the previous region to the requested alignment, so
-    // all gaps reported will be for aligned ranges.
-    vaddr_t prev_region_end = ROUNDUP(base_, align);
-    for (const auto& region : subregions_) {
-        if (region.base() > prev_region_end) {
-            const size_t gap = region.base() - prev_region_end;
-            if (!func(prev_region_end, gap)) {
-                return;
+    if (subregions_.is_empty()) {
+        *gap_base = base_;
+        *gap_end = base_ + size_;
+        return base_ + rank;
+    }
+
+    // the gaps before the first child and after the last one
+    auto node = subregions_.root();
+    if (rank < node->subtree_base_ - base_) {
+        *gap_base = base_;
+        *gap_end = node->subtree_base_;
+        return base_ + rank;
+    }
+    rank -= node->subtree_base_ - base_;
+    if (rank >= node->subtree_gap_bytes_) {
+        *gap_base = node->subtree_end_;
+        *gap_end = base_ + size_;
+        return *gap_base + (rank - node->subtree_gap_bytes_);
+    }
+
+    // Descend to the gap holding the byte, where |rank| counts up from the
+    // first gap inside |node|'s subtree.
+    for (;;) {
+        auto left = node.left();
+        if (left.IsValid()) {
+            if (rank < left->subtree_gap_bytes_) {
+                node = left;
+                continue;
             }
+            rank -= left->subtree_gap_bytes_;
+            const size_t gap = node->base() - left->subtree_end_;
+            if (rank < gap) {
+                *gap_base = left->subtree_end_;
+                *gap_end = node->base();
+                return *gap_base + rank;
+            }
+            rank -= gap;
         }
-        prev_region_end = ROUNDUP(region.base() + region.size(), align);
-    }
 
-    // Grab the gap to the right of the last region (note that if there are no
-    // regions, this handles reporting the VMAR's whole span as a gap).
-    const vaddr_t end = base_ + size_;
-    if (end > prev_region_end) {
-        const size_t gap = end - prev_region_end;
-        func(prev_region_end, gap);
+        auto right = node.right();
+        DEBUG_ASSERT(right.IsValid());
+        const vaddr_t end = node->base() + node->size();
+        const size_t gap = right->subtree_base_ - end;
+        if (rank < gap) {
+            *gap_base = end;
+            *gap_end = right->subtree_base_;
+            return end + rank;
+        }
+        rank -= gap;
+        node = right;
     }
 }
 
@@ -914,6 +1077,10 @@ constexpr size_t AllocationSpotsInRange(size_t range_size, size_t alloc_size, ui
     return ((range_size - alloc_size) >> align_pow2) + 1;
 }
 
+// Number of random free pages the non-compact allocator tries before settling
+// for the next gap that fits.
+constexpr uint kRandomSpotAttempts = 8;
+
 } // namespace {}
 
 // Perform allocations for VMARs that aren't using the COMPACT policy.  This
@@ -928,63 +1095,54 @@ zx_status_t VmAddressRegion::NonCompactRandomizedRegionAllocatorLocked(size_t si
     align_pow2 = fbl::max(align_pow2, static_cast<uint8_t>(PAGE_SIZE_SHIFT));
     const vaddr_t align = 1UL << align_pow2;
 
-    // Calculate the number of spaces that we can fit this allocation in.
-    size_t candidate_spaces = 0;
-    ForEachGap([align, align_pow2, size, &candidate_spaces](vaddr_t gap_base, size_t gap_len) -> bool {
-        DEBUG_ASSERT(IS_ALIGNED(gap_base, align));
-        if (gap_len >= size) {
-            candidate_spaces += AllocationSpotsInRange(gap_len, size, align_pow2);
-        }
-        return true;
-    },
-               align_pow2);
-
-    if (candidate_spaces == 0) {
+    const size_t free_bytes = FreeBytesLocked();
+    if (free_bytes < size) {
         return ZX_ERR_NO_MEMORY;
     }
 
-    // Choose the index of the allocation to use.
-    size_t selected_index = aspace_->AslrPrng().RandInt(candidate_spaces);
-    DEBUG_ASSERT(selected_index < candidate_spaces);
+    // Choose a free page uniformly at random, by rank in the augmented tree,
+    // and try the aligned position at or below it.  Each position that fits
+    // is reached from exactly the pages in its first min(size, align) bytes,
+    // so all of them are equally likely.
+    vaddr_t sample = base_;
+    for (uint i = 0; i < kRandomSpotAttempts; ++i) {
+        const size_t rank = aspace_->AslrPrng().RandInt(free_bytes >> PAGE_SIZE_SHIFT)
+                            << PAGE_SIZE_SHIFT;
+        vaddr_t gap_base, gap_end;
+        sample = FreeByteAtRankLocked(rank, &gap_base, &gap_end);
+        const vaddr_t candidate = ROUNDDOWN(sample, align);
+        if (candidate < gap_base || sample - candidate >= size || gap_end - candidate < size) {
+            continue;
+        }
+        if (CheckSpotLocked(candidate, align, size, arch_mmu_flags, spot)) {
+            return ZX_OK;
+        }
+    }
 
-    // Find which allocation we picked.
-    vaddr_t alloc_spot = static_cast<vaddr_t>(-1);
-    ForEachGap([align_pow2, size, &alloc_spot, &selected_index](vaddr_t gap_base,
-                                                                size_t gap_len) -> bool {
+    // Most of the free space is in gaps too small for the request.  Rather
+    // than count every position that fits, take a random one in the first gap
+    // at or after the last sample that has room, wrapping around to the bottom
+    // of the region.
+    zx_status_t status = ZX_ERR_NO_MEMORY;
+    auto pick = [this, align, align_pow2, size, arch_mmu_flags, spot,
+                 &status](vaddr_t gap_base, size_t gap_len) -> bool {
         if (gap_len < size) {
             return true;
         }
-
         const size_t spots = AllocationSpotsInRange(gap_len, size, align_pow2);
-        if (selected_index < spots) {
-            alloc_spot = gap_base + (selected_index << align_pow2);
+        const vaddr_t candidate = gap_base + (aspace_->AslrPrng().RandInt(spots) << align_pow2);
+        if (CheckSpotLocked(candidate, align, size, arch_mmu_flags, spot) ||
+            CheckSpotLocked(gap_base, align, size, arch_mmu_flags, spot)) {
+            status = ZX_OK;
             return false;
         }
-        selected_index -= spots;
         return true;
-    },
-               align_pow2);
-    ASSERT(alloc_spot != static_cast<vaddr_t>(-1));
-    ASSERT(IS_ALIGNED(alloc_spot, align));
-
-    // Sanity check that the allocation fits.
-    auto after_iter = subregions_.upper_bound(alloc_spot + size - 1);
-    auto before_iter = after_iter;
-
-    if (after_iter == subregions_.begin() || subregions_.size() == 0) {
-        before_iter = subregions_.end();
-    } else {
-        --before_iter;
-    }
-
-    ASSERT(before_iter == subregions_.end() || before_iter.IsValid());
-
-    if (CheckGapLocked(before_iter, after_iter, spot, alloc_spot, align, size, 0,
-                       arch_mmu_flags) &&
-        *spot != static_cast<vaddr_t>(-1)) {
-        return ZX_OK;
+    };
+    ForEachGap(pick, align_pow2, size, sample);
+    if (status != ZX_OK) {
+        ForEachGap(pick, align_pow2, size);
     }
-    panic("Unexpected allocation failure\n");
+    return status;
 }
 
 // The COMPACT allocator begins by picking a random offset in the region to
@@ -9,6 +9,7 @@
 #include "vm_priv.h"
 #include <assert.h>
 #include <err.h>
+#include <fbl/algorithm.h>
 #include <fbl/auto_call.h>
 #include <inttypes.h>
 #include <string.h>
@@ -90,3 +91,25 @@ size_t VmAddressRegionOrMapping::AllocatedPages() const {
     }
     return AllocatedPagesLocked();
 }
+
+void VmAddressRegionOrMapping::SubtreeObserver::RecordSubtreeChange(
+    VmAddressRegionOrMapping* node, VmAddressRegionOrMapping* left,
+    VmAddressRegionOrMapping* right) {
+    const vaddr_t end = node->base_ + node->size_;
+
+    node->subtree_base_ = left ? left->subtree_base_ : node->base_;
+    node->subtree_end_ = right ? right->subtree_end_ : end;
+    node->subtree_max_gap_ = 0;
+    node->subtree_gap_bytes_ = 0;
+    if (left) {
+        const size_t gap = node->base_ - left->subtree_end_;
+        node->subtree_max_gap_ = fbl::max(left->subtree_max_gap_, gap);
+        node->subtree_gap_bytes_ = left->subtree_gap_bytes_ + gap;
+    }
+    if (right) {
+        const size_t gap = right->subtree_base_ - end;
+        node->subtree_max_gap_ = fbl::max(node->subtree_max_gap_,
+                                          fbl::max(right->subtree_max_gap_, gap));
+        node->subtree_gap_bytes_ += right->subtree_gap_bytes_ + gap;
+    }
+}
@@ -251,6 +251,52 @@ fbl::RefPtr<VmAddressRegion> VmAspace::RootVmar() {
     return ktl::move(ref);
 }
 
+void VmAspace::BeginTlbBatchLocked() {
+    DEBUG_ASSERT(lock_.lock().IsHeld());
+
+    if (tlb_batch_depth_++ == 0) {
+        arch_aspace_.BeginTlbBatch();
+    }
+}
+
+void VmAspace::EndTlbBatchLocked() {
+    DEBUG_ASSERT(lock_.lock().IsHeld());
+    DEBUG_ASSERT(tlb_batch_depth_ > 0);
+
+    if (--tlb_batch_depth_ == 0) {
+        arch_aspace_.EndTlbBatch();
+
+        // The translations are gone, so the VMOs may free the pages now.
+        while (!tlb_batch_objects_.is_empty()) {
+            fbl::unique_ptr<VmTlbBatchRef> ref = tlb_batch_objects_.pop_front();
+            Guard<fbl::Mutex> guard{ref->object()->lock()};
+            ref->object()->RemoveTlbBatchLocked(ref.get());
+            guard.Release();
+            // may drop the last reference to the VMO
+            ref.reset();
+        }
+    }
+}
+
+void VmAspace::AddTlbBatchObjectLocked(const fbl::RefPtr<VmObject>& vmo) {
+    DEBUG_ASSERT(lock_.lock().IsHeld());
+    DEBUG_ASSERT(vmo->lock()->lock().IsHeld());
+
+    if (tlb_batch_depth_ == 0 || vmo->HasTlbBatchLocked(this)) {
+        return;
+    }
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<VmTlbBatchRef> ref(new (&ac) VmTlbBatchRef(this, vmo));
+    if (!ac.check()) {
+        // Issue what has been batched so far instead.
+        arch_aspace_.FlushTlbBatch();
+        return;
+    }
+    vmo->AddTlbBatchLocked(ref.get());
+    tlb_batch_objects_.push_front(ktl::move(ref));
+}
+
 zx_status_t VmAspace::Destroy() {
     canary_.Assert();
     LTRACEF("%p '%s'\n", this, name_);
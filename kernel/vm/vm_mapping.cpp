@@ -13,6 +13,9 @@
 #include <fbl/auto_call.h>
 #include <ktl/move.h>
 #include <inttypes.h>
+#include <kernel/cmdline.h>
+#include <lib/counters.h>
+#include <lk/init.h>
 #include <trace.h>
 #include <vm/fault.h>
 #include <vm/vm.h>
@@ -22,6 +25,39 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+// Number of page faults handled by VmMappings.
+KCOUNTER(vm_mapping_page_faults, "kernel.vm.fault.count");
+
+// Number of page faults that also mapped some neighboring pages.
+KCOUNTER(vm_mapping_fault_around, "kernel.vm.fault.around.count");
+
+// Number of neighboring pages mapped by fault-around, each of which would
+// otherwise have taken a fault of its own when touched.
+KCOUNTER(vm_mapping_fault_around_pages, "kernel.vm.fault.around.pages");
+
+// Number of page faults that were satisfied by mapping a whole large page.
+KCOUNTER(vm_mapping_fault_large_page, "kernel.vm.fault.large_page");
+
+namespace {
+
+// Upper bound on the fault-around window, which also sizes the stack buffer
+// used to batch the mappings.
+constexpr uint32_t kMaxFaultAroundPages = 64;
+constexpr uint32_t kDefaultFaultAroundPages = 16;
+
+// Size of the aligned window of pages, including the faulting page, that is
+// checked for resident pages on a fault. 1 disables fault-around.
+uint32_t fault_around_pages = kDefaultFaultAroundPages;
+
+void fault_around_init(uint level) {
+    uint32_t pages = cmdline_get_uint32("kernel.vm.fault-around-pages", kDefaultFaultAroundPages);
+    fault_around_pages = fbl::clamp<uint32_t>(pages, 1, kMaxFaultAroundPages);
+}
+
+} // namespace
+
+LK_INIT_HOOK(vm_fault_around, &fault_around_init, LK_INIT_LEVEL_VM);
+
 VmMapping::VmMapping(VmAddressRegion& parent, vaddr_t base, size_t size, uint32_t vmar_flags,
                      fbl::RefPtr<VmObject> vmo, uint64_t vmo_offset, uint arch_mmu_flags)
     : VmAddressRegionOrMapping(base, size, vmar_flags,
@@ -159,7 +195,7 @@ zx_status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mm
         LTRACEF("arch_mmu_protect returns %d\n", status);
         arch_mmu_flags_ = new_arch_mmu_flags;
 
-        size_ = size;
+        SetBaseAndSizeLocked(base_, size);
         mapping->ActivateLocked();
         return ZX_OK;
     }
@@ -180,7 +216,7 @@ zx_status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mm
         zx_status_t status = ProtectOrUnmap(aspace_, base, size, new_arch_mmu_flags);
         LTRACEF("arch_mmu_protect returns %d\n", status);
 
-        size_ -= size;
+        SetBaseAndSizeLocked(base_, size_ - size);
         mapping->ActivateLocked();
         return ZX_OK;
     }
@@ -209,7 +245,7 @@ zx_status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mm
     LTRACEF("arch_mmu_protect returns %d\n", status);
 
     // Turn us into the left half
-    size_ = left_size;
+    SetBaseAndSizeLocked(base_, left_size);
 
     center_mapping->ActivateLocked();
     right_mapping->ActivateLocked();
@@ -276,15 +312,19 @@ zx_status_t VmMapping::UnmapLocked(vaddr_t base, size_t size) {
             return status;
         }
 
-        if (base_ == base && size_ != size) {
-            // We need to remove ourselves from tree before updating base_,
-            // since base_ is the tree key.
-            fbl::RefPtr<VmAddressRegionOrMapping> ref(parent_->subregions_.erase(*this));
-            base_ += size;
+        // Once the range leaves our mapping, the VMO won't call back into us
+        // before freeing its pages, so have it flush the TLB batch instead.
+        aspace_->AddTlbBatchObjectLocked(object_);
+
+        if (size_ == size) {
+            // DestroyLocked() is about to remove us from the parent.
+            size_ = 0;
+        } else if (base_ == base) {
             object_offset_ += size;
-            parent_->subregions_.insert(ktl::move(ref));
+            SetBaseAndSizeLocked(base_ + size, size_ - size);
+        } else {
+            SetBaseAndSizeLocked(base_, size_ - size);
         }
-        size_ -= size;
 
         return ZX_OK;
     }
@@ -310,13 +350,24 @@ zx_status_t VmMapping::UnmapLocked(vaddr_t base, size_t size) {
     if (status != ZX_OK) {
         return status;
     }
+    aspace_->AddTlbBatchObjectLocked(object_);
 
     // Turn us into the left half
-    size_ = base - base_;
+    SetBaseAndSizeLocked(base_, base - base_);
     mapping->ActivateLocked();
     return ZX_OK;
 }
 
+void VmMapping::SetBaseAndSizeLocked(vaddr_t base, size_t size) {
+    DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
+    DEBUG_ASSERT(parent_);
+
+    fbl::RefPtr<VmAddressRegionOrMapping> ref(parent_->subregions_.erase(*this));
+    base_ = base;
+    size_ = size;
+    parent_->subregions_.insert(ktl::move(ref));
+}
+
 zx_status_t VmMapping::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) const {
     canary_.Assert();
 
@@ -548,6 +599,29 @@ zx_status_t VmMapping::DecommitRange(size_t offset, size_t len) {
     return object_->DecommitRange(object_offset_ + offset, len);
 }
 
+zx_status_t VmMapping::ReplacePages(vaddr_t va, list_node* pages) {
+    canary_.Assert();
+    const size_t len = list_length(pages) * PAGE_SIZE;
+    LTRACEF("%p va %#" PRIxPTR ", len %#zx\n", this, va, len);
+
+    Guard<fbl::Mutex> guard{aspace_->lock()};
+    if (state_ != LifeCycleState::ALIVE) {
+        return ZX_ERR_BAD_STATE;
+    }
+    // The mapping may have moved or shrunk since the caller looked it up.
+    if (va < base_) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+    const size_t offset = va - base_;
+    if (offset + len < offset || offset + len > size_) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+    if (!(arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_WRITE)) {
+        return ZX_ERR_ACCESS_DENIED;
+    }
+    return object_->ReplacePages(object_offset_ + offset, pages);
+}
+
 zx_status_t VmMapping::DestroyLocked() {
     canary_.Assert();
     DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
@@ -603,6 +677,8 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags, PageRequest* p
 
     DEBUG_ASSERT(va >= base_ && va <= base_ + size_ - 1);
 
+    kcounter_add(vm_mapping_page_faults, 1);
+
     va = ROUNDDOWN(va, PAGE_SIZE);
     uint64_t vmo_offset = va - base_ + object_offset_;
 
@@ -644,6 +720,13 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags, PageRequest* p
     currently_faulting_ = true;
     auto ac = fbl::MakeAutoCall([&]() { currently_faulting_ = false; });
 
+#if VM_LARGE_PAGES
+    if (!(pf_flags & VMM_PF_FLAG_GUEST) && object_->allows_large_pages() &&
+        MapLargePageLocked(va, pf_flags)) {
+        return ZX_OK;
+    }
+#endif
+
     // fault in or grab an existing page
     paddr_t new_pa;
     vm_page_t* page;
@@ -732,6 +815,10 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags, PageRequest* p
             return ZX_ERR_NO_MEMORY;
         }
         DEBUG_ASSERT(mapped == 1);
+
+        if (!(pf_flags & VMM_PF_FLAG_GUEST)) {
+            FaultAroundLocked(va, mmu_flags);
+        }
     }
 
 // TODO: figure out what to do with this
@@ -745,6 +832,139 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags, PageRequest* p
     return ZX_OK;
 }
 
+void VmMapping::FaultAroundLocked(vaddr_t va, uint mmu_flags) {
+    const uint32_t window = fault_around_pages;
+    if (window <= 1 || !object_->is_paged()) {
+        return;
+    }
+
+    // Use the window-aligned (relative to the start of the mapping) block of
+    // pages containing |va|, clipped to the mapping.
+    const size_t window_size = window * PAGE_SIZE;
+    const vaddr_t start = va - (va - base_) % window_size;
+    const vaddr_t end = start + fbl::min(window_size, base_ + size_ - start);
+
+    // Neighbors are always mapped read-only. They may belong to a parent
+    // object and need a copy-on-write fault before they can be written, and
+    // for pages the object owns a write just upgrades the mapping in place.
+    mmu_flags &= ~ARCH_MMU_FLAG_PERM_WRITE;
+
+    // Batch up runs of consecutive resident, unmapped pages.
+    paddr_t run_pa[kMaxFaultAroundPages];
+    vaddr_t run_va = 0;
+    size_t run_len = 0;
+    size_t total_mapped = 0;
+    auto flush_run = [&]() {
+        if (run_len == 0) {
+            return;
+        }
+        size_t mapped = 0;
+        zx_status_t status = aspace_->arch_aspace().Map(run_va, run_pa, run_len, mmu_flags,
+                                                        &mapped);
+        if (status != ZX_OK) {
+            // not fatal, the pages will just be faulted in individually
+            LTRACEF("failed to map fault-around run at %#" PRIxPTR ": %d\n", run_va, status);
+        }
+#if ARCH_ARM64
+        if (mapped > 0 && (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE)) {
+            arch_sync_cache_range(run_va, mapped * PAGE_SIZE);
+        }
+#endif
+        total_mapped += mapped;
+        run_len = 0;
+    };
+
+    for (vaddr_t addr = start; addr < end; addr += PAGE_SIZE) {
+        if (addr == va) {
+            flush_run();
+            continue;
+        }
+
+        // skip anything that is already mapped
+        paddr_t pa;
+        uint page_flags;
+        if (aspace_->arch_aspace().Query(addr, &pa, &page_flags) == ZX_OK) {
+            flush_run();
+            continue;
+        }
+
+        // with no fault flags this only finds pages that are already present
+        // in the object or its parents, and never allocates or asks a pager.
+        // The pages haven't been touched, so leave them unreferenced for
+        // reclaim to age them like any other.
+        if (object_->GetPageLocked(addr - base_ + object_offset_, VMM_PF_FLAG_NO_REFERENCE,
+                                   nullptr, nullptr, nullptr, &pa) != ZX_OK) {
+            flush_run();
+            continue;
+        }
+
+        if (run_len == 0) {
+            run_va = addr;
+        }
+        run_pa[run_len++] = pa;
+    }
+    flush_run();
+
+    if (total_mapped > 0) {
+        kcounter_add(vm_mapping_fault_around, 1);
+        kcounter_add(vm_mapping_fault_around_pages, total_mapped);
+    }
+}
+
+bool VmMapping::MapLargePageLocked(vaddr_t va, uint pf_flags) {
+    const vaddr_t start = ROUNDDOWN(va, VM_LARGE_PAGE_SIZE);
+    if (size_ < VM_LARGE_PAGE_SIZE || start < base_ ||
+        start - base_ > size_ - VM_LARGE_PAGE_SIZE) {
+        return false;
+    }
+
+    // Only pages the object owns qualify, so there is no parent page that a
+    // write would have to copy first.
+    paddr_t pa;
+    if (object_->LookupContiguousLocked(start - base_ + object_offset_, VM_LARGE_PAGE_SIZE,
+                                        &pa) != ZX_OK ||
+        !IS_ALIGNED(pa, VM_LARGE_PAGE_SIZE)) {
+        return false;
+    }
+
+    // as for a single page, a read fault maps the block without write permissions
+    uint mmu_flags = arch_mmu_flags_;
+    if (!(pf_flags & VMM_PF_FLAG_WRITE)) {
+        mmu_flags &= ~ARCH_MMU_FLAG_PERM_WRITE;
+    }
+
+    // another thread may have just mapped the block
+    paddr_t cur_pa;
+    uint cur_flags;
+    if (aspace_->arch_aspace().Query(va, &cur_pa, &cur_flags) == ZX_OK &&
+        cur_pa == pa + (va - start) &&
+        (cur_flags == arch_mmu_flags_ || cur_flags == mmu_flags)) {
+        return true;
+    }
+
+    // Drop whatever is already mapped in the block, e.g. base pages from
+    // fault-around or the block itself read-only, so the arch layer can install
+    // a large page with the new permissions in its place.
+    zx_status_t status = aspace_->arch_aspace().Unmap(start, VM_LARGE_PAGE_SIZE / PAGE_SIZE,
+                                                      nullptr);
+    if (status != ZX_OK) {
+        return false;
+    }
+
+    size_t mapped;
+    status = aspace_->arch_aspace().MapContiguous(start, pa, VM_LARGE_PAGE_SIZE / PAGE_SIZE,
+                                                  mmu_flags, &mapped);
+    if (status != ZX_OK) {
+        // not fatal, the faulting page gets mapped on its own
+        LTRACEF("failed to map large page at %#" PRIxPTR ": %d\n", start, status);
+        return false;
+    }
+    DEBUG_ASSERT(mapped == VM_LARGE_PAGE_SIZE / PAGE_SIZE);
+
+    kcounter_add(vm_mapping_fault_large_page, 1);
+    return true;
+}
+
 // We disable thread safety analysis here because one of the common uses of this
 // function is for splitting one mapping object into several that will be backed
 // by the same VmObject.  In that case, object_->lock() gets aliased across all
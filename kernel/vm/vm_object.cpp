@@ -22,6 +22,7 @@
 
 #include <vm/vm.h>
 #include <vm/vm_address_region.h>
+#include <vm/vm_aspace.h>
 
 #include <zircon/types.h>
 
@@ -63,6 +64,7 @@ VmObject::~VmObject() {
 
     DEBUG_ASSERT(mapping_list_.is_empty());
     DEBUG_ASSERT(children_list_.is_empty());
+    DEBUG_ASSERT(tlb_batch_list_.is_empty());
 
     // Remove ourself from the global VMO list.
     {
@@ -131,6 +133,29 @@ void VmObject::RemoveMappingLocked(VmMapping* r) {
     mapping_list_len_--;
 }
 
+void VmObject::AddTlbBatchLocked(VmTlbBatchRef* r) {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.lock().IsHeld());
+    tlb_batch_list_.push_front(r);
+}
+
+void VmObject::RemoveTlbBatchLocked(VmTlbBatchRef* r) {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.lock().IsHeld());
+    tlb_batch_list_.erase(*r);
+}
+
+bool VmObject::HasTlbBatchLocked(const VmAspace* aspace) const {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.lock().IsHeld());
+    for (const auto& r : tlb_batch_list_) {
+        if (r.aspace() == aspace) {
+            return true;
+        }
+    }
+    return false;
+}
+
 uint32_t VmObject::num_mappings() const {
     canary_.Assert();
     Guard<fbl::Mutex> guard{&lock_};
@@ -243,12 +268,24 @@ void VmObject::RangeChangeUpdateLocked(uint64_t offset, uint64_t len) {
         m.UnmapVmoRangeLocked(aligned_offset, aligned_len);
     }
 
+    // mappings that already left us may still be cached by the TLB
+    FlushTlbBatchesLocked();
+
     // inform all our children this as well, so they can inform their mappings
     for (auto& child : children_list_) {
         child.RangeChangeUpdateFromParentLocked(offset, len);
     }
 }
 
+void VmObject::FlushTlbBatchesLocked() {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.lock().IsHeld());
+
+    for (auto& r : tlb_batch_list_) {
+        r.aspace()->arch_aspace().FlushTlbBatch();
+    }
+}
+
 static int cmd_vm_object(int argc, const cmd_args* argv, uint32_t flags) {
     if (argc < 2) {
     notenoughargs:
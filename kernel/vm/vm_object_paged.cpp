@@ -16,6 +16,7 @@
 #include <inttypes.h>
 #include <ktl/move.h>
 #include <lib/console.h>
+#include <lib/counters.h>
 #include <stdlib.h>
 #include <string.h>
 #include <trace.h>
@@ -28,6 +29,18 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+// Number of large page sized chunks that CommitRange() managed to back with
+// physically contiguous, large page aligned memory.
+KCOUNTER(vm_commit_large_pages, "kernel.vm.commit.large_page");
+
+// Resident pages that the page reclaimer looked at, and the clean,
+// unreferenced pages of pager-backed objects among them that it evicted.
+KCOUNTER(vm_reclaim_scanned, "kernel.vm.reclaim.scanned");
+KCOUNTER(vm_reclaim_evicted, "kernel.vm.reclaim.evicted");
+
+// Zero-filled pages that deduplication freed instead of sharing.
+KCOUNTER(vm_dedup_zero, "kernel.vm.dedup.zero");
+
 namespace {
 
 void ZeroPage(paddr_t pa) {
@@ -46,6 +59,39 @@ void InitializeVmPage(vm_page_t* p) {
     DEBUG_ASSERT(p->state == VM_PAGE_STATE_ALLOC);
     p->state = VM_PAGE_STATE_OBJECT;
     p->object.pin_count = 0;
+    p->object.referenced = 0;
+    p->object.dirty = 0;
+}
+
+// Counts the entries of a tree keyed by page offset that lie in [start, end).
+template <typename Tree>
+size_t CountInRange(const Tree& tree, uint64_t start, uint64_t end) {
+    size_t count = 0;
+    for (auto iter = tree.lower_bound(start); iter.IsValid() && iter->GetKey() < end; ++iter) {
+        count++;
+    }
+    return count;
+}
+
+// Erases the entries of a tree keyed by page offset that lie in [start, end).
+template <typename Tree>
+void EraseInRange(Tree& tree, uint64_t start, uint64_t end) {
+    auto iter = tree.lower_bound(start);
+    while (iter.IsValid() && iter->GetKey() < end) {
+        tree.erase(iter++);
+    }
+}
+
+// Returns true if the page at |pa| is filled with zeros.
+bool IsZeroPage(paddr_t pa) {
+    const uint64_t* words = static_cast<const uint64_t*>(paddr_to_physmap(pa));
+    DEBUG_ASSERT(words);
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(uint64_t); i++) {
+        if (words[i] != 0) {
+            return false;
+        }
+    }
+    return true;
 }
 
 // round up the size to the next page size boundary and make sure we dont wrap
@@ -65,6 +111,8 @@ zx_status_t RoundSize(uint64_t size, uint64_t* out_size) {
 
 } // namespace
 
+VmObjectPaged::ReclaimList VmObjectPaged::reclaim_list_ = {};
+
 VmObjectPaged::VmObjectPaged(
     uint32_t options, uint32_t pmm_alloc_flags, uint64_t size,
     fbl::RefPtr<VmObject> parent, fbl::RefPtr<PageSource> page_source)
@@ -84,6 +132,16 @@ VmObjectPaged::~VmObjectPaged() {
 
     LTRACEF("%p\n", this);
 
+    {
+        // ReclaimColdPages briefly takes objects off the list to rotate it, so
+        // membership can only be trusted under the lock. Taking it here also
+        // orders our destruction against its ref upgrade.
+        Guard<fbl::Mutex> guard{ReclaimListLock::Get()};
+        if (reclaim_list_state_.InContainer()) {
+            reclaim_list_.erase(*this);
+        }
+    }
+
     page_list_.ForEveryPage(
         [this](const auto p, uint64_t off) {
             if (this->is_contiguous()) {
@@ -95,6 +153,8 @@ VmObjectPaged::~VmObjectPaged() {
 
     // free all of the pages attached to us
     page_list_.FreeAllPages();
+    compressed_pages_.clear();
+    shared_pages_.clear();
 
     if (page_source_) {
         page_source_->Close();
@@ -116,12 +176,16 @@ zx_status_t VmObjectPaged::Create(uint32_t pmm_alloc_flags,
     }
 
     fbl::AllocChecker ac;
-    auto vmo = fbl::AdoptRef<VmObject>(
+    auto vmo = fbl::AdoptRef<VmObjectPaged>(
         new (&ac) VmObjectPaged(options, pmm_alloc_flags, size, nullptr, nullptr));
     if (!ac.check()) {
         return ZX_ERR_NO_MEMORY;
     }
 
+    if (options & kCompressible) {
+        vmo->AddToReclaimList();
+    }
+
     *obj = ktl::move(vmo);
 
     return ZX_OK;
@@ -253,12 +317,14 @@ zx_status_t VmObjectPaged::CreateExternal(fbl::RefPtr<PageSource> src,
     }
 
     fbl::AllocChecker ac;
-    auto vmo = fbl::AdoptRef<VmObject>(new (&ac) VmObjectPaged(
+    auto vmo = fbl::AdoptRef<VmObjectPaged>(new (&ac) VmObjectPaged(
             kResizable, PMM_ALLOC_FLAG_ANY, size, nullptr, ktl::move(src)));
     if (!ac.check()) {
         return ZX_ERR_NO_MEMORY;
     }
 
+    vmo->AddToReclaimList();
+
     *obj = ktl::move(vmo);
 
     return ZX_OK;
@@ -276,7 +342,8 @@ zx_status_t VmObjectPaged::CloneCOW(bool resizable, uint64_t offset, uint64_t si
         return status;
     }
 
-    auto options = resizable ? kResizable : 0u;
+    // the clone's own pages are anonymous, so they can be compressed if ours can
+    auto options = (resizable ? kResizable : 0u) | (options_ & kCompressible);
 
     // allocate the clone up front outside of our lock
     fbl::AllocChecker ac;
@@ -286,6 +353,10 @@ zx_status_t VmObjectPaged::CloneCOW(bool resizable, uint64_t offset, uint64_t si
         return ZX_ERR_NO_MEMORY;
     }
 
+    if (options & kCompressible) {
+        vmo->AddToReclaimList();
+    }
+
     Guard<fbl::Mutex> guard{&lock_};
 
     // add the new VMO as a child before we do anything, since its
@@ -330,8 +401,9 @@ void VmObjectPaged::Dump(uint depth, bool verbose) {
         printf("  ");
     }
     printf("vmo %p/k%" PRIu64 " size %#" PRIx64
-           " pages %zu ref %d parent k%" PRIu64 "\n",
-           this, user_id_, size_, count, ref_count_debug(), parent_id);
+           " pages %zu compressed %zu shared %zu ref %d parent k%" PRIu64 "\n",
+           this, user_id_, size_, count, compressed_pages_.size(), shared_pages_.size(),
+           ref_count_debug(), parent_id);
 
     if (verbose) {
         auto f = [depth](const auto p, uint64_t offset) {
@@ -366,9 +438,160 @@ size_t VmObjectPaged::AllocatedPagesInRangeLocked(uint64_t offset, uint64_t len)
             }
             return ZX_ERR_NEXT;
         });
+    // compressed and shared pages are still committed, they just take up less space
+    count += CountInRange(compressed_pages_, offset, offset + new_len);
+    count += CountInRange(shared_pages_, offset, offset + new_len);
     return count;
 }
 
+bool VmObjectPaged::AnyPagesInRangeLocked(uint64_t offset, uint64_t len) const {
+    bool found = false;
+    page_list_.ForEveryPageInRange(
+        [&found](const auto p, uint64_t off) {
+            found = true;
+            return ZX_ERR_STOP;
+        },
+        offset, offset + len);
+    return found || CountInRange(compressed_pages_, offset, offset + len) > 0 ||
+           CountInRange(shared_pages_, offset, offset + len) > 0;
+}
+
+zx_status_t VmObjectPaged::DecompressPageLocked(uint64_t offset, list_node* free_list,
+                                                vm_page_t** page_out) {
+    DEBUG_ASSERT(lock_.lock().IsHeld());
+
+    if (compressed_pages_.is_empty()) {
+        return ZX_ERR_NOT_FOUND;
+    }
+    auto compressed = compressed_pages_.find(offset);
+    if (!compressed.IsValid()) {
+        return ZX_ERR_NOT_FOUND;
+    }
+
+    vm_page_t* p = nullptr;
+    paddr_t pa;
+    if (free_list) {
+        p = list_remove_head_type(free_list, vm_page, queue_node);
+        if (p) {
+            pa = p->paddr();
+        }
+    }
+    if (!p) {
+        pmm_alloc_page(pmm_alloc_flags_, &p, &pa);
+    }
+    if (!p) {
+        return ZX_ERR_NO_MEMORY;
+    }
+
+    InitializeVmPage(p);
+    compressed->Decompress(pa);
+    compressed_pages_.erase(compressed);
+
+    // The page was unmapped everywhere when it was compressed, so there are
+    // no mappings to update.
+    __UNUSED zx_status_t status = page_list_.AddPage(p, offset);
+    DEBUG_ASSERT(status == ZX_OK);
+
+    p->object.referenced = 1;
+    p->object.dirty = 1;
+    *page_out = p;
+    return ZX_OK;
+}
+
+zx_status_t VmObjectPaged::UnsharePageLocked(uint64_t offset, list_node* free_list,
+                                             vm_page_t** page_out) {
+    DEBUG_ASSERT(lock_.lock().IsHeld());
+
+    if (shared_pages_.is_empty()) {
+        return ZX_ERR_NOT_FOUND;
+    }
+    auto shared = shared_pages_.find(offset);
+    if (!shared.IsValid()) {
+        return ZX_ERR_NOT_FOUND;
+    }
+
+    // if no one else is using the page any more, just take it back
+    vm_page_t* p = shared->TakeIfExclusive();
+    if (!p) {
+        paddr_t pa;
+        if (free_list) {
+            p = list_remove_head_type(free_list, vm_page, queue_node);
+            if (p) {
+                pa = p->paddr();
+            }
+        }
+        if (!p) {
+            pmm_alloc_page(pmm_alloc_flags_, &p, &pa);
+        }
+        if (!p) {
+            return ZX_ERR_NO_MEMORY;
+        }
+
+        InitializeVmPage(p);
+        memcpy(paddr_to_physmap(pa), paddr_to_physmap(shared->page()->paddr()), PAGE_SIZE);
+    }
+    shared_pages_.erase(shared);
+
+    // the shared page may still be mapped read-only, so this unmaps it
+    __UNUSED zx_status_t status = AddPageLocked(p, offset);
+    DEBUG_ASSERT(status == ZX_OK);
+
+    p->object.referenced = 1;
+    p->object.dirty = 1;
+    *page_out = p;
+    return ZX_OK;
+}
+
+zx_status_t VmObjectPaged::DecompressRangeLocked(uint64_t start, uint64_t end) {
+    DEBUG_ASSERT(lock_.lock().IsHeld());
+
+    auto compressed = compressed_pages_.lower_bound(start);
+    while (compressed.IsValid() && compressed->GetKey() < end) {
+        const uint64_t offset = compressed->GetKey();
+        // step past the entry first, since decompressing it erases it
+        ++compressed;
+        vm_page_t* p;
+        zx_status_t status = DecompressPageLocked(offset, nullptr, &p);
+        if (status != ZX_OK) {
+            return status;
+        }
+    }
+    return ZX_OK;
+}
+
+zx_status_t VmObjectPaged::MakeRangePrivateLocked(uint64_t start, uint64_t end) {
+    DEBUG_ASSERT(lock_.lock().IsHeld());
+
+    zx_status_t status = DecompressRangeLocked(start, end);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    auto shared = shared_pages_.lower_bound(start);
+    while (shared.IsValid() && shared->GetKey() < end) {
+        const uint64_t offset = shared->GetKey();
+        ++shared;
+        vm_page_t* p;
+        status = UnsharePageLocked(offset, nullptr, &p);
+        if (status != ZX_OK) {
+            return status;
+        }
+    }
+    return ZX_OK;
+}
+
+void VmObjectPaged::FreeStoredRangeLocked(uint64_t start, uint64_t end) {
+    DEBUG_ASSERT(lock_.lock().IsHeld());
+
+    EraseInRange(compressed_pages_, start, end);
+    EraseInRange(shared_pages_, start, end);
+}
+
+void VmObjectPaged::AddToReclaimList() {
+    Guard<fbl::Mutex> guard{ReclaimListLock::Get()};
+    reclaim_list_.push_back(this);
+}
+
 zx_status_t VmObjectPaged::AddPage(vm_page_t* p, uint64_t offset) {
     Guard<fbl::Mutex> guard{&lock_};
 
@@ -421,6 +644,34 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
     // see if we already have a page at that offset
     p = page_list_.GetPage(offset);
     if (p) {
+        if (!(pf_flags & VMM_PF_FLAG_NO_REFERENCE)) {
+            p->object.referenced = 1;
+        }
+        if (pf_flags & VMM_PF_FLAG_WRITE) {
+            p->object.dirty = 1;
+        }
+        if (page_out) {
+            *page_out = p;
+        }
+        if (pa_out) {
+            *pa_out = p->paddr();
+        }
+        return ZX_OK;
+    }
+
+    // A compressed page of ours takes precedence over the parent.  Bringing
+    // it back allocates a page, so that is only done when faulting.
+    if (!compressed_pages_.is_empty() && compressed_pages_.find(offset).IsValid()) {
+        if ((pf_flags & VMM_PF_FLAG_FAULT_MASK) == 0) {
+            return ZX_ERR_NOT_FOUND;
+        }
+        zx_status_t status = DecompressPageLocked(offset, free_list, &p);
+        if (status != ZX_OK) {
+            return status;
+        }
+
+        LTRACEF("decompressed page %p, pa %#" PRIxPTR "\n", p, p->paddr());
+
         if (page_out) {
             *page_out = p;
         }
@@ -430,6 +681,30 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
         return ZX_OK;
     }
 
+    // A shared page of ours also takes precedence over the parent.  Like a
+    // page of the parent, it is handed out as is for reading, and copied for
+    // writing.
+    if (!shared_pages_.is_empty()) {
+        auto shared = shared_pages_.find(offset);
+        if (shared.IsValid()) {
+            if (pf_flags & VMM_PF_FLAG_WRITE) {
+                zx_status_t status = UnsharePageLocked(offset, free_list, &p);
+                if (status != ZX_OK) {
+                    return status;
+                }
+            } else {
+                p = shared->page();
+            }
+            if (page_out) {
+                *page_out = p;
+            }
+            if (pa_out) {
+                *pa_out = p->paddr();
+            }
+            return ZX_OK;
+        }
+    }
+
     __UNUSED char pf_string[5];
     LTRACEF("vmo %p, offset %#" PRIx64 ", pf_flags %#x (%s)\n", this, offset, pf_flags,
             vmm_pf_flags_to_string(pf_flags, pf_string));
@@ -480,6 +755,7 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
             }
 
             InitializeVmPage(p_clone);
+            p_clone->object.referenced = 1;
 
             void* dst = paddr_to_physmap(pa_clone);
             DEBUG_ASSERT(dst);
@@ -527,6 +803,10 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
         if (status != ZX_OK) {
             return status;
         }
+        p->object.referenced = 1;
+        // a page just read in from the source is clean, unless it is about
+        // to be written through the mapping this fault is for
+        p->object.dirty = (pf_flags & VMM_PF_FLAG_WRITE) ? 1 : 0;
     } else {
         // if we're read faulting, we don't already have a page, and the parent doesn't have it,
         // return the single global zero page
@@ -549,16 +829,14 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
             }
         }
         if (!p) {
-            pmm_alloc_page(pmm_alloc_flags_, &p, &pa);
+            pmm_alloc_page(pmm_alloc_flags_ | PMM_ALLOC_FLAG_ZEROED, &p, &pa);
         }
         if (!p) {
             return ZX_ERR_NO_MEMORY;
         }
 
         InitializeVmPage(p);
-
-        // TODO: remove once pmm returns zeroed pages
-        ZeroPage(pa);
+        p->object.referenced = 1;
 
         // if ARM and not fully cached, clean/invalidate the page after zeroing it
 #if ARCH_ARM64
@@ -586,6 +864,45 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
     return ZX_OK;
 }
 
+zx_status_t VmObjectPaged::LookupContiguousLocked(uint64_t offset, uint64_t len, paddr_t* pa) {
+    canary_.Assert();
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(offset) && IS_PAGE_ALIGNED(len));
+
+    if (len == 0 || offset >= size_ || len > size_ - offset) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+
+    // A large mapping would hide accesses and writes to the individual pages
+    // from the page reclaimer, so pages from a page source never qualify.
+    if (page_source_) {
+        return ZX_ERR_NOT_FOUND;
+    }
+
+    // every page has to be present, so a gap anywhere (including at the end) fails
+    paddr_t base = 0;
+    uint64_t expected_next_off = offset;
+    zx_status_t status = page_list_.ForEveryPageInRange(
+        [&base, &expected_next_off, offset](const auto p, uint64_t off) {
+            if (off != expected_next_off) {
+                return ZX_ERR_NOT_FOUND;
+            }
+            if (off == offset) {
+                base = p->paddr();
+            } else if (p->paddr() != base + (off - offset)) {
+                return ZX_ERR_NOT_FOUND;
+            }
+            expected_next_off = off + PAGE_SIZE;
+            return ZX_ERR_NEXT;
+        },
+        offset, offset + len);
+    if (status != ZX_OK || expected_next_off != offset + len) {
+        return ZX_ERR_NOT_FOUND;
+    }
+
+    *pa = base;
+    return ZX_OK;
+}
+
 zx_status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len) {
     canary_.Assert();
     LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
@@ -629,27 +946,82 @@ zx_status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len) {
     // the end.  Add it back in
     DEBUG_ASSERT(end >= expected_next_off);
     count += (end - expected_next_off) / PAGE_SIZE;
+
+    // shared pages are committed already
+    count -= CountInRange(shared_pages_, offset, end);
     if (count == 0) {
         return ZX_OK;
     }
 
+    // If asked to, back any completely empty, large page aligned chunks of the
+    // range with contiguous runs so that mappings of them can use large pages.
+    // This is opportunistic: if the pmm doesn't readily have a run, that chunk
+    // and the rest of the range are committed with ordinary pages below, and
+    // the runs drivers need for DMA are left alone.
+    list_node large_page_list;
+    list_initialize(&large_page_list);
+    size_t large_page_count = 0;
+#if VM_LARGE_PAGES
+    if (options_ & kLargePages) {
+        for (uint64_t o = ROUNDUP(offset, VM_LARGE_PAGE_SIZE);
+             o < end && end - o >= VM_LARGE_PAGE_SIZE; o += VM_LARGE_PAGE_SIZE) {
+            if (AnyPagesInRangeLocked(o, VM_LARGE_PAGE_SIZE)) {
+                continue;
+            }
+            paddr_t pa;
+            if (pmm_alloc_contiguous(VM_LARGE_PAGE_SIZE / PAGE_SIZE,
+                                     pmm_alloc_flags_ | PMM_ALLOC_FLAG_NO_DRAIN,
+                                     VM_LARGE_PAGE_SHIFT, &pa, &large_page_list) != ZX_OK) {
+                break;
+            }
+            large_page_count++;
+        }
+    }
+#endif
+    count -= large_page_count * (VM_LARGE_PAGE_SIZE / PAGE_SIZE);
+
     // allocate count number of pages
     list_node page_list;
     list_initialize(&page_list);
 
-    zx_status_t status = pmm_alloc_pages(count, pmm_alloc_flags_, &page_list);
+    // GetPageLocked expects the pages it is handed to already be zeroed
+    zx_status_t status = pmm_alloc_pages(count, pmm_alloc_flags_ | PMM_ALLOC_FLAG_ZEROED,
+                                         &page_list);
     if (status != ZX_OK) {
+        pmm_free(&large_page_list);
         return status;
     }
 
     // unmap all of the pages in this range on all the mapping regions
     RangeChangeUpdateLocked(offset, end - offset);
 
+    // Install the contiguous runs first, in the same order they were picked
+    // above, so the loop below only fills in what is left.
+#if VM_LARGE_PAGES
+    if (large_page_count > 0) {
+        for (uint64_t o = ROUNDUP(offset, VM_LARGE_PAGE_SIZE);
+             !list_is_empty(&large_page_list); o += VM_LARGE_PAGE_SIZE) {
+            if (AnyPagesInRangeLocked(o, VM_LARGE_PAGE_SIZE)) {
+                continue;
+            }
+            for (uint64_t po = o; po < o + VM_LARGE_PAGE_SIZE; po += PAGE_SIZE) {
+                vm_page_t* p = list_remove_head_type(&large_page_list, vm_page, queue_node);
+                DEBUG_ASSERT(p);
+                InitializeVmPage(p);
+                ZeroPage(p);
+                status = AddPageLocked(p, po);
+                DEBUG_ASSERT(status == ZX_OK);
+            }
+        }
+        kcounter_add(vm_commit_large_pages, large_page_count);
+    }
+#endif
+
     // add them to the appropriate range of the object
     for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
         // Don't commit if we already have this page
         vm_page_t* p = page_list_.GetPage(o);
-        if (p) {
+        if (p || (!shared_pages_.is_empty() && shared_pages_.find(o).IsValid())) {
             continue;
         }
 
@@ -709,6 +1081,97 @@ zx_status_t VmObjectPaged::DecommitRange(uint64_t offset, uint64_t len) {
     RangeChangeUpdateLocked(start, page_aligned_len);
 
     page_list_.FreePages(start, end);
+    FreeStoredRangeLocked(start, end);
+
+    return ZX_OK;
+}
+
+zx_status_t VmObjectPaged::DeduplicateRange(uint64_t offset, uint64_t len) {
+    canary_.Assert();
+    LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
+
+    // Pages of a page source have to stay where the source put them, and
+    // contiguous objects have to keep their physical layout.
+    if (page_source_ || (options_ & kContiguous)) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
+    Guard<fbl::Mutex> guard{&lock_};
+
+    // trim the size
+    uint64_t new_len;
+    if (!TrimRange(offset, len, size_, &new_len)) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+
+    // was in range, just zero length
+    if (new_len == 0) {
+        return ZX_OK;
+    }
+
+    // the shared pages are all mapped cached
+    if (cache_policy_ != ARCH_MMU_FLAG_CACHED) {
+        return ZX_ERR_BAD_STATE;
+    }
+
+    const uint64_t start = ROUNDDOWN(offset, PAGE_SIZE);
+    const uint64_t end = ROUNDUP_PAGE_SIZE(offset + new_len);
+
+    // Unmap the range, so that nothing writes to the pages while they are
+    // compared, and so that the next write to a shared page faults and makes
+    // a copy.
+    RangeChangeUpdateLocked(start, end - start);
+
+    list_node free_list;
+    list_initialize(&free_list);
+
+    // The pages are looked at in batches, since the page list can't change
+    // while it is being walked.
+    static constexpr size_t kBatchPages = 64;
+    uint64_t batch_start = start;
+    while (batch_start < end) {
+        uint64_t offsets[kBatchPages];
+        size_t num_offsets = 0;
+        uint64_t batch_end = end;
+        page_list_.ForEveryPageInRange(
+            [&](vm_page* p, uint64_t off) {
+                if (num_offsets == kBatchPages) {
+                    batch_end = off;
+                    return ZX_ERR_STOP;
+                }
+                if (p->state == VM_PAGE_STATE_OBJECT && p->object.pin_count == 0) {
+                    offsets[num_offsets++] = off;
+                }
+                return ZX_ERR_NEXT;
+            },
+            batch_start, end);
+
+        for (size_t i = 0; i < num_offsets; i++) {
+            vm_page_t* p = page_list_.GetPage(offsets[i]);
+            DEBUG_ASSERT(p);
+
+            // Without a parent, a missing page reads as zeros, so a page of
+            // zeros can be dropped outright.
+            if (!parent_ && IsZeroPage(p->paddr())) {
+                page_list_.RemovePage(offsets[i], &p);
+                list_add_tail(&free_list, &p->queue_node);
+                kcounter_add(vm_dedup_zero, 1);
+                continue;
+            }
+
+            ktl::unique_ptr<VmSharedPageRef> ref =
+                VmSharedPageRef::Share(offsets[i], p, &free_list);
+            if (!ref) {
+                pmm_free(&free_list);
+                return ZX_ERR_NO_MEMORY;
+            }
+            page_list_.RemovePage(offsets[i], &p);
+            shared_pages_.insert(ktl::move(ref));
+        }
+        batch_start = batch_end;
+    }
+
+    pmm_free(&free_list);
 
     return ZX_OK;
 }
@@ -735,8 +1198,14 @@ zx_status_t VmObjectPaged::PinLocked(uint64_t offset, uint64_t len) {
     const uint64_t start_page_offset = ROUNDDOWN(offset, PAGE_SIZE);
     const uint64_t end_page_offset = ROUNDUP(offset + len, PAGE_SIZE);
 
+    // a device can't access a compressed page, and must not write a shared one
+    zx_status_t status = MakeRangePrivateLocked(start_page_offset, end_page_offset);
+    if (status != ZX_OK) {
+        return status;
+    }
+
     uint64_t expected_next_off = start_page_offset;
-    zx_status_t status = page_list_.ForEveryPageInRange(
+    status = page_list_.ForEveryPageInRange(
         [&expected_next_off](const auto p, uint64_t off) {
             if (off != expected_next_off) {
                 return ZX_ERR_NOT_FOUND;
@@ -748,6 +1217,8 @@ zx_status_t VmObjectPaged::PinLocked(uint64_t offset, uint64_t len) {
             }
 
             p->object.pin_count++;
+            // a pinned page may be written by a device behind our back
+            p->object.dirty = 1;
             expected_next_off = off + PAGE_SIZE;
             return ZX_ERR_NEXT;
         },
@@ -862,6 +1333,7 @@ zx_status_t VmObjectPaged::ResizeLocked(uint64_t s) {
         RangeChangeUpdateLocked(start, len);
 
         page_list_.FreePages(start, end);
+        FreeStoredRangeLocked(start, end);
     } else if (s > size_) {
         // expanding
         // figure the starting and ending page offset that is affected
@@ -1016,8 +1488,16 @@ zx_status_t VmObjectPaged::Lookup(uint64_t offset, uint64_t len,
     const uint64_t start_page_offset = ROUNDDOWN(offset, PAGE_SIZE);
     const uint64_t end_page_offset = ROUNDUP(offset + len, PAGE_SIZE);
 
+    // A compressed page has no physical address until it is brought back,
+    // which the non-faulting GetPageLocked below won't do, and which can't
+    // happen while walking page_list_.
+    zx_status_t status = DecompressRangeLocked(start_page_offset, end_page_offset);
+    if (status != ZX_OK) {
+        return status;
+    }
+
     uint64_t expected_next_off = start_page_offset;
-    zx_status_t status = page_list_.ForEveryPageInRange(
+    status = page_list_.ForEveryPageInRange(
         [&expected_next_off, this, lookup_fn, context,
          start_page_offset](const auto p, uint64_t off) {
 
@@ -1110,6 +1590,11 @@ zx_status_t VmObjectPaged::TakePages(uint64_t offset, uint64_t len, VmPageSplice
         return ZX_ERR_BAD_STATE;
     }
 
+    zx_status_t status = MakeRangePrivateLocked(offset, end);
+    if (status != ZX_OK) {
+        return status;
+    }
+
     // This is only used by the userpager API, which has significant restrictions on
     // what sorts of vmos are acceptable. If splice starts being used in more places,
     // then this restriction might need to be lifted.
@@ -1119,6 +1604,10 @@ zx_status_t VmObjectPaged::TakePages(uint64_t offset, uint64_t len, VmPageSplice
         return ZX_ERR_BAD_STATE;
     }
 
+    // The pages may have been unmapped from an aspace whose TLB batch has
+    // yet to invalidate them
+    FlushTlbBatchesLocked();
+
     *pages = ktl::move(page_list_.TakePages(offset, len));
 
     return ZX_OK;
@@ -1136,6 +1625,9 @@ zx_status_t VmObjectPaged::SupplyPages(uint64_t offset, uint64_t len, VmPageSpli
     page_source_->OnPagesSupplied(offset, len);
     while (!pages->IsDone()) {
         vm_page* src_page = pages->Pop();
+        // freshly supplied pages match the source, and count as just used
+        src_page->object.referenced = 1;
+        src_page->object.dirty = 0;
         zx_status_t status = AddPageLocked(src_page, offset);
         if (status == ZX_ERR_ALREADY_EXISTS) {
             pmm_free_page(src_page);
@@ -1148,6 +1640,229 @@ zx_status_t VmObjectPaged::SupplyPages(uint64_t offset, uint64_t len, VmPageSpli
     return ZX_OK;
 }
 
+zx_status_t VmObjectPaged::ReplacePages(uint64_t offset, list_node* pages) {
+    canary_.Assert();
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(offset));
+
+    // Pages of a page source have to come from the source, and contiguous
+    // objects have to keep their physical layout.
+    if (page_source_ || (options_ & kContiguous)) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
+    const uint64_t len = list_length(pages) * PAGE_SIZE;
+    LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
+
+    Guard<fbl::Mutex> guard{&lock_};
+
+    uint64_t end;
+    if (add_overflow(offset, len, &end) || end > size_) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+
+    // the new pages have only ever been accessed cached
+    if (cache_policy_ != ARCH_MMU_FLAG_CACHED) {
+        return ZX_ERR_BAD_STATE;
+    }
+
+    if (AnyPagesPinnedLocked(offset, len)) {
+        return ZX_ERR_BAD_STATE;
+    }
+
+    // Allocate the page list nodes up front, so that nothing can fail once
+    // the old pages start going away.  On failure the caller keeps |pages|.
+    zx_status_t status = page_list_.PopulateRange(offset, end);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    // unmap the old pages everywhere before letting go of them
+    RangeChangeUpdateLocked(offset, len);
+
+    // Take the old pages out without FreePages(), which would prune the nodes
+    // populated above.
+    list_node old_pages = LIST_INITIAL_VALUE(old_pages);
+    page_list_.ForEveryPageInRange(
+        [&old_pages](vm_page*& p, uint64_t off) {
+            list_add_tail(&old_pages, &p->queue_node);
+            p = nullptr;
+            return ZX_ERR_NEXT;
+        },
+        offset, end);
+    FreeStoredRangeLocked(offset, end);
+
+    for (uint64_t off = offset; off < end; off += PAGE_SIZE) {
+        vm_page_t* p = list_remove_head_type(pages, vm_page, queue_node);
+        InitializeVmPage(p);
+        p->object.referenced = 1;
+        p->object.dirty = 1;
+        status = page_list_.AddPage(p, off);
+        DEBUG_ASSERT(status == ZX_OK);
+    }
+
+    pmm_free(&old_pages);
+    return ZX_OK;
+}
+
+size_t VmObjectPaged::ReclaimPages(size_t max_evict, size_t max_scan) {
+    canary_.Assert();
+
+    // Pages are looked at in batches, dropping the lock in between so that
+    // faults on the object are not held up for a whole sweep.
+    static constexpr size_t kBatchPages = 64;
+
+    // Pages of a page source can simply be dropped, but only clean ones, and
+    // only while the source is around to provide them again.  Anonymous pages
+    // are all compressed, dirty or not.
+    const bool compress = !page_source_ && is_compressible();
+    if (compress) {
+        if (VmCompressedPage::BudgetExhausted()) {
+            return 0;
+        }
+    } else if (!page_source_ || page_source_->IsDetached()) {
+        return 0;
+    }
+
+    size_t evicted = 0;
+    size_t compressed = 0;
+    size_t scanned = 0;
+    bool wrapped = false;
+    uint64_t sweep_start = UINT64_MAX;
+
+    while (evicted + compressed < max_evict && scanned < max_scan) {
+        list_node free_list;
+        list_initialize(&free_list);
+
+        {
+            Guard<fbl::Mutex> guard{&lock_};
+
+            // the page may be visible to a device through a different cache policy
+            if (compress && cache_policy_ != ARCH_MMU_FLAG_CACHED) {
+                break;
+            }
+
+            if (reclaim_cursor_ >= size_) {
+                reclaim_cursor_ = 0;
+            }
+            const uint64_t start = reclaim_cursor_;
+            if (sweep_start == UINT64_MAX) {
+                sweep_start = start;
+            } else if (wrapped && start >= sweep_start) {
+                // the hand has been all the way around
+                break;
+            }
+
+            uint64_t evict_offsets[kBatchPages];
+            size_t num_evict = 0;
+            size_t batch_scanned = 0;
+            bool aged = false;
+            uint64_t end = size_;
+            const size_t batch_limit = fbl::min(kBatchPages, max_scan - scanned);
+            page_list_.ForEveryPageInRange(
+                [&](vm_page* p, uint64_t off) {
+                    if (batch_scanned == batch_limit) {
+                        end = off;
+                        return ZX_ERR_STOP;
+                    }
+                    batch_scanned++;
+                    if (p->object.pin_count > 0 || (!compress && p->object.dirty)) {
+                        return ZX_ERR_NEXT;
+                    }
+                    if (p->object.referenced) {
+                        p->object.referenced = 0;
+                        aged = true;
+                    } else if (evicted + compressed + num_evict < max_evict) {
+                        evict_offsets[num_evict++] = off;
+                    }
+                    return ZX_ERR_NEXT;
+                },
+                start, size_);
+
+            // Unmap the batch before freeing anything, which also makes the
+            // next access to a page that was just aged fault and mark it.
+            // Unmapping first also keeps pages from being written while they
+            // are compressed.
+            if (aged || num_evict > 0) {
+                RangeChangeUpdateLocked(start, end - start);
+            }
+            for (size_t i = 0; i < num_evict; i++) {
+                if (compress) {
+                    if (VmCompressedPage::BudgetExhausted()) {
+                        break;
+                    }
+                    vm_page_t* page = page_list_.GetPage(evict_offsets[i]);
+                    DEBUG_ASSERT(page);
+                    ktl::unique_ptr<VmCompressedPage> compressed_page =
+                        VmCompressedPage::Compress(evict_offsets[i], page->paddr());
+                    if (!compressed_page) {
+                        continue;
+                    }
+                    compressed_pages_.insert(ktl::move(compressed_page));
+                    compressed++;
+                } else {
+                    evicted++;
+                }
+                vm_page_t* page;
+                __UNUSED bool removed = page_list_.RemovePage(evict_offsets[i], &page);
+                DEBUG_ASSERT(removed);
+                list_add_tail(&free_list, &page->queue_node);
+            }
+
+            scanned += batch_scanned;
+            reclaim_cursor_ = end;
+            if (end >= size_) {
+                if (wrapped) {
+                    break;
+                }
+                wrapped = true;
+                reclaim_cursor_ = 0;
+            }
+        }
+
+        pmm_free(&free_list);
+    }
+
+    kcounter_add(vm_reclaim_scanned, scanned);
+    kcounter_add(vm_reclaim_evicted, evicted);
+
+    return evicted + compressed;
+}
+
+size_t VmObjectPaged::ReclaimColdPages(size_t target_pages) {
+    // Upper bound on the pages looked at per visit to one object, so that a
+    // single large object does not absorb all of the work.
+    static constexpr size_t kScanPerVisit = 1024;
+
+    size_t evicted = 0;
+    size_t visits;
+    {
+        Guard<fbl::Mutex> guard{ReclaimListLock::Get()};
+        // every object gets visited at least twice, so a page referenced
+        // before the first visit can still be evicted on the second
+        visits = 2 * reclaim_list_.size_slow();
+    }
+
+    while (evicted < target_pages && visits-- > 0) {
+        fbl::RefPtr<VmObjectPaged> vmo;
+        {
+            Guard<fbl::Mutex> guard{ReclaimListLock::Get()};
+            if (reclaim_list_.is_empty()) {
+                break;
+            }
+            // rotate the list so that consecutive calls spread the work
+            VmObjectPaged* raw = reclaim_list_.pop_front();
+            reclaim_list_.push_back(raw);
+            // the object may already be on its way to destruction
+            vmo = fbl::MakeRefPtrUpgradeFromRaw(raw, ReclaimListLock::Get());
+        }
+        if (vmo) {
+            evicted += vmo->ReclaimPages(target_pages - evicted, kScanPerVisit);
+        }
+    }
+
+    return evicted;
+}
+
 zx_status_t VmObjectPaged::InvalidateCache(const uint64_t offset, const uint64_t len) {
     return CacheOp(offset, len, CacheOpType::Invalidate);
 }
@@ -1246,7 +1961,7 @@ zx_status_t VmObjectPaged::SetMappingCachePolicy(const uint32_t cache_policy) {
     // 2) vmo has no mappings
     // 3) vmo has no clones
     // 4) vmo is not a clone
-    if (!page_list_.IsEmpty()) {
+    if (!page_list_.IsEmpty() || !compressed_pages_.is_empty() || !shared_pages_.is_empty()) {
         return ZX_ERR_BAD_STATE;
     }
     if (!mapping_list_.is_empty()) {
@@ -1296,7 +2011,12 @@ void VmObjectPaged::RangeChangeUpdateFromParentLocked(const uint64_t offset, con
     RangeChangeUpdateLocked(offset_new, len_new);
 }
 
-fbl::RefPtr<PageSource> VmObjectPaged::GetRootPageSourceLocked() {
+bool VmObjectPaged::is_pager_backed() const {
+    Guard<fbl::Mutex> guard{&lock_};
+    return GetRootPageSourceLocked() != nullptr;
+}
+
+fbl::RefPtr<PageSource> VmObjectPaged::GetRootPageSourceLocked() const {
     auto vm_object = this;
     while (vm_object->parent_) {
         vm_object = VmObjectPaged::AsVmObjectPaged(vm_object->parent_);
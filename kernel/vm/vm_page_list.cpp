@@ -10,6 +10,7 @@
 #include <fbl/alloc_checker.h>
 #include <inttypes.h>
 #include <ktl/move.h>
+#include <stddef.h>
 #include <trace.h>
 #include <vm/pmm.h>
 #include <vm/vm.h>
@@ -46,6 +47,8 @@ inline void move_vm_page_list_node(VmPageListNode* dest, VmPageListNode* src) {
 
 VmPageListNode::VmPageListNode(uint64_t offset)
     : obj_offset_(offset) {
+    static_assert(offsetof(VmPageListNode, pages_) % MAX_CACHE_LINE == 0, "");
+    static_assert(sizeof(pages_) % MAX_CACHE_LINE == 0, "");
     LTRACEF("%p offset %#" PRIx64 "\n", this, obj_offset_);
 }
 
@@ -94,7 +97,142 @@ VmPageList::VmPageList() {
 
 VmPageList::~VmPageList() {
     LTRACEF("%p\n", this);
-    DEBUG_ASSERT(list_.is_empty());
+    DEBUG_ASSERT(root_ == nullptr);
+}
+
+VmPageListNode* VmPageList::LookupLeaf(uint64_t leaf_index) const {
+    if (leaf_index > MaxLeafIndex(height_)) {
+        return nullptr;
+    }
+
+    void* node = root_;
+    for (uint level = height_; level > 0 && node; level--) {
+        const size_t shift = (level - 1) * kInteriorFanOutShift;
+        node = static_cast<InteriorNode*>(node)->slots[(leaf_index >> shift) % kInteriorFanOut];
+    }
+    return static_cast<VmPageListNode*>(node);
+}
+
+zx_status_t VmPageList::LookupOrAllocateLeaf(uint64_t leaf_index, VmPageListNode** leaf) {
+    // Grow the tree upwards until it can reach |leaf_index|.  The existing
+    // tree becomes the first child of each new root.
+    while (leaf_index > MaxLeafIndex(height_)) {
+        if (root_) {
+            fbl::AllocChecker ac;
+            InteriorNode* interior = new (&ac) InteriorNode;
+            if (!ac.check()) {
+                return ZX_ERR_NO_MEMORY;
+            }
+            interior->slots[0] = root_;
+            root_ = interior;
+        }
+        height_++;
+    }
+
+    // Walk down, filling in any missing nodes on the way.
+    void** slot = &root_;
+    for (uint level = height_; ; level--) {
+        if (!*slot) {
+            fbl::AllocChecker ac;
+            if (level > 0) {
+                *slot = new (&ac) InteriorNode;
+            } else {
+                const uint64_t node_offset =
+                    leaf_index << (PAGE_SIZE_SHIFT + VmPageListNode::kPageFanOutShift);
+                *slot = new (&ac) VmPageListNode(node_offset);
+                LTRACEF("allocating new leaf node %p\n", *slot);
+            }
+            if (!ac.check()) {
+                // Don't leave behind interior nodes which lead nowhere.
+                PruneEmpty(leaf_index, leaf_index);
+                return ZX_ERR_NO_MEMORY;
+            }
+        }
+        if (level == 0) {
+            break;
+        }
+        const size_t shift = (level - 1) * kInteriorFanOutShift;
+        slot = &static_cast<InteriorNode*>(*slot)->slots[(leaf_index >> shift) % kInteriorFanOut];
+    }
+
+    *leaf = static_cast<VmPageListNode*>(*slot);
+    return ZX_OK;
+}
+
+ktl::unique_ptr<VmPageListNode> VmPageList::DetachLeaf(uint64_t leaf_index) {
+    if (leaf_index > MaxLeafIndex(height_)) {
+        return nullptr;
+    }
+
+    void** slot = &root_;
+    for (uint level = height_; level > 0 && *slot; level--) {
+        const size_t shift = (level - 1) * kInteriorFanOutShift;
+        slot = &static_cast<InteriorNode*>(*slot)->slots[(leaf_index >> shift) % kInteriorFanOut];
+    }
+    if (!*slot) {
+        return nullptr;
+    }
+
+    ktl::unique_ptr<VmPageListNode> leaf(static_cast<VmPageListNode*>(*slot));
+    *slot = nullptr;
+    PruneEmpty(leaf_index, leaf_index);
+    return leaf;
+}
+
+bool VmPageList::PruneEmptyInNode(void** slot, uint level, uint64_t node_first,
+                                  uint64_t first, uint64_t last) {
+    if (!*slot) {
+        return true;
+    }
+
+    if (level == 0) {
+        auto leaf = static_cast<VmPageListNode*>(*slot);
+        if (!leaf->IsEmpty()) {
+            return false;
+        }
+        LTRACEF_LEVEL(2, "%p freeing the list node\n", this);
+        delete leaf;
+        *slot = nullptr;
+        return true;
+    }
+
+    auto interior = static_cast<InteriorNode*>(*slot);
+    const size_t shift = (level - 1) * kInteriorFanOutShift;
+    const uint64_t start = first > node_first ? (first - node_first) >> shift : 0;
+    const uint64_t end = fbl::min<uint64_t>((last - node_first) >> shift, kInteriorFanOut - 1);
+    for (uint64_t i = start; i <= end; i++) {
+        PruneEmptyInNode(&interior->slots[i], level - 1, node_first + (i << shift), first, last);
+    }
+    if (!interior->IsEmpty()) {
+        return false;
+    }
+    delete interior;
+    *slot = nullptr;
+    return true;
+}
+
+void VmPageList::PruneEmpty(uint64_t first, uint64_t last) {
+    last = fbl::min(last, MaxLeafIndex(height_));
+    if (first > last) {
+        return;
+    }
+    if (PruneEmptyInNode(&root_, height_, 0, first, last)) {
+        height_ = 0;
+    }
+}
+
+void VmPageList::FreeNode(void* node, uint level) {
+    if (level == 0) {
+        delete static_cast<VmPageListNode*>(node);
+        return;
+    }
+    auto interior = static_cast<InteriorNode*>(node);
+    for (auto child : interior->slots) {
+        if (child) {
+            FreeNode(child, level - 1);
+        }
+    }
+    delete interior;
 }
 
 zx_status_t VmPageList::AddPage(vm_page* p, uint64_t offset) {
@@ -108,25 +246,13 @@ zx_status_t VmPageList::AddPage(vm_page* p, uint64_t offset) {
     LTRACEF_LEVEL(2, "%p page %p, offset %#" PRIx64 " node_offset %#" PRIx64 " index %zu\n", this, p, offset,
                   node_offset, index);
 
-    // lookup the tree node that holds this page
-    auto pln = list_.find(node_offset);
-    if (!pln.IsValid()) {
-        fbl::AllocChecker ac;
-        ktl::unique_ptr<VmPageListNode> pl =
-            ktl::unique_ptr<VmPageListNode>(new (&ac) VmPageListNode(node_offset));
-        if (!ac.check()) {
-            return ZX_ERR_NO_MEMORY;
-        }
-
-        LTRACEF("allocating new inner node %p\n", pl.get());
-        __UNUSED auto status = pl->AddPage(p, index);
-        DEBUG_ASSERT(status == ZX_OK);
-
-        list_.insert(ktl::move(pl));
-        return ZX_OK;
-    } else {
-        return pln->AddPage(p, index);
+    // lookup the leaf that holds this page, creating it if necessary
+    VmPageListNode* pln;
+    zx_status_t status = LookupOrAllocateLeaf(LeafIndex(offset), &pln);
+    if (status != ZX_OK) {
+        return status;
     }
+    return pln->AddPage(p, index);
 }
 
 vm_page* VmPageList::GetPage(uint64_t offset) {
@@ -136,9 +262,9 @@ vm_page* VmPageList::GetPage(uint64_t offset) {
     LTRACEF_LEVEL(2, "%p offset %#" PRIx64 " node_offset %#" PRIx64 " index %zu\n", this, offset, node_offset,
                   index);
 
-    // lookup the tree node that holds this page
-    auto pln = list_.find(node_offset);
-    if (!pln.IsValid()) {
+    // lookup the leaf that holds this page
+    VmPageListNode* pln = LookupLeaf(LeafIndex(offset));
+    if (!pln) {
         return nullptr;
     }
 
@@ -154,19 +280,18 @@ bool VmPageList::RemovePage(uint64_t offset, vm_page_t** page_out) {
     LTRACEF_LEVEL(2, "%p offset %#" PRIx64 " node_offset %#" PRIx64 " index %zu\n", this, offset, node_offset,
                   index);
 
-    // lookup the tree node that holds this page
-    auto pln = list_.find(node_offset);
-    if (!pln.IsValid()) {
+    // lookup the leaf that holds this page
+    VmPageListNode* pln = LookupLeaf(LeafIndex(offset));
+    if (!pln) {
         return false;
     }
 
     // free this page
     auto page = pln->RemovePage(index);
     if (page) {
-        // if it was the last page in the node, remove the node from the tree
+        // if it was the last page in the leaf, remove the leaf from the tree
         if (pln->IsEmpty()) {
-            LTRACEF_LEVEL(2, "%p freeing the list node\n", this);
-            list_.erase(*pln);
+            PruneEmpty(LeafIndex(offset), LeafIndex(offset));
         }
 
         *page_out = page;
@@ -177,15 +302,9 @@ bool VmPageList::RemovePage(uint64_t offset, vm_page_t** page_out) {
 }
 
 void VmPageList::FreePages(uint64_t start_offset, uint64_t end_offset) {
-    // Find the first node with a start after start_offset; if start_offset
-    // is in a node, it'll be in the one before that one.
-    auto start = --list_.upper_bound(start_offset);
-    if (!start.IsValid()) {
-        start = list_.begin();
+    if (end_offset <= start_offset) {
+        return;
     }
-    // Find the first node which is completely after the end of the region. If
-    // end_offset falls in the middle of a node, this finds the next node.
-    const auto end = list_.lower_bound(end_offset);
 
     list_node list;
     list_initialize(&list);
@@ -198,19 +317,36 @@ void VmPageList::FreePages(uint64_t start_offset, uint64_t end_offset) {
         return ZX_ERR_NEXT;
     };
 
-    // Iterate through all nodes which have at least some overlap with the
-    // region, freeing the pages and erasing nodes which become empty.
-    while (start != end) {
-        auto cur = start++;
-        cur->ForEveryPage(per_page_func, start_offset, end_offset);
-        if (cur->IsEmpty()) {
-            list_.erase(cur);
-        }
-    }
+    // Free the pages of every leaf which has some overlap with the region,
+    // then drop the leaves and interior nodes which became empty.
+    ForEveryPageInRange(per_page_func, start_offset, end_offset);
+    PruneEmpty(LeafIndex(start_offset), LeafIndex(end_offset - 1));
 
     pmm_free(&list);
 }
 
+zx_status_t VmPageList::PopulateRange(uint64_t start_offset, uint64_t end_offset) {
+    if (end_offset <= start_offset) {
+        return ZX_OK;
+    }
+    if (offset_to_node_offset(end_offset - 1) >= VmObjectPaged::MAX_SIZE) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+
+    const uint64_t first = LeafIndex(start_offset);
+    const uint64_t last = LeafIndex(end_offset - 1);
+    for (uint64_t leaf_index = first; leaf_index <= last; leaf_index++) {
+        VmPageListNode* pln;
+        zx_status_t status = LookupOrAllocateLeaf(leaf_index, &pln);
+        if (status != ZX_OK) {
+            // drop whatever was allocated, leaving the list as it was
+            PruneEmpty(first, leaf_index);
+            return status;
+        }
+    }
+    return ZX_OK;
+}
+
 size_t VmPageList::FreeAllPages() {
     LTRACEF("%p\n", this);
 
@@ -236,13 +372,17 @@ size_t VmPageList::FreeAllPages() {
     pmm_free(&list);
 
     // empty the tree
-    list_.clear();
+    if (root_) {
+        FreeNode(root_, height_);
+        root_ = nullptr;
+    }
+    height_ = 0;
 
     return count;
 }
 
 bool VmPageList::IsEmpty() {
-    return list_.is_empty();
+    return root_ == nullptr;
 }
 
 VmPageSpliceList VmPageList::TakePages(uint64_t offset, uint64_t length) {
@@ -260,14 +400,18 @@ VmPageSpliceList VmPageList::TakePages(uint64_t offset, uint64_t length) {
     }
 
     // As long as the current and end node offsets are different, we
-    // can just move the whole node into the splice list.
-    while (offset_to_node_offset(offset) != offset_to_node_offset(end)) {
-        ktl::unique_ptr<VmPageListNode> node = list_.erase(offset_to_node_offset(offset));
+    // can just move the whole node into the splice list.  Walk the
+    // whole nodes backwards so that pushing each onto the front of the
+    // splice list leaves them in ascending order.
+    const uint64_t tail_offset = offset_to_node_offset(end);
+    for (uint64_t node_offset = tail_offset; node_offset != offset_to_node_offset(offset);) {
+        node_offset -= PAGE_SIZE * VmPageListNode::kPageFanOut;
+        ktl::unique_ptr<VmPageListNode> node = DetachLeaf(LeafIndex(node_offset));
         if (node) {
-            res.middle_.insert(ktl::move(node));
+            res.middle_.push_front(ktl::move(node));
         }
-        offset += (PAGE_SIZE * VmPageListNode::kPageFanOut);
     }
+    offset = fbl::max(offset, tail_offset);
 
     // Move any remaining pages into the splice list tail_ node.
     while (offset < end) {
@@ -343,10 +487,13 @@ vm_page* VmPageSpliceList::Pop() {
         res = head_.RemovePage(cur_node_idx);
     } else if (cur_node_offset != offset_to_node_offset(offset_ + length_)) {
         // If the current offset isn't pointing to the tail node,
-        // look in the middle tree.
-        auto middle_node = middle_.find(cur_node_offset);
-        if (middle_node.IsValid()) {
-            res = middle_node->RemovePage(cur_node_idx);
+        // look in the middle list.  Nodes are released once the last
+        // offset they cover has been popped.
+        if (!middle_.is_empty() && middle_.front().offset() == cur_node_offset) {
+            res = middle_.front().RemovePage(cur_node_idx);
+            if (cur_node_idx == VmPageListNode::kPageFanOut - 1) {
+                middle_.pop_front();
+            }
         } else {
             res = nullptr;
         }
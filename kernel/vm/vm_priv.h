@@ -28,3 +28,15 @@ static inline paddr_t vm_get_zero_page_paddr(void) {
 
     return zero_page_paddr;
 }
+
+// Large pages the VM uses to map physically contiguous, suitably aligned runs
+// of a VMO with a single page table entry. Only the x86 page tables split a
+// large page back down when part of it is unmapped or protected, so other
+// architectures always map with base pages.
+#define VM_LARGE_PAGE_SHIFT 21
+#define VM_LARGE_PAGE_SIZE (1UL << VM_LARGE_PAGE_SHIFT)
+#if ARCH_X86
+#define VM_LARGE_PAGES 1
+#else
+#define VM_LARGE_PAGES 0
+#endif
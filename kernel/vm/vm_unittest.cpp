@@ -4,13 +4,19 @@
 // license that can be found in the LICENSE file or at
 // https://opensource.org/licenses/MIT
 
+#include "vm_priv.h"
 #include <assert.h>
 #include <err.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/array.h>
+#include <kernel/cmdline.h>
 #include <ktl/move.h>
 #include <lib/unittest/unittest.h>
+#include <platform.h>
+#include <vm/compressed_page.h>
+#include <vm/page_source.h>
 #include <vm/physmap.h>
+#include <vm/shared_page.h>
 #include <vm/vm.h>
 #include <vm/vm_address_region.h>
 #include <vm/vm_aspace.h>
@@ -325,6 +331,109 @@ static bool vmaspace_alloc_smoke_test() {
     END_TEST;
 }
 
+// Maps a large number of small regions into an address space, so that placing
+// each new one has to find a gap among all of the others, and then punches
+// holes in them and fills them back in.
+static bool vmaspace_many_regions_test() {
+    BEGIN_TEST;
+    static const size_t kNumRegions = 100000;
+
+    auto aspace = VmAspace::Create(0, "test aspace many");
+    ASSERT_TRUE(aspace, "creating aspace\n");
+    fbl::RefPtr<VmAddressRegion> root = aspace->RootVmar();
+
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, PAGE_SIZE, &vmo);
+    ASSERT_EQ(ZX_OK, status, "vmobject creation\n");
+
+    fbl::AllocChecker ac;
+    fbl::Array<fbl::RefPtr<VmMapping>> mappings(new (&ac) fbl::RefPtr<VmMapping>[kNumRegions],
+                                                kNumRegions);
+    ASSERT_TRUE(ac.check(), "allocating mapping array\n");
+
+    zx_time_t start = current_time();
+    for (size_t i = 0; i < kNumRegions; i++) {
+        status = root->CreateVmMapping(0, PAGE_SIZE, 0, VMAR_CAN_RWX_FLAGS, vmo, 0,
+                                       kArchRwFlags, "test", &mappings[i]);
+        ASSERT_EQ(ZX_OK, status, "mapping region\n");
+    }
+    zx_duration_t elapsed = current_time() - start;
+    unittest_printf("mapped %zu regions in %" PRIi64 " ns per region\n", kNumRegions,
+                    elapsed / static_cast<zx_duration_t>(kNumRegions));
+
+    // Every region is where the aspace thinks it is.
+    for (size_t i = 0; i < kNumRegions; i++) {
+        auto region = root->FindRegion(mappings[i]->base());
+        EXPECT_TRUE(region.get() == mappings[i].get(), "looking up region\n");
+    }
+
+    // Unmap every other region, and map larger ones among those that remain.
+    for (size_t i = 0; i < kNumRegions; i += 2) {
+        status = mappings[i]->Unmap(mappings[i]->base(), PAGE_SIZE);
+        EXPECT_EQ(ZX_OK, status, "unmapping region\n");
+        mappings[i].reset();
+    }
+    fbl::RefPtr<VmObject> big_vmo;
+    status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, 2 * PAGE_SIZE, &big_vmo);
+    ASSERT_EQ(ZX_OK, status, "vmobject creation\n");
+    for (size_t i = 0; i < kNumRegions; i += 2) {
+        status = root->CreateVmMapping(0, 2 * PAGE_SIZE, 0, VMAR_CAN_RWX_FLAGS, big_vmo, 0,
+                                       kArchRwFlags, "test", &mappings[i]);
+        ASSERT_EQ(ZX_OK, status, "mapping region\n");
+        auto region = root->FindRegion(mappings[i]->base() + PAGE_SIZE);
+        EXPECT_TRUE(region.get() == mappings[i].get(), "looking up region\n");
+    }
+
+    status = aspace->Destroy();
+    EXPECT_EQ(ZX_OK, status, "VmAspace::Destroy");
+    END_TEST;
+}
+
+// Fragments a VMAR so that a single gap can fit a request, and checks that
+// randomized placement finds it.
+static bool vmaspace_fragmented_alloc_test() {
+    BEGIN_TEST;
+    static const size_t kHoles = 512;
+    static const size_t kVmarSize = (2 * kHoles + 2) * PAGE_SIZE;
+
+    auto aspace = VmAspace::Create(0, "test aspace fragmented");
+    ASSERT_TRUE(aspace, "creating aspace\n");
+
+    fbl::RefPtr<VmAddressRegion> vmar;
+    zx_status_t status = aspace->RootVmar()->CreateSubVmar(
+        0, kVmarSize, 0, VMAR_FLAG_CAN_MAP_SPECIFIC | VMAR_CAN_RWX_FLAGS, "test vmar", &vmar);
+    ASSERT_EQ(ZX_OK, status, "creating vmar\n");
+
+    fbl::RefPtr<VmObject> vmo;
+    status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, 2 * PAGE_SIZE, &vmo);
+    ASSERT_EQ(ZX_OK, status, "vmobject creation\n");
+
+    // Map every other page, which leaves one-page holes and a three-page one
+    // at the top.
+    for (size_t i = 0; i < kHoles; i++) {
+        fbl::RefPtr<VmMapping> mapping;
+        status = vmar->CreateVmMapping(2 * i * PAGE_SIZE, PAGE_SIZE, 0,
+                                       VMAR_FLAG_SPECIFIC | VMAR_CAN_RWX_FLAGS, vmo, 0,
+                                       kArchRwFlags, "test", &mapping);
+        ASSERT_EQ(ZX_OK, status, "mapping region\n");
+    }
+
+    for (int i = 0; i < 16; i++) {
+        fbl::RefPtr<VmMapping> mapping;
+        status = vmar->CreateVmMapping(0, 2 * PAGE_SIZE, 0, VMAR_CAN_RWX_FLAGS, vmo, 0,
+                                       kArchRwFlags, "test", &mapping);
+        ASSERT_EQ(ZX_OK, status, "mapping region\n");
+        EXPECT_GE(mapping->base(), vmar->base() + (2 * kHoles - 1) * PAGE_SIZE,
+                  "mapped in the only gap that fits\n");
+        status = mapping->Destroy();
+        EXPECT_EQ(ZX_OK, status, "destroying mapping\n");
+    }
+
+    status = aspace->Destroy();
+    EXPECT_EQ(ZX_OK, status, "VmAspace::Destroy");
+    END_TEST;
+}
+
 // Doesn't do anything, just prints all aspaces.
 // Should be run after all other tests so that people can manually comb
 // through the output for leaked test aspaces.
@@ -637,6 +746,126 @@ static bool vmo_demand_paged_map_test() {
     END_TEST;
 }
 
+// Creates a vm object with resident pages, maps it demand paged, and checks
+// that faulting in one page also maps its neighbors, read-only.
+static bool vmo_fault_around_test() {
+    BEGIN_TEST;
+    static const size_t alloc_size = PAGE_SIZE * 16;
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, alloc_size, &vmo);
+    ASSERT_EQ(status, ZX_OK, "vmobject creation\n");
+    ASSERT_TRUE(vmo, "vmobject creation\n");
+
+    // give each page a distinct first byte, which also commits it
+    for (size_t i = 0; i < alloc_size / PAGE_SIZE; i++) {
+        uint8_t val = static_cast<uint8_t>(i + 1);
+        status = vmo->Write(&val, i * PAGE_SIZE, sizeof(val));
+        ASSERT_EQ(ZX_OK, status, "writing vmo");
+    }
+
+    auto ka = VmAspace::kernel_aspace();
+    void* ptr;
+    auto ret = ka->MapObjectInternal(vmo, "test", 0, alloc_size, &ptr,
+                                     0, 0, kArchRwFlags);
+    ASSERT_EQ(ZX_OK, ret, "mapping object");
+
+    volatile uint8_t* base = static_cast<volatile uint8_t*>(ptr);
+    EXPECT_EQ(1u, base[0], "first page contents");
+
+    if (cmdline_get_uint32("kernel.vm.fault-around-pages", 16) > 1) {
+        paddr_t pa;
+        uint flags;
+        status = ka->arch_aspace().Query(reinterpret_cast<vaddr_t>(ptr) + PAGE_SIZE, &pa, &flags);
+        EXPECT_EQ(ZX_OK, status, "neighbor mapped by fault-around");
+        EXPECT_FALSE(flags & ARCH_MMU_FLAG_PERM_WRITE, "neighbor mapped read-only");
+    }
+
+    for (size_t i = 0; i < alloc_size / PAGE_SIZE; i++) {
+        EXPECT_EQ(static_cast<uint8_t>(i + 1), base[i * PAGE_SIZE], "page contents");
+    }
+
+    // writing through a page mapped by fault-around still lands in the vmo
+    base[PAGE_SIZE] = 0xff;
+    uint8_t val;
+    status = vmo->Read(&val, PAGE_SIZE, sizeof(val));
+    EXPECT_EQ(ZX_OK, status, "reading vmo");
+    EXPECT_EQ(0xff, val, "written contents");
+
+    auto err = ka->FreeRegion(reinterpret_cast<vaddr_t>(ptr));
+    EXPECT_EQ(ZX_OK, err, "unmapping object");
+    END_TEST;
+}
+
+// Maps a contiguous vm object and checks that a fault maps the whole large
+// page around it, and that unmapping part of it splits it back down.
+static bool vmo_large_page_test() {
+    BEGIN_TEST;
+    static const size_t alloc_size = VM_LARGE_PAGE_SIZE * 2;
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::CreateContiguous(PMM_ALLOC_FLAG_ANY, alloc_size,
+                                                         VM_LARGE_PAGE_SHIFT, &vmo);
+    ASSERT_EQ(status, ZX_OK, "vmobject creation\n");
+    ASSERT_TRUE(vmo, "vmobject creation\n");
+
+    auto ka = VmAspace::kernel_aspace();
+    void* ptr;
+    auto ret = ka->MapObjectInternal(vmo, "test", 0, alloc_size, &ptr,
+                                     VM_LARGE_PAGE_SHIFT, 0, kArchRwFlags);
+    ASSERT_EQ(ZX_OK, ret, "mapping object");
+
+    volatile uint8_t* base = static_cast<volatile uint8_t*>(ptr);
+    const vaddr_t va = reinterpret_cast<vaddr_t>(ptr);
+    base[0] = 0x5a;
+
+#if VM_LARGE_PAGES
+    // the far end of the block is mapped writable without faulting on it
+    paddr_t pa0, pa;
+    uint flags;
+    status = ka->arch_aspace().Query(va, &pa0, &flags);
+    EXPECT_EQ(ZX_OK, status, "faulting page mapped");
+    status = ka->arch_aspace().Query(va + VM_LARGE_PAGE_SIZE - PAGE_SIZE, &pa, &flags);
+    EXPECT_EQ(ZX_OK, status, "rest of the large page mapped");
+    EXPECT_EQ(pa0 + VM_LARGE_PAGE_SIZE - PAGE_SIZE, pa, "contiguous physical pages");
+    EXPECT_TRUE(flags & ARCH_MMU_FLAG_PERM_WRITE, "large page mapped writable");
+
+    // punching a hole splits the large page and leaves the rest mapped
+    status = ka->arch_aspace().Unmap(va + PAGE_SIZE, 1, nullptr);
+    EXPECT_EQ(ZX_OK, status, "unmapping one page");
+    status = ka->arch_aspace().Query(va + PAGE_SIZE, &pa, &flags);
+    EXPECT_EQ(ZX_ERR_NOT_FOUND, status, "hole unmapped");
+    status = ka->arch_aspace().Query(va + 2 * PAGE_SIZE, &pa, &flags);
+    EXPECT_EQ(ZX_OK, status, "neighbor still mapped");
+    EXPECT_EQ(pa0 + 2 * PAGE_SIZE, pa, "neighbor unchanged");
+#endif
+
+    // the hole faults back in with the same contents
+    base[PAGE_SIZE] = 0xa5;
+    EXPECT_EQ(0x5a, base[0], "first page contents");
+    uint8_t val;
+    status = vmo->Read(&val, PAGE_SIZE, sizeof(val));
+    EXPECT_EQ(ZX_OK, status, "reading vmo");
+    EXPECT_EQ(0xa5, val, "written contents");
+
+    // a read fault maps the second block without write permissions, and a
+    // later write fault upgrades it
+    EXPECT_EQ(0, base[VM_LARGE_PAGE_SIZE], "second block contents");
+#if VM_LARGE_PAGES
+    status = ka->arch_aspace().Query(va + 2 * VM_LARGE_PAGE_SIZE - PAGE_SIZE, &pa, &flags);
+    EXPECT_EQ(ZX_OK, status, "second block mapped");
+    EXPECT_FALSE(flags & ARCH_MMU_FLAG_PERM_WRITE, "read fault maps read-only");
+#endif
+    base[VM_LARGE_PAGE_SIZE] = 0x3c;
+#if VM_LARGE_PAGES
+    status = ka->arch_aspace().Query(va + 2 * VM_LARGE_PAGE_SIZE - PAGE_SIZE, &pa, &flags);
+    EXPECT_EQ(ZX_OK, status, "second block mapped");
+    EXPECT_TRUE(flags & ARCH_MMU_FLAG_PERM_WRITE, "write fault maps writable");
+#endif
+
+    auto err = ka->FreeRegion(va);
+    EXPECT_EQ(ZX_OK, err, "unmapping object");
+    END_TEST;
+}
+
 // Creates a vm object, maps it, drops ref before unmapping.
 static bool vmo_dropped_ref_test() {
     BEGIN_TEST;
@@ -973,6 +1202,329 @@ static bool vmo_lookup_test() {
     END_TEST;
 }
 
+// Times committing, looking up and decommitting the pages of a large vmo, which
+// is dominated by VmPageList operations.
+static bool vmo_large_commit_benchmark() {
+    BEGIN_TEST;
+
+    static const size_t alloc_size = 64 * 1024 * 1024;
+    static const size_t num_pages = alloc_size / PAGE_SIZE;
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, alloc_size, &vmo);
+    ASSERT_EQ(status, ZX_OK, "vmobject creation\n");
+    ASSERT_TRUE(vmo, "vmobject creation\n");
+
+    zx_time_t start = current_time();
+    status = vmo->CommitRange(0, alloc_size);
+    zx_duration_t commit_time = current_time() - start;
+    ASSERT_EQ(ZX_OK, status, "committing vm object\n");
+    EXPECT_EQ(num_pages, vmo->AllocatedPages(), "committing vm object\n");
+
+    size_t pages_seen = 0;
+    auto lookup_fn = [](void* context, size_t offset, size_t index, paddr_t pa) {
+        size_t* pages_seen = static_cast<size_t*>(context);
+        (*pages_seen)++;
+        return ZX_OK;
+    };
+    start = current_time();
+    status = vmo->Lookup(0, alloc_size, lookup_fn, &pages_seen);
+    zx_duration_t lookup_time = current_time() - start;
+    EXPECT_EQ(ZX_OK, status, "lookup on committed pages\n");
+    EXPECT_EQ(num_pages, pages_seen, "lookup on committed pages\n");
+
+    // Look up every page individually, in a scattered order so that each
+    // lookup walks the page list from the top.
+    start = current_time();
+    for (size_t i = 0; i < num_pages; i++) {
+        const uint64_t offset = ((i * 7919) % num_pages) * PAGE_SIZE;
+        paddr_t pa;
+        status = vmo->GetPage(offset, 0, nullptr, nullptr, nullptr, &pa);
+        if (status != ZX_OK) {
+            break;
+        }
+    }
+    zx_duration_t get_page_time = current_time() - start;
+    EXPECT_EQ(ZX_OK, status, "getting page\n");
+
+    start = current_time();
+    status = vmo->DecommitRange(0, alloc_size);
+    zx_duration_t decommit_time = current_time() - start;
+    EXPECT_EQ(ZX_OK, status, "decommitting vm object\n");
+    EXPECT_EQ(0u, vmo->AllocatedPages(), "decommitting vm object\n");
+
+    const zx_duration_t pages = static_cast<zx_duration_t>(num_pages);
+    unittest_printf("%zu pages: commit %" PRIi64 " ns, lookup %" PRIi64 " ns, "
+                    "get page %" PRIi64 " ns, decommit %" PRIi64 " ns per page\n",
+                    num_pages, commit_time / pages, lookup_time / pages,
+                    get_page_time / pages, decommit_time / pages);
+
+    END_TEST;
+}
+
+// A page source which never provides pages itself; tests supply them with
+// VmObject::SupplyPages instead.
+class TestPageSource : public PageSource {
+protected:
+    bool GetPage(uint64_t offset, vm_page_t** const page_out, paddr_t* const pa_out) override {
+        return false;
+    }
+    void GetPageAsync(page_request_t* request) override {}
+    void ClearAsyncRequest(page_request_t* request) override {}
+    void SwapRequest(page_request_t* old, page_request_t* new_req) override {}
+    void OnDetach() override {}
+    void OnClose() override {}
+    zx_status_t WaitOnEvent(event_t* event) override { return ZX_ERR_NOT_SUPPORTED; }
+};
+
+// Tests that the page reclaimer ages and then evicts clean pages of a pager
+// backed vmo, leaving pinned pages alone.
+static bool vmo_reclaim_test() {
+    BEGIN_TEST;
+
+    static const size_t num_pages = 16;
+    static const size_t alloc_size = num_pages * PAGE_SIZE;
+
+    fbl::AllocChecker ac;
+    fbl::RefPtr<PageSource> src = fbl::AdoptRef<PageSource>(new (&ac) TestPageSource());
+    ASSERT_TRUE(ac.check(), "page source creation\n");
+
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::CreateExternal(ktl::move(src), alloc_size, &vmo);
+    ASSERT_EQ(ZX_OK, status, "vmobject creation\n");
+
+    // Supply every page, the way a pager would.
+    fbl::RefPtr<VmObject> aux_vmo;
+    status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, alloc_size, &aux_vmo);
+    ASSERT_EQ(ZX_OK, status, "vmobject creation\n");
+    status = aux_vmo->CommitRange(0, alloc_size);
+    ASSERT_EQ(ZX_OK, status, "committing vm object\n");
+    VmPageSpliceList pages;
+    status = aux_vmo->TakePages(0, alloc_size, &pages);
+    ASSERT_EQ(ZX_OK, status, "taking pages\n");
+    status = vmo->SupplyPages(0, alloc_size, &pages);
+    ASSERT_EQ(ZX_OK, status, "supplying pages\n");
+    EXPECT_EQ(num_pages, vmo->AllocatedPages(), "supplying pages\n");
+
+    status = vmo->Pin(0, PAGE_SIZE);
+    ASSERT_EQ(ZX_OK, status, "pinning page\n");
+
+    VmObjectPaged* paged = VmObjectPaged::AsVmObjectPaged(vmo);
+    ASSERT_NONNULL(paged, "paged vmo\n");
+
+    // Supplied pages start out referenced, so the first sweep only ages them.
+    EXPECT_EQ(0u, paged->ReclaimPages(num_pages, num_pages), "first sweep\n");
+    EXPECT_EQ(num_pages, vmo->AllocatedPages(), "first sweep\n");
+
+    // The second sweep evicts everything except the pinned page.
+    EXPECT_EQ(num_pages - 1, paged->ReclaimPages(num_pages, num_pages), "second sweep\n");
+    EXPECT_EQ(1u, vmo->AllocatedPages(), "second sweep\n");
+
+    vmo->Unpin(0, PAGE_SIZE);
+
+    END_TEST;
+}
+
+// Tests that the page reclaimer compresses cold pages of an anonymous vmo,
+// leaving pinned and incompressible pages alone, and that the pages read back
+// intact.
+static bool vmo_compression_test() {
+    BEGIN_TEST;
+
+    static const size_t num_pages = 16;
+    static const size_t alloc_size = num_pages * PAGE_SIZE;
+
+    if (VmCompressedPage::BudgetExhausted()) {
+        unittest_printf("compression is disabled, skipping\n");
+        END_TEST;
+    }
+
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, VmObjectPaged::kCompressible,
+                                               alloc_size, &vmo);
+    ASSERT_EQ(ZX_OK, status, "vmobject creation\n");
+
+    // Every page but the last gets an easily compressed pattern, and the last
+    // one pseudo-random data that won't compress.
+    fbl::AllocChecker ac;
+    fbl::Array<uint8_t> a(new (&ac) uint8_t[alloc_size], alloc_size);
+    ASSERT_TRUE(ac.check(), "");
+    for (size_t i = 0; i < num_pages - 1; i++) {
+        memset(a.get() + i * PAGE_SIZE, static_cast<int>(i), PAGE_SIZE);
+    }
+    fill_region(99, a.get() + alloc_size - PAGE_SIZE, PAGE_SIZE);
+    status = vmo->Write(a.get(), 0, alloc_size);
+    ASSERT_EQ(ZX_OK, status, "writing to object\n");
+
+    status = vmo->Pin(0, PAGE_SIZE);
+    ASSERT_EQ(ZX_OK, status, "pinning page\n");
+
+    VmObjectPaged* paged = VmObjectPaged::AsVmObjectPaged(vmo);
+    ASSERT_NONNULL(paged, "paged vmo\n");
+
+    // Freshly written pages are referenced, so the first sweep only ages them.
+    EXPECT_EQ(0u, paged->ReclaimPages(num_pages, num_pages), "first sweep\n");
+
+    // The second sweep compresses everything except the pinned page and the
+    // random one.  Compressed pages still count as committed.
+    EXPECT_EQ(num_pages - 2, paged->ReclaimPages(num_pages, num_pages), "second sweep\n");
+    EXPECT_EQ(num_pages, vmo->AllocatedPages(), "second sweep\n");
+
+    vmo->Unpin(0, PAGE_SIZE);
+
+    fbl::Array<uint8_t> b(new (&ac) uint8_t[alloc_size], alloc_size);
+    ASSERT_TRUE(ac.check(), "");
+    status = vmo->Read(b.get(), 0, alloc_size);
+    EXPECT_EQ(ZX_OK, status, "reading from object\n");
+    EXPECT_EQ(0, memcmp(a.get(), b.get(), alloc_size), "reading from object\n");
+
+    // Reading brought every page back, and the next two sweeps compress them
+    // again.
+    paged->ReclaimPages(num_pages, num_pages);
+    EXPECT_EQ(num_pages - 1, paged->ReclaimPages(num_pages, num_pages), "third sweep\n");
+
+    // Looking up the pages brings them back too.
+    size_t pages_seen = 0;
+    auto lookup_fn = [](void* context, size_t offset, size_t index, paddr_t pa) {
+        size_t* pages_seen = static_cast<size_t*>(context);
+        (*pages_seen)++;
+        return ZX_OK;
+    };
+    status = vmo->Lookup(0, alloc_size, lookup_fn, &pages_seen);
+    EXPECT_EQ(ZX_OK, status, "looking up compressed pages\n");
+    EXPECT_EQ(num_pages, pages_seen, "looking up compressed pages\n");
+
+    status = vmo->DecommitRange(0, alloc_size);
+    EXPECT_EQ(ZX_OK, status, "decommitting vm object\n");
+    EXPECT_EQ(0u, vmo->AllocatedPages(), "decommitting vm object\n");
+
+    END_TEST;
+}
+
+static bool vmo_dedup_test() {
+    BEGIN_TEST;
+
+    static const size_t num_pages = 4;
+    static const size_t alloc_size = num_pages * PAGE_SIZE;
+
+    // Both objects get the same contents, with the second page left as zeros.
+    fbl::AllocChecker ac;
+    fbl::Array<uint8_t> a(new (&ac) uint8_t[alloc_size], alloc_size);
+    ASSERT_TRUE(ac.check(), "");
+    fill_region(42, a.get(), alloc_size);
+    memset(a.get() + PAGE_SIZE, 0, PAGE_SIZE);
+
+    fbl::RefPtr<VmObject> vmo[2];
+    for (auto& v : vmo) {
+        zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0, alloc_size, &v);
+        ASSERT_EQ(ZX_OK, status, "vmobject creation\n");
+        status = v->Write(a.get(), 0, alloc_size);
+        ASSERT_EQ(ZX_OK, status, "writing to object\n");
+        status = v->DeduplicateRange(0, alloc_size);
+        EXPECT_EQ(ZX_OK, status, "deduplicating object\n");
+
+        // The page of zeros is freed, the others are shared but still count
+        // as committed.
+        EXPECT_EQ(num_pages - 1, v->AllocatedPages(), "deduplicating object\n");
+    }
+
+    auto lookup_func = [](void* ctx, size_t offset, size_t index, paddr_t pa) {
+        *static_cast<paddr_t*>(ctx) = pa;
+        return ZX_OK;
+    };
+    paddr_t pa[2];
+    for (size_t i = 0; i < 2; i++) {
+        zx_status_t status = vmo[i]->Lookup(0, PAGE_SIZE, lookup_func, &pa[i]);
+        EXPECT_EQ(ZX_OK, status, "vmo lookup\n");
+    }
+    EXPECT_EQ(pa[0], pa[1], "both objects see the same page\n");
+
+    // Writing to the first object has to leave the second one alone.
+    const uint8_t val = static_cast<uint8_t>(~a[0]);
+    zx_status_t status = vmo[0]->Write(&val, 0, sizeof(val));
+    ASSERT_EQ(ZX_OK, status, "writing to object\n");
+    status = vmo[0]->Lookup(0, PAGE_SIZE, lookup_func, &pa[0]);
+    EXPECT_EQ(ZX_OK, status, "vmo lookup\n");
+    EXPECT_NE(pa[0], pa[1], "writing made a private copy\n");
+
+    fbl::Array<uint8_t> b(new (&ac) uint8_t[alloc_size], alloc_size);
+    ASSERT_TRUE(ac.check(), "");
+    status = vmo[1]->Read(b.get(), 0, alloc_size);
+    EXPECT_EQ(ZX_OK, status, "reading from object\n");
+    EXPECT_EQ(0, memcmp(a.get(), b.get(), alloc_size), "reading from object\n");
+
+    a[0] = val;
+    status = vmo[0]->Read(b.get(), 0, alloc_size);
+    EXPECT_EQ(ZX_OK, status, "reading from object\n");
+    EXPECT_EQ(0, memcmp(a.get(), b.get(), alloc_size), "reading from object\n");
+
+    END_TEST;
+}
+
+// Pages whose hashes collide stay apart, and a new page is compared with only
+// a few of them before being shared on its own.
+static bool vmo_dedup_collision_test() {
+    BEGIN_TEST;
+
+    static const size_t num_pages = 16;
+    static const uint64_t hash = 0x5eed;
+
+    auto alloc_page = [](vm_page_t** page) {
+        paddr_t pa;
+        zx_status_t status = pmm_alloc_page(0, page, &pa);
+        if (status == ZX_OK) {
+            (*page)->state = VM_PAGE_STATE_OBJECT;
+            (*page)->object.pin_count = 0;
+        }
+        return status;
+    };
+
+    list_node free_list;
+    list_initialize(&free_list);
+
+    // Different contents, all with the same hash.
+    ktl::unique_ptr<VmSharedPageRef> refs[num_pages];
+    size_t lowest = 0;
+    size_t highest = 0;
+    for (size_t i = 0; i < num_pages; i++) {
+        vm_page_t* page;
+        ASSERT_EQ(ZX_OK, alloc_page(&page), "pmm_alloc single page\n");
+        fill_region(i + 1, paddr_to_physmap(page->paddr()), PAGE_SIZE);
+
+        refs[i] = VmSharedPageRef::ShareWithHash(i * PAGE_SIZE, page, hash, &free_list);
+        ASSERT_TRUE(refs[i] != nullptr, "sharing page\n");
+        EXPECT_EQ(page, refs[i]->page(), "colliding page is shared on its own\n");
+        EXPECT_TRUE(list_is_empty(&free_list), "colliding page is shared on its own\n");
+
+        if (page->paddr() < refs[lowest]->page()->paddr()) {
+            lowest = i;
+        }
+        if (page->paddr() > refs[highest]->page()->paddr()) {
+            highest = i;
+        }
+    }
+
+    // Colliding pages are compared in order of their physical addresses, so a
+    // copy of the first is found, and a copy of the last is not looked for.
+    ktl::unique_ptr<VmSharedPageRef> copies[2];
+    const size_t originals[2] = {lowest, highest};
+    for (size_t i = 0; i < 2; i++) {
+        vm_page_t* page;
+        ASSERT_EQ(ZX_OK, alloc_page(&page), "pmm_alloc single page\n");
+        memcpy(paddr_to_physmap(page->paddr()),
+               paddr_to_physmap(refs[originals[i]]->page()->paddr()), PAGE_SIZE);
+        copies[i] = VmSharedPageRef::ShareWithHash((num_pages + i) * PAGE_SIZE, page, hash,
+                                                   &free_list);
+        ASSERT_TRUE(copies[i] != nullptr, "sharing page\n");
+    }
+    EXPECT_EQ(refs[lowest]->page(), copies[0]->page(), "copy of the first page is shared\n");
+    EXPECT_EQ(1u, list_length(&free_list), "copy of the first page is freed\n");
+    EXPECT_NE(refs[highest]->page(), copies[1]->page(), "comparisons are bounded\n");
+
+    pmm_free(&free_list);
+
+    END_TEST;
+}
+
 // TODO(ZX-1431): The ARM code's error codes are always ZX_ERR_INTERNAL, so
 // special case that.
 #if ARCH_ARM64
@@ -1335,6 +1887,8 @@ VM_UNITTEST(vmm_alloc_contiguous_missing_flag_commit_fails)
 VM_UNITTEST(vmm_alloc_contiguous_zero_size_fails)
 VM_UNITTEST(vmaspace_create_smoke_test)
 VM_UNITTEST(vmaspace_alloc_smoke_test)
+VM_UNITTEST(vmaspace_many_regions_test)
+VM_UNITTEST(vmaspace_fragmented_alloc_test)
 VM_UNITTEST(vmo_create_test)
 VM_UNITTEST(vmo_create_maximum_size)
 VM_UNITTEST(vmo_pin_test)
@@ -1346,12 +1900,19 @@ VM_UNITTEST(vmo_create_contiguous_test)
 VM_UNITTEST(vmo_contiguous_decommit_test)
 VM_UNITTEST(vmo_precommitted_map_test)
 VM_UNITTEST(vmo_demand_paged_map_test)
+VM_UNITTEST(vmo_fault_around_test)
+VM_UNITTEST(vmo_large_page_test)
 VM_UNITTEST(vmo_dropped_ref_test)
 VM_UNITTEST(vmo_remap_test)
 VM_UNITTEST(vmo_double_remap_test)
 VM_UNITTEST(vmo_read_write_smoke_test)
 VM_UNITTEST(vmo_cache_test)
 VM_UNITTEST(vmo_lookup_test)
+VM_UNITTEST(vmo_large_commit_benchmark)
+VM_UNITTEST(vmo_reclaim_test)
+VM_UNITTEST(vmo_compression_test)
+VM_UNITTEST(vmo_dedup_test)
+VM_UNITTEST(vmo_dedup_collision_test)
 VM_UNITTEST(arch_noncontiguous_map)
 // Uncomment for debugging
 // VM_UNITTEST(dump_all_aspaces)  // Run last
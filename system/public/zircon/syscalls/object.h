@@ -425,6 +425,7 @@ typedef struct zx_info_resource {
 // Argument is a size_t.
 #define ZX_PROP_SOCKET_RX_THRESHOLD         12u
 #define ZX_PROP_SOCKET_TX_THRESHOLD         13u
+#define ZX_PROP_SOCKET_RX_BUFFER_MAX        16u
 
 // Terminate this job if the system is low on memory.
 #define ZX_PROP_JOB_KILL_ON_OOM             15u
@@ -15,6 +15,7 @@ __BEGIN_CDECLS
 // zx_object_wait_async() options
 #define ZX_WAIT_ASYNC_ONCE          ((uint32_t)0u)
 #define ZX_WAIT_ASYNC_REPEATING     ((uint32_t)1u)
+#define ZX_WAIT_ASYNC_LEVEL         ((uint32_t)2u)
 
 // packet types.  zx_port_packet_t::type
 #define ZX_PKT_TYPE_USER            ((uint8_t)0x00u)
@@ -31,6 +32,9 @@ __BEGIN_CDECLS
 // For options passed to port_create
 #define ZX_PORT_BIND_TO_INTERRUPT   ((uint32_t)(0x1u << 0))
 
+// Most packets port_wait_batch can return at once
+#define ZX_PORT_MAX_BATCH_PACKETS   ((uint32_t)64u)
+
 #define ZX_PKT_TYPE_MASK            ((uint32_t)0x000000FFu)
 
 #define ZX_PKT_IS_USER(type)          ((type) == ZX_PKT_TYPE_USER)
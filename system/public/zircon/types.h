@@ -192,6 +192,16 @@ typedef struct zx_channel_call_args {
     uint32_t rd_num_handles;
 } zx_channel_call_args_t;
 
+// Structure for zx_channel_write_batch() and zx_channel_read_batch(), one per
+// message.  When reading, |num_bytes| and |num_handles| give the size of the
+// buffers on input, and the size of the message read into them on output.
+typedef struct zx_channel_msg {
+    void* bytes;
+    zx_handle_t* handles;
+    uint32_t num_bytes;
+    uint32_t num_handles;
+} zx_channel_msg_t;
+
 // Maximum number of wait items allowed for zx_object_wait_many()
 // TODO(ZX-1349) Re-lower this.
 #define ZX_WAIT_MANY_MAX_ITEMS ((size_t)16)
@@ -205,6 +215,7 @@ typedef struct zx_wait_item {
 
 // VM Object creation options
 #define ZX_VMO_NON_RESIZABLE             ((uint32_t)1u)
+#define ZX_VMO_LARGE_PAGES               ((uint32_t)2u)
 
 // VM Object opcodes
 #define ZX_VMO_OP_COMMIT                 ((uint32_t)1u)
@@ -216,6 +227,7 @@ typedef struct zx_wait_item {
 #define ZX_VMO_OP_CACHE_INVALIDATE       ((uint32_t)7u)
 #define ZX_VMO_OP_CACHE_CLEAN            ((uint32_t)8u)
 #define ZX_VMO_OP_CACHE_CLEAN_INVALIDATE ((uint32_t)9u)
+#define ZX_VMO_OP_DEDUPLICATE            ((uint32_t)10u)
 
 // VM Object clone flags
 #define ZX_VMO_CLONE_COPY_ON_WRITE        ((uint32_t)1u << 0)
@@ -281,6 +293,7 @@ typedef uint64_t zx_off_t;
 
 #define ZX_CHANNEL_MAX_MSG_BYTES            ((uint32_t)65536u)
 #define ZX_CHANNEL_MAX_MSG_HANDLES          ((uint32_t)64u)
+#define ZX_CHANNEL_MAX_BATCH_MSGS           ((uint32_t)32u)
 
 // Socket options and limits.
 // These options can be passed to zx_socket_shutdown().
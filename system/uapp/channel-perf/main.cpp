@@ -11,8 +11,10 @@
 #include <stdlib.h>
 
 #include <fbl/algorithm.h>
+#include <fbl/unique_free_ptr.h>
 #include <fbl/unique_ptr.h>
 #include <zircon/compiler.h>
+#include <zircon/limits.h>
 #include <zircon/syscalls.h>
 #include <zircon/time.h>
 #include <zircon/types.h>
@@ -34,6 +36,9 @@ struct TestArgs {
     uint32_t size;
     uint32_t handles;
     uint32_t queue;
+    // Whether the message buffer starts on a page boundary.  Large messages read into page
+    // aligned memory can have their pages moved rather than copied.
+    bool page_aligned;
 };
 
 void do_test(uint32_t duration_sec, const TestArgs& test_args) {
@@ -51,10 +56,15 @@ void do_test(uint32_t duration_sec, const TestArgs& test_args) {
     status = zx_event_create(0u, &event);
     assert(status == ZX_OK);
 
-    // Storage space for our messages' stuff.
-    fbl::unique_ptr<uint8_t[]> data;
+    // Storage space for our messages' stuff.  An unaligned buffer is offset by a byte from
+    // the start of a page.
+    fbl::unique_free_ptr<uint8_t> data_storage;
+    uint8_t* data = nullptr;
     if (test_args.size) {
-        data.reset(new uint8_t[test_args.size]);
+        const size_t alloc_size = fbl::round_up(test_args.size + 1u, ZX_PAGE_SIZE);
+        data_storage.reset(static_cast<uint8_t*>(aligned_alloc(ZX_PAGE_SIZE, alloc_size)));
+        assert(data_storage);
+        data = data_storage.get() + (test_args.page_aligned ? 0 : 1);
         for (uint32_t i = 0; i < test_args.size; i++)
             data[i] = static_cast<uint8_t>(i);
     }
@@ -65,7 +75,7 @@ void do_test(uint32_t duration_sec, const TestArgs& test_args) {
     // Pre-queue |test_args.queue| messages (there'll always be this many messages in the queue).
     for (uint32_t i = 0; i < test_args.queue; i++) {
         duplicate_handles(test_args.handles, event, handles.get());
-        status = zx_channel_write(mp[0], 0u, data.get(), test_args.size,
+        status = zx_channel_write(mp[0], 0u, data, test_args.size,
                                   handles.get(), test_args.handles);
         assert(status == ZX_OK);
     }
@@ -79,13 +89,13 @@ void do_test(uint32_t duration_sec, const TestArgs& test_args) {
     for (;;) {
         big_its++;
         for (uint32_t i = 0; i < big_it_size; i++) {
-            status = zx_channel_write(mp[0], 0, data.get(), test_args.size,
+            status = zx_channel_write(mp[0], 0, data, test_args.size,
                                       handles.get(), test_args.handles);
             assert(status == ZX_OK);
 
             uint32_t r_size = test_args.size;
             uint32_t r_handles = test_args.handles;
-            status = zx_channel_read(mp[1], 0u, data.get(), handles.get(), r_size,
+            status = zx_channel_read(mp[1], 0u, data, handles.get(), r_size,
                                      r_handles, &r_size, &r_handles);
             assert(status == ZX_OK);
             assert(r_size == test_args.size);
@@ -110,9 +120,11 @@ void do_test(uint32_t duration_sec, const TestArgs& test_args) {
 
     double real_duration = static_cast<double>(zx_time_sub_time(end_ns, start_ns)) / 1000000000.0;
     double its_per_second = static_cast<double>(big_its) * big_it_size / real_duration;
-    printf("write/read %" PRIu32 " bytes, %" PRIu32 " handles (%" PRIu32 " pre-queued): "
-               "%.0f iterations/second\n",
-           test_args.size, test_args.handles, test_args.queue, its_per_second);
+    double mb_per_second = its_per_second * test_args.size / (1024.0 * 1024.0);
+    printf("write/read %" PRIu32 " bytes%s, %" PRIu32 " handles (%" PRIu32 " pre-queued): "
+               "%.0f iterations/second, %.1f MB/second\n",
+           test_args.size, test_args.page_aligned ? " (page aligned)" : "",
+           test_args.handles, test_args.queue, its_per_second, mb_per_second);
 }
 
 }  // namespace
@@ -129,7 +141,8 @@ int main(int argc, char** argv) {
         "  -d N  set test duration to N seconds (default: 5)\n"
         "  -S N  set message size to N bytes (default: 10)\n"
         "  -H N  set message handle count to N handles (default: 0)\n"
-        "  -Q N  set message pre-queue count to N messages (default: 0)\n";
+        "  -Q N  set message pre-queue count to N messages (default: 0)\n"
+        "  -A    page align the message buffer\n";
 
     bool run_suite = false;  // -o/-s
     uint32_t duration = 5;   // -d
@@ -138,11 +151,12 @@ int main(int argc, char** argv) {
     TestArgs test_args = {
         10,                  // -S (size)
         0,                   // -H (handles)
-        0                    // -Q (queue)
+        0,                   // -Q (queue)
+        false                // -A (page_aligned)
     };
 
     int opt;
-    while ((opt = getopt(argc, argv, "+hosn:d:S:H:Q:")) != -1) {
+    while ((opt = getopt(argc, argv, "+hosAn:d:S:H:Q:")) != -1) {
         // Our option values are always unsigned numbers.
         uint32_t value = 0;
         if (optarg) {
@@ -184,6 +198,9 @@ int main(int argc, char** argv) {
                 assert(optarg);
                 test_args.queue = value;
                 break;
+            case 'A':
+                test_args.page_aligned = true;
+                break;
             default:  // '?'
                 argument_error(argv[0], "invalid option");
                 break;
@@ -217,6 +234,16 @@ int main(int argc, char** argv) {
                 {10, 0, 1},
                 {100, 0, 1},
                 {1000, 0, 1},
+                // Large messages, copied and moved a page at a time, to find where moving
+                // pages starts to pay off.
+                {4096, 0, 0},
+                {4096, 0, 0, true},
+                {16384, 0, 0},
+                {16384, 0, 0, true},
+                {32768, 0, 0},
+                {32768, 0, 0, true},
+                {65536, 0, 0},
+                {65536, 0, 0, true},
             };
             for (size_t i = 0; i < fbl::count_of(suite); i++)
                 do_test(duration, suite[i]);
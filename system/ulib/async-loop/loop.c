@@ -26,6 +26,10 @@
 // The port wait key associated with the dispatcher's control messages.
 #define KEY_CONTROL (0u)
 
+// The number of port packets the loop can hold on to after reading them from
+// its port in a batch, before they are dispatched.
+#define PENDING_PACKETS (16u)
+
 static zx_time_t async_loop_now(async_dispatcher_t* dispatcher);
 static zx_status_t async_loop_begin_wait(async_dispatcher_t* dispatcher, async_wait_t* wait);
 static zx_status_t async_loop_cancel_wait(async_dispatcher_t* dispatcher, async_wait_t* wait);
@@ -90,9 +94,18 @@ typedef struct async_loop {
     list_node_t due_list; // due tasks, earliest deadline first
     list_node_t thread_list; // earliest created thread first
     list_node_t exception_list; // most recently added first
+
+    // Packets read from the port but not yet dispatched, oldest first.
+    zx_port_packet_t pending[PENDING_PACKETS];
+    uint32_t pending_head; // index of the oldest pending packet
+    uint32_t pending_count;
 } async_loop_t;
 
 static zx_status_t async_loop_run_once(async_loop_t* loop, zx_time_t deadline);
+static zx_status_t async_loop_read_packets(async_loop_t* loop, zx_time_t deadline,
+                                           zx_port_packet_t* out_packet);
+static bool async_loop_take_pending_locked(async_loop_t* loop, zx_port_packet_t* out_packet);
+static bool async_loop_cancel_pending_locked(async_loop_t* loop, uint64_t key);
 static zx_status_t async_loop_dispatch_wait(async_loop_t* loop, async_wait_t* wait,
                                             zx_status_t status, const zx_packet_signal_t* signal);
 static zx_status_t async_loop_dispatch_tasks(async_loop_t* loop);
@@ -259,9 +272,14 @@ static zx_status_t async_loop_run_once(async_loop_t* loop, zx_time_t deadline) {
         return ZX_ERR_CANCELED;
 
     zx_port_packet_t packet;
-    zx_status_t status = zx_port_wait(loop->port, deadline, &packet);
-    if (status != ZX_OK)
-        return status;
+    mtx_lock(&loop->lock);
+    bool have_packet = async_loop_take_pending_locked(loop, &packet);
+    mtx_unlock(&loop->lock);
+    if (!have_packet) {
+        zx_status_t status = async_loop_read_packets(loop, deadline, &packet);
+        if (status != ZX_OK)
+            return status;
+    }
 
     if (packet.key == KEY_CONTROL) {
         // Handle wake-up packets.
@@ -308,6 +326,68 @@ static zx_status_t async_loop_run_once(async_loop_t* loop, zx_time_t deadline) {
     return ZX_ERR_INTERNAL;
 }
 
+static zx_status_t async_loop_read_packets(async_loop_t* loop, zx_time_t deadline,
+                                           zx_port_packet_t* out_packet) {
+    // While a single thread is dispatching, read as many packets as there is
+    // room to hold on to, saving a port wait for each of them.  With more
+    // threads, read one packet at a time so that a handler which blocks
+    // cannot hold up packets another thread could have dispatched.
+    // Only the thread that sees itself as the sole dispatcher adds pending
+    // packets, so the room it finds cannot shrink while it waits.
+    uint32_t room = 0u;
+    if (atomic_load_explicit(&loop->active_threads, memory_order_acquire) == 1u) {
+        mtx_lock(&loop->lock);
+        room = PENDING_PACKETS - loop->pending_count;
+        mtx_unlock(&loop->lock);
+    }
+
+    zx_port_packet_t packets[1u + PENDING_PACKETS];
+    uint32_t count = 0u;
+    zx_status_t status = zx_port_wait_batch(loop->port, deadline, packets, 1u + room, &count);
+    if (status != ZX_OK)
+        return status;
+    ZX_DEBUG_ASSERT(count >= 1u && count <= 1u + room);
+
+    *out_packet = packets[0];
+    if (count > 1u) {
+        mtx_lock(&loop->lock);
+        ZX_DEBUG_ASSERT(loop->pending_count + count - 1u <= PENDING_PACKETS);
+        for (uint32_t i = 1u; i < count; i++) {
+            uint32_t index = (loop->pending_head + loop->pending_count) % PENDING_PACKETS;
+            loop->pending[index] = packets[i];
+            loop->pending_count++;
+        }
+        mtx_unlock(&loop->lock);
+    }
+    return ZX_OK;
+}
+
+static bool async_loop_take_pending_locked(async_loop_t* loop, zx_port_packet_t* out_packet) {
+    if (loop->pending_count == 0u)
+        return false;
+    *out_packet = loop->pending[loop->pending_head];
+    loop->pending_head = (loop->pending_head + 1u) % PENDING_PACKETS;
+    loop->pending_count--;
+    return true;
+}
+
+static bool async_loop_cancel_pending_locked(async_loop_t* loop, uint64_t key) {
+    for (uint32_t i = 0u; i < loop->pending_count; i++) {
+        zx_port_packet_t* packet = &loop->pending[(loop->pending_head + i) % PENDING_PACKETS];
+        if (packet->key != key || packet->type != ZX_PKT_TYPE_SIGNAL_ONE)
+            continue;
+
+        // Close the gap, keeping the rest in order.
+        for (uint32_t j = i + 1u; j < loop->pending_count; j++) {
+            loop->pending[(loop->pending_head + j - 1u) % PENDING_PACKETS] =
+                loop->pending[(loop->pending_head + j) % PENDING_PACKETS];
+        }
+        loop->pending_count--;
+        return true;
+    }
+    return false;
+}
+
 async_dispatcher_t* async_loop_get_dispatcher(async_loop_t* loop) {
     // Note: The loop's implementation inherits from async_t so we can upcast to it.
     return (async_dispatcher_t*)loop;
@@ -525,9 +605,12 @@ static zx_status_t async_loop_cancel_wait(async_dispatcher_t* async, async_wait_
 
     // Next, cancel the wait.  This may be racing with another thread that
     // has read the wait's packet but not yet dispatched it.  So if we fail
-    // to cancel then we assume we lost the race.
+    // to cancel then we assume we lost the race, unless the packet is still
+    // waiting among those read in a batch, in which case it is dropped.
     zx_status_t status = zx_port_cancel(loop->port, wait->object,
                                         (uintptr_t)wait);
+    if (status == ZX_ERR_NOT_FOUND && async_loop_cancel_pending_locked(loop, (uintptr_t)wait))
+        status = ZX_OK;
     if (status == ZX_OK) {
         list_delete(node);
     } else {
@@ -121,7 +121,7 @@ template <typename _KeyType,
                                     _KeyType,
                                     typename internal::ContainerPtrTraits<_PtrType>::ValueType>,
           typename _NodeTraits = DefaultWAVLTreeTraits<_PtrType>,
-          typename _Observer   = tests::intrusive_containers::DefaultWAVLTreeObserver>
+          typename _Observer   = DefaultWAVLTreeObserver>
 class WAVLTree {
 private:
     // Private fwd decls of the iterator implementation.
@@ -199,6 +199,11 @@ public:
     // make_iterator : construct an iterator out of a pointer to an object
     iterator make_iterator(ValueType& obj) { return iterator(&obj); }
 
+    // root : the iterator for the node at the root of the tree, or an invalid
+    // iterator if the tree is empty.  See iterator::left and iterator::right.
+    iterator       root()       { return iterator(root_); }
+    const_iterator root() const { return const_iterator(root_); }
+
     // is_empty : True if the tree has at least one element in it, false otherwise.
     bool is_empty() const { return root_ == nullptr; }
 
@@ -627,6 +632,19 @@ private:
         typename IterTraits::RefType operator*()     const { ZX_DEBUG_ASSERT(node_); return *node_; }
         typename IterTraits::RawPtrType operator->() const { ZX_DEBUG_ASSERT(node_); return node_; }
 
+        // Step to the left or right child of this node in the tree, for
+        // searches of trees with augmented state (see the Observer's
+        // RecordSubtreeChange).  Yields an invalid iterator if there is no
+        // such child.
+        iterator_impl left() const {
+            ZX_DEBUG_ASSERT(IsValid());
+            return iterator_impl(NodeTraits::node_state(*node_).left_);
+        }
+        iterator_impl right() const {
+            ZX_DEBUG_ASSERT(IsValid());
+            return iterator_impl(NodeTraits::node_state(*node_).right_);
+        }
+
     private:
         friend ContainerType;
 
@@ -711,6 +729,7 @@ private:
 
             ++count_;
             Observer::RecordInsert();
+            RecordSubtreeChangeToRoot(root_);
             return;
         }
 
@@ -789,6 +808,7 @@ private:
 
         ++count_;
         Observer::RecordInsert();
+        RecordSubtreeChangeToRoot(*owner);
 
         // Finally, perform post-insert balance operations.
         BalancePostInsert(*owner);
@@ -922,6 +942,9 @@ private:
         // Update the count bookkeeping.
         --count_;
         Observer::RecordErase();
+        if (!internal::is_sentinel_ptr(parent)) {
+            RecordSubtreeChangeToRoot(parent);
+        }
 
         // Time to rebalance.  We know that we don't need to rebalance if we
         // just removed the root (IOW - its parent was the sentinel value).
@@ -1007,6 +1030,7 @@ private:
         GetLinkPtrToNode(old_node) = PtrTraits::Leak(new_node);
         new_ns.parent_ = old_ns.parent_;
         old_ns.parent_ = nullptr;
+        RecordSubtreeChangeToRoot(new_raw);
         return PtrTraits::Reclaim(old_node);
     }
 
@@ -1360,6 +1384,35 @@ private:
         if (Y) {
             NodeTraits::node_state(*Y).parent_ = Z;
         }
+
+        // Z's subtree lost X and gained Y, and X's subtree gained Z.  The set
+        // of nodes below G has not changed.
+        RecordSubtreeChange(Z);
+        RecordSubtreeChange(X);
+    }
+
+    // Tell the Observer that |node|'s subtree changed.
+    void RecordSubtreeChange(RawPtrType node) {
+        if (!Observer::kTracksSubtrees) {
+            return;
+        }
+        auto& ns = NodeTraits::node_state(*node);
+        Observer::RecordSubtreeChange(
+            node,
+            internal::valid_sentinel_ptr(ns.left_) ? ns.left_ : nullptr,
+            internal::valid_sentinel_ptr(ns.right_) ? ns.right_ : nullptr);
+    }
+
+    // Tell the Observer that the subtrees of |node| and all of its ancestors
+    // changed.
+    void RecordSubtreeChangeToRoot(RawPtrType node) {
+        if (!Observer::kTracksSubtrees) {
+            return;
+        }
+        while (!internal::is_sentinel_ptr(node)) {
+            RecordSubtreeChange(node);
+            node = NodeTraits::node_state(*node).parent_;
+        }
     }
 
     // PostInsertFixupLR<LRTraits>
@@ -12,10 +12,13 @@ namespace tests {
 namespace intrusive_containers {
 // Fwd decl of sanity checker class used by tests.
 class WAVLTreeChecker;
+}  // namespace intrusive_containers
+}  // namespace tests
 
 // Definition of the default (no-op) Observer.
 //
-// Observers are used by the test framework to record the number of insert,
+// Observers are notified by a WAVLTree of the operations it performs on
+// itself.  The test framework uses them to record the number of insert,
 // erase, rank-promote, rank-demote and rotation operations performed during
 // usage.  The DefaultWAVLTreeObserver does nothing and should fall out of the
 // code during template expansion.
@@ -26,7 +29,29 @@ class WAVLTreeChecker;
 // phase of rebalancing are considered to be part of the cost of rotation and
 // are not tallied in the overall promote/demote accounting.
 //
+// Subtree augmentation
+//
+// Users may also derive from DefaultWAVLTreeObserver to maintain augmented
+// per-node state which depends only on a node and on the nodes in its subtree
+// (for example, the number of nodes or the largest key in the subtree).  To do
+// so, an Observer sets kTracksSubtrees to true and provides
+//
+//   static void RecordSubtreeChange(RawPtrType node,
+//                                   RawPtrType left,
+//                                   RawPtrType right);
+//
+// The tree calls RecordSubtreeChange for every node whose left or right child
+// has changed, or which has had a node inserted or erased somewhere below it,
+// passing the node's current children (nullptr if absent).  Calls are made
+// bottom up, so a node's children are always up to date when it is
+// recomputed; an implementation should only read |node|, |left| and |right|.
+// The hook runs with the tree in the middle of a modification, so it must not
+// access the tree itself.  When kTracksSubtrees is false (the default), the
+// hook is never called and costs nothing.
+//
 struct DefaultWAVLTreeObserver {
+    static constexpr bool kTracksSubtrees = false;
+
     static void RecordInsert()               { }
     static void RecordInsertPromote()        { }
     static void RecordInsertRotation()       { }
@@ -37,6 +62,9 @@ struct DefaultWAVLTreeObserver {
     static void RecordEraseRotation()        { }
     static void RecordEraseDoubleRotation()  { }
 
+    template <typename RawPtrType>
+    static void RecordSubtreeChange(RawPtrType node, RawPtrType left, RawPtrType right) { }
+
     template <typename TreeType>
     static bool VerifyRankRule(const TreeType& tree, typename TreeType::RawPtrType node) {
         return true;
@@ -48,8 +76,12 @@ struct DefaultWAVLTreeObserver {
     }
 };
 
-}  // namespace tests
+namespace tests {
+namespace intrusive_containers {
+// The test framework refers to the default observer by this name.
+using DefaultWAVLTreeObserver = ::fbl::DefaultWAVLTreeObserver;
 }  // namespace intrusive_containers
+}  // namespace tests
 
 // Prototypes for the WAVL tree node state.  By default, we just use a bool to
 // record the rank parity of a node.  During testing, however, we actually use a
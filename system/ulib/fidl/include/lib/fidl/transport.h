@@ -6,10 +6,30 @@
 #define LIB_FIDL_TRANSPORT_H_
 
 #include <zircon/compiler.h>
+#include <zircon/fidl.h>
 #include <zircon/types.h>
 
 __BEGIN_CDECLS
 
+// Writes the |count| encoded messages in |msgs| to |channel| with a single
+// syscall, without messages from other writers in between.
+//
+// Either all of the messages are written or none are.  All of their handles
+// are consumed either way.  |count| may be at most ZX_CHANNEL_MAX_BATCH_MSGS.
+zx_status_t fidl_channel_write_batch(zx_handle_t channel, const fidl_msg_t* msgs,
+                                     uint32_t count);
+
+// Reads up to |count| messages from |channel| with a single syscall, into the
+// buffers given by |msgs|, whose |num_bytes| and |num_handles| are updated to
+// the size of the message read into each.
+//
+// Reading stops early at a message that does not fit the buffers meant for it.
+// Does not block: returns ZX_ERR_SHOULD_WAIT if there is no message to read.
+//
+// The number of messages read is returned in |out_actual|.
+zx_status_t fidl_channel_read_batch(zx_handle_t channel, fidl_msg_t* msgs,
+                                    uint32_t count, uint32_t* out_actual);
+
 // Writes |capacity| bytes from |buffer| to the control channel of |socket|.
 //
 // Blocks until |socket| is able to accept a control plane message.
@@ -5,9 +5,29 @@
 #ifdef __Fuchsia__
 
 #include <lib/fidl/transport.h>
+#include <stddef.h>
 #include <zircon/assert.h>
 #include <zircon/syscalls.h>
 
+// fidl_msg_t is passed straight to the batched channel syscalls.
+static_assert(sizeof(fidl_msg_t) == sizeof(zx_channel_msg_t), "");
+static_assert(offsetof(fidl_msg_t, bytes) == offsetof(zx_channel_msg_t, bytes), "");
+static_assert(offsetof(fidl_msg_t, handles) == offsetof(zx_channel_msg_t, handles), "");
+static_assert(offsetof(fidl_msg_t, num_bytes) == offsetof(zx_channel_msg_t, num_bytes), "");
+static_assert(offsetof(fidl_msg_t, num_handles) == offsetof(zx_channel_msg_t, num_handles), "");
+
+zx_status_t fidl_channel_write_batch(zx_handle_t channel, const fidl_msg_t* msgs,
+                                     uint32_t count) {
+    return zx_channel_write_batch(channel, 0, reinterpret_cast<const zx_channel_msg_t*>(msgs),
+                                  count);
+}
+
+zx_status_t fidl_channel_read_batch(zx_handle_t channel, fidl_msg_t* msgs,
+                                    uint32_t count, uint32_t* out_actual) {
+    return zx_channel_read_batch(channel, 0, reinterpret_cast<zx_channel_msg_t*>(msgs), count,
+                                 out_actual);
+}
+
 zx_status_t fidl_socket_write_control(zx_handle_t socket, const void* buffer,
                                       size_t capacity) {
     for (;;) {
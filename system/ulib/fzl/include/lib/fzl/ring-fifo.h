@@ -0,0 +1,166 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <fbl/macros.h>
+#include <lib/fzl/vmo-mapper.h>
+#include <lib/zx/eventpair.h>
+#include <lib/zx/time.h>
+#include <lib/zx/vmo.h>
+
+#include <stdint.h>
+#include <utility>
+
+namespace fzl {
+
+// A fifo whose elements travel through rings in a VMO that both ends have
+// mapped, rather than being copied through the kernel by zx_fifo_write() and
+// zx_fifo_read().  An eventpair carries the wakeups, and it is only signaled
+// when the other end has said that it is about to block, so a reader and a
+// writer that keep up with each other exchange elements without making any
+// syscalls.
+//
+// Each direction is a ring with a single producer and a single consumer:
+// writes on an end have to be serialized by the caller, and so do reads,
+// although a write and a read may happen at the same time.
+//
+// The ends need not trust each other.  Indices read from the shared memory
+// are checked before they are used, and elements are copied out of the ring
+// before they are returned, so a misbehaving peer can only garble what it
+// sends.
+class RingFifo {
+public:
+    // The most bytes of elements each direction can hold.
+    static constexpr uint32_t kMaxRingBytes = 1024 * 1024;
+
+    RingFifo() = default;
+    ~RingFifo() = default;
+    DISALLOW_COPY_AND_ASSIGN_ALLOW_MOVE(RingFifo);
+    RingFifo(RingFifo&&) = default;
+    RingFifo& operator=(RingFifo&&) = default;
+
+    // Creates a fifo holding up to |elem_count| elements of |elem_size| bytes
+    // in each direction, sets up |out| as one end, and returns the handles
+    // for the other end, to be passed to Attach().  |elem_count| has to be a
+    // power of two.
+    static zx_status_t Create(uint32_t elem_count, uint32_t elem_size, RingFifo* out,
+                              zx::vmo* peer_vmo, zx::eventpair* peer_events);
+
+    // Sets up |out| as the other end of a fifo made by Create().  Fails with
+    // ZX_ERR_INVALID_ARGS if the fifo does not hold elements of |elem_size|
+    // bytes, and with ZX_ERR_NOT_SUPPORTED if |vmo| is resizable.
+    static zx_status_t Attach(zx::vmo vmo, zx::eventpair events, uint32_t elem_size,
+                              RingFifo* out);
+
+    // These work like zx_fifo_write() and zx_fifo_read(), returning
+    // ZX_ERR_SHOULD_WAIT when nothing could be written or read.  They fail
+    // with ZX_ERR_BAD_STATE if the peer has corrupted the indices.  A peer
+    // that has gone away is only noticed by the Wait methods.
+    zx_status_t Write(uint32_t elem_size, const void* buffer, size_t count,
+                      size_t* actual_count);
+    zx_status_t Read(uint32_t elem_size, void* buffer, size_t count, size_t* actual_count);
+
+    // Block until there is something to read, or room to write, or the
+    // deadline passes.  Return ZX_ERR_PEER_CLOSED if the other end has been
+    // closed and the wait could never end otherwise.
+    zx_status_t WaitReadable(zx::time deadline);
+    zx_status_t WaitWritable(zx::time deadline);
+
+    bool is_valid() const { return mapper_.start() != nullptr; }
+    const zx::eventpair& events() const { return events_; }
+
+private:
+    struct Ring;
+    struct Header;
+
+    zx_status_t Init(zx::vmo vmo, zx::eventpair events, uint32_t elem_size,
+                     uint32_t elem_count, uint32_t end);
+
+    Header* header() const;
+    Ring* out_ring() const;
+    Ring* in_ring() const;
+    uint8_t* out_elems() const;
+    uint8_t* in_elems() const;
+
+    VmoMapper mapper_;
+    zx::eventpair events_;
+    uint32_t elem_size_ = 0;
+    uint32_t elem_count_ = 0;
+    // Which end this is, and so which of the two rings it writes to.
+    uint32_t end_ = 0;
+    // Only this end moves the head of the ring it writes and the tail of the
+    // ring it reads, so it keeps its own copies rather than trusting the
+    // shared ones.
+    uint32_t out_head_ = 0;
+    uint32_t in_tail_ = 0;
+};
+
+// Typed wrapper for RingFifo, in the manner of fzl::fifo.
+template<typename W, typename R = W>
+class ring_fifo {
+    static_assert(sizeof(W) == sizeof(R), "W and R must have the same size");
+public:
+    ring_fifo() = default;
+
+    explicit ring_fifo(RingFifo&& fifo) : fifo_(std::move(fifo)) {}
+
+    static zx_status_t attach(zx::vmo vmo, zx::eventpair events, ring_fifo* out) {
+        return RingFifo::Attach(std::move(vmo), std::move(events), sizeof(W), &out->fifo_);
+    }
+
+    const RingFifo& get() const {
+        return fifo_;
+    }
+
+    zx_status_t write(const W* buffer, size_t count, size_t* actual_count) {
+        return fifo_.Write(sizeof(W), buffer, count, actual_count);
+    }
+
+    zx_status_t write_one(const W& element) {
+        return fifo_.Write(sizeof(W), &element, 1, nullptr);
+    }
+
+    zx_status_t read(R* buffer, size_t count, size_t* actual_count) {
+        return fifo_.Read(sizeof(R), buffer, count, actual_count);
+    }
+
+    zx_status_t read_one(R* element) {
+        return fifo_.Read(sizeof(R), element, 1, nullptr);
+    }
+
+    zx_status_t wait_readable(zx::time deadline) {
+        return fifo_.WaitReadable(deadline);
+    }
+
+    zx_status_t wait_writable(zx::time deadline) {
+        return fifo_.WaitWritable(deadline);
+    }
+
+private:
+    RingFifo fifo_;
+};
+
+// Creates both ends of a ring fifo in this process.  Use RingFifo::Create()
+// to hand one end to another process.
+template<typename W, typename R>
+zx_status_t create_ring_fifo(uint32_t elem_count, ring_fifo<W, R>* out0,
+                             ring_fifo<R, W>* out1) {
+    RingFifo end0, end1;
+    zx::vmo vmo;
+    zx::eventpair events;
+    zx_status_t status = RingFifo::Create(elem_count, sizeof(W), &end0, &vmo, &events);
+    if (status != ZX_OK) {
+        return status;
+    }
+    status = RingFifo::Attach(std::move(vmo), std::move(events), sizeof(R), &end1);
+    if (status != ZX_OK) {
+        return status;
+    }
+    *out0 = ring_fifo<W, R>(std::move(end0));
+    *out1 = ring_fifo<R, W>(std::move(end1));
+    return ZX_OK;
+}
+
+} // namespace fzl
@@ -0,0 +1,296 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <lib/fzl/ring-fifo.h>
+
+#include <atomic>
+#include <string.h>
+
+#include <fbl/algorithm.h>
+#include <zircon/assert.h>
+
+namespace fzl {
+
+namespace {
+
+constexpr uint32_t kMagic = 0x52464946; // "RFIF"
+
+// Signals the ends set on each other's side of the eventpair.
+constexpr zx_signals_t kSignalReadable = ZX_USER_SIGNAL_0;
+constexpr zx_signals_t kSignalWritable = ZX_USER_SIGNAL_1;
+
+constexpr size_t kCacheLine = 64;
+
+bool IsPowerOfTwo(uint32_t n) {
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+} // namespace
+
+// The indices of one direction.  The writer owns |head| and the reader owns
+// |tail|, which are free-running counts of the elements written and read.
+// They are kept on separate cache lines so that the two ends do not fight
+// over one.  Each end sets its |waiting| flag before it blocks, and the other
+// end only signals the eventpair when it finds the flag set.
+struct RingFifo::Ring {
+    alignas(kCacheLine) std::atomic<uint32_t> head;
+    std::atomic<uint32_t> reader_waiting;
+    alignas(kCacheLine) std::atomic<uint32_t> tail;
+    std::atomic<uint32_t> writer_waiting;
+};
+
+// The start of the VMO.  The elements of ring 0, which end 0 writes, follow
+// it, and then those of ring 1.
+struct RingFifo::Header {
+    struct Sizes {
+        uint32_t magic;
+        uint32_t elem_size;
+        uint32_t elem_count;
+    } sizes;
+    Ring rings[2];
+};
+
+zx_status_t RingFifo::Create(uint32_t elem_count, uint32_t elem_size, RingFifo* out,
+                             zx::vmo* peer_vmo, zx::eventpair* peer_events) {
+    if (!IsPowerOfTwo(elem_count) || elem_size == 0 ||
+        elem_size > kMaxRingBytes / elem_count) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+
+    const size_t size = sizeof(Header) + 2 * static_cast<size_t>(elem_size) * elem_count;
+    // The VMO can't be resizable, or the peer could shrink it out from under
+    // our mapping.
+    zx::vmo vmo;
+    zx_status_t status = zx::vmo::create(size, ZX_VMO_NON_RESIZABLE, &vmo);
+    if (status != ZX_OK) {
+        return status;
+    }
+    // The VMO starts out zeroed, which leaves only the sizes to fill in.
+    const Header::Sizes sizes = { kMagic, elem_size, elem_count };
+    status = vmo.write(&sizes, 0, sizeof(sizes));
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    zx::eventpair events;
+    if ((status = zx::eventpair::create(0, &events, peer_events)) != ZX_OK ||
+        (status = vmo.duplicate(ZX_RIGHT_SAME_RIGHTS, peer_vmo)) != ZX_OK) {
+        return status;
+    }
+    return out->Init(std::move(vmo), std::move(events), elem_size, elem_count, 0);
+}
+
+zx_status_t RingFifo::Attach(zx::vmo vmo, zx::eventpair events, uint32_t elem_size,
+                             RingFifo* out) {
+    // The sizes are read once here, and never again from the shared memory.
+    Header::Sizes sizes;
+    zx_status_t status = vmo.read(&sizes, 0, sizeof(sizes));
+    if (status != ZX_OK) {
+        return status;
+    }
+    if (sizes.magic != kMagic || sizes.elem_size != elem_size ||
+        !IsPowerOfTwo(sizes.elem_count) || elem_size > kMaxRingBytes / sizes.elem_count) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    return out->Init(std::move(vmo), std::move(events), elem_size, sizes.elem_count, 1);
+}
+
+zx_status_t RingFifo::Init(zx::vmo vmo, zx::eventpair events, uint32_t elem_size,
+                           uint32_t elem_count, uint32_t end) {
+    // The elements follow the header, and should not share its cache lines.
+    static_assert(sizeof(Header) % kCacheLine == 0, "");
+
+    const size_t size = sizeof(Header) + 2 * static_cast<size_t>(elem_size) * elem_count;
+    uint64_t vmo_size;
+    zx_status_t status = vmo.get_size(&vmo_size);
+    if (status != ZX_OK) {
+        return status;
+    }
+    if (vmo_size < size) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+
+    // Checking the size above is only good for a VMO that can't shrink.
+    VmoMapper mapper;
+    status = mapper.Map(vmo, 0, size,
+                        ZX_VM_PERM_READ | ZX_VM_PERM_WRITE | ZX_VM_REQUIRE_NON_RESIZABLE);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    mapper_ = std::move(mapper);
+    events_ = std::move(events);
+    elem_size_ = elem_size;
+    elem_count_ = elem_count;
+    end_ = end;
+    // A fresh fifo has nothing in it, so whatever the peer has done to the
+    // shared indices since then is caught as corruption.
+    out_head_ = 0;
+    in_tail_ = 0;
+    return ZX_OK;
+}
+
+RingFifo::Header* RingFifo::header() const {
+    return static_cast<Header*>(mapper_.start());
+}
+
+RingFifo::Ring* RingFifo::out_ring() const {
+    return &header()->rings[end_];
+}
+
+RingFifo::Ring* RingFifo::in_ring() const {
+    return &header()->rings[end_ ^ 1];
+}
+
+uint8_t* RingFifo::out_elems() const {
+    return reinterpret_cast<uint8_t*>(header() + 1) +
+           static_cast<size_t>(end_) * elem_size_ * elem_count_;
+}
+
+uint8_t* RingFifo::in_elems() const {
+    return reinterpret_cast<uint8_t*>(header() + 1) +
+           static_cast<size_t>(end_ ^ 1) * elem_size_ * elem_count_;
+}
+
+zx_status_t RingFifo::Write(uint32_t elem_size, const void* buffer, size_t count,
+                            size_t* actual_count) {
+    ZX_DEBUG_ASSERT(is_valid());
+    if (elem_size != elem_size_ || count == 0) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+
+    Ring* ring = out_ring();
+    const uint32_t used = out_head_ - ring->tail.load(std::memory_order_acquire);
+    if (used > elem_count_) {
+        return ZX_ERR_BAD_STATE;
+    }
+    const uint32_t n = static_cast<uint32_t>(fbl::min<size_t>(count, elem_count_ - used));
+    if (n == 0) {
+        return ZX_ERR_SHOULD_WAIT;
+    }
+
+    // Copy in at most two pieces, for when the elements wrap around the end
+    // of the ring.
+    const uint8_t* src = static_cast<const uint8_t*>(buffer);
+    const uint32_t start = out_head_ & (elem_count_ - 1);
+    const uint32_t first = fbl::min(n, elem_count_ - start);
+    memcpy(out_elems() + static_cast<size_t>(start) * elem_size_, src,
+           static_cast<size_t>(first) * elem_size_);
+    memcpy(out_elems(), src + static_cast<size_t>(first) * elem_size_,
+           static_cast<size_t>(n - first) * elem_size_);
+
+    out_head_ += n;
+    ring->head.store(out_head_, std::memory_order_release);
+
+    // Pairs with the fence in WaitReadable(): either the reader sees the new
+    // head before blocking, or we see that it is waiting.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ring->reader_waiting.load(std::memory_order_relaxed) &&
+        ring->reader_waiting.exchange(0, std::memory_order_relaxed)) {
+        events_.signal_peer(0, kSignalReadable);
+    }
+
+    if (actual_count) {
+        *actual_count = n;
+    }
+    return ZX_OK;
+}
+
+zx_status_t RingFifo::Read(uint32_t elem_size, void* buffer, size_t count,
+                           size_t* actual_count) {
+    ZX_DEBUG_ASSERT(is_valid());
+    if (elem_size != elem_size_ || count == 0) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+
+    Ring* ring = in_ring();
+    const uint32_t avail = ring->head.load(std::memory_order_acquire) - in_tail_;
+    if (avail > elem_count_) {
+        return ZX_ERR_BAD_STATE;
+    }
+    const uint32_t n = static_cast<uint32_t>(fbl::min<size_t>(count, avail));
+    if (n == 0) {
+        return ZX_ERR_SHOULD_WAIT;
+    }
+
+    uint8_t* dst = static_cast<uint8_t*>(buffer);
+    const uint32_t start = in_tail_ & (elem_count_ - 1);
+    const uint32_t first = fbl::min(n, elem_count_ - start);
+    memcpy(dst, in_elems() + static_cast<size_t>(start) * elem_size_,
+           static_cast<size_t>(first) * elem_size_);
+    memcpy(dst + static_cast<size_t>(first) * elem_size_, in_elems(),
+           static_cast<size_t>(n - first) * elem_size_);
+
+    in_tail_ += n;
+    ring->tail.store(in_tail_, std::memory_order_release);
+
+    // Pairs with the fence in WaitWritable().
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ring->writer_waiting.load(std::memory_order_relaxed) &&
+        ring->writer_waiting.exchange(0, std::memory_order_relaxed)) {
+        events_.signal_peer(0, kSignalWritable);
+    }
+
+    if (actual_count) {
+        *actual_count = n;
+    }
+    return ZX_OK;
+}
+
+zx_status_t RingFifo::WaitReadable(zx::time deadline) {
+    ZX_DEBUG_ASSERT(is_valid());
+    Ring* ring = in_ring();
+
+    // Clear any stale wakeup before saying that we are about to block, so
+    // that one sent after this point is not lost.
+    zx_status_t status = events_.signal(kSignalReadable, 0);
+    if (status != ZX_OK) {
+        return status;
+    }
+    ring->reader_waiting.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ring->head.load(std::memory_order_acquire) != in_tail_) {
+        ring->reader_waiting.store(0, std::memory_order_relaxed);
+        return ZX_OK;
+    }
+
+    zx_signals_t pending;
+    status = events_.wait_one(kSignalReadable | ZX_EVENTPAIR_PEER_CLOSED, deadline, &pending);
+    if (status != ZX_OK) {
+        return status;
+    }
+    // The peer may have written its last elements before going away.
+    if (!(pending & kSignalReadable) && ring->head.load(std::memory_order_acquire) == in_tail_) {
+        return ZX_ERR_PEER_CLOSED;
+    }
+    return ZX_OK;
+}
+
+zx_status_t RingFifo::WaitWritable(zx::time deadline) {
+    ZX_DEBUG_ASSERT(is_valid());
+    Ring* ring = out_ring();
+
+    zx_status_t status = events_.signal(kSignalWritable, 0);
+    if (status != ZX_OK) {
+        return status;
+    }
+    ring->writer_waiting.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (out_head_ - ring->tail.load(std::memory_order_acquire) != elem_count_) {
+        ring->writer_waiting.store(0, std::memory_order_relaxed);
+        return ZX_OK;
+    }
+
+    zx_signals_t pending;
+    status = events_.wait_one(kSignalWritable | ZX_EVENTPAIR_PEER_CLOSED, deadline, &pending);
+    if (status != ZX_OK) {
+        return status;
+    }
+    if (!(pending & kSignalWritable)) {
+        return ZX_ERR_PEER_CLOSED;
+    }
+    return ZX_OK;
+}
+
+} // namespace fzl
@@ -15,6 +15,7 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/owned-vmo-mapper.cpp \
     $(LOCAL_DIR)/pinned-vmo.cpp \
     $(LOCAL_DIR)/resizeable-vmo-mapper.cpp \
+    $(LOCAL_DIR)/ring-fifo.cpp \
     $(LOCAL_DIR)/time.cpp \
     $(LOCAL_DIR)/vmar-manager.cpp \
     $(LOCAL_DIR)/vmo-mapper.cpp \
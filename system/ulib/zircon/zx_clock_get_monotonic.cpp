@@ -0,0 +1,25 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <lib/fixed_point.h>
+#include <zircon/syscalls.h>
+
+#include "private.h"
+
+zx_time_t _zx_clock_get_monotonic(void) {
+    // The kernel decides at boot whether the counter read by zx_ticks_get
+    // is the one its own monotonic clock is based on.  If it is not,
+    // there's no way around the syscall.
+    if (unlikely(!DATA_CONSTANTS.monotonic_from_ticks)) {
+        return SYSCALL_zx_clock_get_monotonic_via_kernel();
+    }
+    const struct fp_32_64 ns_per_tick = {
+        DATA_CONSTANTS.ns_per_tick[0],
+        DATA_CONSTANTS.ns_per_tick[1],
+        DATA_CONSTANTS.ns_per_tick[2],
+    };
+    return u64_mul_u64_fp32_64(VDSO_zx_ticks_get(), ns_per_tick);
+}
+
+VDSO_INTERFACE_FUNCTION(zx_clock_get_monotonic);
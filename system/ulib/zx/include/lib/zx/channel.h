@@ -45,12 +45,22 @@ public:
                                    num_handles, actual_bytes, actual_handles);
     }
 
+    zx_status_t read_batch(uint32_t flags, zx_channel_msg_t* msgs, uint32_t num_msgs,
+                           uint32_t* actual_msgs) const {
+        return zx_channel_read_batch(get(), flags, msgs, num_msgs, actual_msgs);
+    }
+
     zx_status_t write(uint32_t flags, const void* bytes, uint32_t num_bytes,
                       const zx_handle_t* handles, uint32_t num_handles) const {
         return zx_channel_write(get(), flags, bytes, num_bytes, handles,
                                 num_handles);
     }
 
+    zx_status_t write_batch(uint32_t flags, const zx_channel_msg_t* msgs,
+                            uint32_t num_msgs) const {
+        return zx_channel_write_batch(get(), flags, msgs, num_msgs);
+    }
+
     zx_status_t call(uint32_t flags, zx::time deadline,
                      const zx_channel_call_args_t* args,
                      uint32_t* actual_bytes, uint32_t* actual_handles) const {
@@ -38,6 +38,11 @@ public:
         return zx_port_wait(get(), deadline.get(), packet);
     }
 
+    zx_status_t wait_batch(zx::time deadline, zx_port_packet_t* packets, uint32_t num_packets,
+                           uint32_t* actual_packets) const {
+        return zx_port_wait_batch(get(), deadline.get(), packets, num_packets, actual_packets);
+    }
+
     zx_status_t cancel(const object_base& source, uint64_t key) const {
         return zx_port_cancel(get(), source.get(), key);
     }
@@ -7,6 +7,7 @@
 
 #include <lib/zx/handle.h>
 #include <lib/zx/object.h>
+#include <lib/zx/vmo.h>
 
 namespace zx {
 
@@ -35,6 +36,11 @@ public:
         return zx_socket_write(get(), options, buffer, len, actual);
     }
 
+    zx_status_t write_vmo(uint32_t options, const vmo& vmo, uint64_t offset, size_t len,
+                          size_t* actual) const {
+        return zx_socket_write_vmo(get(), options, vmo.get(), offset, len, actual);
+    }
+
     zx_status_t read(uint32_t options, void* buffer, size_t len,
                      size_t* actual) const {
         return zx_socket_read(get(), options, buffer, len, actual);
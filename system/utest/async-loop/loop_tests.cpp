@@ -506,6 +506,23 @@ bool time_test() {
     END_TEST;
 }
 
+class CancelOtherWait : public TestWait {
+public:
+    CancelOtherWait(zx_handle_t object, zx_signals_t trigger, TestWait* other)
+        : TestWait(object, trigger), other_(other) {}
+
+    zx_status_t cancel_result = ZX_ERR_INTERNAL;
+
+protected:
+    TestWait* other_;
+
+    void Handle(async_dispatcher_t* dispatcher, zx_status_t status,
+                const zx_packet_signal_t* signal) override {
+        TestWait::Handle(dispatcher, status, signal);
+        cancel_result = other_->Cancel(dispatcher);
+    }
+};
+
 bool wait_test() {
     BEGIN_TEST;
 
@@ -601,6 +618,35 @@ bool wait_test() {
     END_TEST;
 }
 
+bool wait_cancel_pending_test() {
+    BEGIN_TEST;
+
+    async::Loop loop(&kAsyncLoopConfigNoAttachToThread);
+    zx::event event1, event2;
+    EXPECT_EQ(ZX_OK, zx::event::create(0u, &event1), "create event 1");
+    EXPECT_EQ(ZX_OK, zx::event::create(0u, &event2), "create event 2");
+
+    // Both packets are queued before the loop runs, so they are read in the
+    // same batch and the second one has already left the port by the time
+    // the first handler cancels its wait.
+    TestWait wait2(event2.get(), ZX_USER_SIGNAL_0);
+    CancelOtherWait wait1(event1.get(), ZX_USER_SIGNAL_0, &wait2);
+    EXPECT_EQ(ZX_OK, wait1.Begin(loop.dispatcher()), "wait 1");
+    EXPECT_EQ(ZX_OK, wait2.Begin(loop.dispatcher()), "wait 2");
+    EXPECT_EQ(ZX_OK, event1.signal(0u, ZX_USER_SIGNAL_0), "signal 1");
+    EXPECT_EQ(ZX_OK, event2.signal(0u, ZX_USER_SIGNAL_0), "signal 2");
+
+    EXPECT_EQ(ZX_OK, loop.RunUntilIdle(), "run loop");
+    EXPECT_EQ(1u, wait1.run_count, "run count 1");
+    EXPECT_EQ(ZX_OK, wait1.cancel_result, "cancel result");
+    EXPECT_EQ(0u, wait2.run_count, "run count 2");
+
+    loop.Shutdown();
+    EXPECT_EQ(0u, wait2.run_count, "run count 2");
+
+    END_TEST;
+}
+
 bool wait_unwaitable_handle_test() {
     BEGIN_TEST;
 
@@ -1377,6 +1423,7 @@ RUN_TEST(make_default_true_test)
 RUN_TEST(quit_test)
 RUN_TEST(time_test)
 RUN_TEST(wait_test)
+RUN_TEST(wait_cancel_pending_test)
 RUN_TEST(wait_unwaitable_handle_test)
 RUN_TEST(wait_shutdown_test)
 RUN_TEST(task_test)
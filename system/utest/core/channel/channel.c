@@ -4,6 +4,7 @@
 
 #include <zircon/assert.h>
 #include <zircon/compiler.h>
+#include <zircon/limits.h>
 #include <zircon/rights.h>
 #include <zircon/syscalls.h>
 #include <zircon/syscalls/object.h>
@@ -1048,6 +1049,149 @@ static bool channel_write_takes_all_handles(void) {
     END_TEST;
 }
 
+static bool channel_batch(void) {
+    BEGIN_TEST;
+
+    zx_handle_t channel[2];
+    ASSERT_EQ(zx_channel_create(0, &channel[0], &channel[1]), ZX_OK, "");
+
+    // Three messages of different sizes, the second one carrying a handle.
+    zx_handle_t event;
+    ASSERT_EQ(zx_event_create(0, &event), ZX_OK, "");
+    uint32_t data[3][4] = {{1u}, {2u, 3u}, {4u, 5u, 6u, 7u}};
+    zx_channel_msg_t out[3] = {
+        {data[0], NULL, 4u, 0u},
+        {data[1], &event, 8u, 1u},
+        {data[2], NULL, 16u, 0u},
+    };
+    ASSERT_EQ(zx_channel_write_batch(channel[0], 0, out, 3), ZX_OK, "");
+
+    // A first buffer that is too small leaves everything queued.
+    uint32_t buf[3][4];
+    zx_handle_t handle = ZX_HANDLE_INVALID;
+    zx_channel_msg_t in[3] = {
+        {buf[0], NULL, 2u, 0u},
+        {buf[1], &handle, 16u, 1u},
+        {buf[2], NULL, 16u, 0u},
+    };
+    uint32_t actual = 42u;
+    ASSERT_EQ(zx_channel_read_batch(channel[1], 0, in, 3, &actual), ZX_ERR_BUFFER_TOO_SMALL, "");
+    EXPECT_EQ(actual, 0u, "");
+    EXPECT_EQ(in[0].num_bytes, 4u, "size of the next message");
+
+    // Reading stops at the third message, which doesn't fit.
+    in[0].num_bytes = 16u;
+    in[2].num_bytes = 8u;
+    ASSERT_EQ(zx_channel_read_batch(channel[1], 0, in, 3, &actual), ZX_OK, "");
+    ASSERT_EQ(actual, 2u, "");
+    EXPECT_EQ(in[0].num_bytes, 4u, "");
+    EXPECT_EQ(in[0].num_handles, 0u, "");
+    EXPECT_EQ(buf[0][0], 1u, "");
+    EXPECT_EQ(in[1].num_bytes, 8u, "");
+    EXPECT_EQ(in[1].num_handles, 1u, "");
+    EXPECT_EQ(buf[1][1], 3u, "");
+    EXPECT_NE(handle, ZX_HANDLE_INVALID, "");
+    EXPECT_EQ(zx_handle_close(handle), ZX_OK, "");
+
+    in[0].num_bytes = 16u;
+    ASSERT_EQ(zx_channel_read_batch(channel[1], 0, in, 1, &actual), ZX_OK, "");
+    ASSERT_EQ(actual, 1u, "");
+    EXPECT_EQ(in[0].num_bytes, 16u, "");
+    EXPECT_EQ(buf[0][3], 7u, "");
+
+    EXPECT_EQ(zx_channel_read_batch(channel[1], 0, in, 1, &actual), ZX_ERR_SHOULD_WAIT, "");
+
+    EXPECT_EQ(zx_channel_read_batch(channel[1], 0, in, 0, &actual), ZX_ERR_OUT_OF_RANGE, "");
+    EXPECT_EQ(zx_channel_write_batch(channel[0], 0, out, 0), ZX_ERR_OUT_OF_RANGE, "");
+
+    // A bad handle in any message means none are written, and all handles are consumed.
+    ASSERT_EQ(zx_event_create(0, &event), ZX_OK, "");
+    out[0].handles = &event;
+    out[0].num_handles = 1u;
+    zx_handle_t bad = ZX_HANDLE_INVALID;
+    out[2].handles = &bad;
+    out[2].num_handles = 1u;
+    ASSERT_EQ(zx_channel_write_batch(channel[0], 0, out, 3), ZX_ERR_BAD_HANDLE, "");
+    EXPECT_EQ(zx_handle_close(event), ZX_ERR_BAD_HANDLE, "handle not consumed");
+    EXPECT_EQ(zx_channel_read_batch(channel[1], 0, in, 1, &actual), ZX_ERR_SHOULD_WAIT, "");
+
+    ASSERT_EQ(zx_channel_write_batch(channel[0], 0, out, ZX_CHANNEL_MAX_BATCH_MSGS + 1),
+              ZX_ERR_OUT_OF_RANGE, "");
+
+    EXPECT_EQ(zx_handle_close(channel[1]), ZX_OK, "");
+    EXPECT_EQ(zx_channel_write_batch(channel[0], 0, out, 1), ZX_ERR_PEER_CLOSED, "");
+    EXPECT_EQ(zx_handle_close(channel[0]), ZX_OK, "");
+
+    END_TEST;
+}
+
+static bool channel_batch_read_fault(void) {
+    BEGIN_TEST;
+
+    zx_handle_t channel[2];
+    ASSERT_EQ(zx_channel_create(0, &channel[0], &channel[1]), ZX_OK, "");
+
+    zx_handle_t event;
+    ASSERT_EQ(zx_event_create(0, &event), ZX_OK, "");
+    zx_handle_t event_dup;
+    ASSERT_EQ(zx_handle_duplicate(event, ZX_RIGHT_SAME_RIGHTS, &event_dup), ZX_OK, "");
+    uint32_t data[3][4] = {{1u}, {2u, 3u}, {4u, 5u, 6u, 7u}};
+    zx_channel_msg_t out[3] = {
+        {data[0], NULL, 4u, 0u},
+        {data[1], &event_dup, 8u, 1u},
+        {data[2], NULL, 16u, 0u},
+    };
+    ASSERT_EQ(zx_channel_write_batch(channel[0], 0, out, 3), ZX_OK, "");
+
+    // The second buffer is mapped read-only, so writing out the second message faults.
+    zx_handle_t vmo;
+    ASSERT_EQ(zx_vmo_create(ZX_PAGE_SIZE, 0, &vmo), ZX_OK, "");
+    uintptr_t read_only;
+    ASSERT_EQ(zx_vmar_map(zx_vmar_root_self(), ZX_VM_PERM_READ, 0, vmo, 0, ZX_PAGE_SIZE,
+                          &read_only), ZX_OK, "");
+    uint32_t buf[3][4] = {};
+    zx_handle_t handle = ZX_HANDLE_INVALID;
+    zx_channel_msg_t in[3] = {
+        {buf[0], &handle, 16u, 1u},
+        {(void*)read_only, &handle, 16u, 1u},
+        {buf[2], &handle, 16u, 1u},
+    };
+    uint32_t actual = 42u;
+    EXPECT_EQ(zx_channel_read_batch(channel[1], 0, in, 3, &actual), ZX_ERR_INVALID_ARGS, "");
+
+    // The first message was delivered.
+    EXPECT_EQ(actual, 1u, "");
+    EXPECT_EQ(in[0].num_bytes, 4u, "");
+    EXPECT_EQ(in[0].num_handles, 0u, "");
+    EXPECT_EQ(buf[0][0], 1u, "");
+
+    // The second one was lost along with its handle, and the third was never taken.
+    EXPECT_EQ(handle, ZX_HANDLE_INVALID, "");
+    EXPECT_EQ(buf[2][0], 0u, "");
+    zx_info_handle_count_t info;
+    ASSERT_EQ(zx_object_get_info(event, ZX_INFO_HANDLE_COUNT, &info, sizeof(info), NULL, NULL),
+              ZX_OK, "");
+    EXPECT_EQ(info.handle_count, 1u, "the lost message's handle was closed");
+
+    // What is left in the channel is exactly the third message.
+    in[0].num_bytes = 16u;
+    in[0].num_handles = 1u;
+    in[1].bytes = buf[1];
+    ASSERT_EQ(zx_channel_read_batch(channel[1], 0, in, 3, &actual), ZX_OK, "");
+    ASSERT_EQ(actual, 1u, "");
+    EXPECT_EQ(in[0].num_bytes, 16u, "");
+    EXPECT_EQ(buf[0][3], 7u, "");
+    EXPECT_EQ(zx_channel_read_batch(channel[1], 0, in, 1, &actual), ZX_ERR_SHOULD_WAIT, "");
+
+    EXPECT_EQ(zx_vmar_unmap(zx_vmar_root_self(), read_only, ZX_PAGE_SIZE), ZX_OK, "");
+    EXPECT_EQ(zx_handle_close(vmo), ZX_OK, "");
+    EXPECT_EQ(zx_handle_close(event), ZX_OK, "");
+    EXPECT_EQ(zx_handle_close(channel[0]), ZX_OK, "");
+    EXPECT_EQ(zx_handle_close(channel[1]), ZX_OK, "");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(channel_tests)
 RUN_TEST(channel_test)
 RUN_TEST(channel_read_error_test)
@@ -1066,6 +1210,8 @@ RUN_TEST(channel_disallow_write_to_self)
 RUN_TEST(channel_read_etc)
 RUN_TEST(channel_write_different_sizes)
 RUN_TEST(channel_write_takes_all_handles)
+RUN_TEST(channel_batch)
+RUN_TEST(channel_batch_read_fault)
 END_TEST_CASE(channel_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -32,8 +32,26 @@ static bool clock_monotonic_test(void) {
     END_TEST;
 }
 
+// zx_clock_get_monotonic is usually computed in the vDSO from the tick
+// counter, while zx_clock_get always asks the kernel.  The two have to
+// agree on what time it is.
+static bool clock_monotonic_matches_kernel_test(void) {
+    BEGIN_TEST;
+
+    for (int idx = 0; idx < 100; ++idx) {
+        zx_time_t before = zx_clock_get_monotonic();
+        zx_time_t kernel = zx_clock_get(ZX_CLOCK_MONOTONIC);
+        zx_time_t after = zx_clock_get_monotonic();
+        ASSERT_LE(before, kernel, "vDSO time should not be ahead of the kernel's");
+        ASSERT_LE(kernel, after, "vDSO time should not be behind the kernel's");
+    }
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(clock_tests)
 RUN_TEST(clock_monotonic_test)
+RUN_TEST(clock_monotonic_matches_kernel_test)
 END_TEST_CASE(clock_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -108,6 +108,48 @@ static bool queue_too_many(void) {
     END_TEST;
 }
 
+static bool wait_batch_test(void) {
+    BEGIN_TEST;
+
+    zx_handle_t port;
+    ASSERT_EQ(zx_port_create(0, &port), ZX_OK);
+
+    zx_port_packet_t out[ZX_PORT_MAX_BATCH_PACKETS + 1] = {};
+    uint32_t actual = 42u;
+    EXPECT_EQ(zx_port_wait_batch(port, 0, out, 0, &actual), ZX_ERR_OUT_OF_RANGE);
+    EXPECT_EQ(zx_port_wait_batch(port, 0, out, ZX_PORT_MAX_BATCH_PACKETS + 1, &actual),
+              ZX_ERR_OUT_OF_RANGE);
+    EXPECT_EQ(zx_port_wait_batch(port, zx_deadline_after(ZX_USEC(1)), out, 4, &actual),
+              ZX_ERR_TIMED_OUT);
+
+    // More packets than fit in one batch, and more than the kernel stages at once.
+    const uint32_t kPackets = 40u;
+    for (uint32_t i = 0; i < kPackets; i++) {
+        zx_port_packet_t in = {};
+        in.key = i;
+        in.type = ZX_PKT_TYPE_USER;
+        in.user.u32[0] = i * 2u;
+        ASSERT_EQ(zx_port_queue(port, &in), ZX_OK);
+    }
+
+    ASSERT_EQ(zx_port_wait_batch(port, ZX_TIME_INFINITE, out, 32u, &actual), ZX_OK);
+    ASSERT_EQ(actual, 32u);
+    ASSERT_EQ(zx_port_wait_batch(port, ZX_TIME_INFINITE, out + 32, 32u, &actual), ZX_OK);
+    ASSERT_EQ(actual, kPackets - 32u);
+
+    // Packets come out in the order they were queued.
+    for (uint32_t i = 0; i < kPackets; i++) {
+        EXPECT_EQ(out[i].key, i);
+        EXPECT_EQ(out[i].type, ZX_PKT_TYPE_USER);
+        EXPECT_EQ(out[i].user.u32[0], i * 2u);
+    }
+
+    EXPECT_EQ(zx_port_wait_batch(port, 0, out, 1, nullptr), ZX_ERR_TIMED_OUT);
+    EXPECT_EQ(zx_handle_close(port), ZX_OK);
+
+    END_TEST;
+}
+
 static bool async_wait_channel_test(void) {
     BEGIN_TEST;
     zx_status_t status;
@@ -340,7 +382,7 @@ static bool async_wait_invalid_option() {
     zx_handle_t event;
     ASSERT_EQ(zx_event_create(0u, &event), ZX_OK);
     const uint64_t kKey = 0;
-    const uint32_t kInvalidOption = ZX_WAIT_ASYNC_REPEATING + 1;
+    const uint32_t kInvalidOption = ZX_WAIT_ASYNC_LEVEL + 1;
     EXPECT_EQ(zx_object_wait_async(event, port, kKey, ZX_EVENT_SIGNALED,
                                    kInvalidOption), ZX_ERR_INVALID_ARGS);
     ASSERT_EQ(zx_handle_close(event), ZX_OK);
@@ -348,6 +390,188 @@ static bool async_wait_invalid_option() {
     END_TEST;
 }
 
+// A level-triggered wait keeps a packet queued for as long as the object
+// has one of the signals asserted, however many times it is dequeued.
+static bool async_wait_level_test() {
+    BEGIN_TEST;
+
+    zx_handle_t port;
+    ASSERT_EQ(zx_port_create(0, &port), ZX_OK);
+    zx_handle_t ev;
+    ASSERT_EQ(zx_event_create(0u, &ev), ZX_OK);
+
+    const uint64_t kKey = 5309u;
+    ASSERT_EQ(zx_object_wait_async(ev, port, kKey, ZX_EVENT_SIGNALED | ZX_USER_SIGNAL_2,
+                                   ZX_WAIT_ASYNC_LEVEL), ZX_OK);
+
+    zx_port_packet_t out = {};
+    EXPECT_EQ(zx_port_wait(port, 0ull, &out), ZX_ERR_TIMED_OUT);
+
+    ASSERT_EQ(zx_object_signal(ev, 0u, ZX_EVENT_SIGNALED | ZX_USER_SIGNAL_2), ZX_OK);
+    for (int ix = 0; ix != 3; ++ix) {
+        ASSERT_EQ(zx_port_wait(port, 0ull, &out), ZX_OK);
+        EXPECT_EQ(out.key, kKey);
+        EXPECT_EQ(out.type, ZX_PKT_TYPE_SIGNAL_REP);
+        EXPECT_EQ(out.signal.observed, ZX_EVENT_SIGNALED | ZX_USER_SIGNAL_2);
+        EXPECT_EQ(out.signal.count, 1u);
+    }
+
+    // Dropping one of the signals is reflected in the queued packet.
+    ASSERT_EQ(zx_object_signal(ev, ZX_USER_SIGNAL_2, 0u), ZX_OK);
+    ASSERT_EQ(zx_port_wait(port, 0ull, &out), ZX_OK);
+    EXPECT_EQ(out.signal.observed, ZX_EVENT_SIGNALED);
+
+    // Dropping both takes the packet out of the queue.
+    ASSERT_EQ(zx_object_signal(ev, ZX_EVENT_SIGNALED, 0u), ZX_OK);
+    EXPECT_EQ(zx_port_wait(port, 0ull, &out), ZX_ERR_TIMED_OUT);
+
+    ASSERT_EQ(zx_object_signal(ev, 0u, ZX_EVENT_SIGNALED), ZX_OK);
+    ASSERT_EQ(zx_port_wait(port, 0ull, &out), ZX_OK);
+    EXPECT_EQ(out.key, kKey);
+
+    // Once canceled, nothing more is delivered.
+    EXPECT_EQ(zx_port_cancel(port, ev, kKey), ZX_OK);
+    EXPECT_EQ(zx_port_wait(port, 0ull, &out), ZX_ERR_TIMED_OUT);
+
+    EXPECT_EQ(zx_handle_close(ev), ZX_OK);
+    EXPECT_EQ(zx_handle_close(port), ZX_OK);
+    END_TEST;
+}
+
+// With level-triggered waits on many channels, zx_port_wait_batch() returns
+// the ones that are readable, each once per batch, for as long as they are.
+static bool async_wait_level_many_test() {
+    BEGIN_TEST;
+
+    // Well over what zx_object_wait_many() accepts.
+    constexpr uint32_t kChannels = 200u;
+    constexpr uint32_t kReadable = 50u;
+
+    zx_handle_t port;
+    ASSERT_EQ(zx_port_create(0, &port), ZX_OK);
+
+    zx_handle_t ch[kChannels][2];
+    for (uint32_t ix = 0; ix != kChannels; ++ix) {
+        ASSERT_EQ(zx_channel_create(0u, &ch[ix][0], &ch[ix][1]), ZX_OK);
+        ASSERT_EQ(zx_object_wait_async(ch[ix][1], port, ix, ZX_CHANNEL_READABLE,
+                                       ZX_WAIT_ASYNC_LEVEL), ZX_OK);
+    }
+
+    // Every fourth channel becomes readable.
+    for (uint32_t ix = 0; ix != kChannels; ix += kChannels / kReadable) {
+        ASSERT_EQ(zx_channel_write(ch[ix][0], 0u, "x", 1u, nullptr, 0u), ZX_OK);
+    }
+
+    zx_port_packet_t out[ZX_PORT_MAX_BATCH_PACKETS];
+    for (int round = 0; round != 2; ++round) {
+        bool seen[kChannels] = {};
+        uint32_t total = 0u;
+        while (total < kReadable) {
+            uint32_t actual = 0u;
+            uint32_t want = fbl::min<uint32_t>(kReadable - total, ZX_PORT_MAX_BATCH_PACKETS);
+            ASSERT_EQ(zx_port_wait_batch(port, 0ull, out, want, &actual), ZX_OK);
+            for (uint32_t ix = 0; ix != actual; ++ix) {
+                ASSERT_LT(out[ix].key, kChannels);
+                EXPECT_EQ(out[ix].key % (kChannels / kReadable), 0u);
+                EXPECT_FALSE(seen[out[ix].key]);
+                EXPECT_EQ(out[ix].signal.observed & ZX_CHANNEL_READABLE, ZX_CHANNEL_READABLE);
+                seen[out[ix].key] = true;
+            }
+            total += actual;
+        }
+        EXPECT_EQ(total, kReadable);
+    }
+
+    // Draining the channels leaves nothing to report.
+    for (uint32_t ix = 0; ix != kChannels; ix += kChannels / kReadable) {
+        char byte;
+        uint32_t actual_bytes;
+        ASSERT_EQ(zx_channel_read(ch[ix][1], 0u, &byte, nullptr, 1u, 0u, &actual_bytes, nullptr),
+                  ZX_OK);
+    }
+    uint32_t actual = 0u;
+    EXPECT_EQ(zx_port_wait_batch(port, 0ull, out, ZX_PORT_MAX_BATCH_PACKETS, &actual),
+              ZX_ERR_TIMED_OUT);
+
+    for (uint32_t ix = 0; ix != kChannels; ++ix) {
+        EXPECT_EQ(zx_handle_close(ch[ix][0]), ZX_OK);
+        EXPECT_EQ(zx_handle_close(ch[ix][1]), ZX_OK);
+    }
+    EXPECT_EQ(zx_handle_close(port), ZX_OK);
+    END_TEST;
+}
+
+// A batch larger than what the kernel takes at a time still returns each
+// ready level-triggered wait only once.
+static bool async_wait_level_batch_unique_test() {
+    BEGIN_TEST;
+
+    constexpr uint32_t kEvents = 20u;
+
+    zx_handle_t port;
+    ASSERT_EQ(zx_port_create(0, &port), ZX_OK);
+
+    zx_handle_t ev[kEvents];
+    for (uint32_t ix = 0; ix != kEvents; ++ix) {
+        ASSERT_EQ(zx_event_create(0u, &ev[ix]), ZX_OK);
+        ASSERT_EQ(zx_object_signal(ev[ix], 0u, ZX_EVENT_SIGNALED), ZX_OK);
+        ASSERT_EQ(zx_object_wait_async(ev[ix], port, ix, ZX_EVENT_SIGNALED,
+                                       ZX_WAIT_ASYNC_LEVEL), ZX_OK);
+    }
+
+    zx_port_packet_t out[64];
+    for (int round = 0; round != 2; ++round) {
+        uint32_t actual = 0u;
+        ASSERT_EQ(zx_port_wait_batch(port, 0ull, out, 64u, &actual), ZX_OK);
+        EXPECT_EQ(actual, kEvents);
+        bool seen[kEvents] = {};
+        for (uint32_t ix = 0; ix != actual; ++ix) {
+            ASSERT_LT(out[ix].key, kEvents);
+            EXPECT_FALSE(seen[out[ix].key]);
+            seen[out[ix].key] = true;
+        }
+    }
+
+    for (uint32_t ix = 0; ix != kEvents; ++ix) {
+        EXPECT_EQ(zx_handle_close(ev[ix]), ZX_OK);
+    }
+    EXPECT_EQ(zx_handle_close(port), ZX_OK);
+    END_TEST;
+}
+
+// Ready level-triggered waits don't count toward the port's packet limit.
+static bool async_wait_level_limit_test() {
+    BEGIN_TEST;
+
+    // More than the 2048 packets a port will queue.
+    constexpr uint32_t kEvents = 2100u;
+
+    zx_handle_t port;
+    ASSERT_EQ(zx_port_create(0, &port), ZX_OK);
+
+    zx_handle_t ev[kEvents];
+    for (uint32_t ix = 0; ix != kEvents; ++ix) {
+        ASSERT_EQ(zx_event_create(0u, &ev[ix]), ZX_OK);
+        ASSERT_EQ(zx_object_signal(ev[ix], 0u, ZX_EVENT_SIGNALED), ZX_OK);
+        ASSERT_EQ(zx_object_wait_async(ev[ix], port, ix, ZX_EVENT_SIGNALED,
+                                       ZX_WAIT_ASYNC_LEVEL), ZX_OK);
+    }
+
+    const zx_port_packet_t in = {
+        kEvents,
+        ZX_PKT_TYPE_USER,
+        0,
+        { {} }
+    };
+    EXPECT_EQ(zx_port_queue(port, &in), ZX_OK);
+
+    for (uint32_t ix = 0; ix != kEvents; ++ix) {
+        EXPECT_EQ(zx_handle_close(ev[ix]), ZX_OK);
+    }
+    EXPECT_EQ(zx_handle_close(port), ZX_OK);
+    END_TEST;
+}
+
 static bool pre_writes_channel_test(uint32_t mode) {
     BEGIN_TEST;
     zx_status_t status;
@@ -681,10 +905,15 @@ BEGIN_TEST_CASE(port_tests)
 RUN_TEST(basic_test)
 RUN_TEST(queue_and_close_test)
 RUN_TEST(queue_too_many)
+RUN_TEST(wait_batch_test)
 RUN_TEST(async_wait_channel_test)
 RUN_TEST(async_wait_event_test_single)
 RUN_TEST(async_wait_event_test_repeat)
 RUN_TEST(async_wait_invalid_option)
+RUN_TEST(async_wait_level_test)
+RUN_TEST(async_wait_level_many_test)
+RUN_TEST(async_wait_level_batch_unique_test)
+RUN_TEST(async_wait_level_limit_test)
 RUN_TEST(async_wait_close_order_1)
 RUN_TEST(async_wait_close_order_2)
 RUN_TEST(async_wait_close_order_3)
@@ -6,10 +6,12 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <fbl/array.h>
 #include <unittest/unittest.h>
+#include <zircon/limits.h>
 #include <zircon/syscalls.h>
 
 namespace {
@@ -1376,6 +1378,216 @@ bool socket_share_consumes_on_failure() {
     END_TEST;
 }
 
+bool socket_rx_buffer_max() {
+    BEGIN_TEST;
+
+    zx_handle_t h0, h1;
+    ASSERT_EQ(zx_socket_create(0, &h0, &h1), ZX_OK, "");
+
+    size_t max = 0;
+    ASSERT_EQ(zx_object_get_property(h1, ZX_PROP_SOCKET_RX_BUFFER_MAX, &max, sizeof(max)),
+              ZX_OK, "");
+    zx_info_socket_t info = {};
+    ASSERT_EQ(zx_object_get_info(h0, ZX_INFO_SOCKET, &info, sizeof(info), NULL, NULL), ZX_OK, "");
+    EXPECT_EQ(info.tx_buf_max, max, "");
+
+    max = 0;
+    EXPECT_EQ(zx_object_set_property(h1, ZX_PROP_SOCKET_RX_BUFFER_MAX, &max, sizeof(max)),
+              ZX_ERR_OUT_OF_RANGE, "");
+
+    // Fill the default buffer, then make room by growing it.
+    const size_t big = 1024 * 1024;
+    fbl::Array<char> buffer(new char[big], big);
+    size_t written;
+    ASSERT_EQ(zx_socket_write(h0, 0u, buffer.get(), big, &written), ZX_OK, "");
+    EXPECT_LT(written, big, "");
+    EXPECT_EQ(get_satisfied_signals(h0) & ZX_SOCKET_WRITABLE, 0u, "");
+
+    max = written - 1;
+    EXPECT_EQ(zx_object_set_property(h1, ZX_PROP_SOCKET_RX_BUFFER_MAX, &max, sizeof(max)),
+              ZX_ERR_BAD_STATE, "");
+    max = written + big;
+    ASSERT_EQ(zx_object_set_property(h1, ZX_PROP_SOCKET_RX_BUFFER_MAX, &max, sizeof(max)),
+              ZX_OK, "");
+    EXPECT_EQ(get_satisfied_signals(h0) & ZX_SOCKET_WRITABLE, ZX_SOCKET_WRITABLE, "");
+
+    size_t more;
+    ASSERT_EQ(zx_socket_write(h0, 0u, buffer.get(), big, &more), ZX_OK, "");
+    EXPECT_EQ(more, big, "");
+    ASSERT_EQ(zx_object_get_info(h1, ZX_INFO_SOCKET, &info, sizeof(info), NULL, NULL), ZX_OK, "");
+    EXPECT_EQ(info.rx_buf_max, max, "");
+    EXPECT_EQ(info.rx_buf_size, written + big, "");
+
+    // The buffer cannot shrink below the thresholds.
+    size_t threshold = max;
+    ASSERT_EQ(zx_object_set_property(h1, ZX_PROP_SOCKET_RX_THRESHOLD, &threshold,
+                                     sizeof(threshold)), ZX_OK, "");
+    max = max - 1;
+    EXPECT_EQ(zx_object_set_property(h1, ZX_PROP_SOCKET_RX_BUFFER_MAX, &max, sizeof(max)),
+              ZX_ERR_INVALID_ARGS, "");
+
+    zx_handle_close(h0);
+    zx_handle_close(h1);
+
+    END_TEST;
+}
+
+bool socket_write_vmo() {
+    BEGIN_TEST;
+
+    zx_handle_t vmo;
+    ASSERT_EQ(zx_vmo_create(3 * ZX_PAGE_SIZE, 0, &vmo), ZX_OK, "");
+    fbl::Array<char> data(new char[3 * ZX_PAGE_SIZE], 3 * ZX_PAGE_SIZE);
+    for (size_t i = 0; i < 3 * ZX_PAGE_SIZE; ++i) {
+        data[i] = static_cast<char>(i * 7);
+    }
+    ASSERT_EQ(zx_vmo_write(vmo, data.get(), 0, 3 * ZX_PAGE_SIZE), ZX_OK, "");
+
+    zx_handle_t h0, h1;
+    ASSERT_EQ(zx_socket_create(0, &h0, &h1), ZX_OK, "");
+
+    size_t written;
+    EXPECT_EQ(zx_socket_write_vmo(h0, 1u, vmo, 0, 1, &written), ZX_ERR_INVALID_ARGS, "");
+    EXPECT_EQ(zx_socket_write_vmo(h0, 0u, vmo, 2 * ZX_PAGE_SIZE, ZX_PAGE_SIZE + 1, &written),
+              ZX_ERR_OUT_OF_RANGE, "");
+    EXPECT_EQ(zx_socket_write_vmo(h0, 0u, h1, 0, 1, &written), ZX_ERR_WRONG_TYPE, "");
+    zx_handle_t vmo_no_read;
+    ASSERT_EQ(zx_handle_duplicate(vmo, ZX_RIGHT_WRITE, &vmo_no_read), ZX_OK, "");
+    EXPECT_EQ(zx_socket_write_vmo(h0, 0u, vmo_no_read, 0, 1, &written),
+              ZX_ERR_ACCESS_DENIED, "");
+    zx_handle_close(vmo_no_read);
+
+    // Pager-backed VMOs, and clones of them, are refused.
+    zx_handle_t pager, port, pager_vmo, pager_clone;
+    ASSERT_EQ(zx_pager_create(0, &pager), ZX_OK, "");
+    ASSERT_EQ(zx_port_create(0, &port), ZX_OK, "");
+    ASSERT_EQ(zx_pager_create_vmo(pager, 0, port, 0, ZX_PAGE_SIZE, &pager_vmo), ZX_OK, "");
+    ASSERT_EQ(zx_vmo_clone(pager_vmo, ZX_VMO_CLONE_COPY_ON_WRITE, 0, ZX_PAGE_SIZE, &pager_clone),
+              ZX_OK, "");
+    EXPECT_EQ(zx_socket_write_vmo(h0, 0u, pager_vmo, 0, 1, &written), ZX_ERR_NOT_SUPPORTED, "");
+    EXPECT_EQ(zx_socket_write_vmo(h0, 0u, pager_clone, 0, 1, &written), ZX_ERR_NOT_SUPPORTED,
+              "");
+    zx_handle_close(pager_clone);
+    zx_handle_close(pager_vmo);
+    zx_handle_close(port);
+    zx_handle_close(pager);
+
+    // Write bytes that start and end part way into a page, surrounded by
+    // copied bytes.
+    const size_t offset = 100;
+    const size_t len = 2 * ZX_PAGE_SIZE + 5;
+    ASSERT_EQ(zx_socket_write(h0, 0u, "ab", 2, &written), ZX_OK, "");
+    ASSERT_EQ(zx_socket_write_vmo(h0, 0u, vmo, offset, len, &written), ZX_OK, "");
+    EXPECT_EQ(written, len, "");
+    ASSERT_EQ(zx_socket_write(h0, 0u, "cd", 2, &written), ZX_OK, "");
+
+    // Closing the VMO leaves the queued bytes readable.
+    zx_handle_close(vmo);
+
+    fbl::Array<char> out(new char[len + 4], len + 4);
+    size_t count;
+    ASSERT_EQ(zx_socket_read(h1, 0u, out.get(), len + 4, &count), ZX_OK, "");
+    ASSERT_EQ(count, len + 4, "");
+    EXPECT_EQ(memcmp(out.get(), "ab", 2), 0, "");
+    EXPECT_EQ(memcmp(out.get() + 2, data.get() + offset, len), 0, "");
+    EXPECT_EQ(memcmp(out.get() + 2 + len, "cd", 2), 0, "");
+
+    zx_handle_close(h0);
+    zx_handle_close(h1);
+
+    END_TEST;
+}
+
+bool socket_write_vmo_short_write() {
+    BEGIN_TEST;
+
+    zx_handle_t h0, h1;
+    ASSERT_EQ(zx_socket_create(0, &h0, &h1), ZX_OK, "");
+    size_t max;
+    ASSERT_EQ(zx_object_get_property(h1, ZX_PROP_SOCKET_RX_BUFFER_MAX, &max, sizeof(max)),
+              ZX_OK, "");
+
+    // A stream socket takes as much as fits, as with zx_socket_write().
+    const size_t size = max + ZX_PAGE_SIZE;
+    zx_handle_t vmo;
+    ASSERT_EQ(zx_vmo_create(size, 0, &vmo), ZX_OK, "");
+    size_t written;
+    ASSERT_EQ(zx_socket_write_vmo(h0, 0u, vmo, 0, size, &written), ZX_OK, "");
+    EXPECT_EQ(written, max, "");
+    EXPECT_EQ(zx_socket_write_vmo(h0, 0u, vmo, 0, 1, &written), ZX_ERR_SHOULD_WAIT, "");
+    EXPECT_EQ(get_satisfied_signals(h0) & ZX_SOCKET_WRITABLE, 0u, "");
+
+    zx_handle_close(h0);
+    zx_handle_close(h1);
+
+    // A datagram socket takes all of a datagram or none of it.
+    ASSERT_EQ(zx_socket_create(ZX_SOCKET_DATAGRAM, &h0, &h1), ZX_OK, "");
+    EXPECT_EQ(zx_socket_write_vmo(h0, 0u, vmo, 0, size, &written), ZX_ERR_OUT_OF_RANGE, "");
+    ASSERT_EQ(zx_socket_write_vmo(h0, 0u, vmo, 0, ZX_PAGE_SIZE, &written), ZX_OK, "");
+    EXPECT_EQ(written, ZX_PAGE_SIZE, "");
+    char buf[16];
+    size_t count;
+    ASSERT_EQ(zx_socket_read(h1, 0u, buf, sizeof(buf), &count), ZX_OK, "");
+    EXPECT_EQ(count, sizeof(buf), "");
+    EXPECT_EQ(zx_socket_read(h1, 0u, buf, sizeof(buf), &count), ZX_ERR_SHOULD_WAIT, "");
+
+    zx_handle_close(vmo);
+    zx_handle_close(h0);
+    zx_handle_close(h1);
+
+    END_TEST;
+}
+
+bool socket_write_vmo_write_threshold() {
+    BEGIN_TEST;
+
+    zx_handle_t h0, h1;
+    ASSERT_EQ(zx_socket_create(0, &h0, &h1), ZX_OK, "");
+    size_t max;
+    ASSERT_EQ(zx_object_get_property(h1, ZX_PROP_SOCKET_RX_BUFFER_MAX, &max, sizeof(max)),
+              ZX_OK, "");
+    size_t threshold = ZX_PAGE_SIZE;
+    ASSERT_EQ(zx_object_set_property(h0, ZX_PROP_SOCKET_TX_THRESHOLD, &threshold,
+                                     sizeof(threshold)), ZX_OK, "");
+    EXPECT_EQ(get_satisfied_signals(h0), ZX_SOCKET_WRITABLE | ZX_SOCKET_WRITE_THRESHOLD, "");
+
+    zx_handle_t vmo;
+    ASSERT_EQ(zx_vmo_create(ZX_PAGE_SIZE, 0, &vmo), ZX_OK, "");
+
+    // Each small write uses up much more of the buffer than its one byte, so
+    // the socket fills up long before |max| bytes are queued.  Whenever
+    // WRITE_THRESHOLD is asserted there must be room for another write.
+    size_t total = 0;
+    zx_status_t status = ZX_OK;
+    for (size_t i = 0; i < max && status == ZX_OK; ++i) {
+        bool above_threshold = get_satisfied_signals(h0) & ZX_SOCKET_WRITE_THRESHOLD;
+        size_t written;
+        status = zx_socket_write_vmo(h0, 0u, vmo, 0, 1, &written);
+        if (above_threshold) {
+            ASSERT_EQ(status, ZX_OK, "");
+        }
+        if (status == ZX_OK) {
+            total += written;
+        }
+    }
+    EXPECT_EQ(status, ZX_ERR_SHOULD_WAIT, "");
+    EXPECT_LT(total, max / 2, "");
+    EXPECT_EQ(get_satisfied_signals(h0), 0u, "");
+
+    // Reading the bytes back frees the space again.
+    fbl::Array<char> out(new char[total], total);
+    size_t count;
+    ASSERT_EQ(zx_socket_read(h1, 0u, out.get(), total, &count), ZX_OK, "");
+    EXPECT_EQ(count, total, "");
+    EXPECT_EQ(get_satisfied_signals(h0), ZX_SOCKET_WRITABLE | ZX_SOCKET_WRITE_THRESHOLD, "");
+
+    zx_handle_close(vmo);
+    zx_handle_close(h0);
+    zx_handle_close(h1);
+
+    END_TEST;
+}
+
 } // namespace
 
 BEGIN_TEST_CASE(socket_tests)
@@ -1404,6 +1616,10 @@ RUN_TEST(socket_accept)
 RUN_TEST(socket_share_invalid_handle)
 RUN_TEST(socket_share_consumes_on_failure)
 RUN_TEST(socket_signals2)
+RUN_TEST(socket_rx_buffer_max)
+RUN_TEST(socket_write_vmo)
+RUN_TEST(socket_write_vmo_short_write)
+RUN_TEST(socket_write_vmo_write_threshold)
 END_TEST_CASE(socket_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -142,6 +142,10 @@ public:
     static void RecordEraseRotation()           { ++op_counts_.erase_rotations_; }
     static void RecordEraseDoubleRotation()     { ++op_counts_.erase_double_rotations_; }
 
+    static constexpr bool kTracksSubtrees = false;
+    template <typename RawPtrType>
+    static void RecordSubtreeChange(RawPtrType node, RawPtrType left, RawPtrType right) { }
+
     template <typename TreeType>
     static bool VerifyRankRule(const TreeType& tree, typename TreeType::RawPtrType node) {
         BEGIN_TEST;
@@ -422,6 +426,148 @@ static bool WAVLBalanceTest() {
     END_TEST;
 }
 
+// Objects used by the augmented subtree test.  Each one caches the number of
+// nodes and the largest key in the subtree rooted at it, maintained by the
+// tree through the observer's RecordSubtreeChange hook.
+class AugmentedTestObj;
+
+using AugmentedTestObjPtr = unique_ptr<AugmentedTestObj>;
+
+struct AugmentedTestObserver : public DefaultWAVLTreeObserver {
+    static constexpr bool kTracksSubtrees = true;
+    static void RecordSubtreeChange(AugmentedTestObj* node,
+                                    AugmentedTestObj* left,
+                                    AugmentedTestObj* right);
+};
+
+using AugmentedTestTree = WAVLTree<BalanceTestKeyType,
+                                   AugmentedTestObjPtr,
+                                   DefaultKeyedObjectTraits<BalanceTestKeyType, AugmentedTestObj>,
+                                   DefaultWAVLTreeTraits<AugmentedTestObjPtr, int32_t>,
+                                   AugmentedTestObserver>;
+
+class AugmentedTestObj {
+public:
+    void Init(BalanceTestKeyType val) { key_ = val; }
+
+    BalanceTestKeyType GetKey() const { return key_; }
+    bool InContainer() const { return wavl_node_state_.InContainer(); }
+
+    size_t subtree_count_ = 0;
+    BalanceTestKeyType subtree_max_ = 0;
+
+private:
+    friend DefaultWAVLTreeTraits<AugmentedTestObjPtr, int32_t>;
+
+    static void operator delete(void* ptr) {
+        // Deliberate no-op
+    }
+    friend class fbl::unique_ptr<AugmentedTestObj[]>;
+    friend class fbl::unique_ptr<AugmentedTestObj>;
+
+    BalanceTestKeyType key_;
+    WAVLTreeNodeState<AugmentedTestObjPtr, int32_t> wavl_node_state_;
+};
+
+void AugmentedTestObserver::RecordSubtreeChange(AugmentedTestObj* node,
+                                                AugmentedTestObj* left,
+                                                AugmentedTestObj* right) {
+    node->subtree_count_ = 1;
+    node->subtree_max_ = node->GetKey();
+    if (left != nullptr) {
+        node->subtree_count_ += left->subtree_count_;
+    }
+    if (right != nullptr) {
+        node->subtree_count_ += right->subtree_count_;
+        node->subtree_max_ = right->subtree_max_;
+    }
+}
+
+// Recompute the augmented state of the subtree at |iter| from scratch and
+// make sure that it matches what the tree maintained.
+static bool VerifyAugmentedSubtree(AugmentedTestTree::iterator iter,
+                                   size_t* count, BalanceTestKeyType* max) {
+    BEGIN_TEST;
+
+    size_t left_count = 0, right_count = 0;
+    BalanceTestKeyType left_max = 0, right_max = 0;
+
+    if (iter.left().IsValid())
+        ASSERT_TRUE(VerifyAugmentedSubtree(iter.left(), &left_count, &left_max));
+    if (iter.right().IsValid())
+        ASSERT_TRUE(VerifyAugmentedSubtree(iter.right(), &right_count, &right_max));
+
+    *count = left_count + right_count + 1;
+    *max = iter.right().IsValid() ? right_max : iter->GetKey();
+
+    ASSERT_EQ(*count, iter->subtree_count_);
+    ASSERT_EQ(*max, iter->subtree_max_);
+
+    END_TEST;
+}
+
+static bool VerifyAugmentedTree(AugmentedTestTree& tree) {
+    BEGIN_TEST;
+
+    if (tree.is_empty()) {
+        ASSERT_FALSE(tree.root().IsValid());
+    } else {
+        size_t count;
+        BalanceTestKeyType max;
+        ASSERT_TRUE(VerifyAugmentedSubtree(tree.root(), &count, &max));
+        ASSERT_EQ(tree.size(), count);
+        ASSERT_EQ(tree.back().GetKey(), max);
+    }
+
+    END_TEST;
+}
+
+static bool WAVLAugmentedSubtreeTest() {
+    BEGIN_TEST;
+
+    static constexpr size_t kAugmentedTestSize = 512;
+
+    unique_ptr<AugmentedTestObj[]> objects;
+    AugmentedTestTree tree;
+    Lfsr<BalanceTestKeyType> rng(0x5c0ffee15badf00du);
+
+    {
+        AllocChecker ac;
+        objects.reset(new (&ac) AugmentedTestObj[kAugmentedTestSize]);
+        ASSERT_TRUE(ac.check(), "Failed to allocate test objects!");
+    }
+
+    for (size_t i = 0; i < kAugmentedTestSize; ++i)
+        objects[i].Init(rng.GetNext());
+
+    // Insert everything, checking the augmented state of the whole tree after
+    // each operation so that every rebalance case gets validated.
+    for (size_t i = 0; i < kAugmentedTestSize; ++i) {
+        ASSERT_TRUE(tree.insert_or_find(AugmentedTestObjPtr(&objects[i])));
+        ASSERT_TRUE(VerifyAugmentedTree(tree));
+    }
+
+    // Randomly erase and re-insert objects.
+    for (size_t i = 0; i < (kAugmentedTestSize * 4); ++i) {
+        AugmentedTestObj* obj = &objects[rng.GetNext() % kAugmentedTestSize];
+        if (obj->InContainer()) {
+            AugmentedTestObjPtr erased = tree.erase(*obj);
+            ASSERT_EQ(obj, erased.get());
+        } else {
+            ASSERT_TRUE(tree.insert_or_find(AugmentedTestObjPtr(obj)));
+        }
+        ASSERT_TRUE(VerifyAugmentedTree(tree));
+    }
+
+    // Finally, drain the tree from the front.
+    while (!tree.is_empty()) {
+        tree.pop_front();
+        ASSERT_TRUE(VerifyAugmentedTree(tree));
+    }
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(wavl_tree_tests)
 //////////////////////////////////////////
 // General container specific tests.
@@ -596,6 +742,7 @@ RUN_NAMED_TEST("LowerBound (RefPtr)",                      RPTE::LowerBoundTest)
 ////////////////////////////
 // ZX-2230: This can take more than 20 seconds in CI, so mark it medium.
 RUN_NAMED_TEST_MEDIUM("BalanceTest", WAVLBalanceTest)
+RUN_NAMED_TEST("AugmentedSubtreeTest", WAVLAugmentedSubtreeTest)
 
 END_TEST_CASE(wavl_tree_tests);
 
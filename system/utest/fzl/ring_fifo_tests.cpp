@@ -0,0 +1,212 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <lib/fzl/ring-fifo.h>
+
+#include <threads.h>
+
+#include <fbl/unique_ptr.h>
+
+#include <unittest/unittest.h>
+
+#include <utility>
+
+namespace {
+
+bool create_validates_sizes() {
+    BEGIN_TEST;
+
+    fzl::RingFifo end;
+    zx::vmo vmo;
+    zx::eventpair events;
+    EXPECT_EQ(fzl::RingFifo::Create(0, 8, &end, &vmo, &events), ZX_ERR_OUT_OF_RANGE);
+    EXPECT_EQ(fzl::RingFifo::Create(3, 8, &end, &vmo, &events), ZX_ERR_OUT_OF_RANGE);
+    EXPECT_EQ(fzl::RingFifo::Create(4, 0, &end, &vmo, &events), ZX_ERR_OUT_OF_RANGE);
+    EXPECT_EQ(fzl::RingFifo::Create(1024 * 1024, 2, &end, &vmo, &events), ZX_ERR_OUT_OF_RANGE);
+    EXPECT_FALSE(end.is_valid());
+
+    ASSERT_EQ(fzl::RingFifo::Create(16, 8, &end, &vmo, &events), ZX_OK);
+    EXPECT_TRUE(end.is_valid());
+
+    // The other end has to agree on the element size.
+    fzl::RingFifo peer;
+    EXPECT_EQ(fzl::RingFifo::Attach(std::move(vmo), std::move(events), 4, &peer),
+              ZX_ERR_INVALID_ARGS);
+    EXPECT_FALSE(peer.is_valid());
+
+    END_TEST;
+}
+
+bool rejects_resizable_vmo() {
+    BEGIN_TEST;
+
+    fzl::RingFifo end;
+    zx::vmo vmo;
+    zx::eventpair events;
+    ASSERT_EQ(fzl::RingFifo::Create(4, 8, &end, &vmo, &events), ZX_OK);
+    // The peer can't shrink the memory out from under the other end.
+    EXPECT_EQ(vmo.set_size(0), ZX_ERR_UNAVAILABLE);
+
+    // A VMO that could be shrunk is turned down, even with valid contents.
+    uint64_t size;
+    ASSERT_EQ(vmo.get_size(&size), ZX_OK);
+    fbl::unique_ptr<uint8_t[]> contents(new uint8_t[size]);
+    ASSERT_EQ(vmo.read(contents.get(), 0, size), ZX_OK);
+    zx::vmo resizable;
+    ASSERT_EQ(zx::vmo::create(size, 0, &resizable), ZX_OK);
+    ASSERT_EQ(resizable.write(contents.get(), 0, size), ZX_OK);
+    fzl::RingFifo peer;
+    EXPECT_EQ(fzl::RingFifo::Attach(std::move(resizable), std::move(events), 8, &peer),
+              ZX_ERR_NOT_SUPPORTED);
+    EXPECT_FALSE(peer.is_valid());
+
+    END_TEST;
+}
+
+bool write_and_read() {
+    BEGIN_TEST;
+
+    fzl::ring_fifo<uint64_t> end0, end1;
+    ASSERT_EQ(fzl::create_ring_fifo(4, &end0, &end1), ZX_OK);
+
+    uint64_t elem;
+    EXPECT_EQ(end1.read_one(&elem), ZX_ERR_SHOULD_WAIT);
+    EXPECT_EQ(end0.write(&elem, 0, nullptr), ZX_ERR_OUT_OF_RANGE);
+
+    // Go around the ring a few times, so that copies wrap around its end.
+    uint64_t next_write = 0;
+    uint64_t next_read = 0;
+    for (int round = 0; round != 5; ++round) {
+        uint64_t in[3] = {next_write, next_write + 1, next_write + 2};
+        size_t actual;
+        ASSERT_EQ(end0.write(in, 3, &actual), ZX_OK);
+        EXPECT_EQ(actual, 3u);
+        next_write += 3;
+
+        uint64_t out[4] = {};
+        ASSERT_EQ(end1.read(out, 4, &actual), ZX_OK);
+        EXPECT_EQ(actual, 3u);
+        for (size_t i = 0; i != actual; ++i) {
+            EXPECT_EQ(out[i], next_read++);
+        }
+    }
+
+    // A full ring takes no more, and the other direction is independent.
+    uint64_t in[5] = {};
+    size_t actual;
+    ASSERT_EQ(end0.write(in, 5, &actual), ZX_OK);
+    EXPECT_EQ(actual, 4u);
+    EXPECT_EQ(end0.write_one(in[0]), ZX_ERR_SHOULD_WAIT);
+    EXPECT_EQ(end1.write_one(42u), ZX_OK);
+    ASSERT_EQ(end0.read_one(&elem), ZX_OK);
+    EXPECT_EQ(elem, 42u);
+
+    END_TEST;
+}
+
+bool corrupt_indices() {
+    BEGIN_TEST;
+
+    fzl::RingFifo end0, end1;
+    zx::vmo vmo, vmo_dup;
+    zx::eventpair events;
+    ASSERT_EQ(fzl::RingFifo::Create(4, 8, &end0, &vmo, &events), ZX_OK);
+    ASSERT_EQ(vmo.duplicate(ZX_RIGHT_SAME_RIGHTS, &vmo_dup), ZX_OK);
+    ASSERT_EQ(fzl::RingFifo::Attach(std::move(vmo), std::move(events), 8, &end1), ZX_OK);
+
+    // Claim far more elements than the ring holds by moving the head of ring
+    // 0, which is at the start of the second cache line.
+    const uint32_t head = 1000;
+    ASSERT_EQ(vmo_dup.write(&head, 64, sizeof(head)), ZX_OK);
+
+    uint64_t elem;
+    EXPECT_EQ(end1.Read(8, &elem, 1, nullptr), ZX_ERR_BAD_STATE);
+
+    END_TEST;
+}
+
+bool peer_closed() {
+    BEGIN_TEST;
+
+    fzl::ring_fifo<uint32_t> end1;
+    {
+        fzl::ring_fifo<uint32_t> end0;
+        ASSERT_EQ(fzl::create_ring_fifo(4, &end0, &end1), ZX_OK);
+        ASSERT_EQ(end0.write_one(7u), ZX_OK);
+    }
+
+    // What the peer wrote before going away can still be read.
+    EXPECT_EQ(end1.wait_readable(zx::time::infinite()), ZX_OK);
+    uint32_t elem;
+    ASSERT_EQ(end1.read_one(&elem), ZX_OK);
+    EXPECT_EQ(elem, 7u);
+    EXPECT_EQ(end1.wait_readable(zx::time::infinite()), ZX_ERR_PEER_CLOSED);
+
+    END_TEST;
+}
+
+constexpr uint64_t kStreamCount = 100000;
+
+int StreamWriter(void* arg) {
+    auto end = static_cast<fzl::ring_fifo<uint64_t>*>(arg);
+    for (uint64_t next = 0; next < kStreamCount;) {
+        zx_status_t status = end->write_one(next);
+        if (status == ZX_ERR_SHOULD_WAIT) {
+            status = end->wait_writable(zx::time::infinite());
+            if (status != ZX_OK) {
+                return -1;
+            }
+            continue;
+        }
+        if (status != ZX_OK) {
+            return -1;
+        }
+        next++;
+    }
+    return 0;
+}
+
+// A writer and a reader on different threads, each blocking whenever it gets
+// ahead of the other, must never miss a wakeup.
+bool stream_between_threads() {
+    BEGIN_TEST;
+
+    fzl::ring_fifo<uint64_t> end0, end1;
+    ASSERT_EQ(fzl::create_ring_fifo(8, &end0, &end1), ZX_OK);
+
+    thrd_t writer;
+    ASSERT_EQ(thrd_create(&writer, StreamWriter, &end0), thrd_success);
+
+    uint64_t expected = 0;
+    while (expected < kStreamCount) {
+        uint64_t elems[8];
+        size_t actual;
+        zx_status_t status = end1.read(elems, 8, &actual);
+        if (status == ZX_ERR_SHOULD_WAIT) {
+            ASSERT_EQ(end1.wait_readable(zx::time::infinite()), ZX_OK);
+            continue;
+        }
+        ASSERT_EQ(status, ZX_OK);
+        for (size_t i = 0; i != actual; ++i) {
+            ASSERT_EQ(elems[i], expected++);
+        }
+    }
+
+    int result;
+    ASSERT_EQ(thrd_join(writer, &result), thrd_success);
+    EXPECT_EQ(result, 0);
+
+    END_TEST;
+}
+
+}  // namespace
+
+BEGIN_TEST_CASE(ring_fifo_tests)
+RUN_TEST(create_validates_sizes)
+RUN_TEST(rejects_resizable_vmo)
+RUN_TEST(write_and_read)
+RUN_TEST(corrupt_indices)
+RUN_TEST(peer_closed)
+RUN_TEST(stream_between_threads)
+END_TEST_CASE(ring_fifo_tests)
@@ -14,6 +14,7 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/fdio.cpp \
     $(LOCAL_DIR)/main.c \
     $(LOCAL_DIR)/memory_probe_tests.cpp \
+    $(LOCAL_DIR)/ring_fifo_tests.cpp \
 
 MODULE_STATIC_LIBS := \
     system/ulib/async.cpp \
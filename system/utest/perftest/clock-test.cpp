@@ -8,9 +8,11 @@
 namespace {
 
 // Performance test for zx_clock_get_monotonic().  This is worth
-// testing because it is a very commonly called syscall.  The kernel's
-// implementation of the syscall is non-trivial and can be rather slow on
-// some machines/VMs.
+// testing because it is a very commonly called syscall.  It is normally
+// computed in the vDSO from the tick counter, so it should cost little more
+// than TicksGet; where it falls back to the kernel, the kernel's
+// implementation is non-trivial and can be rather slow on some
+// machines/VMs.
 bool ClockGetMonotonicTest() {
     zx_clock_get_monotonic();
     return true;
@@ -0,0 +1,195 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <threads.h>
+
+#include <fbl/algorithm.h>
+#include <fbl/string_printf.h>
+#include <fbl/unique_ptr.h>
+#include <lib/fzl/fifo.h>
+#include <lib/fzl/ring-fifo.h>
+#include <perftest/perftest.h>
+#include <zircon/assert.h>
+#include <zircon/device/block.h>
+
+#include <utility>
+
+namespace {
+
+// Number of requests the client sends, and responses it waits for, per test
+// run.  Divide it by the time per run to get operations per second.
+constexpr uint32_t kRequestsPerRun = 4096;
+
+// Most requests in flight at once, as with biotime's default.
+constexpr uint32_t kMaxOutstanding = 128;
+
+// The two ways of passing block requests and responses, with the same
+// interface.  Kernel fifos are what the block server uses today.
+class KernelTransport {
+public:
+    using Client = fzl::fifo<block_fifo_request_t, block_fifo_response_t>;
+    using Server = fzl::fifo<block_fifo_response_t, block_fifo_request_t>;
+
+    static void Create(Client* client, Server* server) {
+        ZX_ASSERT(fzl::create_fifo(BLOCK_FIFO_MAX_DEPTH, 0, client, server) == ZX_OK);
+    }
+
+    template <typename Fifo>
+    static zx_status_t WaitReadable(Fifo* fifo) {
+        zx_signals_t pending;
+        zx_status_t status = fifo->wait_one(ZX_FIFO_READABLE | ZX_FIFO_PEER_CLOSED,
+                                            zx::time::infinite(), &pending);
+        if (status == ZX_OK && !(pending & ZX_FIFO_READABLE)) {
+            return ZX_ERR_PEER_CLOSED;
+        }
+        return status;
+    }
+
+    template <typename Fifo>
+    static zx_status_t WaitWritable(Fifo* fifo) {
+        zx_signals_t pending;
+        zx_status_t status = fifo->wait_one(ZX_FIFO_WRITABLE | ZX_FIFO_PEER_CLOSED,
+                                            zx::time::infinite(), &pending);
+        if (status == ZX_OK && !(pending & ZX_FIFO_WRITABLE)) {
+            return ZX_ERR_PEER_CLOSED;
+        }
+        return status;
+    }
+};
+
+class RingTransport {
+public:
+    using Client = fzl::ring_fifo<block_fifo_request_t, block_fifo_response_t>;
+    using Server = fzl::ring_fifo<block_fifo_response_t, block_fifo_request_t>;
+
+    static void Create(Client* client, Server* server) {
+        ZX_ASSERT(fzl::create_ring_fifo(BLOCK_FIFO_MAX_DEPTH, client, server) == ZX_OK);
+    }
+
+    template <typename Fifo>
+    static zx_status_t WaitReadable(Fifo* fifo) {
+        return fifo->wait_readable(zx::time::infinite());
+    }
+
+    template <typename Fifo>
+    static zx_status_t WaitWritable(Fifo* fifo) {
+        return fifo->wait_writable(zx::time::infinite());
+    }
+};
+
+// Stands in for the block server: answers every request straight away, so
+// that only the cost of moving requests and responses is measured.
+template <typename Transport>
+int EchoServer(void* arg) {
+    fbl::unique_ptr<typename Transport::Server> fifo(
+        static_cast<typename Transport::Server*>(arg));
+    block_fifo_request_t requests[BLOCK_FIFO_MAX_DEPTH];
+    block_fifo_response_t responses[BLOCK_FIFO_MAX_DEPTH];
+    for (;;) {
+        size_t count;
+        zx_status_t status = fifo->read(requests, BLOCK_FIFO_MAX_DEPTH, &count);
+        if (status == ZX_ERR_SHOULD_WAIT) {
+            if (Transport::WaitReadable(fifo.get()) != ZX_OK) {
+                return 0;
+            }
+            continue;
+        }
+        ZX_ASSERT(status == ZX_OK);
+
+        for (size_t i = 0; i < count; ++i) {
+            responses[i] = {};
+            responses[i].status = ZX_OK;
+            responses[i].reqid = requests[i].reqid;
+            responses[i].count = 1;
+        }
+        for (size_t sent = 0; sent < count;) {
+            size_t actual;
+            status = fifo->write(responses + sent, count - sent, &actual);
+            if (status == ZX_ERR_SHOULD_WAIT) {
+                if (Transport::WaitWritable(fifo.get()) != ZX_OK) {
+                    return 0;
+                }
+                continue;
+            }
+            ZX_ASSERT(status == ZX_OK);
+            sent += actual;
+        }
+    }
+}
+
+// Measures a client keeping up to kMaxOutstanding block requests in flight
+// against a server thread, over either transport.
+template <typename Transport>
+bool BlockFifoTest(perftest::RepeatState* state) {
+    typename Transport::Client client;
+    thrd_t server_thread;
+    {
+        typename Transport::Server server;
+        Transport::Create(&client, &server);
+        // The server thread owns its end from here on, and exits when the
+        // client end is closed.
+        auto* owned = new typename Transport::Server(std::move(server));
+        ZX_ASSERT(thrd_create(&server_thread, EchoServer<Transport>, owned) == thrd_success);
+    }
+
+    reqid_t next_reqid = 0;
+    block_fifo_request_t requests[BLOCK_FIFO_MAX_DEPTH] = {};
+    block_fifo_response_t responses[BLOCK_FIFO_MAX_DEPTH];
+    while (state->KeepRunning()) {
+        uint32_t sent = 0;
+        uint32_t received = 0;
+        while (received < kRequestsPerRun) {
+            bool progress = false;
+
+            const uint32_t window = fbl::min(kRequestsPerRun - sent,
+                                             kMaxOutstanding - (sent - received));
+            const size_t batch = fbl::min<size_t>(window, BLOCK_FIFO_MAX_DEPTH);
+            if (batch > 0) {
+                for (size_t i = 0; i < batch; ++i) {
+                    requests[i].reqid = next_reqid + static_cast<reqid_t>(i);
+                    requests[i].opcode = BLOCKIO_READ;
+                    requests[i].length = 1;
+                }
+                size_t actual;
+                zx_status_t status = client.write(requests, batch, &actual);
+                if (status == ZX_OK) {
+                    next_reqid += static_cast<reqid_t>(actual);
+                    sent += static_cast<uint32_t>(actual);
+                    progress = true;
+                } else {
+                    ZX_ASSERT(status == ZX_ERR_SHOULD_WAIT);
+                }
+            }
+
+            size_t actual;
+            zx_status_t status = client.read(responses, BLOCK_FIFO_MAX_DEPTH, &actual);
+            if (status == ZX_OK) {
+                received += static_cast<uint32_t>(actual);
+                progress = true;
+            } else {
+                ZX_ASSERT(status == ZX_ERR_SHOULD_WAIT);
+            }
+
+            // Block only when neither direction can move, which means that
+            // the server is busy with everything sent so far.
+            if (!progress) {
+                ZX_ASSERT(Transport::WaitReadable(&client) == ZX_OK);
+            }
+        }
+    }
+
+    client = typename Transport::Client();
+    ZX_ASSERT(thrd_join(server_thread, nullptr) == thrd_success);
+    return true;
+}
+
+void RegisterTests() {
+    auto name = fbl::StringPrintf("BlockFifo/Kernel/%uRequests", kRequestsPerRun);
+    perftest::RegisterTest(name.c_str(), BlockFifoTest<KernelTransport>);
+    name = fbl::StringPrintf("BlockFifo/Ring/%uRequests", kRequestsPerRun);
+    perftest::RegisterTest(name.c_str(), BlockFifoTest<RingTransport>);
+}
+PERFTEST_CTOR(RegisterTests);
+
+} // namespace
@@ -0,0 +1,48 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fbl/unique_ptr.h>
+#include <fbl/vector.h>
+#include <perftest/perftest.h>
+#include <zircon/assert.h>
+#include <zircon/syscalls.h>
+
+#include <utility>
+
+#include "worker-threads.h"
+
+namespace {
+
+// Number of wait and wake pairs each thread makes per test run.
+constexpr uint32_t kOpsPerRun = 10000;
+
+// Each thread repeatedly operates on a futex of its own, the way an
+// uncontended mutex or condvar would.  The wait never blocks, as the futex
+// never has the expected value, but like the wake it has to look the futex
+// up in the process's futex table.
+WorkerThreads::Body MakeFutexBody(uint32_t thread_count) {
+    // Allocate the futexes separately so that they are not all in one
+    // cache line.
+    fbl::Vector<fbl::unique_ptr<zx_futex_t>> futexes;
+    for (uint32_t i = 0; i < thread_count; ++i) {
+        futexes.push_back(fbl::make_unique<zx_futex_t>(0));
+    }
+    return [futexes = std::move(futexes)](uint32_t index) {
+        const zx_futex_t* futex = futexes[index].get();
+        for (uint32_t i = 0; i < kOpsPerRun; ++i) {
+            ZX_ASSERT(zx_futex_wait(futex, 1, ZX_HANDLE_INVALID,
+                                    ZX_TIME_INFINITE) == ZX_ERR_BAD_STATE);
+            ZX_ASSERT(zx_futex_wake(futex, 1) == ZX_OK);
+        }
+    };
+}
+
+// Measure the time taken for N threads of one process to each make
+// kOpsPerRun futex wait and wake calls on independent futexes concurrently.
+void RegisterTests() {
+    RegisterWorkerThreadsTests("Futex/Scaling", MakeFutexBody);
+}
+PERFTEST_CTOR(RegisterTests);
+
+}  // namespace
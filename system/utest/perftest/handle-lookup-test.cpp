@@ -0,0 +1,45 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fbl/vector.h>
+#include <lib/zx/event.h>
+#include <perftest/perftest.h>
+#include <zircon/assert.h>
+
+#include <utility>
+
+#include "worker-threads.h"
+
+namespace {
+
+// Number of zx_object_signal calls each thread makes per test run.
+constexpr uint32_t kSignalsPerRun = 10000;
+
+// Each thread repeatedly signals an event of its own.  Each call looks up the
+// event's handle in the process's handle table, which is shared by all the
+// threads.
+WorkerThreads::Body MakeSignalBody(uint32_t thread_count) {
+    fbl::Vector<zx::event> targets;
+    for (uint32_t i = 0; i < thread_count; ++i) {
+        zx::event target;
+        ZX_ASSERT(zx::event::create(0, &target) == ZX_OK);
+        targets.push_back(std::move(target));
+    }
+    return [targets = std::move(targets)](uint32_t index) {
+        const zx::event& target = targets[index];
+        for (uint32_t i = 0; i < kSignalsPerRun; ++i) {
+            ZX_ASSERT(target.signal(0, ZX_USER_SIGNAL_0) == ZX_OK);
+        }
+    };
+}
+
+// Measure the time taken for N threads of one process to each make
+// kSignalsPerRun zx_object_signal calls concurrently.  Growth in the time per
+// run indicates contention on the handle table.
+void RegisterTests() {
+    RegisterWorkerThreadsTests("HandleLookup/Scaling", MakeSignalBody);
+}
+PERFTEST_CTOR(RegisterTests);
+
+}  // namespace
@@ -0,0 +1,174 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fbl/string_printf.h>
+#include <fbl/vector.h>
+#include <lib/async-loop/cpp/loop.h>
+#include <lib/async/cpp/receiver.h>
+#include <lib/zx/channel.h>
+#include <lib/zx/port.h>
+#include <perftest/perftest.h>
+#include <zircon/assert.h>
+#include <zircon/syscalls/port.h>
+
+#include <utility>
+
+namespace {
+
+// Number of packets queued on the port for each test run.  Divide it by the
+// time per run to get packets per second.
+constexpr uint32_t kPacketsPerRun = 1024;
+
+void QueuePackets(const zx::port& port) {
+    for (uint32_t i = 0; i < kPacketsPerRun; ++i) {
+        zx_port_packet_t packet = {};
+        packet.key = i;
+        packet.type = ZX_PKT_TYPE_USER;
+        ZX_ASSERT(port.queue(&packet) == ZX_OK);
+    }
+}
+
+// Measures draining a port that has many packets queued, reading
+// |batch_size| packets per syscall.  A batch size of 1 uses zx_port_wait().
+bool PortDrainTest(perftest::RepeatState* state, uint32_t batch_size) {
+    state->DeclareStep("queue");
+    state->DeclareStep("drain");
+
+    zx::port port;
+    ZX_ASSERT(zx::port::create(0, &port) == ZX_OK);
+
+    zx_port_packet_t packets[ZX_PORT_MAX_BATCH_PACKETS];
+    while (state->KeepRunning()) {
+        QueuePackets(port);
+        state->NextStep();
+
+        uint32_t received = 0;
+        while (received < kPacketsPerRun) {
+            if (batch_size == 1) {
+                ZX_ASSERT(port.wait(zx::time::infinite(), &packets[0]) == ZX_OK);
+                received++;
+            } else {
+                uint32_t actual;
+                ZX_ASSERT(port.wait_batch(zx::time::infinite(), packets, batch_size,
+                                          &actual) == ZX_OK);
+                received += actual;
+            }
+        }
+    }
+    return true;
+}
+
+// Measures an async loop dispatching many queued packets, which is how an
+// event loop behaves under load.
+bool AsyncLoopDispatchTest(perftest::RepeatState* state) {
+    state->DeclareStep("queue");
+    state->DeclareStep("dispatch");
+
+    async::Loop loop(&kAsyncLoopConfigNoAttachToThread);
+    uint32_t dispatched = 0;
+    async::Receiver receiver([&dispatched](async_dispatcher_t*, async::Receiver*,
+                                           zx_status_t, const zx_packet_user_t*) {
+        dispatched++;
+    });
+
+    while (state->KeepRunning()) {
+        for (uint32_t i = 0; i < kPacketsPerRun; ++i) {
+            ZX_ASSERT(receiver.QueuePacket(loop.dispatcher()) == ZX_OK);
+        }
+        state->NextStep();
+
+        dispatched = 0;
+        ZX_ASSERT(loop.RunUntilIdle() == ZX_OK);
+        ZX_ASSERT(dispatched == kPacketsPerRun);
+    }
+    return true;
+}
+
+// Number of channels that are readable in the ready set tests, out of
+// however many are being watched.
+constexpr uint32_t kReadyChannels = 16;
+
+struct WatchedChannels {
+    explicit WatchedChannels(uint32_t count) {
+        for (uint32_t i = 0; i < count; ++i) {
+            zx::channel local, remote;
+            ZX_ASSERT(zx::channel::create(0, &local, &remote) == ZX_OK);
+            if (i % (count / kReadyChannels) == 0) {
+                ZX_ASSERT(remote.write(0, "x", 1, nullptr, 0) == ZX_OK);
+            }
+            watched.push_back(std::move(local));
+            peers.push_back(std::move(remote));
+        }
+    }
+
+    fbl::Vector<zx::channel> watched;
+    fbl::Vector<zx::channel> peers;
+};
+
+// Measures finding the readable channels among many, with the interest in
+// them registered once as level-triggered waits.
+bool ReadySetLevelTest(perftest::RepeatState* state, uint32_t channel_count) {
+    zx::port port;
+    ZX_ASSERT(zx::port::create(0, &port) == ZX_OK);
+    WatchedChannels channels(channel_count);
+    for (uint32_t i = 0; i < channel_count; ++i) {
+        ZX_ASSERT(channels.watched[i].wait_async(port, i, ZX_CHANNEL_READABLE,
+                                                 ZX_WAIT_ASYNC_LEVEL) == ZX_OK);
+    }
+
+    zx_port_packet_t packets[kReadyChannels];
+    while (state->KeepRunning()) {
+        uint32_t actual;
+        ZX_ASSERT(port.wait_batch(zx::time::infinite(), packets, kReadyChannels,
+                                  &actual) == ZX_OK);
+        ZX_ASSERT(actual == kReadyChannels);
+    }
+    return true;
+}
+
+// The same as ReadySetLevelTest, but registering one-shot waits on every
+// channel each time and canceling the ones that did not fire, which is what
+// it costs to do this without level-triggered waits.
+bool ReadySetRearmTest(perftest::RepeatState* state, uint32_t channel_count) {
+    zx::port port;
+    ZX_ASSERT(zx::port::create(0, &port) == ZX_OK);
+    WatchedChannels channels(channel_count);
+
+    zx_port_packet_t packets[kReadyChannels];
+    while (state->KeepRunning()) {
+        for (uint32_t i = 0; i < channel_count; ++i) {
+            ZX_ASSERT(channels.watched[i].wait_async(port, i, ZX_CHANNEL_READABLE,
+                                                     ZX_WAIT_ASYNC_ONCE) == ZX_OK);
+        }
+        uint32_t actual;
+        ZX_ASSERT(port.wait_batch(zx::time::infinite(), packets, kReadyChannels,
+                                  &actual) == ZX_OK);
+        ZX_ASSERT(actual == kReadyChannels);
+        for (uint32_t i = 0; i < channel_count; ++i) {
+            port.cancel(channels.watched[i], i);
+        }
+    }
+    return true;
+}
+
+void RegisterTests() {
+    static const uint32_t kBatchSizes[] = {1, 4, 16, ZX_PORT_MAX_BATCH_PACKETS};
+    for (uint32_t batch_size : kBatchSizes) {
+        auto name = fbl::StringPrintf("Port/Drain/%uPackets/Batch%u",
+                                      kPacketsPerRun, batch_size);
+        perftest::RegisterTest(name.c_str(), PortDrainTest, batch_size);
+    }
+    static const uint32_t kChannelCounts[] = {64, 1024, 10240};
+    for (uint32_t channel_count : kChannelCounts) {
+        auto name = fbl::StringPrintf("Port/ReadySet/Level/%uChannels", channel_count);
+        perftest::RegisterTest(name.c_str(), ReadySetLevelTest, channel_count);
+        name = fbl::StringPrintf("Port/ReadySet/Rearm/%uChannels", channel_count);
+        perftest::RegisterTest(name.c_str(), ReadySetRearmTest, channel_count);
+    }
+    auto name = fbl::StringPrintf("AsyncLoop/Dispatch/%uPackets", kPacketsPerRun);
+    perftest::RegisterTest(name.c_str(), AsyncLoopDispatchTest);
+}
+PERFTEST_CTOR(RegisterTests);
+
+} // namespace
@@ -5,6 +5,7 @@
 #include <dlfcn.h>
 #include <limits.h>
 #include <launchpad/launchpad.h>
+#include <mini-process/mini-process.h>
 #include <perftest/perftest.h>
 #include <zircon/assert.h>
 #include <zircon/process.h>
@@ -197,8 +198,41 @@ bool StartTest(perftest::RepeatState* state) {
     return true;
 }
 
+// This benchmark measures a round trip between this process and a minimal
+// child process: a message on a channel, and the child's reply.  Each round
+// trip switches address spaces twice whenever the two threads share a CPU,
+// so this is sensitive to how much TLB state survives a switch (e.g. with
+// PCIDs enabled or disabled via kernel.x86.pcid).
+bool PingPongTest(perftest::RepeatState* state) {
+    zx_handle_t proc_handle;
+    zx_handle_t vmar_handle;
+    ZX_ASSERT(zx_process_create(zx_job_default(), pname, sizeof(pname), 0, &proc_handle,
+                                &vmar_handle) == ZX_OK);
+    zx_handle_t thread_handle;
+    ZX_ASSERT(zx_thread_create(proc_handle, tname, sizeof(tname), 0, &thread_handle) == ZX_OK);
+    zx_handle_t event;
+    ZX_ASSERT(zx_event_create(0, &event) == ZX_OK);
+    zx_handle_t cntrl_channel;
+    ZX_ASSERT(start_mini_process_etc(proc_handle, thread_handle, vmar_handle, event,
+                                     &cntrl_channel) == ZX_OK);
+
+    while (state->KeepRunning()) {
+        ZX_ASSERT(mini_process_cmd(cntrl_channel, MINIP_CMD_ECHO_MSG, nullptr) == ZX_OK);
+    }
+
+    ZX_ASSERT(zx_task_kill(proc_handle) == ZX_OK);
+    ZX_ASSERT(zx_object_wait_one(proc_handle, ZX_TASK_TERMINATED, ZX_TIME_INFINITE,
+                                 nullptr) == ZX_OK);
+    ZX_ASSERT(zx_handle_close(cntrl_channel) == ZX_OK);
+    ZX_ASSERT(zx_handle_close(thread_handle) == ZX_OK);
+    ZX_ASSERT(zx_handle_close(vmar_handle) == ZX_OK);
+    ZX_ASSERT(zx_handle_close(proc_handle) == ZX_OK);
+    return true;
+}
+
 void RegisterTests() {
     perftest::RegisterTest("Process/Start", StartTest);
+    perftest::RegisterTest("Process/PingPong", PingPongTest);
 }
 PERFTEST_CTOR(RegisterTests);
 
@@ -0,0 +1,158 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+#include <threads.h>
+
+#include <fbl/string_printf.h>
+#include <fbl/unique_ptr.h>
+#include <lib/zx/socket.h>
+#include <lib/zx/vmo.h>
+#include <perftest/perftest.h>
+#include <zircon/assert.h>
+
+#include <utility>
+
+namespace {
+
+// Bytes sent from the writer to the reader per test run.
+constexpr size_t kBytesPerRun = 4 * 1024 * 1024;
+
+// Largest write size tested, which the reader also reads at a time.
+constexpr size_t kMaxWriteSize = 1024 * 1024;
+
+// Receive buffer size for the tests that raise it, big enough that the
+// largest writes are taken in one go.
+constexpr size_t kLargeBufferSize = 2 * kMaxWriteSize;
+
+enum class WriteMode {
+    // zx_socket_write() copies the bytes into the socket's buffer.
+    kCopy,
+    // zx_socket_write_vmo() queues references to the bytes.
+    kVmo,
+};
+
+struct SocketTestArgs {
+    WriteMode mode;
+    size_t write_size;
+    // 0 leaves the receive buffer at its default size.
+    size_t rx_buffer_max;
+};
+
+zx_status_t WaitFor(const zx::socket& socket, zx_signals_t signal) {
+    zx_signals_t pending;
+    zx_status_t status = socket.wait_one(signal | ZX_SOCKET_PEER_CLOSED, zx::time::infinite(),
+                                         &pending);
+    if (status == ZX_OK && !(pending & signal)) {
+        return ZX_ERR_PEER_CLOSED;
+    }
+    return status;
+}
+
+// Reads kBytesPerRun bytes at a time, and then answers with a byte of its
+// own so that the writer knows the run is over.  Exits when the writer
+// closes its end.
+int Reader(void* arg) {
+    fbl::unique_ptr<zx::socket> socket(static_cast<zx::socket*>(arg));
+    fbl::unique_ptr<char[]> buffer(new char[kMaxWriteSize]);
+    for (;;) {
+        for (size_t received = 0; received < kBytesPerRun;) {
+            size_t actual;
+            zx_status_t status = socket->read(0, buffer.get(), kMaxWriteSize, &actual);
+            if (status == ZX_ERR_SHOULD_WAIT) {
+                if (WaitFor(*socket, ZX_SOCKET_READABLE) != ZX_OK) {
+                    return 0;
+                }
+                continue;
+            }
+            if (status == ZX_ERR_PEER_CLOSED) {
+                return 0;
+            }
+            ZX_ASSERT(status == ZX_OK);
+            received += actual;
+        }
+        ZX_ASSERT(socket->write(0, "", 1, nullptr) == ZX_OK);
+    }
+}
+
+// Measures the throughput of a stream socket, with the writer sending
+// |args.write_size| bytes at a time to a reader on another thread.
+bool SocketThroughputTest(perftest::RepeatState* state, SocketTestArgs args) {
+    state->SetBytesProcessedPerRun(kBytesPerRun);
+
+    zx::socket writer;
+    thrd_t reader_thread;
+    {
+        zx::socket reader;
+        ZX_ASSERT(zx::socket::create(0, &writer, &reader) == ZX_OK);
+        if (args.rx_buffer_max) {
+            ZX_ASSERT(reader.set_property(ZX_PROP_SOCKET_RX_BUFFER_MAX, &args.rx_buffer_max,
+                                          sizeof(args.rx_buffer_max)) == ZX_OK);
+        }
+        auto* owned = new zx::socket(std::move(reader));
+        ZX_ASSERT(thrd_create(&reader_thread, Reader, owned) == thrd_success);
+    }
+
+    // The source of each write.  It is filled in up front so that reading
+    // from the VMO does not fault in zero pages.
+    fbl::unique_ptr<char[]> buffer(new char[args.write_size]);
+    memset(buffer.get(), 0x5a, args.write_size);
+    zx::vmo vmo;
+    ZX_ASSERT(zx::vmo::create(args.write_size, 0, &vmo) == ZX_OK);
+    ZX_ASSERT(vmo.write(buffer.get(), 0, args.write_size) == ZX_OK);
+
+    while (state->KeepRunning()) {
+        for (size_t sent = 0; sent < kBytesPerRun;) {
+            // Finish off whatever is left of the current write after a short
+            // one.
+            const size_t offset = sent % args.write_size;
+            const size_t len = args.write_size - offset;
+            size_t actual;
+            zx_status_t status;
+            if (args.mode == WriteMode::kCopy) {
+                status = writer.write(0, buffer.get() + offset, len, &actual);
+            } else {
+                status = writer.write_vmo(0, vmo, offset, len, &actual);
+            }
+            if (status == ZX_ERR_SHOULD_WAIT) {
+                ZX_ASSERT(WaitFor(writer, ZX_SOCKET_WRITABLE) == ZX_OK);
+                continue;
+            }
+            ZX_ASSERT(status == ZX_OK);
+            sent += actual;
+        }
+
+        char ack;
+        ZX_ASSERT(WaitFor(writer, ZX_SOCKET_READABLE) == ZX_OK);
+        ZX_ASSERT(writer.read(0, &ack, 1, nullptr) == ZX_OK);
+    }
+
+    writer.reset();
+    ZX_ASSERT(thrd_join(reader_thread, nullptr) == thrd_success);
+    return true;
+}
+
+void RegisterTests() {
+    static const struct {
+        const char* name;
+        WriteMode mode;
+        size_t rx_buffer_max;
+    } kVariants[] = {
+        {"Copy/DefaultBuffer", WriteMode::kCopy, 0},
+        {"Copy/LargeBuffer", WriteMode::kCopy, kLargeBufferSize},
+        {"Vmo/DefaultBuffer", WriteMode::kVmo, 0},
+        {"Vmo/LargeBuffer", WriteMode::kVmo, kLargeBufferSize},
+    };
+    for (const auto& variant : kVariants) {
+        for (size_t write_size = 4096; write_size <= kMaxWriteSize; write_size *= 4) {
+            auto name = fbl::StringPrintf("Socket/Throughput/%s/%zuKiB", variant.name,
+                                          write_size / 1024);
+            SocketTestArgs args = {variant.mode, write_size, variant.rx_buffer_max};
+            perftest::RegisterTest(name.c_str(), SocketThroughputTest, args);
+        }
+    }
+}
+PERFTEST_CTOR(RegisterTests);
+
+}  // namespace
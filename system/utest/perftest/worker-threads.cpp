@@ -0,0 +1,94 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "worker-threads.h"
+
+#include <threads.h>
+
+#include <fbl/atomic.h>
+#include <fbl/string_printf.h>
+#include <lib/zx/event.h>
+#include <perftest/perftest.h>
+#include <zircon/assert.h>
+
+#include <utility>
+
+class WorkerThreads::Worker {
+public:
+    Worker(const Body* body, uint32_t index)
+        : body_(body), index_(index) {
+        ZX_ASSERT(zx::event::create(0, &start_) == ZX_OK);
+        ZX_ASSERT(zx::event::create(0, &done_) == ZX_OK);
+        ZX_ASSERT(thrd_create(&thread_, ThreadFunc, this) == thrd_success);
+    }
+
+    ~Worker() {
+        shutdown_.store(true);
+        ZX_ASSERT(start_.signal(0, ZX_USER_SIGNAL_0) == ZX_OK);
+        ZX_ASSERT(thrd_join(thread_, nullptr) == thrd_success);
+    }
+
+    void Start() {
+        ZX_ASSERT(start_.signal(0, ZX_USER_SIGNAL_0) == ZX_OK);
+    }
+
+    void WaitDone() {
+        ZX_ASSERT(done_.wait_one(ZX_USER_SIGNAL_0, zx::time::infinite(), nullptr) == ZX_OK);
+        ZX_ASSERT(done_.signal(ZX_USER_SIGNAL_0, 0) == ZX_OK);
+    }
+
+private:
+    static int ThreadFunc(void* arg) {
+        auto* worker = static_cast<Worker*>(arg);
+        for (;;) {
+            ZX_ASSERT(worker->start_.wait_one(ZX_USER_SIGNAL_0, zx::time::infinite(),
+                                              nullptr) == ZX_OK);
+            ZX_ASSERT(worker->start_.signal(ZX_USER_SIGNAL_0, 0) == ZX_OK);
+            if (worker->shutdown_.load()) {
+                return 0;
+            }
+            (*worker->body_)(worker->index_);
+            ZX_ASSERT(worker->done_.signal(0, ZX_USER_SIGNAL_0) == ZX_OK);
+        }
+    }
+
+    const Body* const body_;
+    const uint32_t index_;
+    zx::event start_;
+    zx::event done_;
+    thrd_t thread_;
+    fbl::atomic<bool> shutdown_{false};
+};
+
+WorkerThreads::WorkerThreads(uint32_t thread_count, Body body)
+    : body_(std::move(body)) {
+    for (uint32_t i = 0; i < thread_count; ++i) {
+        workers_.push_back(fbl::make_unique<Worker>(&body_, i));
+    }
+}
+
+WorkerThreads::~WorkerThreads() = default;
+
+void WorkerThreads::Run() {
+    for (auto& worker : workers_) {
+        worker->Start();
+    }
+    for (auto& worker : workers_) {
+        worker->WaitDone();
+    }
+}
+
+void RegisterWorkerThreadsTests(const char* name, MakeWorkerBodyFunc* make_body) {
+    for (uint32_t thread_count : {1, 2, 4, 8, 16}) {
+        auto test_name = fbl::StringPrintf("%s/%uThreads", name, thread_count);
+        perftest::RegisterTest(
+            test_name.c_str(), [make_body, thread_count](perftest::RepeatState* state) {
+                WorkerThreads threads(thread_count, make_body(thread_count));
+                while (state->KeepRunning()) {
+                    threads.Run();
+                }
+                return true;
+            });
+    }
+}
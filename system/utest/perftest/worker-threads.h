@@ -0,0 +1,44 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <fbl/function.h>
+#include <fbl/macros.h>
+#include <fbl/unique_ptr.h>
+#include <fbl/vector.h>
+
+// A fixed set of threads of this process which run the same body
+// concurrently, for tests of how a structure shared by the threads of a
+// process scales with the number of threads using it.
+class WorkerThreads {
+public:
+    // The body is called on every thread each time Run() is called, with the
+    // index of the thread, in [0, thread_count).  It may be called on several
+    // threads at once.
+    using Body = fbl::Function<void(uint32_t index)>;
+
+    WorkerThreads(uint32_t thread_count, Body body);
+    ~WorkerThreads();
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(WorkerThreads);
+
+    // Run the body once on every thread and return when all have finished.
+    void Run();
+
+private:
+    class Worker;
+
+    const Body body_;
+    fbl::Vector<fbl::unique_ptr<Worker>> workers_;
+};
+
+// Register tests named "|name|/<N>Threads" for N of 1, 2, 4, 8 and 16, each
+// of which measures the time for N threads to run the body returned by
+// |make_body(N)| once each, concurrently.  If the operations in the body
+// scale, the time per run stays flat as N grows up to the number of CPUs.
+using MakeWorkerBodyFunc = WorkerThreads::Body(uint32_t thread_count);
+void RegisterWorkerThreadsTests(const char* name, MakeWorkerBodyFunc* make_body);
@@ -1432,6 +1432,63 @@ bool vmo_decommit_misaligned_test() {
     END_TEST;
 }
 
+bool vmo_dedup_test() {
+    BEGIN_TEST;
+
+    const size_t size = PAGE_SIZE * 3;
+
+    // page 0 is the same in both vmos, page 1 is zeros, page 2 differs
+    uint8_t buf[2][size];
+    for (size_t i = 0; i < 2; i++) {
+        memset(buf[i], 'a', PAGE_SIZE);
+        memset(buf[i] + PAGE_SIZE, 0, PAGE_SIZE);
+        memset(buf[i] + PAGE_SIZE * 2, static_cast<int>('b' + i), PAGE_SIZE);
+    }
+
+    zx_handle_t vmo[2];
+    for (size_t i = 0; i < 2; i++) {
+        ASSERT_EQ(ZX_OK, zx_vmo_create(size, 0, &vmo[i]), "vm_object_create");
+        EXPECT_EQ(ZX_OK, zx_vmo_write(vmo[i], buf[i], 0, size), "writing to vmo");
+    }
+
+    // deduplicating needs the write right
+    zx_handle_t ro_vmo;
+    ASSERT_EQ(ZX_OK, zx_handle_duplicate(vmo[0], ZX_RIGHT_READ, &ro_vmo), "duplicate");
+    EXPECT_EQ(ZX_ERR_ACCESS_DENIED,
+              zx_vmo_op_range(ro_vmo, ZX_VMO_OP_DEDUPLICATE, 0, size, nullptr, 0),
+              "dedup without write right");
+    EXPECT_EQ(ZX_OK, zx_handle_close(ro_vmo), "close handle");
+
+    for (size_t i = 0; i < 2; i++) {
+        EXPECT_EQ(ZX_OK, zx_vmo_op_range(vmo[i], ZX_VMO_OP_DEDUPLICATE, 0, size, nullptr, 0),
+                  "dedup");
+
+        // the page of zeros is gone, the rest is still committed
+        zx_info_vmo_t info;
+        EXPECT_EQ(ZX_OK, zx_object_get_info(vmo[i], ZX_INFO_VMO, &info, sizeof(info),
+                                            nullptr, nullptr), "info_vmo");
+        EXPECT_EQ(PAGE_SIZE * 2, info.committed_bytes, "committed bytes after dedup");
+    }
+
+    // writing to a shared page through a mapping must not show up in the other vmo
+    uintptr_t ptr;
+    ASSERT_EQ(ZX_OK, zx_vmar_map(zx_vmar_root_self(), ZX_VM_PERM_READ | ZX_VM_PERM_WRITE,
+                                 0, vmo[1], 0, size, &ptr), "map");
+    EXPECT_EQ('a', *reinterpret_cast<volatile uint8_t*>(ptr), "reading shared page");
+    *reinterpret_cast<volatile uint8_t*>(ptr) = 'z';
+    buf[1][0] = 'z';
+    EXPECT_EQ(ZX_OK, zx_vmar_unmap(zx_vmar_root_self(), ptr, size), "unmap");
+
+    for (size_t i = 0; i < 2; i++) {
+        uint8_t check[size];
+        EXPECT_EQ(ZX_OK, zx_vmo_read(vmo[i], check, 0, size), "reading from vmo");
+        EXPECT_EQ(0, memcmp(buf[i], check, size), "vmo contents after dedup");
+        EXPECT_EQ(ZX_OK, zx_handle_close(vmo[i]), "close handle");
+    }
+
+    END_TEST;
+}
+
 // test set 4: deal with clones with nonzero offsets and offsets that extend beyond the original
 bool vmo_clone_test_4() {
     BEGIN_TEST;
@@ -1785,6 +1842,7 @@ RUN_TEST(vmo_clone_size_align_test);
 RUN_TEST(vmo_rights_test);
 RUN_TEST(vmo_commit_test);
 RUN_TEST(vmo_decommit_misaligned_test);
+RUN_TEST(vmo_dedup_test);
 RUN_TEST(vmo_cache_test);
 RUN_TEST_PERFORMANCE(vmo_cache_map_test);
 RUN_TEST(vmo_cache_op_test);